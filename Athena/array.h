@@ -92,6 +92,9 @@ struct Array<typename T, 0>
   T* memory = nullptr;
   size_t size = 0;
   size_t capacity = 0;
+  // Only set for growable arrays (init_growable_array), which reallocate into this
+  // arena instead of asserting once they run out of capacity.
+  MemoryArena* arena = nullptr;
 
   const T& operator[](size_t index) const
   {
@@ -124,11 +127,68 @@ init_array(MEMORY_ARENA_PARAM, size_t capacity)
   return ret;
 }
 
+// For when you don't know up front how big the array is going to get. Every time it fills up it
+// doubles, which either just extends the block in place if nothing else has been pushed onto the
+// arena since, or copies into a new block and leaves the old one behind in the arena. Either way
+// the arena has to outlive the array, so don't use this with scratch arenas that go out of scope.
+template <typename T>
+inline Array<T, 0>
+init_growable_array(MEMORY_ARENA_PARAM, size_t initial_capacity = 8)
+{
+  ASSERT(initial_capacity > 0);
+
+  Array<T, 0> ret = init_array<T>(MEMORY_ARENA_FWD, initial_capacity);
+  ret.arena = MEMORY_ARENA_FWD;
+  return ret;
+}
+
+template <typename T>
+inline void
+array_reserve(Array<T, 0>* arr, size_t capacity)
+{
+  if (capacity <= arr->capacity)
+    return;
+
+  ASSERT(arr->arena != nullptr);
+
+  size_t new_capacity = MAX(capacity, arr->capacity * 2);
+
+  uintptr_t end = reinterpret_cast<uintptr_t>(arr->memory + arr->capacity);
+  if (arr->memory != nullptr && end == *memory_arena_pos_ptr(arr->arena))
+  {
+    push_memory_arena<T>(arr->arena, new_capacity - arr->capacity);
+  }
+  else
+  {
+    T* memory = push_memory_arena<T>(arr->arena, new_capacity);
+    if (arr->size > 0)
+    {
+      memcpy(memory, arr->memory, sizeof(T) * arr->size);
+    }
+    arr->memory = memory;
+  }
+
+  arr->capacity = new_capacity;
+}
+
+template <typename T, size_t S>
+inline void
+array_grow_if_full(Array<T, S>* arr)
+{
+  if constexpr (S == 0)
+  {
+    if (arr->size == arr->capacity && arr->arena != nullptr)
+    {
+      array_reserve(arr, arr->size + 1);
+    }
+  }
+}
 
 template <typename T, size_t S>
 inline T*
 array_add(Array<T, S>* arr)
 {
+  array_grow_if_full(arr);
   ASSERT(arr->memory != nullptr && arr->size < MAX(arr->capacity, S));
 
   T* ret =  &arr->memory[arr->size++];
@@ -140,6 +200,7 @@ template <typename T, size_t S>
 inline T*
 array_insert(Array<T, S>* arr, size_t index)
 {
+  array_grow_if_full(arr);
   ASSERT(arr->memory != nullptr && arr->size < MAX(arr->capacity, S) && index < arr->size);
 
   memmove(arr->memory + index + 1, arr->memory + index, (arr->size - index) * sizeof(T));
@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <type_traits>
+#include "types.h"
+
+// Thin layer over std::atomic so that every access has to spell out its memory ordering.
+// The Interlocked* family is a full barrier on every call, which is way more than most of
+// the job system actually needs.
+//
+// Values are taken as std::type_identity_t<T> so that T is always deduced from the atomic
+// and you don't have to care about literal suffixes.
+
+constant std::memory_order kMemoryOrderRelaxed = std::memory_order_relaxed;
+constant std::memory_order kMemoryOrderAcquire = std::memory_order_acquire;
+constant std::memory_order kMemoryOrderRelease = std::memory_order_release;
+constant std::memory_order kMemoryOrderAcqRel  = std::memory_order_acq_rel;
+constant std::memory_order kMemoryOrderSeqCst  = std::memory_order_seq_cst;
+
+// std::atomic isn't copyable, but pretty much every struct in the engine gets copied around
+// or zero initialized, so copies here are just relaxed loads/stores. Copying an atomic that
+// is being concurrently modified is obviously not going to give you anything meaningful.
+template <typename T>
+struct Atomic
+{
+  static_assert(std::atomic<T>::is_always_lock_free);
+
+  Atomic() : value(T()) {}
+  Atomic(T v) : value(v) {}
+  Atomic(const Atomic& rhs) : value(rhs.value.load(std::memory_order_relaxed)) {}
+
+  Atomic& operator=(const Atomic& rhs)
+  {
+    value.store(rhs.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+  }
+
+  std::atomic<T> value;
+};
+static_assert(sizeof(Atomic<u64>) == sizeof(u64));
+
+template <typename T>
+inline T
+atomic_load(const Atomic<T>* atomic, std::memory_order order)
+{
+  return atomic->value.load(order);
+}
+
+template <typename T>
+inline void
+atomic_store(Atomic<T>* atomic, std::type_identity_t<T> value, std::memory_order order)
+{
+  atomic->value.store(value, order);
+}
+
+template <typename T>
+inline T
+atomic_exchange(Atomic<T>* atomic, std::type_identity_t<T> value, std::memory_order order)
+{
+  return atomic->value.exchange(value, order);
+}
+
+// Returns the value _before_ the add.
+template <typename T>
+inline T
+atomic_fetch_add(Atomic<T>* atomic, std::type_identity_t<T> value, std::memory_order order)
+{
+  return atomic->value.fetch_add(value, order);
+}
+
+// Returns the value _before_ the subtract.
+template <typename T>
+inline T
+atomic_fetch_sub(Atomic<T>* atomic, std::type_identity_t<T> value, std::memory_order order)
+{
+  return atomic->value.fetch_sub(value, order);
+}
+
+// On failure, expected is updated with the current value.
+template <typename T>
+inline bool
+atomic_compare_exchange(Atomic<T>* atomic,
+                        T* expected,
+                        std::type_identity_t<T> desired,
+                        std::memory_order success,
+                        std::memory_order failure)
+{
+  return atomic->value.compare_exchange_strong(*expected, desired, success, failure);
+}
+
+// Can fail spuriously, only use this inside of a loop.
+template <typename T>
+inline bool
+atomic_compare_exchange_weak(Atomic<T>* atomic,
+                             T* expected,
+                             std::type_identity_t<T> desired,
+                             std::memory_order success,
+                             std::memory_order failure)
+{
+  return atomic->value.compare_exchange_weak(*expected, desired, success, failure);
+}
+
+// For counters that only ever have a single writer but can be read from any thread.
+// This is a plain load + add + store on x64 rather than a locked RMW instruction.
+template <typename T>
+inline void
+atomic_add_single_writer(Atomic<T>* atomic, std::type_identity_t<T> value)
+{
+  atomic->value.store(atomic->value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline void
+atomic_thread_fence(std::memory_order order)
+{
+  std::atomic_thread_fence(order);
+}
+
+// Hint to the CPU that we're in a spin-wait loop.
+inline void
+cpu_relax()
+{
+  _mm_pause();
+}
@@ -0,0 +1,2171 @@
+#include "benchmarks.h"
+#include "types.h"
+#include "job_system.h"
+#include "hash_table.h"
+#include "concurrent_hash_table.h"
+#include "threading.h"
+#include "soa_array.h"
+#include "transform_hierarchy.h"
+#include "occlusion.h"
+#include "bvh.h"
+#include "ring_buffer.h"
+#include "math/math.h"
+#include "math/mat.h"
+#include "math/pack.h"
+#include "math/random.h"
+#include "math/simd.h"
+#include "render_graph.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <unordered_map>
+#include <random>
+
+static f64
+get_time_ns()
+{
+  static LARGE_INTEGER frequency = {0};
+  if (frequency.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return f64(counter.QuadPart) * 1e9 / f64(frequency.QuadPart);
+}
+
+static void
+report_benchmark(const char* name, f64 elapsed_ns, u64 iterations)
+{
+  dbgln("[benchmark] %-48s %12.2f ns/iter (%llu iters, %.3f ms)",
+        name,
+        elapsed_ns / f64(iterations),
+        iterations,
+        elapsed_ns / 1e6);
+}
+
+static f64
+run_empty_jobs(u32 batch_count, u32 batch_size, u64* out_lock_acquires)
+{
+  JobDesc descs[256];
+  ASSERT(batch_size <= ARRAY_LENGTH(descs));
+
+  u64 lock_acquires_before = get_job_system_stats().totals.spin_lock_acquires.value;
+
+  f64 start = get_time_ns();
+  for (u32 i = 0; i < batch_count; i++)
+  {
+    for (u32 j = 0; j < batch_size; j++)
+    {
+      descs[j] = init_job_desc_from_closure([]() {});
+    }
+    blocking_kick_job_descs(kJobPriorityHigh, descs, batch_size, JOB_DEBUG_INFO_STRUCT);
+  }
+  f64 elapsed = get_time_ns() - start;
+
+  *out_lock_acquires = get_job_system_stats().totals.spin_lock_acquires.value - lock_acquires_before;
+  return elapsed;
+}
+
+constant size_t kJobStackTouchSize = KiB(16);
+
+// Jobs that write one byte per cache line to kJobStackTouchSize of their stack, and add up how
+// many cycles just the writes took. With flush, the lines are evicted right before, so the
+// writes all miss like they would on a stack that has gone cold.
+static f64
+run_stack_touching_jobs(u32 batch_count, u32 batch_size, bool flush, u64* out_touch_cycles)
+{
+  JobDesc descs[256];
+  ASSERT(batch_size <= ARRAY_LENGTH(descs));
+
+  Atomic<u64> touch_cycles = 0;
+  Atomic<u64>* cycles = &touch_cycles;
+
+  f64 start = get_time_ns();
+  for (u32 i = 0; i < batch_count; i++)
+  {
+    for (u32 j = 0; j < batch_size; j++)
+    {
+      descs[j] = init_job_desc_from_closure([cycles, flush]()
+      {
+        volatile byte buf[kJobStackTouchSize];
+        if (flush)
+        {
+          for (size_t k = 0; k < kJobStackTouchSize; k += 64)
+          {
+            _mm_clflush((const void*)&buf[k]);
+          }
+          _mm_mfence();
+        }
+
+        u64 touch_start = __rdtsc();
+        for (size_t k = 0; k < kJobStackTouchSize; k += 64)
+        {
+          buf[k] = byte(k);
+        }
+        atomic_fetch_add(cycles, __rdtsc() - touch_start, kMemoryOrderRelaxed);
+      });
+    }
+    blocking_kick_job_descs(kJobPriorityHigh, descs, batch_size, JOB_DEBUG_INFO_STRUCT);
+  }
+  f64 elapsed = get_time_ns() - start;
+
+  *out_touch_cycles = atomic_load(&touch_cycles, kMemoryOrderRelaxed);
+  return elapsed;
+}
+
+// The fixed cost of getting a job through the system: kick, dequeue, stack alloc, fiber launch,
+// counter signal. Comparing with and without the per-thread stack cache shows how much of that
+// was the pool and zeroing the stacks.
+//
+// The stack cache is also supposed to hand out stacks that are still in cache. There's no
+// portable way to read the cache miss counters, so instead the jobs that touch their stack
+// time those writes, once as is and once with the lines flushed first. The difference is
+// what a stack coming back cold costs each job.
+static void
+benchmark_empty_jobs()
+{
+  constant u32 kBatchCount = 2000;
+  constant u32 kBatchSize  = 64;
+  constant u64 kJobCount   = u64(kBatchCount) * kBatchSize;
+
+  u64 lock_acquires = 0;
+
+  set_job_stack_cache_enabled(false);
+  run_empty_jobs(kBatchCount / 10, kBatchSize, &lock_acquires);
+  f64 uncached = run_empty_jobs(kBatchCount, kBatchSize, &lock_acquires);
+  report_benchmark("empty jobs (no stack cache)", uncached, kJobCount);
+  dbgln("[benchmark]   %.2f spin lock acquires/job", f64(lock_acquires) / f64(kJobCount));
+
+  set_job_stack_cache_enabled(true);
+  run_empty_jobs(kBatchCount / 10, kBatchSize, &lock_acquires);
+  f64 cached = run_empty_jobs(kBatchCount, kBatchSize, &lock_acquires);
+  report_benchmark("empty jobs (stack cache)", cached, kJobCount);
+  dbgln("[benchmark]   %.2f spin lock acquires/job", f64(lock_acquires) / f64(kJobCount));
+
+  u64 touch_cycles = 0;
+  char name[128];
+  for (bool stack_cache : {false, true})
+  {
+    set_job_stack_cache_enabled(stack_cache);
+    run_stack_touching_jobs(kBatchCount / 10, kBatchSize, false, &touch_cycles);
+    f64 elapsed = run_stack_touching_jobs(kBatchCount, kBatchSize, false, &touch_cycles);
+    snprintf(name, sizeof(name), "%llu KiB stack jobs (%s)", kJobStackTouchSize / KiB(1), stack_cache ? "stack cache" : "no stack cache");
+    report_benchmark(name, elapsed, kJobCount);
+    dbgln("[benchmark]   %.1f cycles/job writing the stack", f64(touch_cycles) / f64(kJobCount));
+  }
+
+  // Flushing is slow enough that a tenth of the jobs is plenty.
+  f64 elapsed = run_stack_touching_jobs(kBatchCount / 10, kBatchSize, true, &touch_cycles);
+  snprintf(name, sizeof(name), "%llu KiB stack jobs (flushed stack)", kJobStackTouchSize / KiB(1));
+  report_benchmark(name, elapsed, kJobCount / 10);
+  dbgln("[benchmark]   %.1f cycles/job writing the stack", f64(touch_cycles) / f64(kJobCount / 10));
+}
+
+// Cheap, deterministic keys so that the benchmarks are comparable between runs.
+static u64
+benchmark_key(u64 i)
+{
+  return i * 0x9E3779B97F4A7C15ull + 1;
+}
+
+static void
+benchmark_hash_table_load_factor()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCapacity = 1 << 16;
+  constant f64 kLoadFactors[] = { 0.5, 0.625, 0.75, 0.87 };
+
+  char name[128];
+  for (f64 load_factor : kLoadFactors)
+  {
+    reset_memory_arena(&arena);
+    auto table = init_hash_table<u64, u64>(&arena, kCapacity);
+    u64 count = u64(f64(table.capacity) * load_factor);
+    for (u64 i = 0; i < count; i++)
+    {
+      *hash_table_insert(&table, benchmark_key(i)) = i;
+    }
+
+    HashTableProbeStats probe_stats = hash_table_probe_stats(&table);
+
+    u64 sum = 0;
+    f64 start = get_time_ns();
+    for (u64 i = 0; i < count; i++)
+    {
+      sum += *unwrap(hash_table_find(&table, benchmark_key(i)));
+    }
+    f64 hit = get_time_ns() - start;
+
+    start = get_time_ns();
+    for (u64 i = count; i < count * 2; i++)
+    {
+      sum += hash_table_find(&table, benchmark_key(i)) ? 1 : 0;
+    }
+    f64 miss = get_time_ns() - start;
+
+    snprintf(name, sizeof(name), "hash table find hit  (load %.2f)", probe_stats.load_factor);
+    report_benchmark(name, hit, count);
+    snprintf(name, sizeof(name), "hash table find miss (load %.2f)", probe_stats.load_factor);
+    report_benchmark(name, miss, count);
+    dbgln("[benchmark]   probe length avg %.3f, max %llu (checksum %llu)",
+          probe_stats.average_probe_length,
+          probe_stats.max_probe_length,
+          sum);
+  }
+
+  // Constant insert/erase churn at a fixed size, which is what the job counter table does. Without
+  // tombstone cleanup this ends up probing the entire table.
+  reset_memory_arena(&arena);
+  auto table = init_hash_table<u64, u64>(&arena, 1024);
+  constant u64 kLive = 512;
+  constant u64 kChurn = 1 << 20;
+  f64 start = get_time_ns();
+  for (u64 i = 0; i < kChurn; i++)
+  {
+    *hash_table_insert(&table, benchmark_key(i)) = i;
+    if (i >= kLive)
+    {
+      hash_table_erase(&table, benchmark_key(i - kLive));
+    }
+  }
+  f64 churn = get_time_ns() - start;
+
+  HashTableProbeStats probe_stats = hash_table_probe_stats(&table);
+  report_benchmark("hash table insert+erase churn", churn, kChurn);
+  dbgln("[benchmark]   capacity %llu, tombstones %llu, probe length avg %.3f, max %llu",
+        table.capacity,
+        probe_stats.tombstones,
+        probe_stats.average_probe_length,
+        probe_stats.max_probe_length);
+}
+
+template <typename K, typename F>
+static void
+benchmark_hash_key_type(const char* key_name, F make_key)
+{
+  MemoryArena arena = alloc_memory_arena(MiB(16));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 16;
+  K* keys = push_memory_arena<K>(&arena, kCount);
+  for (u64 i = 0; i < kCount; i++)
+  {
+    keys[i] = make_key(i);
+  }
+
+  char name[128];
+  u64 sum = 0;
+
+  f64 start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    sum += Hasher<K>::hash(keys[i]);
+  }
+  snprintf(name, sizeof(name), "hash %s (Hasher)", key_name);
+  report_benchmark(name, get_time_ns() - start, kCount);
+
+  // What every key used to go through.
+  start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    sum += hash_u64(keys + i, sizeof(K));
+  }
+  snprintf(name, sizeof(name), "hash %s (XXH64 bytes)", key_name);
+  report_benchmark(name, get_time_ns() - start, kCount);
+
+  auto table = init_hash_table<K, u64>(&arena, kCount);
+  start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    *hash_table_insert(&table, keys[i]) = i;
+  }
+  snprintf(name, sizeof(name), "hash table insert %s", key_name);
+  report_benchmark(name, get_time_ns() - start, kCount);
+
+  start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    sum += *unwrap(hash_table_find(&table, keys[i]));
+  }
+  snprintf(name, sizeof(name), "hash table find %s", key_name);
+  report_benchmark(name, get_time_ns() - start, kCount);
+
+  dbgln("[benchmark]   checksum %llu", sum);
+}
+
+// The key types that the render graph and job system actually use.
+static void
+benchmark_hash_key_types()
+{
+  using namespace gfx::render;
+
+  benchmark_hash_key_type<u64>("u64", [](u64 i) { return benchmark_key(i); });
+  benchmark_hash_key_type<ResourceHandle>("ResourceHandle", [](u64 i)
+  {
+    ResourceHandle ret;
+    ret.id       = u32(i);
+    ret.type     = ResourceType(i % kResourceTypeCount);
+    ret.lifetime = i % 2 ? kResourceLifetimeImported : kResourceLifetimeTransient;
+    return ret;
+  });
+  benchmark_hash_key_type<PhysicalDescriptorKey>("PhysicalDescriptorKey", [](u64 i)
+  {
+    PhysicalDescriptorKey ret;
+    ret.id   = u32(i / 3);
+    ret.type = i % 3 == 0 ? kDescriptorTypeCbv : i % 3 == 1 ? kDescriptorTypeSrv : kDescriptorTypeUav;
+    return ret;
+  });
+}
+
+template <typename Table>
+static void
+benchmark_hash_table_lookups(const char* table_name, Table* table, u64 count)
+{
+  char name[128];
+  u64 sum = 0;
+
+  f64 start = get_time_ns();
+  for (u64 i = 0; i < count; i++)
+  {
+    sum += *unwrap(hash_table_find(table, benchmark_key(i)));
+  }
+  snprintf(name, sizeof(name), "%s find hit", table_name);
+  report_benchmark(name, get_time_ns() - start, count);
+
+  start = get_time_ns();
+  for (u64 i = count; i < count * 2; i++)
+  {
+    sum += hash_table_find(table, benchmark_key(i)) ? 1 : 0;
+  }
+  snprintf(name, sizeof(name), "%s find miss", table_name);
+  report_benchmark(name, get_time_ns() - start, count);
+
+  dbgln("[benchmark]   checksum %llu", sum);
+}
+
+static void
+benchmark_hash_table_vs_std()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 18;
+
+  dbgln("[benchmark] HashTable group width %llu", kHashTableGroupWidth);
+
+  auto table = init_hash_table<u64, u64>(&arena, kCount);
+  auto simd_table = init_hash_table<u64, u64, SimdCompareHasher<u64>>(&arena, kCount);
+  std::unordered_map<u64, u64> std_map;
+  std_map.reserve(kCount);
+
+  f64 start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    *hash_table_insert(&table, benchmark_key(i)) = i;
+  }
+  report_benchmark("HashTable insert", get_time_ns() - start, kCount);
+
+  for (u64 i = 0; i < kCount; i++)
+  {
+    *hash_table_insert(&simd_table, benchmark_key(i)) = i;
+  }
+
+  start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    std_map[benchmark_key(i)] = i;
+  }
+  report_benchmark("std::unordered_map insert", get_time_ns() - start, kCount);
+
+  benchmark_hash_table_lookups("HashTable", &table, kCount);
+  benchmark_hash_table_lookups("HashTable (SimdCompareHasher)", &simd_table, kCount);
+
+  u64 sum = 0;
+  start = get_time_ns();
+  for (u64 i = 0; i < kCount; i++)
+  {
+    sum += std_map.find(benchmark_key(i))->second;
+  }
+  report_benchmark("std::unordered_map find hit", get_time_ns() - start, kCount);
+
+  start = get_time_ns();
+  for (u64 i = kCount; i < kCount * 2; i++)
+  {
+    sum += std_map.find(benchmark_key(i)) != std_map.end() ? 1 : 0;
+  }
+  report_benchmark("std::unordered_map find miss", get_time_ns() - start, kCount);
+  dbgln("[benchmark]   checksum %llu", sum);
+}
+
+typedef SpinLocked<HashTable<u64, u64>> SpinLockedHashTable;
+
+static bool
+contention_find(SpinLockedHashTable* table, u64 key, u64* out)
+{
+  return ACQUIRE(table, auto* t)
+  {
+    Option<u64*> value = hash_table_find(t, key);
+    if (!value)
+      return false;
+
+    *out = *unwrap(value);
+    return true;
+  };
+}
+
+static void
+contention_write(SpinLockedHashTable* table, u64 key, u64 value)
+{
+  ACQUIRE(table, auto* t)
+  {
+    *hash_table_insert(t, key) = value;
+  };
+}
+
+static bool
+contention_find(ConcurrentHashTable<u64, u64>* table, u64 key, u64* out)
+{
+  Option<u64> value = concurrent_hash_table_find(table, key);
+  if (!value)
+    return false;
+
+  *out = unwrap(value);
+  return true;
+}
+
+static void
+contention_write(ConcurrentHashTable<u64, u64>* table, u64 key, u64 value)
+{
+  concurrent_hash_table_insert(table, key, value);
+}
+
+template <typename Table>
+struct HashTableContentionParams
+{
+  Table* table = nullptr;
+  Atomic<u32>* ready = nullptr;
+  Atomic<bool>* go = nullptr;
+  u64 key_count = 0;
+  u64 ops = 0;
+  // Every Nth op overwrites a key instead of looking one up, 0 for read only.
+  u32 write_every = 0;
+  u32 seed = 0;
+  u64 checksum = 0;
+};
+
+template <typename Table>
+static u32
+hash_table_contention_thread(void* param)
+{
+  auto* params = (HashTableContentionParams<Table>*)param;
+
+  atomic_fetch_add(params->ready, 1, kMemoryOrderRelaxed);
+  while (!atomic_load(params->go, kMemoryOrderAcquire))
+  {
+    cpu_relax();
+  }
+
+  u64 sum = 0;
+  u64 rng = params->seed;
+  for (u64 i = 0; i < params->ops; i++)
+  {
+    rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+    u64 key = benchmark_key((rng >> 33) % params->key_count);
+    if (params->write_every != 0 && i % params->write_every == 0)
+    {
+      contention_write(params->table, key, i);
+      continue;
+    }
+
+    u64 value = 0;
+    if (contention_find(params->table, key, &value))
+    {
+      sum += value;
+    }
+  }
+
+  params->checksum = sum;
+  return 0;
+}
+
+// Wall time for thread_count threads to each get through ops operations on the same table.
+template <typename Table>
+static f64
+run_hash_table_contention(MEMORY_ARENA_PARAM, Table* table, u32 thread_count, u64 key_count, u64 ops, u32 write_every)
+{
+  constant u32 kMaxThreads = 32;
+  ASSERT(thread_count <= kMaxThreads);
+
+  Atomic<u32> ready = 0;
+  Atomic<bool> go = false;
+  HashTableContentionParams<Table> params[kMaxThreads];
+  Thread threads[kMaxThreads];
+
+  for (u32 i = 0; i < thread_count; i++)
+  {
+    params[i].table = table;
+    params[i].ready = &ready;
+    params[i].go = &go;
+    params[i].key_count = key_count;
+    params[i].ops = ops;
+    params[i].write_every = write_every;
+    params[i].seed = i + 1;
+    threads[i] = create_thread(sub_alloc_memory_arena(MEMORY_ARENA_FWD, KiB(16)),
+                               KiB(64),
+                               &hash_table_contention_thread<Table>,
+                               &params[i],
+                               u8(i));
+  }
+
+  while (atomic_load(&ready, kMemoryOrderAcquire) != thread_count)
+  {
+    cpu_relax();
+  }
+
+  f64 start = get_time_ns();
+  atomic_store(&go, true, kMemoryOrderRelease);
+  join_threads(threads, thread_count);
+  f64 elapsed = get_time_ns() - start;
+
+  u64 sum = 0;
+  for (u32 i = 0; i < thread_count; i++)
+  {
+    sum += params[i].checksum;
+    destroy_thread(&threads[i]);
+  }
+  dbgln("[benchmark]   checksum %llu", sum);
+
+  return elapsed;
+}
+
+// Read-heavy lookups from a bunch of threads at once, which is the access pattern the job
+// counters and resource caches have. A single SpinLocked table serializes every lookup, while
+// the sharded table lets readers share a shard and only contend when writers hit the same one.
+// The numbers are ns per op summed over all of the threads, so lower is more throughput.
+static void
+benchmark_concurrent_hash_table()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(512));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kKeyCount = 1 << 16;
+  constant u64 kOpsPerThread = 1 << 20;
+
+  SpinLockedHashTable spin_locked = init_hash_table<u64, u64>(&arena, kKeyCount);
+  auto single_shard = init_concurrent_hash_table<u64, u64>(&arena, kKeyCount, kKeyCount, 1);
+  auto sharded = init_concurrent_hash_table<u64, u64>(&arena, kKeyCount, kKeyCount);
+  for (u64 i = 0; i < kKeyCount; i++)
+  {
+    *hash_table_insert(&spin_locked.m_value, benchmark_key(i)) = i;
+    concurrent_hash_table_insert(&single_shard, benchmark_key(i), i);
+    concurrent_hash_table_insert(&sharded, benchmark_key(i), i);
+  }
+
+  u32 max_threads = MIN(get_num_physical_cores(), 32);
+  u32 write_everys[] = { 0, 16 };
+
+  char name[128];
+  for (u32 write_every : write_everys)
+  {
+    for (u32 thread_count = 1; thread_count <= max_threads; thread_count *= 4)
+    {
+      u64 total_ops = thread_count * kOpsPerThread;
+      const char* mix = write_every == 0 ? "read only" : "1/16 writes";
+
+      MemoryArena thread_arena = sub_alloc_memory_arena(&arena, MiB(1));
+
+      snprintf(name, sizeof(name), "SpinLocked HashTable %s, %u threads", mix, thread_count);
+      f64 elapsed = run_hash_table_contention(&thread_arena, &spin_locked, thread_count, kKeyCount, kOpsPerThread, write_every);
+      report_benchmark(name, elapsed, total_ops);
+
+      reset_memory_arena(&thread_arena);
+      snprintf(name, sizeof(name), "ConcurrentHashTable x1 %s, %u threads", mix, thread_count);
+      elapsed = run_hash_table_contention(&thread_arena, &single_shard, thread_count, kKeyCount, kOpsPerThread, write_every);
+      report_benchmark(name, elapsed, total_ops);
+
+      reset_memory_arena(&thread_arena);
+      snprintf(name, sizeof(name), "ConcurrentHashTable x%u %s, %u threads", sharded.shard_count, mix, thread_count);
+      elapsed = run_hash_table_contention(&thread_arena, &sharded, thread_count, kKeyCount, kOpsPerThread, write_every);
+      report_benchmark(name, elapsed, total_ops);
+    }
+  }
+}
+
+typedef SpinLocked<RingQueue<u64>> SpinLockedRingQueue;
+
+// The locked RingQueue gets its batches under a single acquire, to be fair to it.
+static size_t
+queue_push_batch(SpinLockedRingQueue* queue, const u64* items, size_t count)
+{
+  return ACQUIRE(queue, auto* q)
+  {
+    size_t pushed = 0;
+    while (pushed < count && try_ring_queue_push(q, items[pushed]))
+    {
+      pushed++;
+    }
+    return pushed;
+  };
+}
+
+static size_t
+queue_pop_batch(SpinLockedRingQueue* queue, u64* out, size_t count)
+{
+  return ACQUIRE(queue, auto* q)
+  {
+    size_t popped = 0;
+    while (popped < count && try_ring_queue_pop(q, out + popped))
+    {
+      popped++;
+    }
+    return popped;
+  };
+}
+
+static size_t
+queue_push_batch(SpscQueue<u64>* queue, const u64* items, size_t count)
+{
+  return spsc_queue_push_batch(queue, items, count);
+}
+
+static size_t
+queue_pop_batch(SpscQueue<u64>* queue, u64* out, size_t count)
+{
+  return spsc_queue_pop_batch(queue, out, count);
+}
+
+static size_t
+queue_push_batch(MpmcQueue<u64>* queue, const u64* items, size_t count)
+{
+  if (count == 1)
+    return try_mpmc_queue_push(queue, items[0]) ? 1 : 0;
+
+  return mpmc_queue_push_batch(queue, items, count);
+}
+
+static size_t
+queue_pop_batch(MpmcQueue<u64>* queue, u64* out, size_t count)
+{
+  if (count == 1)
+    return try_mpmc_queue_pop(queue, out) ? 1 : 0;
+
+  return mpmc_queue_pop_batch(queue, out, count);
+}
+
+constant u32 kQueueBenchmarkMaxBatch = 64;
+
+template <typename Queue>
+struct QueueThroughputParams
+{
+  Queue* queue = nullptr;
+  Atomic<u32>* ready = nullptr;
+  Atomic<bool>* go = nullptr;
+  // Shared between all of the consumers, so they know when everything has been popped.
+  Atomic<u64>* popped = nullptr;
+  u64 total = 0;
+  // Producers push [first, first + count).
+  u64 first = 0;
+  u64 count = 0;
+  u32 batch_size = 1;
+  u64 checksum = 0;
+};
+
+template <typename Queue>
+static void
+queue_throughput_wait_for_go(QueueThroughputParams<Queue>* params)
+{
+  atomic_fetch_add(params->ready, 1, kMemoryOrderRelaxed);
+  while (!atomic_load(params->go, kMemoryOrderAcquire))
+  {
+    cpu_relax();
+  }
+}
+
+template <typename Queue>
+static u32
+queue_producer_thread(void* param)
+{
+  auto* params = (QueueThroughputParams<Queue>*)param;
+  queue_throughput_wait_for_go(params);
+
+  u64 items[kQueueBenchmarkMaxBatch];
+  u64 next = params->first;
+  u64 end = params->first + params->count;
+  while (next < end)
+  {
+    size_t count = MIN(params->batch_size, end - next);
+    for (size_t i = 0; i < count; i++)
+    {
+      items[i] = next + i;
+    }
+
+    size_t pushed = 0;
+    while (pushed < count)
+    {
+      size_t n = queue_push_batch(params->queue, items + pushed, count - pushed);
+      if (n == 0)
+      {
+        cpu_relax();
+      }
+      pushed += n;
+    }
+    next += count;
+  }
+
+  return 0;
+}
+
+template <typename Queue>
+static u32
+queue_consumer_thread(void* param)
+{
+  auto* params = (QueueThroughputParams<Queue>*)param;
+  queue_throughput_wait_for_go(params);
+
+  u64 items[kQueueBenchmarkMaxBatch];
+  u64 sum = 0;
+  while (atomic_load(params->popped, kMemoryOrderRelaxed) < params->total)
+  {
+    size_t n = queue_pop_batch(params->queue, items, params->batch_size);
+    if (n == 0)
+    {
+      cpu_relax();
+      continue;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+      sum += items[i];
+    }
+    atomic_fetch_add(params->popped, n, kMemoryOrderRelaxed);
+  }
+
+  params->checksum = sum;
+  return 0;
+}
+
+// Wall time for producer_count producers to each push items_per_producer items through the
+// queue while consumer_count consumers pop them, batch_size at a time on both ends.
+template <typename Queue>
+static f64
+run_queue_throughput(MEMORY_ARENA_PARAM,
+                     Queue* queue,
+                     u32 producer_count,
+                     u32 consumer_count,
+                     u64 items_per_producer,
+                     u32 batch_size)
+{
+  constant u32 kMaxThreads = 32;
+  u32 thread_count = producer_count + consumer_count;
+  ASSERT(thread_count <= kMaxThreads);
+  ASSERT(batch_size <= kQueueBenchmarkMaxBatch);
+
+  Atomic<u32> ready = 0;
+  Atomic<bool> go = false;
+  Atomic<u64> popped = 0;
+  QueueThroughputParams<Queue> params[kMaxThreads];
+  Thread threads[kMaxThreads];
+
+  u64 total = producer_count * items_per_producer;
+  for (u32 i = 0; i < thread_count; i++)
+  {
+    params[i].queue = queue;
+    params[i].ready = &ready;
+    params[i].go = &go;
+    params[i].popped = &popped;
+    params[i].total = total;
+    params[i].first = i * items_per_producer;
+    params[i].count = items_per_producer;
+    params[i].batch_size = batch_size;
+
+    ThreadProc proc = i < producer_count ? &queue_producer_thread<Queue> : &queue_consumer_thread<Queue>;
+    threads[i] = create_thread(sub_alloc_memory_arena(MEMORY_ARENA_FWD, KiB(16)), KiB(64), proc, &params[i], u8(i));
+  }
+
+  while (atomic_load(&ready, kMemoryOrderAcquire) != thread_count)
+  {
+    cpu_relax();
+  }
+
+  f64 start = get_time_ns();
+  atomic_store(&go, true, kMemoryOrderRelease);
+  join_threads(threads, thread_count);
+  f64 elapsed = get_time_ns() - start;
+
+  // Every item should've come out exactly once.
+  u64 sum = 0;
+  for (u32 i = 0; i < thread_count; i++)
+  {
+    sum += params[i].checksum;
+    destroy_thread(&threads[i]);
+  }
+  ASSERT(sum == total * (total - 1) / 2);
+
+  return elapsed;
+}
+
+// Moving u64s between threads through the spin locked RingQueue (what the job queues used to
+// be) vs. the lock-free queues, one item at a time and in batches. The numbers are ns per item,
+// so lower is more throughput.
+static void
+benchmark_queues()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCapacity = 1024;
+  constant u64 kItems = 1 << 20;
+
+  u32 max_threads = MIN(get_num_physical_cores(), 32);
+  u32 batch_sizes[] = { 1, 32 };
+
+  char name[128];
+  for (u32 batch_size : batch_sizes)
+  {
+    // Just one of each, which is all an SpscQueue allows.
+    MemoryArena thread_arena = sub_alloc_memory_arena(&arena, MiB(1));
+
+    SpinLockedRingQueue locked = init_ring_queue<u64>(&arena, kCapacity);
+    snprintf(name, sizeof(name), "SpinLocked RingQueue 1:1, batch %u", batch_size);
+    report_benchmark(name, run_queue_throughput(&thread_arena, &locked, 1, 1, kItems, batch_size), kItems);
+
+    reset_memory_arena(&thread_arena);
+    SpscQueue<u64> spsc = init_spsc_queue<u64>(&arena, kCapacity);
+    snprintf(name, sizeof(name), "SpscQueue 1:1, batch %u", batch_size);
+    report_benchmark(name, run_queue_throughput(&thread_arena, &spsc, 1, 1, kItems, batch_size), kItems);
+
+    reset_memory_arena(&thread_arena);
+    MpmcQueue<u64> mpmc = init_mpmc_queue<u64>(&arena, kCapacity);
+    snprintf(name, sizeof(name), "MpmcQueue 1:1, batch %u", batch_size);
+    report_benchmark(name, run_queue_throughput(&thread_arena, &mpmc, 1, 1, kItems, batch_size), kItems);
+
+    // Lots of producers and consumers, which is what the job queues see.
+    for (u32 producers = 2; producers * 2 <= max_threads; producers *= 2)
+    {
+      u64 items_per_producer = kItems / producers;
+
+      reset_memory_arena(&thread_arena);
+      locked = init_ring_queue<u64>(&arena, kCapacity);
+      snprintf(name, sizeof(name), "SpinLocked RingQueue %u:%u, batch %u", producers, producers, batch_size);
+      report_benchmark(name, run_queue_throughput(&thread_arena, &locked, producers, producers, items_per_producer, batch_size), kItems);
+
+      reset_memory_arena(&thread_arena);
+      mpmc = init_mpmc_queue<u64>(&arena, kCapacity);
+      snprintf(name, sizeof(name), "MpmcQueue %u:%u, batch %u", producers, producers, batch_size);
+      report_benchmark(name, run_queue_throughput(&thread_arena, &mpmc, producers, producers, items_per_producer, batch_size), kItems);
+    }
+  }
+}
+
+// What dot_f32 used to do: store the products out to memory and add them up as scalars.
+static f32
+dot_f32_store_and_sum(f32x4 a, f32x4 b)
+{
+  alignas(16) f32 vals[4];
+  _mm_store_ps(vals, hadamard_f32(a, b));
+  return vals[0] + vals[1] + vals[2] + vals[3];
+}
+
+// Every flavour of dot/length/normalize over the same vectors, with the worst error against
+// doubles next to the timings so the speed/precision tradeoff is in one place.
+static void
+benchmark_vector_reductions()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(128));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 20;
+  constant u32 kIterations = 8;
+
+  Vec4* vecs = push_memory_arena<Vec4>(&arena, kCount);
+  Vec4* out = push_memory_arena<Vec4>(&arena, kCount);
+  f32* lengths = push_memory_arena<f32>(&arena, kCount);
+  for (u64 i = 0; i < kCount; i++)
+  {
+    f32 t = f32(i);
+    vecs[i] = Vec4(sinf(t) * 100.0f, cosf(t * 0.7f), t * 1e-4f, 0.0f);
+  }
+
+  auto max_length_error = [&]()
+  {
+    f64 max_error = 0.0;
+    for (u64 i = 0; i < kCount; i++)
+    {
+      f64 x = vecs[i].x, y = vecs[i].y, z = vecs[i].z;
+      f64 length = sqrt(x * x + y * y + z * z);
+      max_error = MAX(max_error, fabs(f64(lengths[i]) - length) / length);
+    }
+    return max_error;
+  };
+
+  auto max_normalize_error = [&]()
+  {
+    f64 max_error = 0.0;
+    for (u64 i = 0; i < kCount; i++)
+    {
+      f64 x = vecs[i].x, y = vecs[i].y, z = vecs[i].z;
+      f64 length = sqrt(x * x + y * y + z * z);
+      max_error = MAX(max_error, fabs(f64(out[i].x) - x / length));
+      max_error = MAX(max_error, fabs(f64(out[i].y) - y / length));
+      max_error = MAX(max_error, fabs(f64(out[i].z) - z / length));
+    }
+    return max_error;
+  };
+
+  u64 total = kCount * kIterations;
+  f32 sum = 0.0f;
+
+  f64 start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      sum += dot_f32_store_and_sum(vecs[i].avx, vecs[(i + 1) & (kCount - 1)].avx);
+    }
+  }
+  report_benchmark("dot (store and sum)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      sum += dot_f32(vecs[i].avx, vecs[(i + 1) & (kCount - 1)].avx);
+    }
+  }
+  report_benchmark("dot (dot_f32)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      lengths[i] = length_f32(vecs[i].avx);
+    }
+  }
+  report_benchmark("length (length_f32)", get_time_ns() - start, total);
+  dbgln("[benchmark]   max relative error %g", max_length_error());
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      lengths[i] = length_fast_f32(vecs[i].avx);
+    }
+  }
+  report_benchmark("length (length_fast_f32)", get_time_ns() - start, total);
+  dbgln("[benchmark]   max relative error %g", max_length_error());
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = normalize_f32(vecs[i].avx);
+    }
+  }
+  report_benchmark("normalize (normalize_f32)", get_time_ns() - start, total);
+  dbgln("[benchmark]   max error %g", max_normalize_error());
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = normalize_fast_f32(vecs[i].avx);
+    }
+  }
+  report_benchmark("normalize (normalize_fast_f32)", get_time_ns() - start, total);
+  dbgln("[benchmark]   max error %g", max_normalize_error());
+
+  dbgln("[benchmark]   checksum %f", sum);
+}
+
+// Transforming and normalizing a mesh-sized pile of vertices, one Vec4 at a time with the
+// math.h operators vs. the batch kernels at each SIMD level the CPU supports.
+static void
+benchmark_batch_math()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(512));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kVertexCount = 1 << 22;
+  constant u32 kIterations = 4;
+
+  Vec4* aos_in = push_memory_arena<Vec4>(&arena, kVertexCount);
+  Vec4* aos_out = push_memory_arena<Vec4>(&arena, kVertexCount);
+  // Same thing with w = 0, for normalizing.
+  Vec3* aos_dirs = push_memory_arena<Vec3>(&arena, kVertexCount);
+  Vec3Soa soa_in = alloc_vec3_soa(&arena, kVertexCount);
+  Vec3Soa soa_out = alloc_vec3_soa(&arena, kVertexCount);
+
+  for (u64 i = 0; i < kVertexCount; i++)
+  {
+    f32 t = f32(i);
+    aos_in[i] = Vec4(sinf(t), cosf(t), t * 1e-6f, 1.0f);
+    aos_dirs[i] = Vec3(aos_in[i].x, aos_in[i].y, aos_in[i].z);
+    soa_in.x[i] = aos_in[i].x;
+    soa_in.y[i] = aos_in[i].y;
+    soa_in.z[i] = aos_in[i].z;
+  }
+
+  Mat4 m = Mat4::columns(Vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                         Vec4(-1.0f, 0.0f, 0.0f, 0.0f),
+                         Vec4(0.0f, 0.0f, 2.0f, 0.0f),
+                         Vec4(10.0f, -5.0f, 3.0f, 1.0f));
+
+  u64 total = kVertexCount * kIterations;
+  f64 start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kVertexCount; i++)
+    {
+      aos_out[i] = m * aos_in[i].avx;
+    }
+  }
+  report_benchmark("transform points (Mat4 * Vec4)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kVertexCount; i++)
+    {
+      aos_out[i] = normalize_f32(aos_dirs[i].avx);
+    }
+  }
+  report_benchmark("normalize (normalize_f32(Vec3))", get_time_ns() - start, total);
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  char name[128];
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      batch_transform_points(m, soa_in, soa_out, kVertexCount);
+    }
+    snprintf(name, sizeof(name), "batch_transform_points (%s)", simd_level_name(SimdLevel(level)));
+    report_benchmark(name, get_time_ns() - start, total);
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      batch_normalize_vec3(soa_in, soa_out, kVertexCount);
+    }
+    snprintf(name, sizeof(name), "batch_normalize_vec3 (%s)", simd_level_name(SimdLevel(level)));
+    report_benchmark(name, get_time_ns() - start, total);
+  }
+
+  dbgln("[benchmark]   checksum %f %f", aos_out[kVertexCount / 2].x, soa_out.x[kVertexCount / 2]);
+}
+
+// Rotating vectors and interpolating between rotations like an animation update would, one
+// Quat at a time vs. the batch kernels at each SIMD level the CPU supports.
+static void
+benchmark_quaternions()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(256));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 20;
+  constant u32 kIterations = 4;
+
+  Quat* aos_a = push_memory_arena<Quat>(&arena, kCount);
+  Quat* aos_b = push_memory_arena<Quat>(&arena, kCount);
+  Quat* aos_out = push_memory_arena<Quat>(&arena, kCount);
+  Vec3* aos_vecs = push_memory_arena<Vec3>(&arena, kCount);
+  Vec3* aos_rotated = push_memory_arena<Vec3>(&arena, kCount);
+  QuatSoa soa_a = alloc_quat_soa(&arena, kCount);
+  QuatSoa soa_b = alloc_quat_soa(&arena, kCount);
+  QuatSoa soa_out = alloc_quat_soa(&arena, kCount);
+  Vec3Soa soa_vecs = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa soa_rotated = alloc_vec3_soa(&arena, kCount);
+  f32* t = push_memory_arena<f32>(&arena, kCount);
+
+  for (u64 i = 0; i < kCount; i++)
+  {
+    f32 s = f32(i);
+    aos_a[i] = quat_from_axis_angle(Vec3(sinf(s), 1.0f, cosf(s)), s * 1e-3f);
+    aos_b[i] = quat_from_axis_angle(Vec3(1.0f, cosf(s), sinf(s)), 2.0f - s * 1e-3f);
+    aos_vecs[i] = Vec3(s, -1.0f, 0.5f);
+    t[i] = f32(i % 64) / 64.0f;
+
+    soa_a.w[i] = aos_a[i].w;  soa_a.x[i] = aos_a[i].x;  soa_a.y[i] = aos_a[i].y;  soa_a.z[i] = aos_a[i].z;
+    soa_b.w[i] = aos_b[i].w;  soa_b.x[i] = aos_b[i].x;  soa_b.y[i] = aos_b[i].y;  soa_b.z[i] = aos_b[i].z;
+    soa_vecs.x[i] = aos_vecs[i].x;  soa_vecs.y[i] = aos_vecs[i].y;  soa_vecs.z[i] = aos_vecs[i].z;
+  }
+
+  u64 total = kCount * kIterations;
+  f64 start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      Quat p(0.0f, aos_vecs[i].x, aos_vecs[i].y, aos_vecs[i].z);
+      Quat res = aos_a[i] * p * quat_conjugate(aos_a[i]);
+      aos_rotated[i] = Vec3(res.x, res.y, res.z);
+    }
+  }
+  report_benchmark("rotate (q * p * conjugate(q))", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      aos_rotated[i] = rotate_vec3_by_quat(aos_vecs[i], aos_a[i]);
+    }
+  }
+  report_benchmark("rotate (rotate_vec3_by_quat)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      aos_out[i] = quat_slerp(aos_a[i], aos_b[i], t[i]);
+    }
+  }
+  report_benchmark("slerp (quat_slerp)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      aos_out[i] = quat_nlerp(aos_a[i], aos_b[i], t[i]);
+    }
+  }
+  report_benchmark("nlerp (quat_nlerp)", get_time_ns() - start, total);
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  char name[128];
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      batch_rotate_vec3(soa_a, soa_vecs, soa_rotated, kCount);
+    }
+    snprintf(name, sizeof(name), "batch_rotate_vec3 (%s)", simd_level_name(SimdLevel(level)));
+    report_benchmark(name, get_time_ns() - start, total);
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      batch_quat_slerp(soa_a, soa_b, t, soa_out, kCount);
+    }
+    snprintf(name, sizeof(name), "batch_quat_slerp (%s)", simd_level_name(SimdLevel(level)));
+    report_benchmark(name, get_time_ns() - start, total);
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      batch_quat_nlerp(soa_a, soa_b, t, soa_out, kCount);
+    }
+    snprintf(name, sizeof(name), "batch_quat_nlerp (%s)", simd_level_name(SimdLevel(level)));
+    report_benchmark(name, get_time_ns() - start, total);
+  }
+
+  dbgln("[benchmark]   checksum %f %f %f %f", aos_rotated[kCount / 2].x, aos_out[kCount / 2].w, soa_rotated.x[kCount / 2], soa_out.w[kCount / 2]);
+}
+
+// Composing and inverting object transforms, the general Mat4 versions vs. the affine ones,
+// both on Mat4 and on the smaller Mat3x4.
+static void
+benchmark_affine_math()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 16;
+  constant u32 kIterations = 16;
+
+  Mat4* transforms = push_memory_arena<Mat4>(&arena, kCount);
+  Mat4* out = push_memory_arena<Mat4>(&arena, kCount);
+  Mat3x4* transforms3x4 = push_memory_arena<Mat3x4>(&arena, kCount);
+  Mat3x4* out3x4 = push_memory_arena<Mat3x4>(&arena, kCount);
+
+  for (u64 i = 0; i < kCount; i++)
+  {
+    f32 t = f32(i);
+    transforms[i] = trs_to_mat4(Vec3(t, -t, 1.0f), quat_from_euler_xyz(t * 0.1f, t * 0.2f, t * 0.3f), Vec3(1.0f + t * 1e-4f, 2.0f, 0.5f));
+    transforms3x4[i] = to_mat3x4(transforms[i]);
+  }
+
+  Mat4 parent = trs_to_mat4(Vec3(1.0f, 2.0f, 3.0f), quat_from_rotation_y(0.5f), Vec3(2.0f));
+  Mat3x4 parent3x4 = to_mat3x4(parent);
+
+  u64 total = kCount * kIterations;
+  f64 start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = parent * transforms[i];
+    }
+  }
+  report_benchmark("multiply (Mat4 * Mat4)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = affine_mul(parent, transforms[i]);
+    }
+  }
+  report_benchmark("multiply (affine_mul)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out3x4[i] = parent3x4 * transforms3x4[i];
+    }
+  }
+  report_benchmark("multiply (Mat3x4 * Mat3x4)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = inverse_mat4(transforms[i]);
+    }
+  }
+  report_benchmark("inverse (inverse_mat4)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = affine_inverse(transforms[i]);
+    }
+  }
+  report_benchmark("inverse (affine_inverse)", get_time_ns() - start, total);
+
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out3x4[i] = inverse_mat3x4(transforms3x4[i]);
+    }
+  }
+  report_benchmark("inverse (inverse_mat3x4)", get_time_ns() - start, total);
+
+  dbgln("[benchmark]   checksum %f %f", out[kCount / 2].entries[3][0], out3x4[kCount / 2].entries[3][0]);
+}
+
+// Filling a big array with uniform floats, std::mt19937 (what generate_random_rotation used to
+// use) vs. Pcg32 one at a time vs. the batch streams at each SIMD level the CPU supports.
+static void
+benchmark_random()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 22;
+  constant u32 kIterations = 4;
+
+  f32* out = push_memory_arena<f32>(&arena, kCount);
+
+  u64 total = kCount * kIterations;
+  std::mt19937 mt;
+  std::uniform_real_distribution<f32> distribution(0.0f, 1.0f);
+  f64 start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = distribution(mt);
+    }
+  }
+  report_benchmark("uniform f32 (std::mt19937)", get_time_ns() - start, total);
+  f32 checksum = out[kCount / 2];
+
+  Pcg32 rng = init_pcg32(1);
+  start = get_time_ns();
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    for (u64 i = 0; i < kCount; i++)
+    {
+      out[i] = pcg32_next_f32(&rng);
+    }
+  }
+  report_benchmark("uniform f32 (pcg32_next_f32)", get_time_ns() - start, total);
+  checksum += out[kCount / 2];
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  char name[128];
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    RandomStreams streams = init_random_streams(1);
+    start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      batch_random_f32(&streams, out, kCount);
+    }
+    snprintf(name, sizeof(name), "batch_random_f32 (%s)", simd_level_name(SimdLevel(level)));
+    report_benchmark(name, get_time_ns() - start, total);
+    checksum += out[kCount / 2];
+  }
+
+  dbgln("[benchmark]   checksum %f", checksum);
+}
+
+// Compressing a million vertices worth of attributes and texels, the scalar conversions one at
+// a time vs. the batch ones. Halfs are the only ones that change with the SIMD level, the rest
+// are SSE2 at every level.
+static void
+benchmark_packing()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kCount = 1 << 20;
+  constant u32 kIterations = 8;
+
+  Vec3Soa normals = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa lighting = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa unpacked = alloc_vec3_soa(&arena, kCount);
+  f32* floats = push_memory_arena<f32>(&arena, kCount);
+  u16* halfs = push_memory_arena<u16>(&arena, kCount);
+  s16* snorms = push_memory_arena<s16>(&arena, kCount);
+  u32* packed = push_memory_arena<u32>(&arena, kCount);
+
+  Pcg32 rng = init_pcg32(1);
+  for (u64 i = 0; i < kCount; i++)
+  {
+    Vec3 n = spherical_fibonacci(f32(i), f32(kCount));
+    normals.x[i] = n.x;
+    normals.y[i] = n.y;
+    normals.z[i] = n.z;
+    lighting.x[i] = pcg32_next_f32(&rng, 0.0f, 4.0f);
+    lighting.y[i] = pcg32_next_f32(&rng, 0.0f, 40.0f);
+    lighting.z[i] = pcg32_next_f32(&rng, 0.0f, 400.0f);
+  }
+
+  u64 total = kCount * kIterations;
+  u64 checksum = 0;
+  auto run = [&](const char* name, auto&& convert)
+  {
+    f64 start = get_time_ns();
+    for (u32 iter = 0; iter < kIterations; iter++)
+    {
+      convert();
+    }
+    report_benchmark(name, get_time_ns() - start, total);
+    checksum += packed[kCount / 2] + halfs[kCount / 2] + snorms[kCount / 2];
+  };
+
+  run("f32 -> f16 (f32_to_f16)", [&]() { for (u64 i = 0; i < kCount; i++) halfs[i] = f32_to_f16(lighting.z[i]); });
+  run("f16 -> f32 (f16_to_f32)", [&]() { for (u64 i = 0; i < kCount; i++) floats[i] = f16_to_f32(halfs[i]); });
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  char name[128];
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+    const char* f16c = get_cpu_features().f16c ? "F16C" : "no F16C";
+
+    snprintf(name, sizeof(name), "batch_f32_to_f16 (%s, %s)", simd_level_name(SimdLevel(level)), f16c);
+    run(name, [&]() { batch_f32_to_f16(lighting.z, halfs, kCount); });
+    snprintf(name, sizeof(name), "batch_f16_to_f32 (%s, %s)", simd_level_name(SimdLevel(level)), f16c);
+    run(name, [&]() { batch_f16_to_f32(halfs, floats, kCount); });
+  }
+
+  run("f32 -> snorm16 (f32_to_snorm16)", [&]() { for (u64 i = 0; i < kCount; i++) snorms[i] = f32_to_snorm16(normals.x[i]); });
+  run("batch_f32_to_snorm16", [&]() { batch_f32_to_snorm16(normals.x, snorms, kCount); });
+
+  run("oct encode (pack_oct_snorm16)", [&]()
+  {
+    for (u64 i = 0; i < kCount; i++) packed[i] = pack_oct_snorm16(Vec3(normals.x[i], normals.y[i], normals.z[i]));
+  });
+  run("batch_pack_oct_snorm16", [&]() { batch_pack_oct_snorm16(normals, packed, kCount); });
+  run("batch_unpack_oct_snorm16", [&]() { batch_unpack_oct_snorm16(packed, unpacked, kCount); });
+
+  run("R11G11B10 (pack_r11g11b10)", [&]()
+  {
+    for (u64 i = 0; i < kCount; i++) packed[i] = pack_r11g11b10(Vec3(lighting.x[i], lighting.y[i], lighting.z[i]));
+  });
+  run("batch_pack_r11g11b10", [&]() { batch_pack_r11g11b10(lighting, packed, kCount); });
+  run("batch_unpack_r11g11b10", [&]() { batch_unpack_r11g11b10(packed, unpacked, kCount); });
+
+  run("RGB9E5 (pack_rgb9e5)", [&]()
+  {
+    for (u64 i = 0; i < kCount; i++) packed[i] = pack_rgb9e5(Vec3(lighting.x[i], lighting.y[i], lighting.z[i]));
+  });
+  run("batch_pack_rgb9e5", [&]() { batch_pack_rgb9e5(lighting, packed, kCount); });
+  run("batch_unpack_rgb9e5", [&]() { batch_unpack_rgb9e5(packed, unpacked, kCount); });
+
+  dbgln("[benchmark]   checksum %llu %f", checksum, floats[kCount / 2] + unpacked.x[kCount / 2]);
+}
+
+// Every triangle of every mesh in the file, with the transforms baked in. False if the file
+// can't be read, which is expected when the assets haven't been pulled.
+static bool
+load_benchmark_triangles(MEMORY_ARENA_PARAM, const char* path, Vec3** positions, u32** indices, u32* triangle_count)
+{
+  Assimp::Importer importer;
+  const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_PreTransformVertices);
+  if (scene == nullptr)
+  {
+    return false;
+  }
+
+  u32 vertex_count = 0;
+  u32 face_count = 0;
+  for (u32 imesh = 0; imesh < scene->mNumMeshes; imesh++)
+  {
+    vertex_count += scene->mMeshes[imesh]->mNumVertices;
+    face_count += scene->mMeshes[imesh]->mNumFaces;
+  }
+
+  *positions = push_memory_arena<Vec3>(MEMORY_ARENA_FWD, vertex_count);
+  *indices = push_memory_arena<u32>(MEMORY_ARENA_FWD, face_count * 3);
+  *triangle_count = 0;
+
+  u32 first_vertex = 0;
+  for (u32 imesh = 0; imesh < scene->mNumMeshes; imesh++)
+  {
+    const aiMesh* mesh = scene->mMeshes[imesh];
+    for (u32 ivertex = 0; ivertex < mesh->mNumVertices; ivertex++)
+    {
+      const aiVector3D& v = mesh->mVertices[ivertex];
+      (*positions)[first_vertex + ivertex] = Vec3(v.x, v.y, v.z);
+    }
+
+    for (u32 iface = 0; iface < mesh->mNumFaces; iface++)
+    {
+      // Lines and points don't survive aiProcess_Triangulate as triangles.
+      const aiFace& face = mesh->mFaces[iface];
+      if (face.mNumIndices != 3)
+      {
+        continue;
+      }
+
+      u32* triangle = *indices + *triangle_count * 3;
+      triangle[0] = first_vertex + face.mIndices[0];
+      triangle[1] = first_vertex + face.mIndices[1];
+      triangle[2] = first_vertex + face.mIndices[2];
+      *triangle_count += 1;
+    }
+    first_vertex += mesh->mNumVertices;
+  }
+
+  return *triangle_count > 0;
+}
+
+// Something shaped roughly like Sponza when it isn't around: a long hall with a tessellated
+// floor, walls and ceiling, and two floors of columns down both sides. About as many
+// triangles (~260K), and just as much of them is big flat walls next to finely tessellated
+// detail.
+static void
+build_synthetic_sponza(MEMORY_ARENA_PARAM, Vec3** positions, u32** indices, u32* triangle_count)
+{
+  constant u32 kGridCells = 104;
+  constant u32 kColumnsPerRow = 12;
+  constant u32 kColumnSegments = 40;
+  constant u32 kColumnRings = 40;
+
+  constant u32 kMaxVertices = 5 * (kGridCells + 1) * (kGridCells + 1) + 4 * kColumnsPerRow * (kColumnSegments + 1) * (kColumnRings + 1);
+  constant u32 kMaxTriangles = 5 * kGridCells * kGridCells * 2 + 4 * kColumnsPerRow * kColumnSegments * kColumnRings * 2;
+
+  *positions = push_memory_arena<Vec3>(MEMORY_ARENA_FWD, kMaxVertices);
+  *indices = push_memory_arena<u32>(MEMORY_ARENA_FWD, kMaxTriangles * 3);
+  u32 vertex_count = 0;
+  u32 index_count = 0;
+
+  // A rows x columns grid of vertices at point(row, column), tiled with two triangles per cell.
+  auto push_grid = [&](u32 rows, u32 columns, auto&& point)
+  {
+    u32 first = vertex_count;
+    for (u32 row = 0; row <= rows; row++)
+    {
+      for (u32 column = 0; column <= columns; column++)
+      {
+        (*positions)[vertex_count++] = point(f32(row) / f32(rows), f32(column) / f32(columns));
+      }
+    }
+
+    for (u32 row = 0; row < rows; row++)
+    {
+      for (u32 column = 0; column < columns; column++)
+      {
+        u32 a = first + row * (columns + 1) + column;
+        u32 b = a + columns + 1;
+        u32* out = *indices + index_count;
+        out[0] = a; out[1] = b; out[2] = a + 1;
+        out[3] = a + 1; out[4] = b; out[5] = b + 1;
+        index_count += 6;
+      }
+    }
+  };
+
+  // The hall, 30 x 12 x 13 like Sponza's atrium.
+  constant f32 kLength = 30.0f;
+  constant f32 kWidth = 12.0f;
+  constant f32 kHeight = 13.0f;
+  push_grid(kGridCells, kGridCells, [&](f32 s, f32 t) { return Vec3((s - 0.5f) * kLength, 0.0f, (t - 0.5f) * kWidth); });
+  push_grid(kGridCells, kGridCells, [&](f32 s, f32 t) { return Vec3((s - 0.5f) * kLength, kHeight, (t - 0.5f) * kWidth); });
+  push_grid(kGridCells, kGridCells, [&](f32 s, f32 t) { return Vec3((s - 0.5f) * kLength, t * kHeight, -0.5f * kWidth); });
+  push_grid(kGridCells, kGridCells, [&](f32 s, f32 t) { return Vec3((s - 0.5f) * kLength, t * kHeight, 0.5f * kWidth); });
+  push_grid(kGridCells, kGridCells, [&](f32 s, f32 t) { return Vec3(0.5f * kLength, t * kHeight, (s - 0.5f) * kWidth); });
+
+  for (u32 level = 0; level < 2; level++)
+  {
+    for (u32 side = 0; side < 2; side++)
+    {
+      for (u32 i = 0; i < kColumnsPerRow; i++)
+      {
+        Vec3 base = Vec3((f32(i) + 0.5f) / f32(kColumnsPerRow) * kLength - 0.5f * kLength,
+                         f32(level) * 6.0f,
+                         side == 0 ? -3.5f : 3.5f);
+        f32 radius = level == 0 ? 0.4f : 0.3f;
+        push_grid(kColumnRings, kColumnSegments, [&](f32 s, f32 t)
+        {
+          // A bit of a bulge so the columns aren't perfect cylinders.
+          f32 r = radius * (1.0f + 0.15f * sinf(s * kPI));
+          return base + Vec3(r * cosf(t * 2.0f * kPI), s * 5.5f, r * sinf(t * 2.0f * kPI));
+        });
+      }
+    }
+  }
+
+  ASSERT(vertex_count <= kMaxVertices && index_count <= kMaxTriangles * 3);
+  *triangle_count = index_count / 3;
+}
+
+// Ray tracing the Sponza triangles (or a stand in of the same size) on one core, with rays
+// from a camera looking down the hall (coherent, what the packets are for) and rays from random
+// points in random directions (incoherent, like diffuse bounces).
+static void
+benchmark_ray_tracing()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(512));
+  defer { free_memory_arena(&arena); };
+
+  Vec3* positions = nullptr;
+  u32* indices = nullptr;
+  u32 triangle_count = 0;
+  const char* scene_name = "Sponza";
+  if (!load_benchmark_triangles(&arena, "assets/sponza/Sponza.gltf", &positions, &indices, &triangle_count))
+  {
+    reset_memory_arena(&arena);
+    build_synthetic_sponza(&arena, &positions, &indices, &triangle_count);
+    scene_name = "synthetic Sponza";
+  }
+
+  f64 start = get_time_ns();
+  Bvh bvh = build_bvh(&arena, positions, indices, triangle_count);
+  f64 build_time = get_time_ns() - start;
+  report_benchmark("build_bvh (binned SAH)", build_time, triangle_count);
+  dbgln("[benchmark]   %s, %u triangles, %u nodes, %.1f ms", scene_name, triangle_count, bvh.node_count, build_time / 1e6);
+
+  Vec3 scene_min = Vec3(bvh.nodes[0].min[0], bvh.nodes[0].min[1], bvh.nodes[0].min[2]);
+  Vec3 scene_max = Vec3(bvh.nodes[0].max[0], bvh.nodes[0].max[1], bvh.nodes[0].max[2]);
+  Vec3 scene_size = scene_max - scene_min;
+
+  // 1280 x 720 primary rays, ordered in 4 x 2 pixel tiles so that every 8 consecutive rays (and
+  // every 4) are a packet of neighbouring pixels.
+  constant u32 kImageWidth = 1280;
+  constant u32 kImageHeight = 720;
+  constant u32 kPrimaryCount = kImageWidth * kImageHeight;
+  Ray* primary = push_memory_arena<Ray>(&arena, kPrimaryCount);
+  {
+    // From one end of the scene, a quarter of the way up, looking down its longest axis.
+    bool along_x = scene_size.x >= scene_size.z;
+    Vec3 eye = Vec3(along_x ? scene_min.x + scene_size.x * 0.1f : (scene_min.x + scene_max.x) * 0.5f,
+                    scene_min.y + scene_size.y * 0.25f,
+                    along_x ? (scene_min.z + scene_max.z) * 0.5f : scene_min.z + scene_size.z * 0.1f);
+    Vec3 forward = along_x ? Vec3(1.0f, 0.0f, 0.0f) : Vec3(0.0f, 0.0f, 1.0f);
+    Vec3 right = along_x ? Vec3(0.0f, 0.0f, -1.0f) : Vec3(1.0f, 0.0f, 0.0f);
+    Vec3 up = Vec3(0.0f, 1.0f, 0.0f);
+
+    f32 tan_half_fov = tanf(kPI / 6.0f);
+    u32 i = 0;
+    for (u32 tile_y = 0; tile_y < kImageHeight; tile_y += 2)
+    {
+      for (u32 tile_x = 0; tile_x < kImageWidth; tile_x += 4)
+      {
+        for (u32 y = tile_y; y < tile_y + 2; y++)
+        {
+          for (u32 x = tile_x; x < tile_x + 4; x++)
+          {
+            f32 ndc_x = ((f32(x) + 0.5f) / f32(kImageWidth) * 2.0f - 1.0f) * tan_half_fov * f32(kImageWidth) / f32(kImageHeight);
+            f32 ndc_y = (1.0f - (f32(y) + 0.5f) / f32(kImageHeight) * 2.0f) * tan_half_fov;
+            primary[i] = Ray();
+            primary[i].origin = eye;
+            primary[i].direction = forward + right * ndc_x + up * ndc_y;
+            i++;
+          }
+        }
+      }
+    }
+  }
+
+  constant u32 kIncoherentCount = 1 << 19;
+  Ray* incoherent = push_memory_arena<Ray>(&arena, kIncoherentCount);
+  Pcg32 rng = init_pcg32(50);
+  for (u32 i = 0; i < kIncoherentCount; i++)
+  {
+    incoherent[i] = Ray();
+    incoherent[i].origin = scene_min + Vec3(pcg32_next_f32(&rng, 0.2f, 0.8f) * scene_size.x,
+                                            pcg32_next_f32(&rng, 0.2f, 0.8f) * scene_size.y,
+                                            pcg32_next_f32(&rng, 0.2f, 0.8f) * scene_size.z);
+    incoherent[i].direction = spherical_fibonacci(f32(pcg32_next_bounded(&rng, 4096)), 4096.0f);
+  }
+
+  u32 max_count = MAX(kPrimaryCount, kIncoherentCount);
+  RayHit* hits = push_memory_arena<RayHit>(&arena, max_count);
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  char name[128];
+  u64 checksum = 0;
+  auto run = [&](const char* rays_name, const Ray* rays, u32 count, RayTriangleTest test, bool packets)
+  {
+    f64 start = get_time_ns();
+    if (packets)
+    {
+      trace_rays(bvh, rays, hits, count, test);
+    }
+    else
+    {
+      for (u32 i = 0; i < count; i++)
+      {
+        hits[i] = trace_ray(bvh, rays[i], test);
+      }
+    }
+    f64 elapsed = get_time_ns() - start;
+
+    snprintf(name,
+             sizeof(name),
+             "%s rays (%s, %s, %s)",
+             rays_name,
+             packets ? "trace_rays" : "trace_ray",
+             test == kRayTriangleWatertight ? "watertight" : "Moller-Trumbore",
+             simd_level_name(get_simd_level()));
+    report_benchmark(name, elapsed, count);
+
+    u32 hit_count = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+      hit_count += hits[i].triangle != kRayMiss ? 1 : 0;
+      checksum += hits[i].triangle;
+    }
+    dbgln("[benchmark]   %.2f Mrays/s, %.1f%% hit", f64(count) * 1e3 / elapsed, 100.0 * f64(hit_count) / f64(count));
+  };
+
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+    for (RayTriangleTest test : {kRayTriangleWatertight, kRayTriangleMollerTrumbore})
+    {
+      run("primary", primary, kPrimaryCount, test, false);
+      run("primary", primary, kPrimaryCount, test, true);
+      run("incoherent", incoherent, kIncoherentCount, test, false);
+      run("incoherent", incoherent, kIncoherentCount, test, true);
+    }
+  }
+
+  dbgln("[benchmark]   checksum %llu", checksum);
+}
+
+// Culling a Sponza sized scene (a few hundred meshes) and a synthetic 1M object one, with the
+// camera in the middle of a big cube of boxes so that most of them are off to the sides or behind.
+static void
+benchmark_frustum_culling()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(128));
+  defer { free_memory_arena(&arena); };
+
+  Mat4 proj = perspective_infinite_reverse_lh(kPI / 4.0f, 16.0f / 9.0f, 0.1f);
+  Mat4 view = look_at_lh(Vec3(0.0f), Vec3(0.3f, -0.1f, 1.0f), Vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = frustum_from_view_proj(proj * view);
+
+  constant u32 kObjectCounts[] = { 400, 1000000 };
+
+  char name[128];
+  for (u32 object_count : kObjectCounts)
+  {
+    reset_memory_arena(&arena);
+
+    Aabb* boxes = push_memory_arena<Aabb>(&arena, object_count);
+    Vec3Soa centers = alloc_vec3_soa(&arena, object_count);
+    Vec3Soa extents = alloc_vec3_soa(&arena, object_count);
+    u8* visible = push_memory_arena<u8>(&arena, object_count);
+
+    for (u32 i = 0; i < object_count; i++)
+    {
+      u64 key = benchmark_key(i);
+      Vec3 center = Vec3(f32(key & 0xFFFF), f32((key >> 16) & 0xFFFF), f32((key >> 32) & 0xFFFF)) * (200.0f / 65535.0f) - Vec3(100.0f);
+      Vec3 extent = Vec3(0.5f + f32((key >> 48) & 0xF) * 0.25f);
+      boxes[i] = Aabb{center, extent};
+      centers.x[i] = center.x; centers.y[i] = center.y; centers.z[i] = center.z;
+      extents.x[i] = extent.x; extents.y[i] = extent.y; extents.z[i] = extent.z;
+    }
+
+    u32 iterations = MAX(10000000 / object_count, 4u);
+    u64 total = u64(object_count) * iterations;
+
+    u64 scalar_visible = 0;
+    f64 start = get_time_ns();
+    for (u32 iter = 0; iter < iterations; iter++)
+    {
+      for (u32 i = 0; i < object_count; i++)
+      {
+        scalar_visible += aabb_in_frustum(frustum, boxes[i]) ? 1 : 0;
+      }
+    }
+    snprintf(name, sizeof(name), "%u boxes (aabb_in_frustum)", object_count);
+    report_benchmark(name, get_time_ns() - start, total);
+    dbgln("[benchmark]   %.1f%% visible", 100.0 * f64(scalar_visible) / f64(total));
+
+    SimdLevel original_level = get_simd_level();
+    defer { set_simd_level(original_level); };
+
+    for (u32 level = 0; level <= get_max_simd_level(); level++)
+    {
+      set_simd_level(SimdLevel(level));
+
+      start = get_time_ns();
+      for (u32 iter = 0; iter < iterations; iter++)
+      {
+        batch_cull_aabbs(frustum, centers, extents, visible, object_count);
+      }
+      snprintf(name, sizeof(name), "%u boxes (batch_cull_aabbs, %s)", object_count, simd_level_name(SimdLevel(level)));
+      report_benchmark(name, get_time_ns() - start, total);
+
+      u64 batch_visible = 0;
+      for (u32 i = 0; i < object_count; i++)
+      {
+        batch_visible += visible[i];
+      }
+      ASSERT(batch_visible * iterations == scalar_visible);
+    }
+  }
+}
+
+// Looking down a street from eye height, through a 16 x 16 grid of buildings that get drawn
+// and also rasterized as occluders, with props scattered around the streets between them.
+// Per frame, this is what the renderer does after frustum culling: build the occlusion buffer
+// from every building, then test the bounds of every draw that survived frustum culling.
+static void
+benchmark_occlusion_culling()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&arena); };
+
+  OcclusionBuffer buffer = init_occlusion_buffer(&arena);
+  MemoryArena scratch = sub_alloc_memory_arena(&arena, MiB(4));
+
+  Mat4 proj = perspective_infinite_reverse_lh(kPI / 4.0f, 16.0f / 9.0f, 0.1f);
+  Mat4 view = look_at_lh(Vec3(0.0f, 1.7f, 0.0f), Vec3(0.2f, 0.0f, 1.0f), Vec3(0.0f, 1.0f, 0.0f));
+  Mat4 view_proj = proj * view;
+  Frustum frustum = frustum_from_view_proj(view_proj);
+
+  // A cube from -1 to 1 that gets scaled up into each building, wound clockwise from the outside.
+  Vec3 cube_positions[8];
+  for (u32 i = 0; i < 8; i++)
+  {
+    cube_positions[i] = Vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+  }
+  u32 cube_indices[] =
+  {
+    0, 6, 2, 0, 4, 6,
+    1, 7, 5, 1, 3, 7,
+    0, 5, 4, 0, 1, 5,
+    2, 7, 3, 2, 6, 7,
+    0, 3, 1, 0, 2, 3,
+    4, 7, 6, 4, 5, 7,
+  };
+  OccluderMesh cube = {cube_positions, cube_indices, 12};
+
+  // 16 wide buildings every 24 units, which leaves 8 wide streets with one running down x = 0.
+  constant u32 kBlocks = 16;
+  constant f32 kBlockSpacing = 24.0f;
+  constant f32 kBuildingExtent = 8.0f;
+  constant u32 kBuildingCount = kBlocks * kBlocks;
+  constant u32 kPropCount = 20000;
+  constant u32 kDrawCount = kBuildingCount + kPropCount;
+
+  Mat4* building_models = push_memory_arena<Mat4>(&arena, kBuildingCount);
+  Aabb* draws = push_memory_arena<Aabb>(&arena, kDrawCount);
+  for (u32 i = 0; i < kBuildingCount; i++)
+  {
+    u64 key = benchmark_key(i);
+    f32 height = 5.0f + f32(key >> 60);
+    Vec3 center = Vec3((f32(i % kBlocks) - 7.5f) * kBlockSpacing, height, 20.0f + f32(i / kBlocks) * kBlockSpacing);
+    Vec3 extents = Vec3(kBuildingExtent, height, kBuildingExtent);
+    building_models[i] = trs_to_mat4(center, Quat(), extents);
+    draws[i] = Aabb{center, extents};
+  }
+
+  for (u32 i = 0; i < kPropCount; i++)
+  {
+    u64 key = benchmark_key(kBuildingCount + i);
+    f32 extent = 0.3f + f32((key >> 48) & 0xF) * 0.05f;
+
+    // Snapped out of whichever building it landed in, into the street on its left.
+    f32 x = (f32(key & 0xFFFF) / 65535.0f - 0.5f) * kBlocks * kBlockSpacing;
+    f32 z = 8.0f + f32((key >> 16) & 0xFFFF) / 65535.0f * kBlocks * kBlockSpacing;
+    f32 block_x = roundf(x / kBlockSpacing - 0.5f) + 0.5f;
+    if (fabsf(x - block_x * kBlockSpacing) < kBuildingExtent + extent)
+    {
+      x = block_x * kBlockSpacing - kBuildingExtent - extent - f32((key >> 32) & 0xFF) / 255.0f * (kBlockSpacing - 2.0f * (kBuildingExtent + extent));
+    }
+    draws[kBuildingCount + i] = Aabb{Vec3(x, extent, z), Vec3(extent)};
+  }
+
+  u32* visible = push_memory_arena<u32>(&arena, kDrawCount);
+  u32 visible_count = 0;
+  for (u32 i = 0; i < kDrawCount; i++)
+  {
+    if (aabb_in_frustum(frustum, draws[i]))
+    {
+      visible[visible_count++] = i;
+    }
+  }
+
+  constant u32 kFrames = 200;
+
+  char name[128];
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  for (u32 level = 0; level <= get_max_simd_level() + 1; level++)
+  {
+    // One more time at the widest level with the bins kicked as jobs.
+    bool parallel = level > get_max_simd_level();
+    set_simd_level(parallel ? get_max_simd_level() : SimdLevel(level));
+    const char* level_name = simd_level_name(get_simd_level());
+
+    f64 start = get_time_ns();
+    for (u32 frame = 0; frame < kFrames; frame++)
+    {
+      reset_memory_arena(&scratch);
+      begin_occlusion_frame(&buffer, view_proj);
+      for (u32 i = 0; i < kBuildingCount; i++)
+      {
+        add_occluder(&buffer, building_models[i], cube);
+      }
+      rasterize_occluders(&scratch, &buffer, parallel);
+    }
+    snprintf(name, sizeof(name), "build %u occluders (%s%s)", kBuildingCount, level_name, parallel ? ", jobs" : "");
+    report_benchmark(name, get_time_ns() - start, kFrames);
+
+    u32 occluded_count = 0;
+    start = get_time_ns();
+    for (u32 frame = 0; frame < kFrames; frame++)
+    {
+      occluded_count = 0;
+      for (u32 i = 0; i < visible_count; i++)
+      {
+        occluded_count += is_aabb_occluded(buffer, draws[visible[i]]) ? 1 : 0;
+      }
+    }
+    snprintf(name, sizeof(name), "test %u boxes (%s%s)", visible_count, level_name, parallel ? ", jobs" : "");
+    report_benchmark(name, get_time_ns() - start, kFrames);
+
+    dbgln("[benchmark]   %u draws, %u after frustum culling, %u after occlusion culling (%.1f%% fewer, %u occluder triangles)",
+          kDrawCount,
+          visible_count,
+          visible_count - occluded_count,
+          100.0 * f64(occluded_count) / f64(visible_count),
+          buffer.triangle_count);
+  }
+}
+
+// Wide, shallow trees (8 children per node) like a scene full of props, from 10k to 1M nodes.
+// The baseline is what the renderer used to do for its one transform: Mat4 * Mat4 and
+// inverse_mat4 for every node, one after the other.
+static void
+benchmark_transform_hierarchy()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(512));
+  defer { free_memory_arena(&arena); };
+
+  constant u32 kNodeCounts[] = { 10000, 100000, 1000000 };
+  constant u32 kFanout = 8;
+
+  char name[128];
+  for (u32 node_count : kNodeCounts)
+  {
+    reset_memory_arena(&arena);
+
+    TransformHierarchy hierarchy = init_transform_hierarchy(&arena, node_count);
+    for (u32 i = 0; i < node_count; i++)
+    {
+      f32 t = f32(i);
+      u32 parent = i == 0 ? kTransformNoParent : (i - 1) / kFanout;
+      add_transform_node(&hierarchy,
+                         parent,
+                         Vec3(sinf(t), 1.0f, cosf(t)),
+                         quat_from_rotation_y(t * 0.01f),
+                         Vec3(1.0f, 1.0f + 0.1f * sinf(t), 1.0f));
+    }
+
+    const u32*  parents      = soa_column<kTransformParent>(&hierarchy.nodes);
+    const Vec3* translations = soa_column<kTransformTranslation>(&hierarchy.nodes);
+    const Quat* rotations    = soa_column<kTransformRotation>(&hierarchy.nodes);
+    const Vec3* scales       = soa_column<kTransformScale>(&hierarchy.nodes);
+
+    Mat4* worlds = push_memory_arena<Mat4>(&arena, node_count);
+    Mat4* normals = push_memory_arena<Mat4>(&arena, node_count);
+    u32 iterations = 10000000 / node_count;
+    u64 total = u64(node_count) * iterations;
+
+    f64 start = get_time_ns();
+    for (u32 iter = 0; iter < iterations; iter++)
+    {
+      for (u32 i = 0; i < node_count; i++)
+      {
+        Mat4 world = trs_to_mat4(translations[i], rotations[i], scales[i]);
+        if (parents[i] != kTransformNoParent)
+        {
+          world = worlds[parents[i]] * world;
+        }
+        worlds[i] = world;
+        normals[i] = transpose_f32(inverse_mat4(world));
+      }
+    }
+    snprintf(name, sizeof(name), "%u nodes (one at a time, inverse_mat4)", node_count);
+    report_benchmark(name, get_time_ns() - start, total);
+
+    // The first update also sorts the nodes into levels, which doesn't happen again.
+    update_transform_hierarchy(&hierarchy, false);
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < iterations; iter++)
+    {
+      update_transform_hierarchy(&hierarchy, false);
+    }
+    snprintf(name, sizeof(name), "%u nodes (update_transform_hierarchy, 1 thread)", node_count);
+    report_benchmark(name, get_time_ns() - start, total);
+
+    start = get_time_ns();
+    for (u32 iter = 0; iter < iterations; iter++)
+    {
+      update_transform_hierarchy(&hierarchy, true);
+    }
+    snprintf(name, sizeof(name), "%u nodes (update_transform_hierarchy, jobs)", node_count);
+    report_benchmark(name, get_time_ns() - start, total);
+
+    u32 last = node_count - 1;
+    dbgln("[benchmark]   checksum %f %f", normals[last].entries[0][3], get_normal_transform(hierarchy, last).entries[0][3]);
+  }
+}
+
+// What a draw looks like once it has everything the renderer wants per draw: a transform,
+// bounds for culling and the state to sort on.
+struct BenchmarkDraw
+{
+  Mat4 transform;
+  Vec4 bounds;
+  u64 pso;
+  u32 index_offset;
+  u32 index_count;
+  u32 material;
+  u32 flags;
+};
+
+enum BenchmarkDrawField
+{
+  kBenchmarkDrawTransform,
+  kBenchmarkDrawBounds,
+  kBenchmarkDrawPso,
+  kBenchmarkDrawIndexOffset,
+  kBenchmarkDrawIndexCount,
+  kBenchmarkDrawMaterial,
+  kBenchmarkDrawFlags,
+};
+typedef SoaArray<Mat4, Vec4, u64, u32, u32, u32, u32> BenchmarkDrawList;
+
+constant u32 kBenchmarkDrawVisible = 0x1;
+
+static u64
+benchmark_draw_sort_key(u64 pso, u32 material)
+{
+  return (pso << 32) | material;
+}
+
+// Visibility filtering, state sorting and a single field pass over a big draw list, stored as an
+// Array of structs vs. an SoaArray. Each op starts from a fresh copy of the same list, and the
+// copy isn't timed.
+static void
+benchmark_draw_lists()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(512));
+  defer { free_memory_arena(&arena); };
+
+  constant u64 kDrawCount  = 1 << 18;
+  constant u32 kIterations = 8;
+
+  auto source = init_array<BenchmarkDraw>(&arena, kDrawCount);
+  u64 rng = 1;
+  for (u64 i = 0; i < kDrawCount; i++)
+  {
+    rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+    BenchmarkDraw* draw = array_add(&source);
+    draw->transform = Mat4();
+    draw->bounds = Vec4(f32(i), 0.0f, 0.0f, 1.0f);
+    draw->pso = (rng >> 58) + 1;
+    draw->index_offset = u32(i * 64);
+    draw->index_count = u32(rng >> 52);
+    draw->material = u32(rng >> 40) & 0xFF;
+    draw->flags = (rng >> 33) & 1 ? kBenchmarkDrawVisible : 0;
+  }
+
+  auto aos = init_array<BenchmarkDraw>(&arena, kDrawCount);
+  auto aos_sorted = init_array<BenchmarkDraw>(&arena, kDrawCount);
+  BenchmarkDrawList soa = init_soa_array<Mat4, Vec4, u64, u32, u32, u32, u32>(&arena, kDrawCount);
+
+  auto reset_aos = [&]()
+  {
+    clear_array(&aos);
+    array_copy(&aos, source);
+  };
+
+  auto reset_soa = [&]()
+  {
+    clear_soa_array(&soa);
+    for (const BenchmarkDraw& draw : source)
+    {
+      soa_push(&soa, draw.transform, draw.bounds, draw.pso, draw.index_offset, draw.index_count, draw.material, draw.flags);
+    }
+  };
+
+  u64 checksum = 0;
+  f64 aos_filter_time = 0.0, soa_filter_time = 0.0;
+  f64 aos_sort_time = 0.0, soa_sort_time = 0.0;
+  f64 aos_sum_time = 0.0, soa_sum_time = 0.0;
+  for (u32 iter = 0; iter < kIterations; iter++)
+  {
+    reset_aos();
+    f64 start = get_time_ns();
+    size_t kept = 0;
+    for (size_t i = 0; i < aos.size; i++)
+    {
+      if (aos[i].flags & kBenchmarkDrawVisible)
+      {
+        aos[kept++] = aos[i];
+      }
+    }
+    aos.size = kept;
+    aos_filter_time += get_time_ns() - start;
+    checksum += aos.size;
+
+    reset_soa();
+    start = get_time_ns();
+    const u32* flags = soa_column<kBenchmarkDrawFlags>(&soa);
+    soa_filter(&arena, &soa, [&](size_t i) { return (flags[i] & kBenchmarkDrawVisible) != 0; });
+    soa_filter_time += get_time_ns() - start;
+    checksum += soa.size;
+
+    // Sorting structs means moving the whole struct, so sort (key, index) pairs and then gather.
+    start = get_time_ns();
+    {
+      uintptr_t* pos = memory_arena_pos_ptr(&arena);
+      uintptr_t saved_pos = *pos;
+      u64* keys = push_memory_arena<u64>(&arena, aos.size);
+      u32* order = push_memory_arena<u32>(&arena, aos.size);
+      for (size_t i = 0; i < aos.size; i++)
+      {
+        keys[i] = benchmark_draw_sort_key(aos[i].pso, aos[i].material);
+        order[i] = u32(i);
+      }
+      radix_sort_u64(&arena, keys, order, aos.size);
+
+      clear_array(&aos_sorted);
+      for (size_t i = 0; i < aos.size; i++)
+      {
+        *array_add(&aos_sorted) = aos[order[i]];
+      }
+      *pos = saved_pos;
+    }
+    aos_sort_time += get_time_ns() - start;
+    checksum += aos_sorted[0].pso;
+
+    start = get_time_ns();
+    const u64* psos = soa_column<kBenchmarkDrawPso>(&soa);
+    const u32* materials = soa_column<kBenchmarkDrawMaterial>(&soa);
+    soa_sort(&arena, &soa, [&](size_t i) { return benchmark_draw_sort_key(psos[i], materials[i]); });
+    soa_sort_time += get_time_ns() - start;
+    checksum += soa_column<kBenchmarkDrawPso>(&soa)[0];
+
+    start = get_time_ns();
+    u64 aos_indices = 0;
+    for (const BenchmarkDraw& draw : aos_sorted)
+    {
+      aos_indices += draw.index_count;
+    }
+    aos_sum_time += get_time_ns() - start;
+
+    start = get_time_ns();
+    u64 soa_indices = 0;
+    for (u32 index_count : soa_span<kBenchmarkDrawIndexCount>(&soa))
+    {
+      soa_indices += index_count;
+    }
+    soa_sum_time += get_time_ns() - start;
+
+    ASSERT(aos_indices == soa_indices);
+    checksum += aos_indices + soa_indices;
+  }
+
+  u64 total = kDrawCount * kIterations;
+  report_benchmark("draw list filter (AoS)", aos_filter_time, total);
+  report_benchmark("draw list filter (SoaArray)", soa_filter_time, total);
+  report_benchmark("draw list sort (AoS)", aos_sort_time, total);
+  report_benchmark("draw list sort (SoaArray)", soa_sort_time, total);
+  report_benchmark("draw list sum index counts (AoS)", aos_sum_time, total);
+  report_benchmark("draw list sum index counts (SoaArray)", soa_sum_time, total);
+  dbgln("[benchmark]   checksum %llu", checksum);
+}
+
+void
+run_all_benchmarks()
+{
+  benchmark_empty_jobs();
+  benchmark_hash_table_load_factor();
+  benchmark_hash_key_types();
+  benchmark_hash_table_vs_std();
+  benchmark_concurrent_hash_table();
+  benchmark_queues();
+  benchmark_vector_reductions();
+  benchmark_batch_math();
+  benchmark_quaternions();
+  benchmark_affine_math();
+  benchmark_random();
+  benchmark_packing();
+  benchmark_ray_tracing();
+  benchmark_frustum_culling();
+  benchmark_occlusion_culling();
+  benchmark_transform_hierarchy();
+  benchmark_draw_lists();
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Needs the job system to be initialized and its workers spawned.
+void run_all_benchmarks();
@@ -0,0 +1,541 @@
+#include "bvh.h"
+
+// Per axis. More bins find slightly better splits, but the build gets slower and the tree
+// hardly any faster past this.
+constant u32 kBvhBinCount = 16;
+
+// The cost of visiting a node relative to testing one triangle, for the SAH.
+constant f32 kBvhTraversalCost = 1.0f;
+
+struct BuildBounds
+{
+  f32 min[3] = { F32_MAX,  F32_MAX,  F32_MAX};
+  f32 max[3] = {-F32_MAX, -F32_MAX, -F32_MAX};
+};
+
+static void
+grow_bounds(BuildBounds* bounds, const f32 min[3], const f32 max[3])
+{
+  for (u32 axis = 0; axis < 3; axis++)
+  {
+    bounds->min[axis] = MIN(bounds->min[axis], min[axis]);
+    bounds->max[axis] = MAX(bounds->max[axis], max[axis]);
+  }
+}
+
+// Half of the surface area, which is all the SAH needs since it only compares ratios.
+static f32
+half_area(const BuildBounds& bounds)
+{
+  f32 dx = bounds.max[0] - bounds.min[0];
+  f32 dy = bounds.max[1] - bounds.min[1];
+  f32 dz = bounds.max[2] - bounds.min[2];
+  if (dx < 0.0f)
+  {
+    return 0.0f;
+  }
+  return dx * dy + dy * dz + dz * dx;
+}
+
+struct BuildTask
+{
+  u32 node;
+  u32 first;
+  u32 count;
+  u32 depth;
+};
+
+Bvh
+build_bvh(MEMORY_ARENA_PARAM, const Vec3* positions, const u32* indices, u32 triangle_count)
+{
+  ASSERT(triangle_count > 0);
+
+  BuildBounds* triangle_bounds = push_memory_arena<BuildBounds>(MEMORY_ARENA_FWD, triangle_count);
+  f32* centroids = push_memory_arena<f32>(MEMORY_ARENA_FWD, triangle_count * 3);
+  u32* order = push_memory_arena<u32>(MEMORY_ARENA_FWD, triangle_count);
+  for (u32 i = 0; i < triangle_count; i++)
+  {
+    BuildBounds bounds;
+    for (u32 corner = 0; corner < 3; corner++)
+    {
+      Vec3 p = positions[indices[i * 3 + corner]];
+      f32 point[3] = {p.x, p.y, p.z};
+      grow_bounds(&bounds, point, point);
+    }
+    triangle_bounds[i] = bounds;
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+      centroids[i * 3 + axis] = (bounds.min[axis] + bounds.max[axis]) * 0.5f;
+    }
+    order[i] = i;
+  }
+
+  Bvh ret;
+  // A binary tree with at least one triangle per leaf never needs more than this.
+  ret.nodes = push_memory_arena<BvhNode>(MEMORY_ARENA_FWD, triangle_count * 2 - 1);
+  ret.node_count = 1;
+
+  BuildTask stack[kBvhMaxDepth];
+  u32 stack_size = 0;
+  stack[stack_size++] = {0, 0, triangle_count, 0};
+
+  while (stack_size > 0)
+  {
+    BuildTask task = stack[--stack_size];
+    // The traversal's stacks are this deep too. Only a pathological mesh gets anywhere close.
+    ASSERT(task.depth < kBvhMaxDepth);
+
+    BuildBounds bounds;
+    BuildBounds centroid_bounds;
+    for (u32 i = task.first; i < task.first + task.count; i++)
+    {
+      grow_bounds(&bounds, triangle_bounds[order[i]].min, triangle_bounds[order[i]].max);
+      grow_bounds(&centroid_bounds, centroids + order[i] * 3, centroids + order[i] * 3);
+    }
+
+    BvhNode* node = &ret.nodes[task.node];
+    memcpy(node->min, bounds.min, sizeof(node->min));
+    memcpy(node->max, bounds.max, sizeof(node->max));
+
+    // Binned SAH over all three axes. A split after bin i puts bins [0, i] on the left.
+    f32 best_cost = F32_MAX;
+    u32 best_axis = 0;
+    u32 best_bin = 0;
+    for (u32 axis = 0; axis < 3 && task.count > 1; axis++)
+    {
+      f32 extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+      if (extent <= 0.0f)
+      {
+        continue;
+      }
+
+      BuildBounds bins[kBvhBinCount];
+      u32 bin_counts[kBvhBinCount] = {};
+      f32 bin_scale = f32(kBvhBinCount) / extent;
+      for (u32 i = task.first; i < task.first + task.count; i++)
+      {
+        u32 triangle = order[i];
+        u32 bin = MIN(u32((centroids[triangle * 3 + axis] - centroid_bounds.min[axis]) * bin_scale), kBvhBinCount - 1);
+        grow_bounds(&bins[bin], triangle_bounds[triangle].min, triangle_bounds[triangle].max);
+        bin_counts[bin]++;
+      }
+
+      f32 right_costs[kBvhBinCount];
+      BuildBounds right;
+      u32 right_count = 0;
+      for (u32 bin = kBvhBinCount - 1; bin > 0; bin--)
+      {
+        grow_bounds(&right, bins[bin].min, bins[bin].max);
+        right_count += bin_counts[bin];
+        right_costs[bin - 1] = right_count > 0 ? half_area(right) * f32(right_count) : -1.0f;
+      }
+
+      BuildBounds left;
+      u32 left_count = 0;
+      for (u32 bin = 0; bin < kBvhBinCount - 1; bin++)
+      {
+        grow_bounds(&left, bins[bin].min, bins[bin].max);
+        left_count += bin_counts[bin];
+        if (left_count == 0 || right_costs[bin] < 0.0f)
+        {
+          continue;
+        }
+
+        f32 cost = half_area(left) * f32(left_count) + right_costs[bin];
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = bin;
+        }
+      }
+    }
+
+    bool can_split = best_cost < F32_MAX;
+    f32 leaf_cost = f32(task.count);
+    f32 split_cost = kBvhTraversalCost + best_cost / half_area(bounds);
+    if (task.count <= kBvhMaxLeafTriangles && (!can_split || split_cost >= leaf_cost))
+    {
+      node->index = task.first;
+      node->triangle_count = u16(task.count);
+      node->axis = 0;
+      continue;
+    }
+
+    u32 split;
+    if (can_split)
+    {
+      f32 bin_scale = f32(kBvhBinCount) / (centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis]);
+      u32 i = task.first;
+      u32 end = task.first + task.count;
+      while (i < end)
+      {
+        f32 centroid = centroids[order[i] * 3 + best_axis];
+        u32 bin = MIN(u32((centroid - centroid_bounds.min[best_axis]) * bin_scale), kBvhBinCount - 1);
+        if (bin <= best_bin)
+        {
+          i++;
+        }
+        else
+        {
+          end--;
+          u32 tmp = order[i];
+          order[i] = order[end];
+          order[end] = tmp;
+        }
+      }
+      split = i;
+    }
+    else
+    {
+      // Too many triangles with the exact same centroid to fit in a leaf, any split is as
+      // good as any other.
+      split = task.first + task.count / 2;
+    }
+
+    u32 child = ret.node_count;
+    ret.node_count += 2;
+    node->index = child;
+    node->triangle_count = 0;
+    node->axis = u16(best_axis);
+
+    ASSERT(stack_size + 2 <= kBvhMaxDepth);
+    stack[stack_size++] = {child + 1, split, task.first + task.count - split, task.depth + 1};
+    stack[stack_size++] = {child, task.first, split - task.first, task.depth + 1};
+  }
+
+  u32 padded_count = triangle_count + kBvhMaxLeafTriangles;
+  ret.v0 = alloc_vec3_soa(MEMORY_ARENA_FWD, padded_count);
+  ret.v1 = alloc_vec3_soa(MEMORY_ARENA_FWD, padded_count);
+  ret.v2 = alloc_vec3_soa(MEMORY_ARENA_FWD, padded_count);
+  ret.triangle_ids = push_memory_arena<u32>(MEMORY_ARENA_FWD, triangle_count);
+  ret.triangle_count = triangle_count;
+  for (u32 i = 0; i < padded_count; i++)
+  {
+    Vec3 v0, v1, v2;
+    if (i < triangle_count)
+    {
+      u32 triangle = order[i];
+      v0 = positions[indices[triangle * 3 + 0]];
+      v1 = positions[indices[triangle * 3 + 1]];
+      v2 = positions[indices[triangle * 3 + 2]];
+      ret.triangle_ids[i] = triangle;
+    }
+    ret.v0.x[i] = v0.x; ret.v0.y[i] = v0.y; ret.v0.z[i] = v0.z;
+    ret.v1.x[i] = v1.x; ret.v1.y[i] = v1.y; ret.v1.z[i] = v1.z;
+    ret.v2.x[i] = v2.x; ret.v2.y[i] = v2.y; ret.v2.z[i] = v2.z;
+  }
+
+  return ret;
+}
+
+alignas(64) static const f32 kLaneIndices[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+template <typename F>
+static Vec3xN<F>
+broadcast_vec3(const f32 v[3])
+{
+  return {simd_set1<F>(v[0]), simd_set1<F>(v[1]), simd_set1<F>(v[2])};
+}
+
+template <typename F>
+static Vec3xN<F>
+load_vec3(Vec3Soa soa, u32 index)
+{
+  return {simd_load<F>(soa.x + index), simd_load<F>(soa.y + index), simd_load<F>(soa.z + index)};
+}
+
+template <typename F>
+static Vec3xN<F>
+broadcast_vec3(Vec3Soa soa, u32 index)
+{
+  return {simd_set1<F>(soa.x[index]), simd_set1<F>(soa.y[index]), simd_set1<F>(soa.z[index])};
+}
+
+template <typename F, RayTriangleTest kTest>
+static F
+intersect_triangles(const RayxN<F>& ray,
+                    const WatertightRayxN<F>& watertight,
+                    Vec3xN<F> v0,
+                    Vec3xN<F> v1,
+                    Vec3xN<F> v2,
+                    F* t,
+                    F* u,
+                    F* v)
+{
+  if constexpr (kTest == kRayTriangleWatertight)
+  {
+    return intersect_ray_triangle_watertight(ray, watertight, v0, v1, v2, t, u, v);
+  }
+  else
+  {
+    return intersect_ray_triangle(ray, v0, v1, v2, t, u, v);
+  }
+}
+
+// The boxes one at a time with plain floats, the leaves a register of triangles at a time.
+// Children get visited nearest first, and anything on the stack that starts past the closest
+// hit so far gets skipped when it comes back off.
+template <typename F, RayTriangleTest kTest>
+static RayHit
+trace_ray_kernel(const Bvh& bvh, const Ray& ray)
+{
+  constexpr u32 kWidth = SimdWidth<F>::kValue;
+
+  RayxN<f32> box_ray = broadcast_ray<f32>(ray);
+  RayxN<F> triangle_ray = broadcast_ray<F>(ray);
+  WatertightRayxN<F> watertight = {};
+  if constexpr (kTest == kRayTriangleWatertight)
+  {
+    watertight = setup_watertight_ray(triangle_ray);
+  }
+
+  RayHit ret;
+  ret.t = ray.t_max;
+
+  struct StackEntry
+  {
+    u32 node;
+    f32 t_enter;
+  };
+  StackEntry stack[kBvhMaxDepth];
+  u32 stack_size = 0;
+
+  f32 t_enter;
+  if (intersect_ray_aabb(box_ray, broadcast_vec3<f32>(bvh.nodes[0].min), broadcast_vec3<f32>(bvh.nodes[0].max), &t_enter) >= 0.0f)
+  {
+    stack[stack_size++] = {0, t_enter};
+  }
+
+  while (stack_size > 0)
+  {
+    StackEntry entry = stack[--stack_size];
+    if (entry.t_enter > ret.t)
+    {
+      continue;
+    }
+
+    const BvhNode* node = &bvh.nodes[entry.node];
+    while (node && node->triangle_count == 0)
+    {
+      u32 near = node->index;
+      u32 far = node->index + 1;
+      f32 near_enter, far_enter;
+      bool hit_near = intersect_ray_aabb(box_ray, broadcast_vec3<f32>(bvh.nodes[near].min), broadcast_vec3<f32>(bvh.nodes[near].max), &near_enter) >= 0.0f;
+      bool hit_far = intersect_ray_aabb(box_ray, broadcast_vec3<f32>(bvh.nodes[far].min), broadcast_vec3<f32>(bvh.nodes[far].max), &far_enter) >= 0.0f;
+
+      if (hit_near && hit_far)
+      {
+        if (far_enter < near_enter)
+        {
+          u32 tmp = near; near = far; far = tmp;
+          f32 tmp_enter = near_enter; near_enter = far_enter; far_enter = tmp_enter;
+        }
+        ASSERT(stack_size < kBvhMaxDepth);
+        stack[stack_size++] = {far, far_enter};
+        node = &bvh.nodes[near];
+      }
+      else if (hit_near || hit_far)
+      {
+        node = &bvh.nodes[hit_near ? near : far];
+      }
+      else
+      {
+        node = nullptr;
+      }
+    }
+
+    if (!node)
+    {
+      continue;
+    }
+
+    for (u32 i = 0; i < node->triangle_count; i += kWidth)
+    {
+      u32 first = node->index + i;
+      F t, u, v;
+      F hit = intersect_triangles<F, kTest>(triangle_ray,
+                                            watertight,
+                                            load_vec3<F>(bvh.v0, first),
+                                            load_vec3<F>(bvh.v1, first),
+                                            load_vec3<F>(bvh.v2, first),
+                                            &t, &u, &v);
+      // hit goes second, so that a NaN in it stays a miss.
+      F valid = simd_sub(simd_set1<F>(f32(node->triangle_count - i) - 0.5f), simd_load<F>(kLaneIndices));
+      u32 mask = simd_nonnegative_mask(simd_min(valid, hit));
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      f32 ts[kWidth], us[kWidth], vs[kWidth];
+      simd_store(ts, t);
+      simd_store(us, u);
+      simd_store(vs, v);
+      for (; mask != 0; mask &= mask - 1)
+      {
+        u32 lane = _tzcnt_u32(mask);
+        if (ts[lane] <= ret.t)
+        {
+          ret.t = ts[lane];
+          ret.u = us[lane];
+          ret.v = vs[lane];
+          ret.triangle = bvh.triangle_ids[first + lane];
+        }
+      }
+      box_ray.t_max = ret.t;
+      triangle_ray.t_max = simd_set1<F>(ret.t);
+    }
+  }
+
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+
+  return ret;
+}
+
+// The whole packet goes down the tree together, as long as any of its rays hit the node.
+// Children get visited in the order the first ray of the packet would want on the node's
+// split axis, which is the right order for all of them when they're coherent.
+template <typename F, RayTriangleTest kTest>
+static void
+trace_packet(const Bvh& bvh, const Ray* rays, RayHit* hits, u32 count)
+{
+  constexpr u32 kWidth = SimdWidth<F>::kValue;
+
+  RayxN<F> packet = load_rays<F>(rays, count);
+  WatertightRayxN<F> watertight = {};
+  if constexpr (kTest == kRayTriangleWatertight)
+  {
+    watertight = setup_watertight_ray(packet);
+  }
+
+  u32 far_first[3] = {rays[0].direction.x < 0.0f, rays[0].direction.y < 0.0f, rays[0].direction.z < 0.0f};
+
+  F best_u = simd_set1<F>(0.0f);
+  F best_v = simd_set1<F>(0.0f);
+  u32 best_triangles[kWidth];
+  for (u32 lane = 0; lane < kWidth; lane++)
+  {
+    best_triangles[lane] = kRayMiss;
+  }
+
+  u32 stack[kBvhMaxDepth];
+  u32 stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while (stack_size > 0)
+  {
+    const BvhNode* node = &bvh.nodes[stack[--stack_size]];
+    while (true)
+    {
+      // packet.t_max is the closest hit so far for every ray, so this also drops nodes that
+      // are entirely behind what the rays already hit.
+      F t_enter;
+      F hit_box = intersect_ray_aabb(packet, broadcast_vec3<F>(node->min), broadcast_vec3<F>(node->max), &t_enter);
+      if (simd_nonnegative_mask(hit_box) == 0)
+      {
+        break;
+      }
+
+      if (node->triangle_count == 0)
+      {
+        u32 near = node->index + far_first[node->axis];
+        u32 far = node->index + 1 - far_first[node->axis];
+        ASSERT(stack_size < kBvhMaxDepth);
+        stack[stack_size++] = far;
+        node = &bvh.nodes[near];
+        continue;
+      }
+
+      for (u32 i = 0; i < node->triangle_count; i++)
+      {
+        u32 triangle = node->index + i;
+        F t, u, v;
+        F hit = intersect_triangles<F, kTest>(packet,
+                                              watertight,
+                                              broadcast_vec3<F>(bvh.v0, triangle),
+                                              broadcast_vec3<F>(bvh.v1, triangle),
+                                              broadcast_vec3<F>(bvh.v2, triangle),
+                                              &t, &u, &v);
+        // The test already checks t against t_max, so every ray that hit has a new closest hit.
+        u32 mask = simd_nonnegative_mask(hit);
+        if (mask == 0)
+        {
+          continue;
+        }
+
+        packet.t_max = simd_select_nonnegative(hit, t, packet.t_max);
+        best_u = simd_select_nonnegative(hit, u, best_u);
+        best_v = simd_select_nonnegative(hit, v, best_v);
+        for (; mask != 0; mask &= mask - 1)
+        {
+          best_triangles[_tzcnt_u32(mask)] = bvh.triangle_ids[triangle];
+        }
+      }
+      break;
+    }
+  }
+
+  f32 ts[kWidth], us[kWidth], vs[kWidth];
+  simd_store(ts, packet.t_max);
+  simd_store(us, best_u);
+  simd_store(vs, best_v);
+  for (u32 lane = 0; lane < count; lane++)
+  {
+    hits[lane].t = ts[lane];
+    hits[lane].u = us[lane];
+    hits[lane].v = vs[lane];
+    hits[lane].triangle = best_triangles[lane];
+  }
+}
+
+template <typename F, RayTriangleTest kTest>
+static void
+trace_rays_kernel(const Bvh& bvh, const Ray* rays, RayHit* hits, size_t count)
+{
+  constexpr u32 kWidth = SimdWidth<F>::kValue;
+
+  for (size_t i = 0; i < count; i += kWidth)
+  {
+    trace_packet<F, kTest>(bvh, rays + i, hits + i, u32(MIN(count - i, size_t(kWidth))));
+  }
+
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+}
+
+typedef RayHit (*TraceRayKernel)(const Bvh& bvh, const Ray& ray);
+typedef void (*TraceRaysKernel)(const Bvh& bvh, const Ray* rays, RayHit* hits, size_t count);
+
+// Leaves never have more than 8 triangles and packets are 8 rays at most, so AVX-512 doesn't
+// get any wider than AVX2 does.
+static const TraceRayKernel kTraceRayKernels[kSimdLevelCount][2] =
+{
+  { &trace_ray_kernel<f32x4, kRayTriangleWatertight>, &trace_ray_kernel<f32x4, kRayTriangleMollerTrumbore> },
+  { &trace_ray_kernel<f32x8, kRayTriangleWatertight>, &trace_ray_kernel<f32x8, kRayTriangleMollerTrumbore> },
+  { &trace_ray_kernel<f32x8, kRayTriangleWatertight>, &trace_ray_kernel<f32x8, kRayTriangleMollerTrumbore> },
+};
+
+static const TraceRaysKernel kTraceRaysKernels[kSimdLevelCount][2] =
+{
+  { &trace_rays_kernel<f32x4, kRayTriangleWatertight>, &trace_rays_kernel<f32x4, kRayTriangleMollerTrumbore> },
+  { &trace_rays_kernel<f32x8, kRayTriangleWatertight>, &trace_rays_kernel<f32x8, kRayTriangleMollerTrumbore> },
+  { &trace_rays_kernel<f32x8, kRayTriangleWatertight>, &trace_rays_kernel<f32x8, kRayTriangleMollerTrumbore> },
+};
+
+RayHit
+trace_ray(const Bvh& bvh, const Ray& ray, RayTriangleTest test)
+{
+  return kTraceRayKernels[get_simd_level()][test](bvh, ray);
+}
+
+void
+trace_rays(const Bvh& bvh, const Ray* rays, RayHit* hits, size_t count, RayTriangleTest test)
+{
+  kTraceRaysKernels[get_simd_level()][test](bvh, rays, hits, count);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "math/ray.h"
+
+// A bounding volume hierarchy over a triangle soup, for ray queries on the CPU: picking,
+// tests of what the GPU ray tracing should see, and anything else that can't wait for a
+// DXR dispatch to come back.
+//
+// The tree is binary and built with the binned surface area heuristic. Leaves hold up to
+// kBvhMaxLeafTriangles triangles, stored SoA in leaf order so that a single ray can test a
+// whole leaf at once.
+//
+// Single rays go through trace_ray, which walks the tree one node at a time and tests the
+// triangles of each leaf 4 or 8 at a time. trace_rays does packets of 4 (SSE2) or 8 (AVX2
+// and up) rays, which go down the tree together as long as any one of them hits a node.
+// Packets only pay off when the rays are coherent (primary rays, shadow rays to one light).
+
+constant u32 kBvhMaxLeafTriangles = 8;
+constant u32 kBvhMaxDepth = 64;
+constant u32 kRayMiss = U32_MAX;
+
+struct BvhNode
+{
+  f32 min[3];
+  // Interior nodes: the first child, the second one is right after it. Leaves: the first
+  // triangle.
+  u32 index;
+  f32 max[3];
+  // 0 for interior nodes.
+  u16 triangle_count;
+  // The axis the children were split along, interior nodes only.
+  u16 axis;
+};
+
+struct Bvh
+{
+  BvhNode* nodes = nullptr;
+  u32 node_count = 0;
+
+  // The triangles in leaf order. Padded by a few degenerate triangles at the end, so a full
+  // register of them can be loaded from any leaf.
+  Vec3Soa v0;
+  Vec3Soa v1;
+  Vec3Soa v2;
+  // Where each of them was in the triangle list the tree was built from.
+  u32* triangle_ids = nullptr;
+  u32 triangle_count = 0;
+};
+
+struct RayHit
+{
+  f32 t = 0.0f;
+  // Barycentric weights of the triangle's second and third vertex.
+  f32 u = 0.0f;
+  f32 v = 0.0f;
+  // Index into the triangle list the tree was built from, or kRayMiss.
+  u32 triangle = kRayMiss;
+};
+
+enum RayTriangleTest : u8
+{
+  // Woop et al., never lets a ray slip between two triangles that share an edge.
+  kRayTriangleWatertight,
+  // Möller–Trumbore. A bit cheaper, but can miss right on shared edges.
+  kRayTriangleMollerTrumbore,
+};
+
+// 3 indices per triangle. Everything gets pushed onto the arena, including some scratch space
+// during the build that isn't given back.
+Bvh build_bvh(MEMORY_ARENA_PARAM, const Vec3* positions, const u32* indices, u32 triangle_count);
+
+// The closest hit in [ray.t_min, ray.t_max].
+RayHit trace_ray(const Bvh& bvh, const Ray& ray, RayTriangleTest test = kRayTriangleWatertight);
+
+// Same as trace_ray for every ray, in packets of consecutive rays.
+void trace_rays(const Bvh& bvh,
+                const Ray* rays,
+                RayHit* hits,
+                size_t count,
+                RayTriangleTest test = kRayTriangleWatertight);
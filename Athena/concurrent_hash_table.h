@@ -0,0 +1,194 @@
+#pragma once
+#include "hash_table.h"
+#include "threading.h"
+
+// A HashTable split into a bunch of independently locked shards, so that threads looking up
+// different keys don't all serialize on one lock the way a SpinLocked<HashTable> does.
+//
+// Each shard is a normal HashTable behind a RWLock, so any number of readers can be in a shard
+// at once and writers only block the one shard their key lands in. The shard is picked from
+// bits of the hash that neither the group index (low bits) nor the control byte (top 7 bits)
+// use, so keys within a shard are still spread over the whole shard's table.
+//
+// Lookups copy the value out while holding the lock rather than returning a pointer, since
+// another thread can grow the shard (and move everything) as soon as the lock is released.
+// Use concurrent_hash_table_read/write when you need to do more than that under the lock.
+
+constant u32 kConcurrentHashTableDefaultShards = 64;
+
+template <typename K, typename V, typename H = Hasher<K>>
+struct ConcurrentHashTable
+{
+  // Padded out to a cache line so that taking one shard's lock doesn't invalidate the
+  // neighbouring shard's lock on other cores.
+  struct alignas(64) Shard
+  {
+    RWLock lock;
+    HashTable<K, V, H> table;
+    // Each shard grows into its own arena, since the arena itself isn't thread-safe.
+    MemoryArena arena;
+  };
+
+  Shard* shards = nullptr;
+  // Always a power of 2.
+  u32 shard_count = 0;
+};
+
+// `max_capacity` is the most elements that will ever be in the table at once. Nothing stops all
+// of them from hashing to the same shard, so every shard's arena is sized to hold `max_capacity`
+// on its own. That makes the memory cost shard_count * hash_table_arena_size(max_capacity), so
+// don't use more shards than there's actually contention for. The shards start out at
+// `capacity` and grow from there.
+template <typename K, typename V, typename H = Hasher<K>>
+inline ConcurrentHashTable<K, V, H>
+init_concurrent_hash_table(MEMORY_ARENA_PARAM,
+                           u64 capacity,
+                           u64 max_capacity,
+                           u32 shard_count = kConcurrentHashTableDefaultShards)
+{
+  using Shard = typename ConcurrentHashTable<K, V, H>::Shard;
+
+  ASSERT(is_pow2(shard_count));
+  ASSERT(capacity <= max_capacity);
+
+  ConcurrentHashTable<K, V, H> ret;
+  ret.shard_count = shard_count;
+  ret.shards      = push_memory_arena<Shard>(MEMORY_ARENA_FWD, shard_count);
+
+  u64 shard_capacity = capacity / shard_count + 1;
+  size_t arena_size  = hash_table_arena_size<K, V, H>(max_capacity);
+
+  for (u32 i = 0; i < shard_count; i++)
+  {
+    Shard* shard = ret.shards + i;
+    shard->lock  = RWLock();
+    shard->arena = sub_alloc_memory_arena(MEMORY_ARENA_FWD, arena_size, 64);
+    shard->table = init_hash_table<K, V, H>(&shard->arena, shard_capacity);
+  }
+
+  return ret;
+}
+
+template <typename K, typename V, typename H>
+inline typename ConcurrentHashTable<K, V, H>::Shard*
+concurrent_hash_table_shard(const ConcurrentHashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h)
+{
+  return table->shards + ((h.position >> 48) & (table->shard_count - 1));
+}
+
+template <typename K, typename V, typename H>
+inline typename HashTable<K, V, H>::Hash
+concurrent_hash_table_hash(const ConcurrentHashTable<K, V, H>* table, const K& key)
+{
+  // The hash doesn't actually depend on which table it's for.
+  return hash_table_hash(&table->shards[0].table, key);
+}
+
+template <typename K, typename V, typename H>
+inline Option<V>
+concurrent_hash_table_find(ConcurrentHashTable<K, V, H>* table, const std::type_identity_t<K>& key)
+{
+  auto h = concurrent_hash_table_hash(table, key);
+  auto* shard = concurrent_hash_table_shard(table, h);
+
+  rw_acquire_read(&shard->lock);
+  defer { rw_release_read(&shard->lock); };
+
+  Option<V*> value = hash_table_find_hashed(&shard->table, h, key);
+  if (!value)
+    return None;
+
+  return *unwrap(value);
+}
+
+template <typename K, typename V, typename H>
+inline bool
+concurrent_hash_table_contains(ConcurrentHashTable<K, V, H>* table, const std::type_identity_t<K>& key)
+{
+  auto h = concurrent_hash_table_hash(table, key);
+  auto* shard = concurrent_hash_table_shard(table, h);
+
+  rw_acquire_read(&shard->lock);
+  defer { rw_release_read(&shard->lock); };
+
+  return (bool)hash_table_find_hashed(&shard->table, h, key);
+}
+
+// Inserts or overwrites. Returns true if the key wasn't already in the table.
+template <typename K, typename V, typename H>
+inline bool
+concurrent_hash_table_insert(ConcurrentHashTable<K, V, H>* table,
+                             const std::type_identity_t<K>& key,
+                             const std::type_identity_t<V>& value)
+{
+  auto h = concurrent_hash_table_hash(table, key);
+  auto* shard = concurrent_hash_table_shard(table, h);
+
+  rw_acquire_write(&shard->lock);
+  defer { rw_release_write(&shard->lock); };
+
+  u64 used = shard->table.used;
+  *hash_table_insert_hashed(&shard->table, h, key) = value;
+  return shard->table.used != used;
+}
+
+template <typename K, typename V, typename H>
+inline bool
+concurrent_hash_table_erase(ConcurrentHashTable<K, V, H>* table, const std::type_identity_t<K>& key)
+{
+  auto h = concurrent_hash_table_hash(table, key);
+  auto* shard = concurrent_hash_table_shard(table, h);
+
+  rw_acquire_write(&shard->lock);
+  defer { rw_release_write(&shard->lock); };
+
+  return hash_table_erase_hashed(&shard->table, h, key);
+}
+
+// Calls f with the shard `key` lives in, holding its lock in shared mode. f gets a
+// const HashTable*, and anything it does with it has to stay in that shard (i.e. only
+// ever look up `key`).
+template <typename K, typename V, typename H, typename F>
+inline auto
+concurrent_hash_table_read(ConcurrentHashTable<K, V, H>* table, const std::type_identity_t<K>& key, F f)
+{
+  auto h = concurrent_hash_table_hash(table, key);
+  auto* shard = concurrent_hash_table_shard(table, h);
+
+  rw_acquire_read(&shard->lock);
+  defer { rw_release_read(&shard->lock); };
+
+  return f((const HashTable<K, V, H>*)&shard->table);
+}
+
+// Same as concurrent_hash_table_read, but with the lock held exclusively so f can
+// insert/erase/modify `key`.
+template <typename K, typename V, typename H, typename F>
+inline auto
+concurrent_hash_table_write(ConcurrentHashTable<K, V, H>* table, const std::type_identity_t<K>& key, F f)
+{
+  auto h = concurrent_hash_table_hash(table, key);
+  auto* shard = concurrent_hash_table_shard(table, h);
+
+  rw_acquire_write(&shard->lock);
+  defer { rw_release_write(&shard->lock); };
+
+  return f(&shard->table);
+}
+
+// Only a snapshot, the shards are locked one at a time.
+template <typename K, typename V, typename H>
+inline u64
+concurrent_hash_table_size(ConcurrentHashTable<K, V, H>* table)
+{
+  u64 ret = 0;
+  for (u32 i = 0; i < table->shard_count; i++)
+  {
+    auto* shard = table->shards + i;
+    rw_acquire_read(&shard->lock);
+    ret += shard->table.used;
+    rw_release_read(&shard->lock);
+  }
+
+  return ret;
+}
@@ -62,14 +62,11 @@ pop_context()
   ASSERT(tls_ctx.prev->scratch_arena.start != 0);
 
   Context ret = tls_ctx;
+  // The previous context was stored at the start of the popped context's own arena (see
+  // init_context), not on the previous arena, so its position is just whatever it was when
+  // it got pushed.
   tls_ctx = *prev;
 
-  uintptr_t prev_pos = reinterpret_cast<uintptr_t>(prev);
-
-  // Here we essentially just pop the context data that we previously pushed
-  // onto the memory arena.
-  tls_ctx.scratch_arena.pos = prev_pos;
-
   ASSERT(tls_ctx.scratch_arena.start != 0);
 
   return ret;
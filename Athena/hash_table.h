@@ -2,6 +2,7 @@
 #include "memory/memory.h"
 #include "option.h"
 #include "vendor/xxhash/xxhash.h"
+#include <type_traits>
 
 inline u64
 hash_u64(const void* data, size_t size)
@@ -9,6 +10,68 @@ hash_u64(const void* data, size_t size)
   return XXH64(data, size, 0);
 }
 
+// Murmur3's finalizer. Every input bit affects every output bit, which matters since both
+// the low bits (group index) and the top bits (control byte) get used.
+inline u64
+hash_int_mix(u64 x)
+{
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDull;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// The default way of hashing and comparing HashTable keys. Keys get hashed as raw bytes, so
+// they can't have any implicit padding (explicit __padding__ members are fine since they're always
+// zeroed) or floats. Anything that doesn't fit that needs its own hasher, which is just
+// any struct with the same two static functions.
+template <typename K>
+struct Hasher
+{
+  static_assert(std::has_unique_object_representations_v<K>,
+                "Key can't be hashed as raw bytes, pass a custom hasher to the HashTable.");
+
+  static u64
+  hash(const K& key)
+  {
+    if constexpr (sizeof(K) <= sizeof(u64))
+    {
+      u64 bits = 0;
+      memcpy(&bits, &key, sizeof(K));
+      return hash_int_mix(bits);
+    }
+    else
+    {
+      return XXH3_64bits(&key, sizeof(K));
+    }
+  }
+
+  static bool
+  equal(const K& lhs, const K& rhs)
+  {
+    return lhs == rhs;
+  }
+};
+
+// For null-terminated string keys, hashes and compares the contents rather than the pointer.
+// The table only stores the pointer, so the string has to outlive its entry.
+struct CStringHasher
+{
+  static u64
+  hash(const char* key)
+  {
+    return XXH3_64bits(key, strlen(key));
+  }
+
+  static bool
+  equal(const char* lhs, const char* rhs)
+  {
+    return strcmp(lhs, rhs) == 0;
+  }
+};
+
 enum HashTableCtrl : u8
 {
   kHashTableCtrlEmpty     = 0x80,
@@ -16,263 +79,754 @@ enum HashTableCtrl : u8
   kHashTableCtrlFullMask = 0x7F,
 };
 
+// Define to use 32 wide groups matched with AVX2 instead of the default 16 wide SSE2 ones.
+// Only worth it for big tables, and it needs to be compiled with /arch:AVX2.
+//#define HASH_TABLE_AVX2
+
+#ifdef HASH_TABLE_AVX2
+constant u64 kHashTableGroupWidth = 32;
+typedef u8x32 HashTableCtrls;
+#else
+constant u64 kHashTableGroupWidth = 16;
+typedef u8x16 HashTableCtrls;
+#endif
+constant u64 kHashTableInvalidSlot = U64_MAX;
+
+// Past 7/8 full (counting tombstones) probe lengths start blowing up, so that's when we either
+// clean up the tombstones or grow.
+inline u64
+hash_table_max_load(u64 capacity)
+{
+  return capacity - capacity / 8;
+}
+
+// One bit per slot in a group. Iterating gives the indices of the set bits, lowest first.
+struct HashTableBitMask
+{
+  u32 mask = 0;
+
+  struct Iter
+  {
+    u32 mask = 0;
+
+    u32 operator*() const { return _tzcnt_u32(mask); }
+    Iter& operator++() { mask &= mask - 1; return *this; }
+    bool operator!=(const Iter& rhs) const { return mask != rhs.mask; }
+  };
+
+  Iter begin() const { return Iter{mask}; }
+  Iter end() const { return Iter{0}; }
+
+  explicit operator bool() const { return mask != 0; }
+  u32 lowest() const { return _tzcnt_u32(mask); }
+};
+
+#ifdef HASH_TABLE_AVX2
+inline HashTableBitMask
+hash_table_match_meta(HashTableCtrls ctrls, u8 meta)
+{
+  return HashTableBitMask{(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(meta), ctrls))};
+}
+
+inline HashTableBitMask
+hash_table_match_empty(HashTableCtrls ctrls)
+{
+  return HashTableBitMask{(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(kHashTableCtrlEmpty), ctrls))};
+}
+
+// Empty and deleted both have the high bit set.
+inline HashTableBitMask
+hash_table_match_empty_or_deleted(HashTableCtrls ctrls)
+{
+  return HashTableBitMask{(u32)_mm256_movemask_epi8(ctrls)};
+}
+
+inline HashTableBitMask
+hash_table_match_full(HashTableCtrls ctrls)
+{
+  return HashTableBitMask{~(u32)_mm256_movemask_epi8(ctrls)};
+}
+#else
+inline HashTableBitMask
+hash_table_match_meta(HashTableCtrls ctrls, u8 meta)
+{
+  return HashTableBitMask{(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(meta), ctrls))};
+}
+
+inline HashTableBitMask
+hash_table_match_empty(HashTableCtrls ctrls)
+{
+  return HashTableBitMask{(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(kHashTableCtrlEmpty), ctrls))};
+}
+
+// Empty and deleted both have the high bit set.
+inline HashTableBitMask
+hash_table_match_empty_or_deleted(HashTableCtrls ctrls)
+{
+  return HashTableBitMask{(u32)_mm_movemask_epi8(ctrls)};
+}
+
+inline HashTableBitMask
+hash_table_match_full(HashTableCtrls ctrls)
+{
+  return HashTableBitMask{~(u32)_mm_movemask_epi8(ctrls) & 0xFFFF};
+}
+#endif
+
+// Tables with an empty value type (i.e. HashSet) don't allocate any values at all.
+template <typename Table>
+inline auto
+hash_table_value(Table* table, u64 slot) -> decltype(table->values)
+{
+  using V = std::remove_pointer_t<decltype(table->values)>;
+  if constexpr (std::is_empty_v<V>)
+  {
+    // Never actually read from or written to, it just needs to be a valid pointer.
+    return reinterpret_cast<V*>(table->groups);
+  }
+  else
+  {
+    return table->values + slot;
+  }
+}
+
+// Walks the full slots a group at a time, so empty stretches of the table are skipped 16 (or 32)
+// slots at a time. Modifying the table while iterating is not allowed.
+template <typename Table, typename K, typename V>
+struct HashTableIterator
+{
+  struct Entry
+  {
+    const K& key;
+    V& value;
+  };
+
+  Table* table = nullptr;
+  u64 group_index = 0;
+  u32 mask = 0;
+
+  Entry operator*() const
+  {
+    u32 i = _tzcnt_u32(mask);
+    return Entry{table->groups[group_index].keys[i], *hash_table_value(table, group_index * kHashTableGroupWidth + i)};
+  }
+
+  HashTableIterator& operator++()
+  {
+    mask &= mask - 1;
+    skip_empty_groups();
+    return *this;
+  }
+
+  bool operator!=(const HashTableIterator& rhs) const
+  {
+    return group_index != rhs.group_index || mask != rhs.mask;
+  }
+
+  void skip_empty_groups()
+  {
+    while (mask == 0)
+    {
+      group_index++;
+      if (group_index >= table->groups_size)
+        return;
+
+      mask = hash_table_match_full(table->groups[group_index].ctrls_simd).mask;
+    }
+  }
+};
+
+template <typename Table, typename K, typename V>
+inline HashTableIterator<Table, K, V>
+hash_table_begin(Table* table)
+{
+  HashTableIterator<Table, K, V> ret = {table, 0, 0};
+  if (table->groups_size == 0)
+    return ret;
+
+  ret.mask = hash_table_match_full(table->groups[0].ctrls_simd).mask;
+  ret.skip_empty_groups();
+  return ret;
+}
+
 // Swiss-table implementation. Really simple to implement and really well optimized.
-template <typename K, typename V>
+template <typename K, typename V, typename H = Hasher<K>>
 struct HashTable
 {
-  union Hash
+  // Same split as Abseil: H1 picks the group to start probing at and H2 is the 7 bits stored in
+  // the control byte. They come from opposite ends of the hash so that entries that start in
+  // the same group don't also end up with correlated metadata.
+  struct Hash
   {
-    struct
-    {
-      // 7 bits of metadata
-      u64 meta : 7;
-      // The remaining bits are for the position index.
-      u64 position : 57;
-      // 57 + 7 = 64 bits
-    };
-    u64 raw = 0;
+    // H1, the low bits. Masked by groups_size - 1.
+    u64 position = 0;
+    // H2, the top 7 bits.
+    u8 meta = 0;
   };
 
   struct Group
   {
     union
     {
-      u8x16 ctrls_sse;
-      u8 ctrls[16];
+      HashTableCtrls ctrls_simd;
+      u8 ctrls[kHashTableGroupWidth];
     };
-    K keys[16];
+    K keys[kHashTableGroupWidth];
   };
 
-  typedef u64 (*HashFunc)(const void* data, size_t size);
-
   Group* groups = nullptr;
   V* values = nullptr;
-  HashFunc hash_func = &hash_u64;
 
+  // Where the table grows into once it fills up. The old blocks just stay in the arena.
+  MemoryArena* arena = nullptr;
+
+  // Always a power of 2, so the group index is just a mask.
   u64 groups_size = 0;
   u64 capacity = 0;
 
   u64 used = 0;
+  // Deleted slots still count towards the load, since lookups have to probe past them.
+  u64 tombstones = 0;
 
-#if 0
-  Iterator<HashTable, T> begin() { return Iterator<Container, T>::begin(this);  }
-  Iterator<Container, T> end() { return Iterator<Container, T>::end(this);  }
-  Iterator<const Container, const T> begin() const { return Iterator<const Container, const T>::begin(this);  }
-  Iterator<const Container, const T> end() const { return Iterator<const Container, const T>::end(this);  }
-private:
-  friend Iterator<Container, T>;
-  friend Iterator<const Container, const T>;
-  size_t m_increment_idx(size_t idx) const
-  { 
-    ASSERT(idx < groups_size * 16);
-    idx++;
-
-    while (idx / 16 < groups_size)
-    {
-      HashTable::Group* group = this->groups + idx / 16;
-      u16 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(kHashTableCtrlFullMask), group->ctrls_sse));
+  HashTableIterator<HashTable, K, V> begin() { return hash_table_begin<HashTable, K, V>(this); }
+  HashTableIterator<HashTable, K, V> end() { return HashTableIterator<HashTable, K, V>{this, groups_size, 0}; }
+  HashTableIterator<const HashTable, K, const V> begin() const { return hash_table_begin<const HashTable, K, const V>(this); }
+  HashTableIterator<const HashTable, K, const V> end() const { return HashTableIterator<const HashTable, K, const V>{this, groups_size, 0}; }
+};
 
-      do
-      {
-        u64 shift = idx % 16;
-        if ((mask & (1 << shift)) != 0)
-          return idx;
+template <typename K, typename V, typename H>
+inline void
+hash_table_alloc_groups(HashTable<K, V, H>* table, u64 groups_size)
+{
+  using Group = typename HashTable<K, V, H>::Group;
 
-        idx++;
-      }
-      while (idx % 16 != 0);
-    }
+  ASSERT(table->arena != nullptr);
+  ASSERT(is_pow2(groups_size));
 
-    ASSERT(idx == groups_size * 16);
-    return idx;
+  table->groups_size = groups_size;
+  table->groups      = push_memory_arena<Group>(table->arena, groups_size);
+  zero_memory(table->groups, groups_size * sizeof(Group));
+  table->capacity    = groups_size * kHashTableGroupWidth;
+  if constexpr (!std::is_empty_v<V>)
+  {
+    table->values    = push_memory_arena<V>(table->arena, table->capacity);
   }
+  table->used        = 0;
+  table->tombstones  = 0;
 
-  size_t m_decrement_idx(size_t idx) const
-  { 
-    ASSERT(idx > 0);
-    idx--;
+  for (u64 i = 0; i < groups_size; i++)
+  {
+    memset(table->groups[i].ctrls, kHashTableCtrlEmpty, kHashTableGroupWidth);
+  }
+}
 
-    while (idx > 0)
-    {
-      HashTable::Group* group = this->groups + idx / 16;
-      u16 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(kHashTableCtrlFullMask), group->ctrls_sse));
+// Leaves room for 1/3 more than asked for, so that `capacity` elements fit without ever
+// hitting the max load and growing.
+inline u64
+hash_table_groups_for_capacity(u64 capacity)
+{
+  return next_pow2((capacity * 4 / 3 + kHashTableGroupWidth - 1) / kHashTableGroupWidth);
+}
 
-      do
-      {
-        u64 shift = idx % 16;
-        if ((mask & (1 << shift)) != 0)
-          return idx;
+// The arena needs to outlive the table, it's used again whenever the table grows.
+template <typename K, typename V, typename H = Hasher<K>>
+inline HashTable<K, V, H>
+init_hash_table(MEMORY_ARENA_PARAM, u64 capacity)
+{
+  HashTable<K, V, H> ret = {};
+  ret.arena = MEMORY_ARENA_FWD;
 
-        idx--;
-      }
-      while (idx % 16 != 0);
-    }
+  hash_table_alloc_groups(&ret, hash_table_groups_for_capacity(capacity));
+
+  return ret;
+}
 
-    ASSERT(idx == 0);
-    return idx;
+// Upper bound on how much arena memory a table takes to hold up to `capacity` elements,
+// including all of the blocks left behind by growing into it.
+template <typename K, typename V, typename H = Hasher<K>>
+inline size_t
+hash_table_arena_size(u64 capacity)
+{
+  using Group = typename HashTable<K, V, H>::Group;
+
+  u64 groups_size = hash_table_groups_for_capacity(capacity);
+  size_t ret = groups_size * sizeof(Group) + alignof(Group);
+  if constexpr (!std::is_empty_v<V>)
+  {
+    ret += groups_size * kHashTableGroupWidth * sizeof(V) + alignof(V);
   }
 
-  size_t m_begin_idx() const { return m_increment_idx(0); }
-  size_t m_end_idx() const { return groups_size * 16; }
-#endif
-};
+  // Growing only ever doubles, so everything before the final block adds up to less than it.
+  return ret * 2;
+}
 
-template <typename K, typename V>
-inline HashTable<K, V>
-init_hash_table(MEMORY_ARENA_PARAM, u64 capacity)
+template <typename K, typename V, typename H>
+inline typename HashTable<K, V, H>::Hash
+hash_table_hash(const HashTable<K, V, H>* table, const K& key)
 {
-  HashTable<K, V> ret = {};
+  u64 raw = H::hash(key);
 
-  capacity = capacity * 4 / 3 + 15;
-  ret.groups_size = capacity / 16;
-  ret.groups      = push_memory_arena<typename HashTable<K, V>::Group>(MEMORY_ARENA_FWD, ret.groups_size);
-  zero_memory(ret.groups, ret.groups_size * sizeof(typename HashTable<K, V>::Group));
-  ret.values      = push_memory_arena<V>(MEMORY_ARENA_FWD, capacity);
-  ret.capacity    = capacity;
-  ret.used        = 0;
+  typename HashTable<K, V, H>::Hash h;
+  h.position = raw;
+  h.meta     = u8(raw >> 57);
+  return h;
+}
 
-  for (u64 i = 0; i < ret.groups_size; i++)
-  {
-    ret.groups[i].ctrls_sse = _mm_set1_epi8(kHashTableCtrlEmpty);
-  }
+// The sequence of groups that a hash visits. This is triangular probing (start + 0, +1, +3, +6, ...),
+// which with a power of 2 number of groups visits every group exactly once within groups_size steps,
+// and doesn't pile up clusters the way linear probing does.
+struct HashTableProbe
+{
+  u64 group_index = 0;
+  u64 step = 0;
+};
 
+template <typename K, typename V, typename H>
+inline HashTableProbe
+init_hash_table_probe(const HashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h)
+{
+  HashTableProbe ret;
+  ret.group_index = h.position & (table->groups_size - 1);
   return ret;
 }
 
-// TODO(Brandon): Add branch prediction hints
+template <typename K, typename V, typename H>
+inline void
+hash_table_probe_next(const HashTable<K, V, H>* table, HashTableProbe* probe)
+{
+  probe->step++;
+  probe->group_index = (probe->group_index + probe->step) & (table->groups_size - 1);
+}
 
-template <typename K, typename V>
-inline V*
-hash_table_insert(HashTable<K, V>* table, const K& key)
+// Opt-in hasher for 4 and 8 byte keys that compares the key against the whole group at once
+// instead of checking the metadata matches one at a time.
+// NOTE: In the benchmarks this is slower than the default (~2-3x on hits), since the
+// 7 bit metadata already leaves ~1 candidate per group and this has to touch every key in it.
+// Might be worth it for tables with a lot of H2 collisions, which is why it's still here.
+template <typename K>
+struct SimdCompareHasher : Hasher<K>
 {
-  ASSERT(table->used < table->capacity);
+  static_assert(sizeof(K) == 4 || sizeof(K) == 8);
+};
+
+template <typename K, typename H>
+constexpr bool kHashTableSimdKeyCompare = std::is_same_v<H, SimdCompareHasher<K>>;
 
-  using Hash = typename HashTable<K, V>::Hash;
+template <typename K>
+inline HashTableBitMask
+hash_table_match_keys(const K* keys, const K& key)
+{
+  static_assert(sizeof(K) == 4 || sizeof(K) == 8);
 
-  Hash h = {0};
-  h.raw = table->hash_func(&key, sizeof(key));
+  u64 bits = 0;
+  memcpy(&bits, &key, sizeof(K));
 
-  u64 start_index = h.position % table->groups_size;
-  u64 group_index = start_index;
-  do
+  u32 ret = 0;
+#ifdef HASH_TABLE_AVX2
+  if constexpr (sizeof(K) == 8)
   {
-    auto* group = table->groups + group_index;
+    __m256i needle = _mm256_set1_epi64x(s64(bits));
+    for (u32 i = 0; i < kHashTableGroupWidth; i += 4)
+    {
+      __m256i cmp = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(keys + i)), needle);
+      ret |= u32(_mm256_movemask_pd(_mm256_castsi256_pd(cmp))) << i;
+    }
+  }
+  else
+  {
+    __m256i needle = _mm256_set1_epi32(s32(bits));
+    for (u32 i = 0; i < kHashTableGroupWidth; i += 8)
+    {
+      __m256i cmp = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(keys + i)), needle);
+      ret |= u32(_mm256_movemask_ps(_mm256_castsi256_ps(cmp))) << i;
+    }
+  }
+#else
+  if constexpr (sizeof(K) == 8)
+  {
+    // SSE2 doesn't have a 64 bit compare, so compare the 32 bit halves and AND them together.
+    u64x2 needle = _mm_set1_epi64x(s64(bits));
+    for (u32 i = 0; i < kHashTableGroupWidth; i += 2)
     {
-      // Look for already existing key.
-      u16 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h.meta), group->ctrls_sse));
-      if (mask != 0)
+      u32x4 cmp = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(keys + i)), needle);
+      cmp = _mm_and_si128(cmp, _mm_shuffle_epi32(cmp, _MM_SHUFFLE(2, 3, 0, 1)));
+      ret |= u32(_mm_movemask_pd(_mm_castsi128_pd(cmp))) << i;
+    }
+  }
+  else
+  {
+    u32x4 needle = _mm_set1_epi32(s32(bits));
+    for (u32 i = 0; i < kHashTableGroupWidth; i += 4)
+    {
+      u32x4 cmp = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(keys + i)), needle);
+      ret |= u32(_mm_movemask_ps(_mm_castsi128_ps(cmp))) << i;
+    }
+  }
+#endif
+
+  return HashTableBitMask{ret};
+}
+
+template <typename K, typename V, typename H>
+inline u64
+hash_table_find_slot(const HashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h, const K& key)
+{
+  HashTableProbe probe = init_hash_table_probe(table, h);
+  for (u64 step = 0; step < table->groups_size; step++)
+  {
+    auto* group = table->groups + probe.group_index;
+    HashTableBitMask candidates = hash_table_match_meta(group->ctrls_simd, h.meta);
+    if constexpr (kHashTableSimdKeyCompare<K, H>)
+    {
+      if (candidates)
       {
-        for (u8 i = 0; i < 16; i++)
-        {
-          if ((mask & (1 << i)) == 0)
-            continue;
-          if (group->keys[i] != key)
-            continue;
-
-          return &table->values[group_index * 16 + i];
-        }
+        HashTableBitMask matches = {candidates.mask & hash_table_match_keys(group->keys, key).mask};
+        if (matches)
+          return probe.group_index * kHashTableGroupWidth + matches.lowest();
       }
     }
+    else
     {
-      // We AND with the ctrl_empty mask because we also want to include
-      // tombstones here.
-      u16 mask = _mm_movemask_epi8(_mm_and_si128(_mm_set1_epi8(kHashTableCtrlEmpty), group->ctrls_sse));
-
-      // Find the first empty/deleted element in the hashmap
-      for (u8 i = 0; i < 16; i++)
+      for (u32 i : candidates)
       {
-        if ((mask & (1 << i)) == 0)
+        if (!H::equal(group->keys[i], key))
           continue;
-  
-        group->ctrls[i] = (u8)h.meta & kHashTableCtrlFullMask;
-        group->keys[i] = key;
-
-        table->used++;
-  
-        return &table->values[group_index * 16 + i];
+        return probe.group_index * kHashTableGroupWidth + i;
       }
     }
 
-    group_index = (group_index + 1) % table->groups_size;
-  } while (group_index != start_index);
+    // If there is at least one empty element, then that means that the hash _had_
+    // a place to go, but the key obviously isn't there.
+    if (hash_table_match_empty(group->ctrls_simd))
+      return kHashTableInvalidSlot;
+
+    hash_table_probe_next(table, &probe);
+  }
+
+  return kHashTableInvalidSlot;
+}
+
+// First empty or deleted slot along the probe sequence.
+template <typename K, typename V, typename H>
+inline u64
+hash_table_find_free_slot(const HashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h)
+{
+  HashTableProbe probe = init_hash_table_probe(table, h);
+  for (u64 step = 0; step < table->groups_size; step++)
+  {
+    auto* group = table->groups + probe.group_index;
+    HashTableBitMask mask = hash_table_match_empty_or_deleted(group->ctrls_simd);
+    if (mask)
+      return probe.group_index * kHashTableGroupWidth + mask.lowest();
+
+    hash_table_probe_next(table, &probe);
+  }
 
   UNREACHABLE;
-  return nullptr;
+  return kHashTableInvalidSlot;
 }
 
-template <typename K, typename V>
-inline Option<V*>
-hash_table_find(const HashTable<K, V>* table, const K& key)
+template <typename K, typename V, typename H>
+inline u8*
+hash_table_ctrl(HashTable<K, V, H>* table, u64 slot)
+{
+  return &table->groups[slot / kHashTableGroupWidth].ctrls[slot % kHashTableGroupWidth];
+}
+
+template <typename K, typename V, typename H>
+inline K*
+hash_table_key(HashTable<K, V, H>* table, u64 slot)
+{
+  return &table->groups[slot / kHashTableGroupWidth].keys[slot % kHashTableGroupWidth];
+}
+
+// Stop-the-world rehash into a new block from the table's arena.
+template <typename K, typename V, typename H>
+inline void
+hash_table_resize(HashTable<K, V, H>* table, u64 groups_size)
 {
-  using Hash = typename HashTable<K, V>::Hash;
+  using Hash = typename HashTable<K, V, H>::Hash;
+
+  HashTable<K, V, H> old = *table;
+  ASSERT(groups_size * kHashTableGroupWidth > old.used);
 
-  Hash h = {0};
-  h.raw = table->hash_func(&key, sizeof(key));
+  hash_table_alloc_groups(table, groups_size);
 
-  u64 start_index = h.position % table->groups_size;
-  u64 group_index = start_index;
-  do
+  for (u64 group_index = 0; group_index < old.groups_size; group_index++)
+  {
+    auto* group = old.groups + group_index;
+    for (u32 i : hash_table_match_full(group->ctrls_simd))
+    {
+      Hash h = hash_table_hash(table, group->keys[i]);
+      u64 slot = hash_table_find_free_slot(table, h);
+      *hash_table_ctrl(table, slot) = h.meta;
+      *hash_table_key(table, slot) = group->keys[i];
+      *hash_table_value(table, slot) = *hash_table_value(&old, group_index * kHashTableGroupWidth + i);
+    }
+  }
+
+  table->used = old.used;
+}
+
+// Gets rid of all of the tombstones without allocating, same idea as Abseil's
+// drop_deletes_without_resize:
+//   1. Mark every deleted slot as empty, and every full slot as deleted (meaning "still needs a home").
+//   2. Walk the slots, and for each one still marked deleted find where it would go now. If that's in
+//      the same group it's already in, it stays. If it's an empty slot, move it there. If it's
+//      another slot that still needs a home, swap the two and go again on this slot.
+template <typename K, typename V, typename H>
+inline void
+hash_table_drop_tombstones(HashTable<K, V, H>* table)
+{
+  using Hash = typename HashTable<K, V, H>::Hash;
+
+  for (u64 group_index = 0; group_index < table->groups_size; group_index++)
   {
     auto* group = table->groups + group_index;
-    u16 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h.meta), group->ctrls_sse));
-    for (u8 i = 0; i < 16; i++)
+    for (u8 i = 0; i < kHashTableGroupWidth; i++)
+    {
+      group->ctrls[i] = (group->ctrls[i] & kHashTableCtrlEmpty) ? kHashTableCtrlEmpty : kHashTableCtrlDeleted;
+    }
+  }
+
+  for (u64 slot = 0; slot < table->capacity; slot++)
+  {
+    if (*hash_table_ctrl(table, slot) != kHashTableCtrlDeleted)
+      continue;
+
+    Hash h = hash_table_hash(table, *hash_table_key(table, slot));
+    u64 target = hash_table_find_free_slot(table, h);
+
+    if (target / kHashTableGroupWidth == slot / kHashTableGroupWidth)
     {
-      if ((mask & (1 << i)) == 0)
-        continue;
-      if (group->keys[i] != key)
-        continue;
-      return &table->values[group_index * 16 + i];
+      *hash_table_ctrl(table, slot) = h.meta;
+      continue;
     }
 
-    u16 empty_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(kHashTableCtrlEmpty), group->ctrls_sse));
+    if (*hash_table_ctrl(table, target) == kHashTableCtrlEmpty)
+    {
+      *hash_table_ctrl(table, target) = h.meta;
+      *hash_table_key(table, target) = *hash_table_key(table, slot);
+      *hash_table_value(table, target) = *hash_table_value(table, slot);
+      *hash_table_ctrl(table, slot) = kHashTableCtrlEmpty;
+      continue;
+    }
+
+    // The target is another element that hasn't been placed yet, swap them and process whatever
+    // ended up in this slot.
+    K tmp_key = *hash_table_key(table, target);
+    V tmp_value = *hash_table_value(table, target);
+    *hash_table_key(table, target) = *hash_table_key(table, slot);
+    *hash_table_value(table, target) = *hash_table_value(table, slot);
+    *hash_table_key(table, slot) = tmp_key;
+    *hash_table_value(table, slot) = tmp_value;
+
+    *hash_table_ctrl(table, target) = h.meta;
+    slot--;
+  }
+
+  table->tombstones = 0;
+}
+
+// Makes sure there's room for one more element.
+template <typename K, typename V, typename H>
+inline void
+hash_table_prepare_insert(HashTable<K, V, H>* table)
+{
+  if (table->used + table->tombstones < hash_table_max_load(table->capacity))
+    return;
+
+  // If a good chunk of the load is just tombstones, cleaning them up is enough, otherwise
+  // we'd just end up back here again really soon.
+  if (table->used * 32 <= table->capacity * 25 && table->tombstones > 0)
+  {
+    hash_table_drop_tombstones(table);
+  }
+  else
+  {
+    hash_table_resize(table, table->groups_size * 2);
+  }
+}
+
+// TODO(Brandon): Add branch prediction hints
+
+// The *_hashed versions are for when the caller already needs the hash for something else,
+// like picking a shard in the ConcurrentHashTable.
+template <typename K, typename V, typename H>
+inline V*
+hash_table_insert_hashed(HashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h, const K& key)
+{
+  u64 slot = hash_table_find_slot(table, h, key);
+  if (slot != kHashTableInvalidSlot)
+    return hash_table_value(table, slot);
+
+  hash_table_prepare_insert(table);
 
-    // If there is at least one non-empty element, then that means that the hash _had_
-    // a place to go, but there obviously isn't one.
-    if (empty_mask != 0)
-      return None;
+  slot = hash_table_find_free_slot(table, h);
+  u8* ctrl = hash_table_ctrl(table, slot);
+  if (*ctrl == kHashTableCtrlDeleted)
+  {
+    table->tombstones--;
+  }
 
-    group_index = (group_index + 1) % table->groups_size;
-  } while (group_index != start_index);
+  *ctrl = h.meta;
+  *hash_table_key(table, slot) = key;
+  table->used++;
+
+  return hash_table_value(table, slot);
+}
+
+template <typename K, typename V, typename H>
+inline V*
+hash_table_insert(HashTable<K, V, H>* table, const std::type_identity_t<K>& key)
+{
+  return hash_table_insert_hashed(table, hash_table_hash(table, key), key);
+}
+
+template <typename K, typename V, typename H>
+inline Option<V*>
+hash_table_find_hashed(const HashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h, const K& key)
+{
+  u64 slot = hash_table_find_slot(table, h, key);
+  if (slot == kHashTableInvalidSlot)
+    return None;
+
+  return hash_table_value(table, slot);
+}
+
+template <typename K, typename V, typename H>
+inline Option<V*>
+hash_table_find(const HashTable<K, V, H>* table, const std::type_identity_t<K>& key)
+{
+  return hash_table_find_hashed(table, hash_table_hash(table, key), key);
+}
+
+template <typename K, typename V, typename H>
+inline bool
+hash_table_erase_hashed(HashTable<K, V, H>* table, typename HashTable<K, V, H>::Hash h, const K& key)
+{
+  u64 slot = hash_table_find_slot(table, h, key);
+  if (slot == kHashTableInvalidSlot)
+    return false;
+
+  // If the group still has an empty slot, no probe sequence ever continued past it, so
+  // there's no need for a tombstone.
+  auto* group = table->groups + slot / kHashTableGroupWidth;
+  if (hash_table_match_empty(group->ctrls_simd))
+  {
+    group->ctrls[slot % kHashTableGroupWidth] = kHashTableCtrlEmpty;
+  }
+  else
+  {
+    group->ctrls[slot % kHashTableGroupWidth] = kHashTableCtrlDeleted;
+    table->tombstones++;
+  }
 
-  return None;
+  table->used--;
+  return true;
 }
 
-template <typename K, typename V>
+template <typename K, typename V, typename H>
 inline bool
-hash_table_erase(HashTable<K, V>* table, const K& key)
+hash_table_erase(HashTable<K, V, H>* table, const std::type_identity_t<K>& key)
 {
-  using Hash = typename HashTable<K, V>::Hash;
+  return hash_table_erase_hashed(table, hash_table_hash(table, key), key);
+}
 
-  Hash h = {0};
-  h.raw = table->hash_func(&key, sizeof(key));
+struct HashTableProbeStats
+{
+  f64 average_probe_length = 0.0;
+  u64 max_probe_length = 0;
+  f64 load_factor = 0.0;
+  u64 tombstones = 0;
+};
 
-  u64 start_index = h.position % table->groups_size;
-  u64 group_index = start_index;
-  do
+// How many groups a lookup of each element has to visit (1 is optimal), used by the benchmarks.
+template <typename K, typename V, typename H>
+inline HashTableProbeStats
+hash_table_probe_stats(const HashTable<K, V, H>* table)
+{
+  using Hash = typename HashTable<K, V, H>::Hash;
+
+  HashTableProbeStats ret;
+  ret.load_factor = f64(table->used) / f64(table->capacity);
+  ret.tombstones  = table->tombstones;
+
+  u64 total = 0;
+  for (u64 group_index = 0; group_index < table->groups_size; group_index++)
   {
-    auto* group = table->groups + group_index;
-    u16 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h.meta), group->ctrls_sse));
-    u16 empty_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(kHashTableCtrlEmpty), group->ctrls_sse));
-    for (u8 i = 0; i < 16; i++)
+    const auto* group = table->groups + group_index;
+    for (u32 i : hash_table_match_full(group->ctrls_simd))
     {
-      if ((mask & (1 << i)) == 0)
-        continue;
-      if (group->keys[i] != key)
-        continue;
-
-      table->used--;
-      group->ctrls[i] = empty_mask == 0 ? kHashTableCtrlDeleted : kHashTableCtrlEmpty;
-      return true;
+      Hash h = hash_table_hash(table, group->keys[i]);
+      HashTableProbe probe = init_hash_table_probe(table, h);
+      u64 length = 1;
+      while (probe.group_index != group_index)
+      {
+        hash_table_probe_next(table, &probe);
+        length++;
+      }
+
+      total += length;
+      ret.max_probe_length = MAX(ret.max_probe_length, length);
     }
+  }
 
-    // If there is at least one non-empty element, then that means that the hash _had_
-    // a place to go, but there obviously isn't one.
-    if (empty_mask != 0)
-      return false;
+  ret.average_probe_length = table->used > 0 ? f64(total) / f64(table->used) : 0.0;
+  return ret;
+}
 
-    group_index = (group_index + 1) % table->groups_size;
-  } while (group_index != start_index);
+struct HashSetEmpty {};
+
+// Just a HashTable without any values, so it's the same groups/probing and doesn't waste
+// any memory on the values array.
+template <typename K, typename H = Hasher<K>>
+struct HashSet
+{
+  HashTable<K, HashSetEmpty, H> table;
+
+  struct Iter
+  {
+    HashTableIterator<const HashTable<K, HashSetEmpty, H>, K, const HashSetEmpty> it;
 
-  return false;
+    const K& operator*() const { return (*it).key; }
+    Iter& operator++() { ++it; return *this; }
+    bool operator!=(const Iter& rhs) const { return it != rhs.it; }
+  };
+
+  Iter begin() const { return Iter{table.begin()}; }
+  Iter end() const { return Iter{table.end()}; }
+};
+
+template <typename K, typename H = Hasher<K>>
+inline HashSet<K, H>
+init_hash_set(MEMORY_ARENA_PARAM, u64 capacity)
+{
+  HashSet<K, H> ret;
+  ret.table = init_hash_table<K, HashSetEmpty, H>(MEMORY_ARENA_FWD, capacity);
+  return ret;
 }
 
+// Returns true if the key wasn't already in the set.
+template <typename K, typename H>
+inline bool
+hash_set_insert(HashSet<K, H>* set, const std::type_identity_t<K>& key)
+{
+  u64 used = set->table.used;
+  hash_table_insert(&set->table, key);
+  return set->table.used != used;
+}
+
+template <typename K, typename H>
+inline bool
+hash_set_contains(const HashSet<K, H>* set, const std::type_identity_t<K>& key)
+{
+  return (bool)hash_table_find(&set->table, key);
+}
+
+template <typename K, typename H>
+inline bool
+hash_set_erase(HashSet<K, H>* set, const std::type_identity_t<K>& key)
+{
+  return hash_table_erase(&set->table, key);
+}
@@ -7,6 +7,65 @@ static JobSystem* g_job_system = nullptr;
 thread_local u64 tls_worker_fiber_id = 0;
 thread_local u64 tls_job_fiber_id = 0;
 
+thread_local JobThreadStats* tls_job_stats = nullptr;
+thread_local u32 tls_job_stats_index = 0;
+
+// Lazily hands out a stats slot to whichever thread calls into the job system.
+static JobThreadStats*
+get_thread_stats()
+{
+  if (tls_job_stats != nullptr)
+    return tls_job_stats;
+
+  ASSERT(g_job_system != nullptr);
+  u64 index = atomic_fetch_add(&g_job_system->thread_stats_count, 1, kMemoryOrderRelaxed);
+  ASSERT(index < kMaxJobStatsThreads);
+
+  tls_job_stats_index = u32(index);
+  tls_job_stats = &g_job_system->thread_stats[index];
+  return tls_job_stats;
+}
+
+// Returns the timestamp that the lock was acquired at, which needs to be passed to the release.
+static u64
+timed_spin_acquire(SpinLock* lock)
+{
+  u64 start = __rdtsc();
+  spin_acquire(lock);
+  u64 acquired = __rdtsc();
+
+  JobThreadStats* stats = get_thread_stats();
+  atomic_add_single_writer(&stats->spin_lock_acquires, 1);
+  atomic_add_single_writer(&stats->spin_lock_wait_cycles, acquired - start);
+
+  return acquired;
+}
+
+static void
+timed_spin_release(SpinLock* lock, u64 acquired)
+{
+  spin_release(lock);
+  atomic_add_single_writer(&get_thread_stats()->spin_lock_hold_cycles, __rdtsc() - acquired);
+}
+
+template <typename T>
+struct TimedSpinLocked
+{
+  SpinLocked<T>* lock = nullptr;
+};
+
+template <typename T, typename F>
+static auto
+operator*(TimedSpinLocked<T> timed, F f)
+{
+  u64 acquired = timed_spin_acquire(&timed.lock->m_lock);
+  defer { timed_spin_release(&timed.lock->m_lock, acquired); };
+  return f(&timed.lock->m_value);
+}
+
+// Same as ACQUIRE, but records wait and hold times into the calling thread's stats.
+#define JOB_ACQUIRE(lock, var) TimedSpinLocked{lock} * [&](var)
+
 #if 0
 extern "C" void on_fiber_enter()
 {
@@ -48,9 +107,8 @@ init_fiber(void* stack, size_t stack_size, void* proc, void* param)
 static JobQueue
 init_job_queue(MEMORY_ARENA_PARAM, size_t size)
 {
-  JobQueue ret = {0};
-  size *= sizeof(JobDesc);
-  ret.queue = init_ring_buffer(MEMORY_ARENA_FWD, alignof(JobDesc), size);
+  JobQueue ret;
+  ret.queue = init_mpmc_queue<JobDesc>(MEMORY_ARENA_FWD, size);
 
   return ret;
 }
@@ -58,20 +116,113 @@ init_job_queue(MEMORY_ARENA_PARAM, size_t size)
 static void
 enqueue_jobs(JobQueue* job_queue, const JobDesc* jobs, size_t count)
 {
-  spin_acquire(&job_queue->lock);
-  defer { spin_release(&job_queue->lock); };
-
-  ring_buffer_push(&job_queue->queue, jobs, count * sizeof(JobDesc));
+  // A batch of jobs goes in with a single CAS on the write index rather than one per job.
+  size_t pushed = mpmc_queue_push_batch(&job_queue->queue, jobs, count);
+  ASSERT(pushed == count);
 }
 
 static bool
 dequeue_job(JobQueue* job_queue, JobDesc* out)
 {
   ASSERT(out != nullptr);
-  spin_acquire(&job_queue->lock);
-  defer { spin_release(&job_queue->lock); };
+  return try_mpmc_queue_pop(&job_queue->queue, out);
+}
+
+static void
+swap_job_descs(JobDesc* a, JobDesc* b)
+{
+  JobDesc tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static void
+enqueue_deadline_jobs(DeadlineJobQueue* job_queue, const JobDesc* jobs, size_t count)
+{
+  u64 acquired = timed_spin_acquire(&job_queue->lock);
+  defer { timed_spin_release(&job_queue->lock, acquired); };
+
+  // The heap is fixed size like the other queues. Whatever doesn't fit is dropped rather than
+  // written past the end, same as a full MPMC queue.
+  Array<JobDesc>* heap = &job_queue->heap;
+  size_t pushed = MIN(count, heap->capacity - heap->size);
+  ASSERT(pushed == count);
+
+  for (size_t i = 0; i < pushed; i++)
+  {
+    size_t index = heap->size;
+    *array_add(heap) = jobs[i];
+
+    // Sift up
+    while (index > 0)
+    {
+      size_t parent = (index - 1) / 2;
+      if (heap->memory[parent].deadline_frame <= heap->memory[index].deadline_frame)
+        break;
+
+      swap_job_descs(&heap->memory[parent], &heap->memory[index]);
+      index = parent;
+    }
+  }
+
+  if (heap->size > 0)
+  {
+    atomic_store(&job_queue->earliest_deadline_frame, heap->memory[0].deadline_frame, kMemoryOrderRelaxed);
+  }
+}
+
+// Only dequeues the earliest deadline job if its deadline is <= max_deadline_frame.
+static bool
+dequeue_deadline_job(DeadlineJobQueue* job_queue, u64 max_deadline_frame, JobDesc* out)
+{
+  ASSERT(out != nullptr);
+
+  // Deadline jobs never have kJobNoDeadline, so that always means empty. This can be stale, but
+  // that just means a job kicked a moment ago gets picked up on the next poll instead.
+  u64 earliest = atomic_load(&job_queue->earliest_deadline_frame, kMemoryOrderRelaxed);
+  if (earliest == kJobNoDeadline || earliest > max_deadline_frame)
+    return false;
+
+  u64 acquired = timed_spin_acquire(&job_queue->lock);
+  defer { timed_spin_release(&job_queue->lock, acquired); };
+
+  Array<JobDesc>* heap = &job_queue->heap;
+  if (heap->size == 0 || heap->memory[0].deadline_frame > max_deadline_frame)
+    return false;
+
+  *out = heap->memory[0];
+  heap->memory[0] = heap->memory[heap->size - 1];
+  array_remove_last(heap);
+
+  // Sift down
+  size_t index = 0;
+  for (;;)
+  {
+    size_t left     = index * 2 + 1;
+    size_t right    = left + 1;
+    size_t smallest = index;
+
+    if (left < heap->size && heap->memory[left].deadline_frame < heap->memory[smallest].deadline_frame)
+    {
+      smallest = left;
+    }
+
+    if (right < heap->size && heap->memory[right].deadline_frame < heap->memory[smallest].deadline_frame)
+    {
+      smallest = right;
+    }
+
+    if (smallest == index)
+      break;
+
+    swap_job_descs(&heap->memory[index], &heap->memory[smallest]);
+    index = smallest;
+  }
+
+  u64 next = heap->size > 0 ? heap->memory[0].deadline_frame : kJobNoDeadline;
+  atomic_store(&job_queue->earliest_deadline_frame, next, kMemoryOrderRelaxed);
 
-  return try_ring_buffer_pop(&job_queue->queue, sizeof(JobDesc), out);
+  return true;
 }
 
 static void
@@ -135,21 +286,59 @@ enum JobType : u8
   JOB_TYPE_COUNT,
 };
 
+// Doesn't block, returns JOB_TYPE_INVALID if there's nothing to run right now.
 static JobType
-wait_for_next_job(JobSystem* job_system, JobDesc* job_out, WorkingJob** working_job_out)
+try_get_next_job(JobSystem* job_system, JobDesc* job_out, WorkingJob** working_job_out)
 {
-  while (!job_system->should_exit)
+  if (JOB_ACQUIRE(&job_system->working_jobs_queue, auto* q) {
+    return dequeue_working_job(q, working_job_out); 
+  })
+    return JOB_TYPE_WORKING;
+
+  // Earliest-deadline-first for anything that is due this frame (or is already late).
+  u64 urgent_frame = atomic_load(&job_system->current_frame, kMemoryOrderRelaxed) + kJobUrgentDeadlineFrames;
+  if (dequeue_deadline_job(&job_system->deadline_priority, urgent_frame, job_out))
+    return JOB_TYPE_LAUNCH;
+
+  // Age the medium priority queue so that it can't be starved by a constant stream of
+  // high priority work.
+  if (atomic_load(&job_system->high_priority_streak, kMemoryOrderRelaxed) >= kJobAgingThreshold &&
+      dequeue_job(&job_system->medium_priority, job_out))
   {
-    if (ACQUIRE(&job_system->working_jobs_queue, auto* q) {
-      return dequeue_working_job(q, working_job_out); 
-    })
-      return JOB_TYPE_WORKING;
+    atomic_store(&job_system->high_priority_streak, 0, kMemoryOrderRelaxed);
+    return JOB_TYPE_LAUNCH;
+  }
 
-    if (dequeue_job(&job_system->high_priority, job_out))
-      return JOB_TYPE_LAUNCH;
+  if (dequeue_job(&job_system->high_priority, job_out))
+  {
+    if (mpmc_queue_size(&job_system->medium_priority.queue) > 0)
+    {
+      atomic_fetch_add(&job_system->high_priority_streak, 1, kMemoryOrderRelaxed);
+    }
+    return JOB_TYPE_LAUNCH;
+  }
 
-    if (dequeue_job(&job_system->medium_priority, job_out))
-      return JOB_TYPE_LAUNCH;
+  if (dequeue_job(&job_system->medium_priority, job_out))
+  {
+    atomic_store(&job_system->high_priority_streak, 0, kMemoryOrderRelaxed);
+    return JOB_TYPE_LAUNCH;
+  }
+
+  // Nothing else to do, so get a head start on deadlines in future frames.
+  if (dequeue_deadline_job(&job_system->deadline_priority, kJobNoDeadline, job_out))
+    return JOB_TYPE_LAUNCH;
+
+  return JOB_TYPE_INVALID;
+}
+
+static JobType
+wait_for_next_job(JobSystem* job_system, JobDesc* job_out, WorkingJob** working_job_out)
+{
+  while (!atomic_load(&job_system->should_exit, kMemoryOrderRelaxed))
+  {
+    JobType type = try_get_next_job(job_system, job_out, working_job_out);
+    if (type != JOB_TYPE_INVALID)
+      return type;
   }
   return JOB_TYPE_INVALID;
 }
@@ -157,7 +346,7 @@ wait_for_next_job(JobSystem* job_system, JobDesc* job_out, WorkingJob** working_
 static JobType
 wait_for_async_job(JobSystem* job_system, JobDesc* job_out)
 {
-  while (!job_system->should_exit)
+  while (!atomic_load(&job_system->should_exit, kMemoryOrderRelaxed))
   {
     if (dequeue_job(&job_system->low_priority, job_out))
       return JOB_TYPE_LAUNCH;
@@ -176,18 +365,24 @@ init_job_system(MEMORY_ARENA_PARAM, size_t job_queue_size)
   ret->high_priority = init_job_queue(MEMORY_ARENA_FWD, job_queue_size);
   ret->medium_priority = init_job_queue(MEMORY_ARENA_FWD, job_queue_size);
   ret->low_priority = init_job_queue(MEMORY_ARENA_FWD, job_queue_size);
+  ret->deadline_priority.heap = init_array<JobDesc>(MEMORY_ARENA_FWD, job_queue_size);
+  atomic_store(&ret->deadline_priority.earliest_deadline_frame, kJobNoDeadline, kMemoryOrderRelaxed);
 
   ret->job_stack_allocator = init_pool<JobStack>(MEMORY_ARENA_FWD, job_queue_size / 2);
 
   ret->working_job_allocator = init_pool<WorkingJob>(MEMORY_ARENA_FWD, job_queue_size / 2);
-  ret->job_counters = init_hash_table<JobHandle, JobCounter>(MEMORY_ARENA_FWD, 128);
+  // Every live counter has at least one job that's either queued or parked in a working job.
+  ret->job_counters = init_concurrent_hash_table<JobHandle, JobCounter>(MEMORY_ARENA_FWD, 128, job_queue_size * 4 + job_queue_size / 2, kJobCounterShards);
 
   g_job_system = ret;
 
   return ret;
 }
 
+// Only non-null while a job is running on this thread.
 thread_local Fiber* tls_fiber = nullptr;
+// Jobs launched by the async worker aren't allowed to yield.
+thread_local bool tls_job_can_yield = false;
 
 enum YieldParamType : u8
 {
@@ -218,11 +413,12 @@ yield_to_counter(JobHandle counter)
 static void
 signal_job_counter(JobSystem* job_system, JobHandle signal)
 {
-  Option<WorkingJobQueue> woken_jobs = ACQUIRE(&job_system->job_counters, auto* counters) -> Option<WorkingJobQueue>
+  Option<WorkingJobQueue> woken_jobs = concurrent_hash_table_write(&job_system->job_counters, signal, [&](auto* counters) -> Option<WorkingJobQueue>
   {
     JobCounter* counter = unwrap(hash_table_find(counters, signal));
-    ASSERT(counter->value > 0);
-    auto value = InterlockedDecrement(&counter->value);
+    // The counter is protected by its shard's lock, so relaxed is all we need here.
+    u64 value = atomic_fetch_sub(&counter->value, 1, kMemoryOrderRelaxed) - 1;
+    ASSERT(value != U64_MAX);
     if (value == 0)
     {
       WorkingJobQueue waiting = counter->waiting_jobs;
@@ -235,12 +431,12 @@ signal_job_counter(JobSystem* job_system, JobHandle signal)
     }
 
     return None;
-  };
+  });
 
   if (!woken_jobs)
     return;
 
-  ACQUIRE(&job_system->working_jobs_queue, auto* working_jobs_queue)
+  JOB_ACQUIRE(&job_system->working_jobs_queue, auto* working_jobs_queue)
   {
     enqueue_working_jobs(working_jobs_queue, &unwrap(woken_jobs));
   };
@@ -251,7 +447,7 @@ working_job_wait_for_counter(JobSystem* job_system,
                              JobHandle signal,
                              WorkingJob* working_job)
 {
-  bool res = ACQUIRE(&job_system->job_counters, auto* job_counters)
+  bool res = concurrent_hash_table_write(&job_system->job_counters, signal, [&](auto* job_counters)
   {
     auto maybe_counter = hash_table_find(job_counters, signal);
     if (!maybe_counter)
@@ -260,25 +456,68 @@ working_job_wait_for_counter(JobSystem* job_system,
     JobCounter* counter = unwrap(maybe_counter);
     enqueue_working_job(&counter->waiting_jobs, working_job);
     return true;
-  };
+  });
 
   if (res)
     return;
 
-  ACQUIRE(&job_system->working_jobs_queue, auto* working_jobs_queue)
+  JOB_ACQUIRE(&job_system->working_jobs_queue, auto* working_jobs_queue)
   {
     enqueue_working_job(working_jobs_queue, working_job);
   };
 }
 
+thread_local JobStack* tls_job_stack_cache[kJobStackCacheSize];
+thread_local u32 tls_job_stack_cache_count = 0;
+
+static JobStack*
+alloc_job_stack(JobSystem* job_system)
+{
+  if (tls_job_stack_cache_count > 0 && !atomic_load(&job_system->disable_job_stack_cache, kMemoryOrderRelaxed))
+  {
+    tls_job_stack_cache_count--;
+    return tls_job_stack_cache[tls_job_stack_cache_count];
+  }
+
+  // Nothing in the stack or scratch memory needs to start out zeroed, and clearing 144 KiB
+  // per job was most of the cost of launching one.
+  return JOB_ACQUIRE(&job_system->job_stack_allocator, auto* allocator)
+  {
+    return pool_alloc_no_zero(allocator);
+  };
+}
+
 static void
-finish_job(JobSystem* job_system, JobStack* job_stack, JobHandle completion_signal)
+free_job_stack(JobSystem* job_system, JobStack* job_stack)
 {
-  ACQUIRE(&job_system->job_stack_allocator, auto* allocator) {
+  if (tls_job_stack_cache_count < kJobStackCacheSize && !atomic_load(&job_system->disable_job_stack_cache, kMemoryOrderRelaxed))
+  {
+    tls_job_stack_cache[tls_job_stack_cache_count] = job_stack;
+    tls_job_stack_cache_count++;
+    return;
+  }
+
+  JOB_ACQUIRE(&job_system->job_stack_allocator, auto* allocator)
+  {
     pool_free(allocator, job_stack);
   };
+}
 
-  signal_job_counter(job_system, completion_signal);
+static void
+finish_job(JobSystem* job_system, JobStack* job_stack, const JobDesc& job)
+{
+  free_job_stack(job_system, job_stack);
+
+  if (job.deadline_frame != kJobNoDeadline)
+  {
+    atomic_fetch_add(&job_system->deadline_stats.completed, 1, kMemoryOrderRelaxed);
+    if (atomic_load(&job_system->current_frame, kMemoryOrderRelaxed) > job.deadline_frame)
+    {
+      atomic_fetch_add(&job_system->deadline_stats.missed, 1, kMemoryOrderRelaxed);
+    }
+  }
+
+  signal_job_counter(job_system, job.completion_signal);
 }
 
 static void
@@ -299,10 +538,8 @@ yield_working_job(JobSystem* job_system, WorkingJob* working_job)
 static void
 launch_job(JobSystem* job_system, JobDesc job, bool can_yield = true)
 {
-  JobStack* stack = ACQUIRE(&job_system->job_stack_allocator, auto* allocator)
-  {
-    return pool_alloc(allocator);
-  };
+  JobStack* stack = alloc_job_stack(job_system);
+  atomic_add_single_writer(&stack->stats.jobs_run, 1);
 
   MemoryArena scratch_arena = {0};
   scratch_arena.start = reinterpret_cast<uintptr_t>(stack->scratch_buf);
@@ -313,6 +550,7 @@ launch_job(JobSystem* job_system, JobDesc job, bool can_yield = true)
 
   Fiber fiber = init_fiber(stack->memory, STACK_SIZE, job.entry.func_ptr, job.entry.params + job.entry.param_offset);
   tls_fiber = &fiber;
+  tls_job_can_yield = can_yield;
 
   auto* stack_high_before = fiber.stack_high;
   ASSERT(fiber.rip != nullptr);
@@ -326,6 +564,7 @@ launch_job(JobSystem* job_system, JobDesc job, bool can_yield = true)
 #endif
 
   launch_fiber(&fiber);
+  tls_fiber = nullptr;
 
 #if 0
   profiler::end_switch_to_fiber(tls_job_fiber_id);
@@ -334,19 +573,22 @@ launch_job(JobSystem* job_system, JobDesc job, bool can_yield = true)
   ctx = pop_context();
   ASSERT(fiber.stack_high == stack_high_before);
 
+  JobThreadStats* stats = get_thread_stats();
+  atomic_add_single_writer(&stats->jobs_launched, 1);
+
   // The job actually finished, means we can recycle everything.
   if (!fiber.yielded)
   {
 #if 0
     profiler::unregister_fiber(job.completion_signal);
 #endif
-    finish_job(job_system, stack, job.completion_signal);
+    finish_job(job_system, stack, job);
     return;
   }
 
   ASSERT(can_yield);
 
-  WorkingJob* working_job = ACQUIRE(&job_system->working_job_allocator, auto* allocator)
+  WorkingJob* working_job = JOB_ACQUIRE(&job_system->working_job_allocator, auto* allocator)
   {
     return pool_alloc(allocator);
   };
@@ -356,6 +598,9 @@ launch_job(JobSystem* job_system, JobDesc job, bool can_yield = true)
   working_job->stack = stack;
   working_job->next = nullptr;
   working_job->ctx = ctx;
+  working_job->yielded_thread = tls_job_stats_index;
+  atomic_add_single_writer(&stats->jobs_yielded, 1);
+  atomic_add_single_writer(&stack->stats.yields, 1);
   yield_working_job(job_system, working_job);
 }
 
@@ -364,6 +609,7 @@ resume_working_job(JobSystem* job_system, WorkingJob* working_job)
 {
   push_context(working_job->ctx);
   tls_fiber = &working_job->fiber;
+  tls_job_can_yield = true;
 
   tls_job_fiber_id = working_job->job.completion_signal;
 #if 0
@@ -371,6 +617,7 @@ resume_working_job(JobSystem* job_system, WorkingJob* working_job)
 #endif
 
   resume_fiber(&working_job->fiber, working_job->fiber.stack_high);
+  tls_fiber = nullptr;
 
 #if 0
   profiler::end_switch_to_fiber(tls_job_fiber_id);
@@ -378,11 +625,19 @@ resume_working_job(JobSystem* job_system, WorkingJob* working_job)
 
   working_job->ctx = pop_context();
 
+  JobThreadStats* stats = get_thread_stats();
+  atomic_add_single_writer(&stats->jobs_resumed, 1);
+  atomic_add_single_writer(&working_job->stack->stats.resumes, 1);
+  if (working_job->yielded_thread != tls_job_stats_index)
+  {
+    atomic_add_single_writer(&stats->jobs_stolen, 1);
+  }
+
   // The job actually finished, means we can recycle everything.
   if (!working_job->fiber.yielded)
   {
-    finish_job(job_system, working_job->stack, working_job->job.completion_signal);
-    ACQUIRE(&job_system->working_job_allocator, auto* allocator)
+    finish_job(job_system, working_job->stack, working_job->job);
+    JOB_ACQUIRE(&job_system->working_job_allocator, auto* allocator)
     {
       pool_free(allocator, working_job);
     };
@@ -390,6 +645,9 @@ resume_working_job(JobSystem* job_system, WorkingJob* working_job)
   }
 
   working_job->next = nullptr;
+  working_job->yielded_thread = tls_job_stats_index;
+  atomic_add_single_writer(&stats->jobs_yielded, 1);
+  atomic_add_single_writer(&working_job->stack->stats.yields, 1);
   yield_working_job(job_system, working_job);
 }
 
@@ -406,7 +664,7 @@ job_worker(void* param)
   profiler::register_fiber(tls_worker_fiber_id);
 #endif
 
-  while (!g_job_system->should_exit)
+  while (!atomic_load(&g_job_system->should_exit, kMemoryOrderRelaxed))
   {
     JobDesc job = {0};
     WorkingJob* working_job = nullptr;
@@ -439,7 +697,7 @@ async_worker(void* param)
 #if 0
   profiler::register_fiber(tls_worker_fiber_id);
 #endif
-  while(!g_job_system->should_exit)
+  while (!atomic_load(&g_job_system->should_exit, kMemoryOrderRelaxed))
   {
     JobDesc job = {0};
     JobType type = wait_for_async_job(g_job_system, &job);
@@ -505,10 +763,7 @@ job_has_completed(JobHandle handle, JobSystem* job_system)
 
   ASSERT(job_system != nullptr);
 
-  return ACQUIRE(&job_system->job_counters, auto* counters) -> bool
-  {
-    return !hash_table_find(counters, handle);
-  };
+  return !concurrent_hash_table_contains(&job_system->job_counters, handle);
 }
 
 static JobQueue*
@@ -529,7 +784,39 @@ get_queue(JobSystem* job_system, JobPriority priority)
 static JobHandle
 get_next_job_counter_id(JobSystem* job_system)
 {
-  return InterlockedIncrement(&job_system->current_job_counter_id);
+  // Only needs to be unique, nothing is published through it.
+  return atomic_fetch_add(&job_system->current_job_counter_id, 1, kMemoryOrderRelaxed) + 1;
+}
+
+static JobHandle
+init_job_counter(JobSystem* job_system,
+                 JobDesc* jobs,
+                 size_t count,
+                 JobDebugInfo debug_info,
+                 u64 deadline_frame,
+                 Option<ThreadSignal*> thread_signal)
+{
+  JobHandle ret = get_next_job_counter_id(job_system);
+
+  JobCounter counter;
+  counter.id = ret;
+  atomic_store(&counter.value, count, kMemoryOrderRelaxed);
+  counter.waiting_jobs = { 0 };
+  counter.completion_signal = thread_signal;
+  bool inserted = concurrent_hash_table_insert(&job_system->job_counters, ret, counter);
+  ASSERT(inserted);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    ASSERT(jobs[i].entry.func_ptr != nullptr);
+    jobs[i].completion_signal = ret;
+    jobs[i].debug_info = debug_info;
+    jobs[i].deadline_frame = deadline_frame;
+  }
+
+  atomic_add_single_writer(&get_thread_stats()->jobs_kicked, count);
+
+  return ret;
 }
 
 JobHandle
@@ -541,29 +828,180 @@ _kick_jobs(JobPriority priority,
 {
   ASSERT(g_job_system != nullptr);
 
-  JobHandle ret = ACQUIRE(&g_job_system->job_counters, auto* job_counters)
+  JobHandle ret = init_job_counter(g_job_system, jobs, count, debug_info, kJobNoDeadline, thread_signal);
+
+  JobQueue* queue = get_queue(g_job_system, priority);
+
+  enqueue_jobs(queue, jobs, count);
+
+  return ret;
+}
+
+JobHandle
+_kick_jobs_with_deadline(u64 deadline_frame,
+                         JobDesc* jobs,
+                         size_t count,
+                         JobDebugInfo debug_info,
+                         Option<ThreadSignal*> thread_signal)
+{
+  ASSERT(g_job_system != nullptr);
+  ASSERT(deadline_frame != kJobNoDeadline);
+
+  JobHandle ret = init_job_counter(g_job_system, jobs, count, debug_info, deadline_frame, thread_signal);
+
+  atomic_fetch_add(&g_job_system->deadline_stats.kicked, count, kMemoryOrderRelaxed);
+
+  enqueue_deadline_jobs(&g_job_system->deadline_priority, jobs, count);
+
+  return ret;
+}
+
+// Runs whatever try_get_next_job hands out on the calling thread. Returns false if there was
+// nothing to run.
+static bool
+run_next_job(JobSystem* job_system)
+{
+  JobDesc job = {0};
+  WorkingJob* working_job = nullptr;
+  switch (try_get_next_job(job_system, &job, &working_job))
   {
-    JobHandle counter_id = get_next_job_counter_id(g_job_system);
-    JobCounter* counter = hash_table_insert(job_counters, counter_id);
-    counter->id = counter_id;
-    counter->value = count;
-    counter->waiting_jobs = { 0 };
-    counter->completion_signal = thread_signal;
-    return counter->id;
-  };
+    case JOB_TYPE_LAUNCH:
+    {
+      launch_job(job_system, job);
+    } break;
+    case JOB_TYPE_WORKING:
+    {
+      resume_working_job(job_system, working_job);
+    } break;
+    case JOB_TYPE_INVALID:
+    {
+      return false;
+    } break;
+    default:
+      UNREACHABLE;
+  }
 
-  for (size_t i = 0; i < count; i++)
+  return true;
+}
+
+void
+run_queued_jobs(JobSystem* job_system)
+{
+  if (job_system == nullptr)
   {
-    ASSERT(jobs[i].entry.func_ptr != nullptr);
-    jobs[i].completion_signal = ret;
-    jobs[i].debug_info = debug_info;
+    job_system = g_job_system;
   }
 
-  JobQueue* queue = get_queue(g_job_system, priority);
+  ASSERT(job_system != nullptr);
+  // We can't launch fibers from inside of a fiber.
+  ASSERT(tls_fiber == nullptr);
 
-  enqueue_jobs(queue, jobs, count);
+  while (run_next_job(job_system)) { }
+}
 
-  return ret;
+void
+blocking_kick_job_descs(JobPriority priority,
+                        JobDesc* jobs,
+                        size_t count,
+                        JobDebugInfo debug_info,
+                        JobWaitMode wait_mode)
+{
+  ASSERT(g_job_system != nullptr);
+
+  // Inside of a job the fiber can just be parked on the counter, which frees up the
+  // thread for other jobs anyways.
+  if (tls_fiber != nullptr && tls_job_can_yield)
+  {
+    JobHandle counter = _kick_jobs(priority, jobs, count, debug_info);
+    yield_to_counter(counter);
+    return;
+  }
+
+  ThreadSignal signal = init_thread_signal();
+  _kick_jobs(priority, jobs, count, debug_info, &signal);
+
+  // We can't launch fibers from inside of a fiber, so jobs on the async worker have to sleep.
+  // Low priority jobs are only ever run by the async worker, so helping with those would just
+  // mean spinning (or running other people's work) for as long as they take.
+  if (wait_mode == kJobWaitSleep || tls_fiber != nullptr || priority == kJobPriorityLow)
+  {
+    wait_for_thread_signal(&signal);
+    return;
+  }
+
+  // Once there's nothing left to pick up, whatever we're waiting on is already running on a
+  // worker, so there's no point in keeping a whole core spinning until it's done.
+  u32 empty_polls = 0;
+  while (!is_thread_signaled(&signal))
+  {
+    if (run_next_job(g_job_system))
+    {
+      empty_polls = 0;
+      continue;
+    }
+
+    empty_polls++;
+    if (empty_polls >= kJobWaitHelpMaxEmptyPolls)
+    {
+      wait_for_thread_signal(&signal);
+      return;
+    }
+
+    cpu_relax();
+  }
+}
+
+void
+advance_job_system_frame(JobSystem* job_system)
+{
+  if (job_system == nullptr)
+  {
+    job_system = g_job_system;
+  }
+
+  ASSERT(job_system != nullptr);
+
+  atomic_fetch_add(&job_system->current_frame, 1, kMemoryOrderRelaxed);
+}
+
+u64
+get_job_system_frame(JobSystem* job_system)
+{
+  if (job_system == nullptr)
+  {
+    job_system = g_job_system;
+  }
+
+  ASSERT(job_system != nullptr);
+
+  return atomic_load(&job_system->current_frame, kMemoryOrderRelaxed);
+}
+
+JobDeadlineStats
+get_job_deadline_stats(JobSystem* job_system)
+{
+  if (job_system == nullptr)
+  {
+    job_system = g_job_system;
+  }
+
+  ASSERT(job_system != nullptr);
+
+  return job_system->deadline_stats;
+}
+
+void
+destroy_job_system(JobSystem* job_system)
+{
+  ASSERT(job_system == g_job_system);
+  ASSERT(tls_fiber == nullptr);
+
+  // The calling thread's cached stacks and stats slot point into the job system's memory.
+  tls_job_stack_cache_count = 0;
+  tls_job_stats = nullptr;
+  tls_job_stats_index = 0;
+
+  g_job_system = nullptr;
 }
 
 JobSystem*
@@ -576,5 +1014,193 @@ get_job_system()
 void
 kill_job_system(JobSystem* job_system)
 {
-  job_system->should_exit = true;
+  atomic_store(&job_system->should_exit, true, kMemoryOrderRelease);
+}
+
+static void
+accumulate_stat(Atomic<u64>* dst, const Atomic<u64>& src)
+{
+  atomic_add_single_writer(dst, atomic_load(&src, kMemoryOrderRelaxed));
+}
+
+static void
+accumulate_thread_stats(JobThreadStats* dst, const JobThreadStats& src)
+{
+  accumulate_stat(&dst->jobs_kicked,           src.jobs_kicked);
+  accumulate_stat(&dst->jobs_launched,         src.jobs_launched);
+  accumulate_stat(&dst->jobs_resumed,          src.jobs_resumed);
+  accumulate_stat(&dst->jobs_yielded,          src.jobs_yielded);
+  accumulate_stat(&dst->jobs_stolen,           src.jobs_stolen);
+  accumulate_stat(&dst->spin_lock_acquires,    src.spin_lock_acquires);
+  accumulate_stat(&dst->spin_lock_wait_cycles, src.spin_lock_wait_cycles);
+  accumulate_stat(&dst->spin_lock_hold_cycles, src.spin_lock_hold_cycles);
+}
+
+void
+set_job_stack_cache_enabled(bool enabled, JobSystem* job_system)
+{
+  if (job_system == nullptr)
+  {
+    job_system = g_job_system;
+  }
+
+  ASSERT(job_system != nullptr);
+
+  atomic_store(&job_system->disable_job_stack_cache, !enabled, kMemoryOrderRelaxed);
+}
+
+JobSystemStats
+get_job_system_stats(JobSystem* job_system)
+{
+  if (job_system == nullptr)
+  {
+    job_system = g_job_system;
+  }
+
+  ASSERT(job_system != nullptr);
+
+  JobSystemStats ret;
+  u64 thread_count = atomic_load(&job_system->thread_stats_count, kMemoryOrderRelaxed);
+  ret.thread_count = u32(MIN(thread_count, kMaxJobStatsThreads));
+  for (u32 i = 0; i < ret.thread_count; i++)
+  {
+    const JobThreadStats& src = job_system->thread_stats[i];
+    ret.threads[i] = src;
+
+    accumulate_thread_stats(&ret.totals, src);
+  }
+
+  // Intentionally not going through JOB_ACQUIRE, we don't want the snapshot to show up in the stats.
+  JobStack* job_stacks = nullptr;
+  ACQUIRE(&job_system->job_stack_allocator, auto* allocator)
+  {
+    job_stacks = allocator->pool;
+    ret.job_stack_pool_size = allocator->size;
+    ret.job_stack_pool_used = allocator->size - allocator->free_count;
+  };
+
+  // The stacks never move, and the counters are atomics, so there's no need to hold the
+  // pool lock while going through all of them.
+  for (u64 i = 0; i < ret.job_stack_pool_size; i++)
+  {
+    const JobFiberStats& fiber = job_stacks[i].stats;
+    u64 jobs_run = atomic_load(&fiber.jobs_run, kMemoryOrderRelaxed);
+    if (jobs_run == 0)
+      continue;
+
+    u64 yields = atomic_load(&fiber.yields, kMemoryOrderRelaxed);
+    u64 resumes = atomic_load(&fiber.resumes, kMemoryOrderRelaxed);
+
+    ret.fibers_used++;
+    atomic_add_single_writer(&ret.fiber_totals.jobs_run, jobs_run);
+    atomic_add_single_writer(&ret.fiber_totals.yields, yields);
+    atomic_add_single_writer(&ret.fiber_totals.resumes, resumes);
+    atomic_store(&ret.fiber_max.jobs_run, MAX(atomic_load(&ret.fiber_max.jobs_run, kMemoryOrderRelaxed), jobs_run), kMemoryOrderRelaxed);
+    atomic_store(&ret.fiber_max.yields, MAX(atomic_load(&ret.fiber_max.yields, kMemoryOrderRelaxed), yields), kMemoryOrderRelaxed);
+    atomic_store(&ret.fiber_max.resumes, MAX(atomic_load(&ret.fiber_max.resumes, kMemoryOrderRelaxed), resumes), kMemoryOrderRelaxed);
+  }
+
+  ACQUIRE(&job_system->working_job_allocator, auto* allocator)
+  {
+    ret.working_job_pool_size = allocator->size;
+    ret.working_job_pool_used = allocator->size - allocator->free_count;
+  };
+
+  ret.live_job_counters = concurrent_hash_table_size(&job_system->job_counters);
+
+  ret.deadlines = get_job_deadline_stats(job_system);
+
+  return ret;
+}
+
+static void
+append_json(char* out, size_t out_size, size_t* pos, const char* fmt, ...)
+{
+  ASSERT(*pos < out_size);
+
+  va_list args;
+  va_start(args, fmt);
+  s32 written = vsnprintf(out + *pos, out_size - *pos, fmt, args);
+  va_end(args);
+
+  ASSERT(written >= 0);
+  // On truncation, vsnprintf still null terminates so we just clamp to the end.
+  *pos += MIN(size_t(written), out_size - *pos - 1);
+}
+
+static void
+append_thread_stats_json(const JobThreadStats& stats, char* out, size_t out_size, size_t* pos)
+{
+  append_json(out,
+              out_size,
+              pos,
+              "{\"jobs_kicked\":%llu,\"jobs_launched\":%llu,\"jobs_resumed\":%llu,"
+              "\"jobs_yielded\":%llu,\"jobs_stolen\":%llu,\"spin_lock_acquires\":%llu,"
+              "\"spin_lock_wait_cycles\":%llu,\"spin_lock_hold_cycles\":%llu}",
+              atomic_load(&stats.jobs_kicked,           kMemoryOrderRelaxed),
+              atomic_load(&stats.jobs_launched,         kMemoryOrderRelaxed),
+              atomic_load(&stats.jobs_resumed,          kMemoryOrderRelaxed),
+              atomic_load(&stats.jobs_yielded,          kMemoryOrderRelaxed),
+              atomic_load(&stats.jobs_stolen,           kMemoryOrderRelaxed),
+              atomic_load(&stats.spin_lock_acquires,    kMemoryOrderRelaxed),
+              atomic_load(&stats.spin_lock_wait_cycles, kMemoryOrderRelaxed),
+              atomic_load(&stats.spin_lock_hold_cycles, kMemoryOrderRelaxed));
+}
+
+size_t
+job_system_stats_to_json(const JobSystemStats& stats, char* out, size_t out_size)
+{
+  ASSERT(out != nullptr && out_size > 0);
+
+  size_t pos = 0;
+  out[0] = 0;
+
+  append_json(out, out_size, &pos, "{\"totals\":");
+  append_thread_stats_json(stats.totals, out, out_size, &pos);
+
+  append_json(out, out_size, &pos, ",\"threads\":[");
+  for (u32 i = 0; i < stats.thread_count; i++)
+  {
+    if (i > 0)
+    {
+      append_json(out, out_size, &pos, ",");
+    }
+    append_thread_stats_json(stats.threads[i], out, out_size, &pos);
+  }
+  append_json(out, out_size, &pos, "],");
+
+  append_json(out,
+              out_size,
+              &pos,
+              "\"job_stack_pool_used\":%llu,\"job_stack_pool_size\":%llu,"
+              "\"working_job_pool_used\":%llu,\"working_job_pool_size\":%llu,"
+              "\"live_job_counters\":%llu,",
+              stats.job_stack_pool_used,
+              stats.job_stack_pool_size,
+              stats.working_job_pool_used,
+              stats.working_job_pool_size,
+              stats.live_job_counters);
+
+  append_json(out,
+              out_size,
+              &pos,
+              "\"fibers\":{\"used\":%llu,\"jobs_run\":%llu,\"yields\":%llu,\"resumes\":%llu,"
+              "\"max_jobs_run\":%llu,\"max_yields\":%llu,\"max_resumes\":%llu},",
+              stats.fibers_used,
+              atomic_load(&stats.fiber_totals.jobs_run, kMemoryOrderRelaxed),
+              atomic_load(&stats.fiber_totals.yields,   kMemoryOrderRelaxed),
+              atomic_load(&stats.fiber_totals.resumes,  kMemoryOrderRelaxed),
+              atomic_load(&stats.fiber_max.jobs_run,    kMemoryOrderRelaxed),
+              atomic_load(&stats.fiber_max.yields,      kMemoryOrderRelaxed),
+              atomic_load(&stats.fiber_max.resumes,     kMemoryOrderRelaxed));
+
+  append_json(out,
+              out_size,
+              &pos,
+              "\"deadlines\":{\"kicked\":%llu,\"completed\":%llu,\"missed\":%llu}}",
+              atomic_load(&stats.deadlines.kicked,    kMemoryOrderRelaxed),
+              atomic_load(&stats.deadlines.completed, kMemoryOrderRelaxed),
+              atomic_load(&stats.deadlines.missed,    kMemoryOrderRelaxed));
+
+  return pos;
 }
@@ -1,6 +1,6 @@
 #pragma once
 #include "ring_buffer.h"
-#include "hash_table.h"
+#include "concurrent_hash_table.h"
 #include "context.h"
 #include "threading.h"
 #include "pool_allocator.h"
@@ -57,13 +57,30 @@ extern "C" void* get_rsp();
 // _more_ stack space than a typical maybe 16 KiB, not have the default
 // be a worst case -_-
 #define STACK_SIZE KiB(128)
+
+// Every job gets its own fiber on a JobStack, and stacks get reused by later jobs, so these
+// count everything that ever ran on one stack. Only the thread currently running the fiber
+// writes to them.
+struct JobFiberStats
+{
+  Atomic<u64> jobs_run = 0;
+  Atomic<u64> yields = 0;
+  Atomic<u64> resumes = 0;
+};
+
 // Literally just a hunk of memory lol.
 struct JobStack
 {
   alignas(16) byte memory[STACK_SIZE];
   byte scratch_buf[DEFAULT_SCRATCH_SIZE];
+  // Not cleared when the stack is freed, so they keep counting across jobs.
+  JobFiberStats stats;
 };
 
+// Every thread keeps a few stacks from jobs it finished so the next launch can reuse them
+// while they're still warm in cache, without going through the pool lock. They don't get zeroed.
+constant u32 kJobStackCacheSize = 4;
+
 typedef u64 JobHandle;
 
 void yield_to_counter(JobHandle counter);
@@ -82,6 +99,10 @@ struct JobEntry
   u8 param_offset = 0;
 };
 
+// Deadlines are expressed in job system frames (see advance_job_system_frame).
+// A job with a deadline of N must finish before frame N is presented.
+constant u64 kJobNoDeadline = U64_MAX;
+
 struct JobDesc
 {
   JobHandle completion_signal = 0;
@@ -89,6 +110,8 @@ struct JobDesc
   JobEntry entry = {0};
 
   JobDebugInfo debug_info = {0};
+
+  u64 deadline_frame = kJobNoDeadline;
 };
 
 struct WorkingJob
@@ -99,6 +122,9 @@ struct WorkingJob
   JobStack* stack = nullptr;
   Context ctx;
 
+  // The stats slot of the thread that yielded this job, used to detect steals.
+  u32 yielded_thread = 0;
+
   WorkingJob* next = nullptr;
 };
 
@@ -110,23 +136,100 @@ struct WorkingJobQueue
 
 struct JobCounter
 {
-  volatile u64 value = 0;
+  // Only ever touched while holding the counter's job_counters shard lock.
+  Atomic<u64> value = 0;
   JobHandle id = 0;
   WorkingJobQueue waiting_jobs = {0};
   Option<ThreadSignal*> completion_signal = None;
 };
 
+// Every job_counters shard gets sized for all of the live counters landing in it, so this is
+// kept to about the number of threads that can be kicking and finishing jobs at once.
+constant u32 kJobCounterShards = 16;
+
+// Any thread can kick jobs and any worker can pick them up, so this is lock-free MPMC.
 struct JobQueue
 {
-  RingBuffer queue;
+  MpmcQueue<JobDesc> queue;
+};
+
+// Min-heap of jobs ordered by deadline_frame, so the earliest deadline is always
+// at index 0 (earliest-deadline-first).
+struct DeadlineJobQueue
+{
+  Array<JobDesc> heap;
   SpinLock lock;
+  // heap[0]'s deadline, or kJobNoDeadline when the heap is empty. Only written under the lock,
+  // but read without it so that idle workers polling an empty heap don't all fight over the lock.
+  Atomic<u64> earliest_deadline_frame = kJobNoDeadline;
 };
 
+struct JobDeadlineStats
+{
+  Atomic<u64> kicked = 0;
+  Atomic<u64> completed = 0;
+  Atomic<u64> missed = 0;
+};
+
+constant u32 kMaxJobStatsThreads = 32;
+
+// Each thread that touches the job system owns one of these and is the only one that writes
+// to it, so incrementing is just a plain add (atomic_add_single_writer). They are padded out to a cache line so that
+// threads don't false share, which makes it cheap enough to leave on in release.
+struct alignas(64) JobThreadStats
+{
+  Atomic<u64> jobs_kicked = 0;
+  Atomic<u64> jobs_launched = 0;
+  Atomic<u64> jobs_resumed = 0;
+  Atomic<u64> jobs_yielded = 0;
+  // A yielded job that was resumed on a different thread than the one it yielded on.
+  Atomic<u64> jobs_stolen = 0;
+
+  Atomic<u64> spin_lock_acquires = 0;
+  Atomic<u64> spin_lock_wait_cycles = 0;
+  Atomic<u64> spin_lock_hold_cycles = 0;
+};
+static_assert(sizeof(JobThreadStats) == 64);
+
+// Aggregated on demand by get_job_system_stats(). Since threads keep writing their counters
+// while the snapshot is taken, the totals are approximate.
+struct JobSystemStats
+{
+  JobThreadStats totals;
+
+  u32 thread_count = 0;
+  JobThreadStats threads[kMaxJobStatsThreads];
+
+  // Includes the stacks sitting in the per-thread caches.
+  u64 job_stack_pool_used = 0;
+  u64 job_stack_pool_size = 0;
+  u64 working_job_pool_used = 0;
+  u64 working_job_pool_size = 0;
+  u64 live_job_counters = 0;
+
+  // Over every job stack that has run at least one job. fiber_max is the most any one of
+  // them has done of each, so a fiber that keeps getting yielded stands out.
+  u64 fibers_used = 0;
+  JobFiberStats fiber_totals;
+  JobFiberStats fiber_max;
+
+  JobDeadlineStats deadlines;
+};
+
+// How many consecutive high priority jobs can be run while medium priority jobs are
+// waiting before a medium priority job is forced through. Prevents starvation.
+constant u32 kJobAgingThreshold = 8;
+
+// Deadline jobs due within this many frames are run ahead of all other queued jobs.
+// Anything further out only runs when the high and medium queues are empty.
+constant u64 kJobUrgentDeadlineFrames = 1;
+
 struct JobSystem
 {
   JobQueue high_priority;
   JobQueue medium_priority;
   JobQueue low_priority;
+  DeadlineJobQueue deadline_priority;
 
   // TODO(Brandon): Ideally, these pools would just be atomic
   // and not SpinLocked.
@@ -135,12 +238,22 @@ struct JobSystem
 
   SpinLocked<Pool<WorkingJob>> working_job_allocator;
 
-  SpinLocked<HashTable<JobHandle, JobCounter>> job_counters;
+  ConcurrentHashTable<JobHandle, JobCounter> job_counters;
   SpinLocked<WorkingJobQueue> working_jobs_queue;
 
-  volatile JobHandle current_job_counter_id = 1;
+  Atomic<JobHandle> current_job_counter_id = 1;
+
+  Atomic<u64> current_frame = 0;
+  Atomic<u64> high_priority_streak = 0;
+  JobDeadlineStats deadline_stats;
 
-  bool should_exit = 0;
+  JobThreadStats thread_stats[kMaxJobStatsThreads];
+  Atomic<u64> thread_stats_count = 0;
+
+  // Mostly just here so the benchmarks can compare against the uncached path.
+  Atomic<bool> disable_job_stack_cache = false;
+
+  Atomic<bool> should_exit = false;
 };
 
 enum JobPriority : u8
@@ -152,7 +265,13 @@ enum JobPriority : u8
   kJobPriorityCount,
 };
 
+// job_queue_size is how many jobs each priority can have queued at once, and how many deadline
+// jobs can be queued at once. Kicking more than that asserts and drops the extra jobs.
 JobSystem* init_job_system(MEMORY_ARENA_PARAM, size_t job_queue_size);
+// For job systems that don't have any workers running (never spawned, or all joined), so that
+// another one can be initialized. Has to be called from the thread that used it. The memory
+// belongs to the arena it was initialized from.
+void destroy_job_system(JobSystem* job_system);
 
 // These must be called _inside_ of a job.
 JobSystem* get_job_system();
@@ -162,12 +281,37 @@ Array<Thread> spawn_job_system_workers(MEMORY_ARENA_PARAM, JobSystem* job_system
 
 bool job_has_completed(JobHandle handle, JobSystem* job_system = nullptr);
 
+// Runs queued jobs on the calling thread, in the order a worker would, until there's nothing
+// left that it can run. Low priority jobs are left for the async worker. Mostly for tests,
+// can't be called from inside of a job.
+void run_queued_jobs(JobSystem* job_system = nullptr);
+
+// Should be called once per frame after present. Any deadline job that completes
+// after its deadline frame has been passed is counted as missed.
+void advance_job_system_frame(JobSystem* job_system = nullptr);
+u64  get_job_system_frame(JobSystem* job_system = nullptr);
+JobDeadlineStats get_job_deadline_stats(JobSystem* job_system = nullptr);
+
+void set_job_stack_cache_enabled(bool enabled, JobSystem* job_system = nullptr);
+
+JobSystemStats get_job_system_stats(JobSystem* job_system = nullptr);
+// Writes the stats as a JSON object into out, returns the number of characters written
+// (not including the null terminator).
+size_t job_system_stats_to_json(const JobSystemStats& stats, char* out, size_t out_size);
+
 JobHandle _kick_jobs(JobPriority priority,
                         JobDesc* jobs,
                         size_t count,
                         JobDebugInfo debug_info,
                         Option<ThreadSignal*> thread_signal = None);
 
+// Deadline jobs are not tied to a JobPriority, they are scheduled earliest-deadline-first.
+JobHandle _kick_jobs_with_deadline(u64 deadline_frame,
+                                   JobDesc* jobs,
+                                   size_t count,
+                                   JobDebugInfo debug_info,
+                                   Option<ThreadSignal*> thread_signal = None);
+
 inline JobHandle
 _kick_single_job(JobPriority priority,
                  JobDesc desc,
@@ -177,23 +321,43 @@ _kick_single_job(JobPriority priority,
   return _kick_jobs(priority, &desc, 1, debug_info, thread_signal);
 }
 
-inline void
-blocking_kick_job_descs(JobPriority priority,
-                        JobDesc* jobs,
-                        size_t count,
-                        JobDebugInfo debug_info)
+inline JobHandle
+_kick_single_job_with_deadline(u64 deadline_frame,
+                               JobDesc desc,
+                               JobDebugInfo debug_info,
+                               Option<ThreadSignal*> thread_signal = None)
 {
-  ThreadSignal signal = init_thread_signal();
-  _kick_jobs(priority, jobs, count, debug_info, &signal);
-  wait_for_thread_signal(&signal);
+  return _kick_jobs_with_deadline(deadline_frame, &desc, 1, debug_info, thread_signal);
 }
 
+enum JobWaitMode : u8
+{
+  // The calling thread runs queued jobs itself until the kicked jobs are done. Once the
+  // queues come up empty kJobWaitHelpMaxEmptyPolls times in a row it goes to sleep instead.
+  // It can pick up any queued job, not just the ones it kicked, so it can return a bit after
+  // they're done if it's in the middle of something else.
+  kJobWaitHelp,
+  // The calling thread goes to sleep until the kicked jobs are done.
+  kJobWaitSleep,
+};
+
+constant u32 kJobWaitHelpMaxEmptyPolls = 64;
+
+// When called from inside of a job this just yields to the counter regardless of the wait mode.
+// Low priority kicks always sleep, since only the async worker runs those.
+void blocking_kick_job_descs(JobPriority priority,
+                             JobDesc* jobs,
+                             size_t count,
+                             JobDebugInfo debug_info,
+                             JobWaitMode wait_mode = kJobWaitHelp);
+
 inline void
 _blocking_kick_single_job(JobPriority priority,
                           JobDesc desc,
-                          JobDebugInfo debug_info)
+                          JobDebugInfo debug_info,
+                          JobWaitMode wait_mode = kJobWaitHelp)
 {
-  blocking_kick_job_descs(priority, &desc, 1, debug_info);
+  blocking_kick_job_descs(priority, &desc, 1, debug_info, wait_mode);
 }
 
 
@@ -219,6 +383,8 @@ init_job_desc_from_closure(F func)
 }
 
 #define kick_job_descs(priority, job_descs, count, ...) _kick_jobs(priority, job_descs, count, JOB_DEBUG_INFO_STRUCT, __VA_ARGS__)
+#define kick_job_descs_with_deadline(deadline_frame, job_descs, count, ...) _kick_jobs_with_deadline(deadline_frame, job_descs, count, JOB_DEBUG_INFO_STRUCT, __VA_ARGS__)
+#define kick_closure_job_with_deadline(deadline_frame, closure) _kick_single_job_with_deadline(deadline_frame, init_job_desc_from_closure(closure), JOB_DEBUG_INFO_STRUCT)
 #define kick_closure_job(priority, closure) _kick_single_job(priority, init_job_desc_from_closure(closure), JOB_DEBUG_INFO_STRUCT)
 #define kick_job(priority, function_call) kick_closure_job(priority, [=]() { function_call; })
 #define blocking_kick_closure_job(priority, closure) _blocking_kick_single_job(priority, init_job_desc_from_closure(closure), JOB_DEBUG_INFO_STRUCT)
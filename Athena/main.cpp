@@ -1,4 +1,5 @@
 #include "tests.h"
+#include "benchmarks.h"
 #include "math/math.h"
 #include "graphics.h"
 #include "job_system.h"
@@ -95,7 +96,11 @@ using namespace gfx;
 static void
 draw_debug(RenderOptions* out_render_options,
            interlop::DirectionalLight* out_directional_light,
-           Camera* out_camera)
+           Camera* out_camera,
+           const MemoryArena* frame_arena,
+           size_t frame_memory_used,
+           size_t frame_memory_peak,
+           const RenderStats& render_stats)
 {
   // Start the Dear ImGui frame
   ImGui_ImplDX12_NewFrame();
@@ -136,6 +141,17 @@ draw_debug(RenderOptions* out_render_options,
 
   ImGui::InputFloat3("Camera Position", (f32*)&out_camera->world_pos);
 
+  ImGui::Text("Frame Memory: %.1f / %.1f KiB (peak %.1f KiB)",
+              f64(frame_memory_used) / 1024.0,
+              f64(frame_arena->size) / 1024.0,
+              f64(frame_memory_peak) / 1024.0);
+  ImGui::Checkbox("Occlusion Culling", &out_render_options->occlusion_culling);
+  ImGui::Text("Draws: %u submitted, %u frustum culled, %u occlusion culled",
+              render_stats.draws_submitted,
+              render_stats.draws_frustum_culled,
+              render_stats.draws_occlusion_culled);
+  ImGui::Text("Occluder Triangles: %u", render_stats.occluder_triangles);
+
   ImGui::End();
 
   ImGui::Render();
@@ -212,6 +228,10 @@ application_entry(MEMORY_ARENA_PARAM, HINSTANCE instance, int show_code, JobSyst
 
   RenderOptions render_options;
 
+  // How much of the frame arena the last frame used, and the most any frame has used so far.
+  size_t frame_memory_used = 0;
+  size_t frame_memory_peak = 0;
+
   bool done = false;
   while (!done)
   {
@@ -271,8 +291,8 @@ application_entry(MEMORY_ARENA_PARAM, HINSTANCE instance, int show_code, JobSyst
     {
       move.y -= 1.0f;
     }
-    // TODO(Brandon): Something is completely fucked with my quaternion math...
-    Quat rot = quat_from_rotation_y(scene.camera.yaw); // * quat_from_rotation_x(-scene.camera.pitch);  //quat_from_euler_yxz(scene.camera.yaw, 0, 0);
+    // Fly along wherever the camera is looking, pitch included.
+    Quat rot = quat_from_rotation_y(scene.camera.yaw) * quat_from_rotation_x(-scene.camera.pitch);
     move = rotate_vec3_by_quat(move, rot);
     move *= 4.0f / 60.0f;
 
@@ -281,10 +301,11 @@ application_entry(MEMORY_ARENA_PARAM, HINSTANCE instance, int show_code, JobSyst
     if (done)
       break;
 
-    draw_debug(&render_options, &scene.directional_light, &scene.camera);
+    draw_debug(&render_options, &scene.directional_light, &scene.camera, &frame_arena, frame_memory_used, frame_memory_peak, renderer.stats);
 
 //    blocking_kick_closure_job(kJobPriorityMedium, [&]()
 //    {
+    update_transform_hierarchy(&scene.transforms);
     begin_renderer_recording(&frame_arena, &renderer);
     submit_scene(scene, &renderer);
     execute_render(&frame_arena,
@@ -298,6 +319,11 @@ application_entry(MEMORY_ARENA_PARAM, HINSTANCE instance, int show_code, JobSyst
                   render_options,
                   scene.directional_light);
 //    });
+
+    frame_memory_used = memory_arena_used(&frame_arena);
+    frame_memory_peak = MAX(frame_memory_peak, frame_memory_used);
+
+    advance_job_system_frame(job_system);
   }
 
   wait_for_device_idle(&graphics_device);
@@ -329,6 +355,11 @@ WinMain(HINSTANCE instance, HINSTANCE prev_instance, PSTR cmdline, int show_code
   JobSystem* job_system = init_job_system(&arena, 512);
   Array<Thread> threads = spawn_job_system_workers(&arena, job_system);
 
+//#define RUN_BENCHMARKS
+#ifdef RUN_BENCHMARKS
+  run_all_benchmarks();
+#endif
+
   MemoryArena game_memory = alloc_memory_arena(GiB(1));
 
   application_entry(&game_memory, instance, show_code, job_system);
@@ -0,0 +1,349 @@
+#pragma once
+#include "math.h"
+#include <type_traits>
+
+// Fixed size matrices that can be built, multiplied and inverted at compile time.
+//
+// Mat4 lives in SSE registers, which makes it fast but means none of it can be constexpr.
+// Mat<R, C> is plain floats instead, so anything with constant inputs (projections, basis
+// changes, fixed offsets) can be folded into a constant. Used at runtime, the operations that
+// matter switch over to the SIMD versions in math.h.
+//
+// Mat3x4 is an affine transform: the upper 3 rows of a Mat4 with the bottom row implied to be
+// (0, 0, 0, 1). That's 25% less to store and to multiply for object transforms, and it can be
+// inverted without going through the general 4x4 inverse.
+//
+// Same layout as Mat4, column major, entries[column][row].
+template <u32 R, u32 C>
+struct Mat
+{
+  // Identity, like Mat4. For Mat3x4 that's the identity transform.
+  constexpr Mat()
+  {
+    for (u32 col = 0; col < C; col++)
+    {
+      for (u32 row = 0; row < R; row++)
+      {
+        entries[col][row] = row == col ? 1.0f : 0.0f;
+      }
+    }
+  }
+
+  static constexpr Mat
+  columns(const f32 (&values)[C][R])
+  {
+    Mat ret;
+    for (u32 col = 0; col < C; col++)
+    {
+      for (u32 row = 0; row < R; row++)
+      {
+        ret.entries[col][row] = values[col][row];
+      }
+    }
+    return ret;
+  }
+
+  // Reads the same way the matrix is written out on paper.
+  static constexpr Mat
+  rows(const f32 (&values)[R][C])
+  {
+    Mat ret;
+    for (u32 col = 0; col < C; col++)
+    {
+      for (u32 row = 0; row < R; row++)
+      {
+        ret.entries[col][row] = values[row][col];
+      }
+    }
+    return ret;
+  }
+
+  constexpr f32&       operator()(u32 row, u32 col)       { return entries[col][row]; }
+  constexpr const f32& operator()(u32 row, u32 col) const { return entries[col][row]; }
+
+  f32 entries[C][R];
+};
+
+typedef Mat<3, 3> Mat3;
+typedef Mat<3, 4> Mat3x4;
+typedef Mat<4, 4> Mat4x4;
+
+static_assert(sizeof(Mat3)   == sizeof(f32) * 3 * 3);
+static_assert(sizeof(Mat3x4) == sizeof(f32) * 3 * 4);
+static_assert(sizeof(Mat4x4) == sizeof(Mat4));
+
+template <u32 R, u32 K, u32 C>
+constexpr Mat<R, C>
+operator*(const Mat<R, K>& a, const Mat<K, C>& b)
+{
+  Mat<R, C> ret;
+  for (u32 col = 0; col < C; col++)
+  {
+    for (u32 row = 0; row < R; row++)
+    {
+      f32 sum = 0.0f;
+      for (u32 k = 0; k < K; k++)
+      {
+        sum += a.entries[k][row] * b.entries[col][k];
+      }
+      ret.entries[col][row] = sum;
+    }
+  }
+  return ret;
+}
+
+template <u32 R, u32 C>
+constexpr Mat<R, C>
+operator+(const Mat<R, C>& a, const Mat<R, C>& b)
+{
+  Mat<R, C> ret;
+  for (u32 col = 0; col < C; col++)
+  {
+    for (u32 row = 0; row < R; row++)
+    {
+      ret.entries[col][row] = a.entries[col][row] + b.entries[col][row];
+    }
+  }
+  return ret;
+}
+
+template <u32 R, u32 C>
+constexpr Mat<R, C>
+operator-(const Mat<R, C>& a, const Mat<R, C>& b)
+{
+  Mat<R, C> ret;
+  for (u32 col = 0; col < C; col++)
+  {
+    for (u32 row = 0; row < R; row++)
+    {
+      ret.entries[col][row] = a.entries[col][row] - b.entries[col][row];
+    }
+  }
+  return ret;
+}
+
+template <u32 R, u32 C>
+constexpr Mat<R, C>
+operator*(const Mat<R, C>& a, f32 scale)
+{
+  Mat<R, C> ret;
+  for (u32 col = 0; col < C; col++)
+  {
+    for (u32 row = 0; row < R; row++)
+    {
+      ret.entries[col][row] = a.entries[col][row] * scale;
+    }
+  }
+  return ret;
+}
+
+template <u32 R, u32 C>
+constexpr bool
+operator==(const Mat<R, C>& a, const Mat<R, C>& b)
+{
+  for (u32 col = 0; col < C; col++)
+  {
+    for (u32 row = 0; row < R; row++)
+    {
+      if (a.entries[col][row] != b.entries[col][row])
+        return false;
+    }
+  }
+  return true;
+}
+
+template <u32 R, u32 C>
+constexpr Mat<C, R>
+transpose_f32(const Mat<R, C>& m)
+{
+  Mat<C, R> ret;
+  for (u32 col = 0; col < C; col++)
+  {
+    for (u32 row = 0; row < R; row++)
+    {
+      ret.entries[row][col] = m.entries[col][row];
+    }
+  }
+  return ret;
+}
+
+// Between the registers and the constexpr types. Mat3x4 comes back with the implied bottom
+// row filled in, and to_mat3x4 drops it.
+inline Mat4
+to_mat4(const Mat4x4& m)
+{
+  return Mat4::columns(_mm_loadu_ps(m.entries[0]),
+                       _mm_loadu_ps(m.entries[1]),
+                       _mm_loadu_ps(m.entries[2]),
+                       _mm_loadu_ps(m.entries[3]));
+}
+
+inline Mat4x4
+to_mat4x4(const Mat4& m)
+{
+  Mat4x4 ret;
+  for (u32 col = 0; col < 4; col++)
+  {
+    _mm_storeu_ps(ret.entries[col], m.cols[col]);
+  }
+  return ret;
+}
+
+// The 12 floats of a Mat3x4 are 3 loads, which then get shuffled apart into columns.
+inline Mat4
+to_mat4(const Mat3x4& m)
+{
+  const f32* src = m.entries[0];
+  f32x4 r0 = _mm_loadu_ps(src + 0); // c0.x c0.y c0.z c1.x
+  f32x4 r1 = _mm_loadu_ps(src + 4); // c1.y c1.z c2.x c2.y
+  f32x4 r2 = _mm_loadu_ps(src + 8); // c2.z c3.x c3.y c3.z
+
+  f32x4 xyz_only = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  f32x4 c1_xy = VEC_SHUFFLE(r0, r1, 3, 3, 0, 0);
+
+  Mat4 ret;
+  ret.cols[0] = _mm_and_ps(r0, xyz_only);
+  ret.cols[1] = _mm_and_ps(VEC_SHUFFLE(c1_xy, r1, 0, 2, 1, 1), xyz_only);
+  ret.cols[2] = _mm_and_ps(VEC_SHUFFLE(r1, r2, 2, 3, 0, 0), xyz_only);
+  ret.cols[3] = _mm_or_ps(_mm_and_ps(VEC_SWIZZLE(r2, 1, 2, 3, 3), xyz_only), _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+  return ret;
+}
+
+// The reverse of to_mat4, the bottom row of m is ignored.
+inline Mat3x4
+to_mat3x4(const Mat4& m)
+{
+  f32x4 c0z_c1x = VEC_SHUFFLE(m.cols[0], m.cols[1], 2, 2, 0, 0);
+  f32x4 c2z_c3x = VEC_SHUFFLE(m.cols[2], m.cols[3], 2, 2, 0, 0);
+
+  Mat3x4 ret;
+  f32* dst = ret.entries[0];
+  _mm_storeu_ps(dst + 0, VEC_SHUFFLE(m.cols[0], c0z_c1x, 0, 1, 0, 2));
+  _mm_storeu_ps(dst + 4, VEC_SHUFFLE(m.cols[1], m.cols[2], 1, 2, 0, 1));
+  _mm_storeu_ps(dst + 8, VEC_SHUFFLE(c2z_c3x, m.cols[3], 0, 2, 1, 2));
+  return ret;
+}
+
+// a * b with the implied (0, 0, 0, 1) bottom rows, see affine_mul.
+constexpr Mat3x4
+operator*(const Mat3x4& a, const Mat3x4& b)
+{
+  if (!std::is_constant_evaluated())
+    return to_mat3x4(affine_mul(to_mat4(a), to_mat4(b)));
+
+  Mat3x4 ret;
+  for (u32 col = 0; col < 4; col++)
+  {
+    for (u32 row = 0; row < 3; row++)
+    {
+      f32 sum = col == 3 ? a.entries[3][row] : 0.0f;
+      for (u32 k = 0; k < 3; k++)
+      {
+        sum += a.entries[k][row] * b.entries[col][k];
+      }
+      ret.entries[col][row] = sum;
+    }
+  }
+  return ret;
+}
+
+constexpr f32
+determinant_mat3(const Mat3& m)
+{
+  return m(0, 0) * (m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1))
+       - m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0))
+       + m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
+}
+
+// The adjugate over the determinant. Singular matrices give infinities, same as inverse_mat4.
+constexpr Mat3
+inverse_mat3(const Mat3& m)
+{
+  f32 inv_det = 1.0f / determinant_mat3(m);
+
+  Mat3 ret;
+  ret(0, 0) = (m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1)) * inv_det;
+  ret(0, 1) = (m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2)) * inv_det;
+  ret(0, 2) = (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * inv_det;
+  ret(1, 0) = (m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2)) * inv_det;
+  ret(1, 1) = (m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0)) * inv_det;
+  ret(1, 2) = (m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2)) * inv_det;
+  ret(2, 0) = (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0)) * inv_det;
+  ret(2, 1) = (m(0, 1) * m(2, 0) - m(0, 0) * m(2, 1)) * inv_det;
+  ret(2, 2) = (m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0)) * inv_det;
+  return ret;
+}
+
+// The upper 3x3 gets inverted on its own and the translation becomes -(A^-1 * t). At runtime
+// this is affine_inverse.
+constexpr Mat3x4
+inverse_mat3x4(const Mat3x4& m)
+{
+  if (!std::is_constant_evaluated())
+    return to_mat3x4(affine_inverse(to_mat4(m)));
+
+  Mat3 linear;
+  for (u32 col = 0; col < 3; col++)
+  {
+    for (u32 row = 0; row < 3; row++)
+    {
+      linear.entries[col][row] = m.entries[col][row];
+    }
+  }
+  linear = inverse_mat3(linear);
+
+  Mat3x4 ret;
+  for (u32 row = 0; row < 3; row++)
+  {
+    f32 t = 0.0f;
+    for (u32 col = 0; col < 3; col++)
+    {
+      ret.entries[col][row] = linear.entries[col][row];
+      t -= linear.entries[col][row] * m.entries[3][col];
+    }
+    ret.entries[3][row] = t;
+  }
+  return ret;
+}
+
+// Taylor series, good to double precision for |x| <= pi. Only here so that the projections
+// below can be constexpr, use sinf/cosf for anything at runtime.
+constexpr f64
+sin_constexpr(f64 x)
+{
+  f64 term = x;
+  f64 sum = x;
+  for (u32 i = 1; i < 16; i++)
+  {
+    term *= -x * x / f64((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr f64
+cos_constexpr(f64 x)
+{
+  f64 term = 1.0;
+  f64 sum = 1.0;
+  for (u32 i = 1; i < 16; i++)
+  {
+    term *= -x * x / f64((2 * i - 1) * (2 * i));
+    sum += term;
+  }
+  return sum;
+}
+
+// Same as perspective_infinite_reverse_lh, for when the inputs are constants.
+//   constexpr Mat4x4 kShadowProj = perspective_infinite_reverse_lh_mat4x4(kPI / 2.0f, 1.0f, 0.1f);
+constexpr Mat4x4
+perspective_infinite_reverse_lh_mat4x4(f32 fov_y_rads, f32 aspect_ratio, f32 z_near)
+{
+  f32 h = f32(cos_constexpr(0.5 * fov_y_rads) / sin_constexpr(0.5 * fov_y_rads));
+  f32 w = h / aspect_ratio;
+
+  return Mat4x4::columns({{w,    0.0f, 0.0f,   0.0f},
+                          {0.0f, h,    0.0f,   0.0f},
+                          {0.0f, 0.0f, 0.0f,   1.0f},
+                          {0.0f, 0.0f, z_near, 0.0f}});
+}
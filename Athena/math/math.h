@@ -2,7 +2,6 @@
 #include "../types.h"
 #include "../memory/memory.h"
 #include <cmath>
-#include <random>
 
 static constexpr f32 kPI  = 3.1415926535897932f;
 static constexpr f32 k2PI = 6.2831853071795864f;
@@ -91,34 +90,76 @@ hadamard_f32(f32x4 a, f32x4 b)
   return _mm_mul_ps(a, b);
 }
 
-inline f32 pass_by_register 
-dot_f32(f32x4 a, f32x4 b)
+// The dot product broadcast to every lane. Stays in registers the whole way: swap neighbouring
+// pairs and add, then swap the halves and add. No _mm_dp_ps since that needs SSE4.1 and is
+// slower than this on most CPUs anyway.
+inline f32x4 pass_by_register
+dot_splat_f32(f32x4 a, f32x4 b)
 {
   f32x4 res = hadamard_f32(a, b);
-  f32 vals[4];
-  _mm_store_ps(vals, res);
+  res = res + _mm_shuffle_ps(res, res, _MM_SHUFFLE(2, 3, 0, 1));
+  res = res + _mm_shuffle_ps(res, res, _MM_SHUFFLE(1, 0, 3, 2));
+  return res;
+}
 
-  return vals[0] + vals[1] + vals[2] + vals[3];
+inline f32 pass_by_register 
+dot_f32(f32x4 a, f32x4 b)
+{
+  return _mm_cvtss_f32(dot_splat_f32(a, b));
 }
 
 inline f32 pass_by_register 
 length_f32(f32x4 v)
 {
-  return sqrt(dot_f32(v, v));
+  return _mm_cvtss_f32(_mm_sqrt_ss(dot_splat_f32(v, v)));
 }
 
 inline f32x4 pass_by_register
 normalize_f32(f32x4 v)
 {
-  return v / sqrt(dot_f32(v, v));
+  return v / _mm_sqrt_ps(dot_splat_f32(v, v));
+}
+
+// 1 / sqrt(v) per lane, using rsqrtps plus one Newton-Raphson step.
+//
+// rsqrtps on its own is only good to a relative error of 1.5 * 2^-12 (~3.7e-4). One step of
+// y' = y * (1.5 - 0.5 * v * y * y) squares that error, which takes it to within 2^-21 (~4.8e-7)
+// of the real thing, i.e. a few ulps. That's plenty for directions and lighting, but use the
+// exact versions for anything that accumulates (like renormalizing a rotation every frame).
+//
+// Zero gives NaN (instead of inf), and denormals are treated as zero.
+inline f32x4 pass_by_register
+rsqrt_fast_f32(f32x4 v)
+{
+  f32x4 y = _mm_rsqrt_ps(v);
+  f32x4 half_v_y_y = hadamard_f32(hadamard_f32(_mm_set1_ps(0.5f), v), hadamard_f32(y, y));
+  return hadamard_f32(y, _mm_set1_ps(1.5f) - half_v_y_y);
+}
+
+// Same error bound as rsqrt_fast_f32, and quite a bit faster than normalize_f32 since there's
+// no sqrt or divide.
+inline f32x4 pass_by_register
+normalize_fast_f32(f32x4 v)
+{
+  return hadamard_f32(v, rsqrt_fast_f32(dot_splat_f32(v, v)));
 }
 
+inline f32 pass_by_register
+length_fast_f32(f32x4 v)
+{
+  // sqrt(x) = x * (1 / sqrt(x))
+  f32x4 dot = dot_splat_f32(v, v);
+  return _mm_cvtss_f32(hadamard_f32(dot, rsqrt_fast_f32(dot)));
+}
+
+// out[i] = dot(a[i], b[i]) for 4 vectors at a time. Transposes each group of 4 so that the
+// dot products are vertical adds instead of horizontal ones.
 template <typename T>
 inline void
 dot_f32_arrays_x4(const T* a,
-                              const T* b,
-                              size_t count,
-                              f32* out)
+                  const T* b,
+                  size_t count,
+                  f32* out)
 {
   static_assert(sizeof(T) == sizeof(f32x4));
 
@@ -126,15 +167,15 @@ dot_f32_arrays_x4(const T* a,
 
   for (size_t i = 0; i < count; i += 4)
   {
-    f32x4 a_x = a[i];
-    f32x4 a_y = a[i];
-    f32x4 a_z = a[i];
-    f32x4 a_w = a[i];
+    f32x4 a_x = a[i + 0];
+    f32x4 a_y = a[i + 1];
+    f32x4 a_z = a[i + 2];
+    f32x4 a_w = a[i + 3];
 
-    f32x4 b_x = b[i];
-    f32x4 b_y = b[i];
-    f32x4 b_z = b[i];
-    f32x4 b_w = b[i];
+    f32x4 b_x = b[i + 0];
+    f32x4 b_y = b[i + 1];
+    f32x4 b_z = b[i + 2];
+    f32x4 b_w = b[i + 3];
 
     _MM_TRANSPOSE4_PS(a_x, a_y, a_z, a_w);
     _MM_TRANSPOSE4_PS(b_x, b_y, b_z, b_w);
@@ -142,10 +183,10 @@ dot_f32_arrays_x4(const T* a,
     f32x4 res;
     res = hadamard_f32(a_x, b_x);
     res = res + hadamard_f32(a_y, b_y);
-    res = res + hadamard_f32(a_z, a_z);
-    res = res + hadamard_f32(a_w, a_w);
+    res = res + hadamard_f32(a_z, b_z);
+    res = res + hadamard_f32(a_w, b_w);
 
-    _mm_store_ps(&out[i], res);
+    _mm_storeu_ps(&out[i], res);
   }
 }
 
@@ -241,9 +282,8 @@ struct alignas(16) Vec2
 inline f32 pass_by_register
 dot_f32(Vec2 a, Vec2 b)
 {
-  Vec2 res = hadamard_f32(a, b);
-
-  return res.x + res.y;
+  f32x4 res = hadamard_f32(a, b);
+  return _mm_cvtss_f32(_mm_add_ss(res, _mm_shuffle_ps(res, res, _MM_SHUFFLE(1, 1, 1, 1))));
 }
 
 inline Vec2 pass_by_register
@@ -435,11 +475,13 @@ struct alignas(16) Vec4
   };
 };
 
+// Only x, y and z, so it doesn't matter what's in w.
 inline f32 pass_by_register dot_f32(Vec3 a, Vec3 b)
 {
-  Vec3 res = hadamard_f32(a, b);
-
-  return res.x + res.y + res.z;
+  f32x4 res = hadamard_f32(a, b);
+  f32x4 y = _mm_shuffle_ps(res, res, _MM_SHUFFLE(1, 1, 1, 1));
+  f32x4 z = _mm_movehl_ps(res, res);
+  return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(res, y), z));
 }
 
 static_assert(sizeof(Vec4) == sizeof(f32) * 4);
@@ -674,6 +716,174 @@ inline Mat4 transform_inverse_no_scale(Mat4 in)
   return ret;
 }
 
+// The inverse-transpose of an affine transform (bottom row of 0, 0, 0, 1), which is what normals
+// have to go through once there's non-uniform scale. Much cheaper than inverse_mat4 + transpose.
+//
+// With a0..a2 the columns of the upper 3x3, the columns of its inverse-transpose are just
+// (a1 x a2, a2 x a0, a0 x a1) / det. The translation ends up in the bottom row as -(A^-1 * t),
+// which is -dot(column, t) for each of those columns.
+inline Mat4 pass_by_register
+affine_inverse_transpose(const Mat4& in)
+{
+  f32x4 c0 = cross_f32(in.cols[1], in.cols[2]);
+  f32x4 c1 = cross_f32(in.cols[2], in.cols[0]);
+  f32x4 c2 = cross_f32(in.cols[0], in.cols[1]);
+
+  f32x4 inv_det = _mm_set1_ps(1.0f) / dot_splat_f32(in.cols[0], c0);
+  c0 = hadamard_f32(c0, inv_det);
+  c1 = hadamard_f32(c1, inv_det);
+  c2 = hadamard_f32(c2, inv_det);
+
+  // The crosses all have w = 0, so the dot with t ignores its w.
+  f32x4 w_only = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+  Mat4 ret;
+  ret.cols[0] = c0 - hadamard_f32(w_only, dot_splat_f32(c0, in.cols[3]));
+  ret.cols[1] = c1 - hadamard_f32(w_only, dot_splat_f32(c1, in.cols[3]));
+  ret.cols[2] = c2 - hadamard_f32(w_only, dot_splat_f32(c2, in.cols[3]));
+  ret.cols[3] = w_only;
+  return ret;
+}
+
+// a * b for affine transforms, i.e. the bottom row of both is (0, 0, 0, 1). Skips the
+// multiplies by that row, 12 multiplies and 9 adds instead of 16 and 12.
+inline Mat4 pass_by_register
+affine_mul(const Mat4& a, const Mat4& b)
+{
+  Mat4 ret;
+  for (u32 col = 0; col < 4; col++)
+  {
+    ret.cols[col] = hadamard_f32(a.cols[0], VEC_SWIZZLE_1(b.cols[col], 0))
+                  + hadamard_f32(a.cols[1], VEC_SWIZZLE_1(b.cols[col], 1))
+                  + hadamard_f32(a.cols[2], VEC_SWIZZLE_1(b.cols[col], 2));
+  }
+  ret.cols[3] += a.cols[3];
+  return ret;
+}
+
+// The inverse of an affine transform, with any scale or shear (unlike
+// transform_inverse_no_scale). Same idea as affine_inverse_transpose, those crosses are the
+// rows of the inverse here. Quite a bit cheaper than inverse_mat4.
+inline Mat4 pass_by_register
+affine_inverse(const Mat4& in)
+{
+  f32x4 c0 = cross_f32(in.cols[1], in.cols[2]);
+  f32x4 c1 = cross_f32(in.cols[2], in.cols[0]);
+  f32x4 c2 = cross_f32(in.cols[0], in.cols[1]);
+
+  f32x4 inv_det = _mm_set1_ps(1.0f) / dot_splat_f32(in.cols[0], c0);
+
+  Mat4 ret;
+  ret.cols[0] = hadamard_f32(c0, inv_det);
+  ret.cols[1] = hadamard_f32(c1, inv_det);
+  ret.cols[2] = hadamard_f32(c2, inv_det);
+  ret.cols[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+  ret = transpose_f32(ret);
+
+  // -(A^-1 * t). The w lanes of the first three columns are all 0, so this leaves w at 1.
+  ret.cols[3] = ret.cols[3] - hadamard_f32(ret.cols[0], VEC_SWIZZLE_1(in.cols[3], 0))
+                            - hadamard_f32(ret.cols[1], VEC_SWIZZLE_1(in.cols[3], 1))
+                            - hadamard_f32(ret.cols[2], VEC_SWIZZLE_1(in.cols[3], 2));
+  return ret;
+}
+
+inline f32x4 pass_by_register
+abs_f32(f32x4 v)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+// Center and half-extents rather than min/max, since that's what the culling tests want.
+struct Aabb
+{
+  Vec3 center;
+  Vec3 extents;
+};
+
+inline Aabb
+aabb_from_min_max(Vec3 min, Vec3 max)
+{
+  Aabb ret;
+  ret.center = (max + min) * 0.5f;
+  ret.extents = (max - min) * 0.5f;
+  return ret;
+}
+
+// The smallest box around the transformed box, which is bigger than the original whenever
+// there's any rotation. Only right for affine transforms.
+inline Aabb
+transform_aabb(const Mat4& m, const Aabb& box)
+{
+  f32x4 xyz_only = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+  Aabb ret;
+  ret.center = Vec3(_mm_and_ps(m * Vec4(box.center, 1.0f).avx, xyz_only));
+  ret.extents = hadamard_f32(abs_f32(m.cols[0]), _mm_set1_ps(box.extents.x))
+              + hadamard_f32(abs_f32(m.cols[1]), _mm_set1_ps(box.extents.y))
+              + hadamard_f32(abs_f32(m.cols[2]), _mm_set1_ps(box.extents.z));
+  return ret;
+}
+
+// Planes are (normal, d) with the normals pointing inwards, so a point p is inside of a plane
+// when dot(normal, p) + d >= 0.
+struct Frustum
+{
+  Vec4 planes[6];
+};
+
+// Gribb/Hartmann, every plane is the sum or difference of two rows of view_proj. Works for any
+// D3D style projection (0 <= z <= w), including perspective_infinite_reverse_lh, where the
+// z >= 0 plane is at infinity and comes out as (0, 0, 0, z_near) so that it never culls anything.
+// The rest get normalized so that distances are in world units and spheres can be tested too.
+inline Frustum
+frustum_from_view_proj(const Mat4& view_proj)
+{
+  Mat4 rows = transpose_f32(view_proj);
+
+  Frustum ret;
+  ret.planes[0] = rows.cols[3] + rows.cols[0];
+  ret.planes[1] = rows.cols[3] - rows.cols[0];
+  ret.planes[2] = rows.cols[3] + rows.cols[1];
+  ret.planes[3] = rows.cols[3] - rows.cols[1];
+  ret.planes[4] = rows.cols[2];
+  ret.planes[5] = rows.cols[3] - rows.cols[2];
+
+  for (Vec4& plane : ret.planes)
+  {
+    f32 length = sqrtf(dot_f32(Vec3(plane.avx), Vec3(plane.avx)));
+    if (length > 0.0f)
+    {
+      plane = plane.avx / length;
+    }
+  }
+
+  return ret;
+}
+
+// Conservative, so boxes that are just outside near a corner of the frustum still pass.
+inline bool
+aabb_in_frustum(const Frustum& frustum, const Aabb& box)
+{
+  for (const Vec4& plane : frustum.planes)
+  {
+    f32 distance = dot_f32(Vec3(plane.avx), box.center) + plane.w;
+    f32 radius = dot_f32(Vec3(abs_f32(plane.avx)), box.extents);
+    if (distance + radius < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+inline bool
+sphere_in_frustum(const Frustum& frustum, Vec3 center, f32 radius)
+{
+  for (const Vec4& plane : frustum.planes)
+  {
+    if (dot_f32(Vec3(plane.avx), center) + plane.w + radius < 0.0f)
+      return false;
+  }
+  return true;
+}
+
 // for column major matrix
 // we use __m128 to represent 2x2 matrix as A = | A0  A2 |
 //                                              | A1  A3 |
@@ -777,7 +987,7 @@ inline Mat4 inverse_mat4(const Mat4& inM)
 
 struct alignas(16) Quat
 {
-  Quat() : avx(_mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f)) {}
+  Quat() : avx(_mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f)) {}
   Quat(f32 w, f32 x, f32 y, f32 z) : avx(_mm_set_ps(z, y, x, w)) {}
   Quat(f32x4 q) : avx(q) {}
 
@@ -823,13 +1033,35 @@ quat_from_rotation_z(f32 z)
   return Quat(c, 0, 0, s);
 }
 
+inline Quat
+quat_from_axis_angle(Vec3 axis, f32 angle)
+{
+  Vec3 n = normalize_f32(axis);
+  f32 s = sinf(angle * 0.5f);
+  f32 c = cosf(angle * 0.5f);
+  return Quat(c, n.x * s, n.y * s, n.z * s);
+}
+
+// The Hamilton product, so (lhs * rhs) rotates by rhs first and then lhs.
+//
+// Each lane of the result is lhs.w * rhs, plus lhs.x, lhs.y and lhs.z each times a shuffled
+// copy of rhs with some of the signs flipped. Written out for lanes (w, x, y, z):
+//   w = lw * rw - lx * rx - ly * ry - lz * rz
+//   x = lw * rx + lx * rw + ly * rz - lz * ry
+//   y = lw * ry - lx * rz + ly * rw + lz * rx
+//   z = lw * rz + lx * ry - ly * rx + lz * rw
 inline Quat pass_by_register
 quat_mul(Quat lhs, Quat rhs)
 {
-  return Quat((lhs.w, rhs.w) - (lhs.x * rhs.x) - (lhs.y * rhs.y) - (lhs.z * rhs.z),
-              (lhs.w * rhs.x) + (lhs.x * rhs.w) + (lhs.y * rhs.z) - (lhs.z * rhs.y),
-              (lhs.w * rhs.y) - (lhs.x * rhs.z) + (lhs.y * rhs.w) + (lhs.z * rhs.x),
-              (lhs.w * rhs.z) + (lhs.x * rhs.y) - (lhs.y * rhs.x) + (lhs.z * rhs.w));
+  const f32x4 kSignX = _mm_setr_ps(-0.0f,  0.0f, -0.0f,  0.0f);
+  const f32x4 kSignY = _mm_setr_ps(-0.0f,  0.0f,  0.0f, -0.0f);
+  const f32x4 kSignZ = _mm_setr_ps(-0.0f, -0.0f,  0.0f,  0.0f);
+
+  f32x4 ret = _mm_mul_ps(VEC_SWIZZLE_1(lhs.avx, 0), rhs.avx);
+  ret = _mm_add_ps(ret, _mm_mul_ps(VEC_SWIZZLE_1(lhs.avx, 1), _mm_xor_ps(VEC_SWIZZLE(rhs.avx, 1, 0, 3, 2), kSignX)));
+  ret = _mm_add_ps(ret, _mm_mul_ps(VEC_SWIZZLE_1(lhs.avx, 2), _mm_xor_ps(VEC_SWIZZLE(rhs.avx, 2, 3, 0, 1), kSignY)));
+  ret = _mm_add_ps(ret, _mm_mul_ps(VEC_SWIZZLE_1(lhs.avx, 3), _mm_xor_ps(VEC_SWIZZLE(rhs.avx, 3, 2, 1, 0), kSignZ)));
+  return ret;
 }
 
 inline Quat pass_by_register
@@ -860,54 +1092,139 @@ quat_from_euler_yxz(f32 y, f32 x, f32 z)
 inline Quat pass_by_register
 quat_conjugate(Quat quat)
 {
-  return Quat(quat.w, -quat.x, -quat.y, -quat.z);
+  return Quat(_mm_xor_ps(quat.avx, _mm_setr_ps(0.0f, -0.0f, -0.0f, -0.0f)));
 }
 
-inline Vec3 pass_by_register
-rotate_vec3_by_quat(Vec3 vec, Quat q)
+inline f32 pass_by_register
+quat_dot(Quat a, Quat b)
 {
-  Quat p = Quat(0, vec.x, vec.y, vec.z);
-  Quat c = quat_conjugate(q);
-  Quat res = q * p * c;
+  return dot_f32(a.avx, b.avx);
+}
 
-  return Vec3(res.x, res.y, res.z);
+inline Quat pass_by_register
+quat_normalize(Quat q)
+{
+  return normalize_f32(q.avx);
 }
 
-inline Mat4
-generate_random_rotation()
+// Same as quat_conjugate for unit quaternions.
+inline Quat pass_by_register
+quat_inverse(Quat q)
 {
-  static std::uniform_real_distribution<f32> s_Distribution(0.f, 1.f);
-  static std::mt19937 s_Rng;
+  return Quat(_mm_div_ps(quat_conjugate(q).avx, dot_splat_f32(q.avx, q.avx)));
+}
 
-  f32 u1 = k2PI * s_Distribution(s_Rng);
-  f32 cos1 = cosf(u1);
-  f32 sin1 = sinf(u1);
+// Rotation matrix for a unit quaternion.
+inline Mat4 pass_by_register
+quat_to_mat4(Quat q)
+{
+  f32 xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  f32 xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  f32 wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
 
-  f32 u2 = k2PI * s_Distribution(s_Rng);
-  f32 cos2 = cosf(u2);
-  f32 sin2 = sinf(u2);
+  return Mat4::columns(Vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f),
+                       Vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f),
+                       Vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f),
+                       Vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
 
-  f32 u3 = s_Distribution(s_Rng);
-  f32 sq3 = 2.0f * sqrtf(u3 * (1.0f - u3));
+// translation * rotation * scale, so the scale gets applied first.
+inline Mat4 pass_by_register
+trs_to_mat4(Vec3 translation, Quat rotation, Vec3 scale)
+{
+  Mat4 ret = quat_to_mat4(rotation);
+  ret.cols[0] = ret.cols[0] * scale.x;
+  ret.cols[1] = ret.cols[1] * scale.y;
+  ret.cols[2] = ret.cols[2] * scale.z;
+  ret.cols[3] = Vec4(translation.x, translation.y, translation.z, 1.0f);
+  return ret;
+}
 
-  f32 s2 = 2.0f * u3 * sin2 * sin2 - 1.0f;
-  f32 c2 = 2.0f * u3 * cos2 * cos2 - 1.0f;
-  f32 sc = 2.0f * u3 * sin2 * cos2;
+// The rotation part of m, which has to be orthonormal (so no scale). Picks whichever of w, x,
+// y or z is biggest to solve for first (Shepperd's method), so that it never divides by
+// something close to 0.
+inline Quat
+mat4_to_quat(const Mat4& m)
+{
+  // m_rc is row r, column c.
+  f32 m00 = m.entries[0][0], m01 = m.entries[1][0], m02 = m.entries[2][0];
+  f32 m10 = m.entries[0][1], m11 = m.entries[1][1], m12 = m.entries[2][1];
+  f32 m20 = m.entries[0][2], m21 = m.entries[1][2], m22 = m.entries[2][2];
 
-  f32 _11 = cos1 * c2 - sin1 * sc;
-  f32 _12 = sin1 * c2 + cos1 * sc;
-  f32 _13 = sq3 * cos2;
+  f32 trace = m00 + m11 + m22;
+  if (trace > 0.0f)
+  {
+    f32 s = sqrtf(trace + 1.0f) * 2.0f;
+    f32 inv_s = 1.0f / s;
+    return Quat(0.25f * s, (m21 - m12) * inv_s, (m02 - m20) * inv_s, (m10 - m01) * inv_s);
+  }
+  else if (m00 > m11 && m00 > m22)
+  {
+    f32 s = sqrtf(1.0f + m00 - m11 - m22) * 2.0f;
+    f32 inv_s = 1.0f / s;
+    return Quat((m21 - m12) * inv_s, 0.25f * s, (m01 + m10) * inv_s, (m02 + m20) * inv_s);
+  }
+  else if (m11 > m22)
+  {
+    f32 s = sqrtf(1.0f + m11 - m00 - m22) * 2.0f;
+    f32 inv_s = 1.0f / s;
+    return Quat((m02 - m20) * inv_s, (m01 + m10) * inv_s, 0.25f * s, (m12 + m21) * inv_s);
+  }
+  else
+  {
+    f32 s = sqrtf(1.0f + m22 - m00 - m11) * 2.0f;
+    f32 inv_s = 1.0f / s;
+    return Quat((m10 - m01) * inv_s, (m02 + m20) * inv_s, (m12 + m21) * inv_s, 0.25f * s);
+  }
+}
 
-  f32 _21 = cos1 * sc - sin1 * s2;
-  f32 _22 = sin1 * sc + cos1 * s2;
-  f32 _23 = sq3 * sin2;
+// For a unit quaternion, the same as the vector part of q * Quat(0, v) * conjugate(q), but
+// expanded out into v + w * t + q.xyz x t with t = 2 * (q.xyz x v). Two cross products instead
+// of two full quaternion products.
+inline Vec3 pass_by_register
+rotate_vec3_by_quat(Vec3 vec, Quat q)
+{
+  // The vector part with w moved out of the way. Both w lanes have to be 0 for the cross
+  // products to leave 0 in theirs.
+  f32x4 xyz = _mm_and_ps(VEC_SWIZZLE(q.avx, 1, 2, 3, 0), _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+  f32x4 t = cross_f32(xyz, vec.avx) * 2.0f;
+  return vec.avx + hadamard_f32(VEC_SWIZZLE_1(q.avx, 0), t) + cross_f32(xyz, t);
+}
 
-  f32 _31 = cos1 * (sq3 * cos2) - sin1 * (sq3 * sin2);
-  f32 _32 = sin1 * (sq3 * cos2) + cos1 * (sq3 * sin2);
-  f32 _33 = 1.0f - 2.0f * u3;
+// Past this cos(angle) slerp and nlerp are the same to within float precision, and slerp's
+// 1 / sin(angle) starts blowing up.
+constant f32 kQuatSlerpThreshold = 0.9995f;
 
-  return Mat4::columns(Vec4(_11, _21, _31, 0.0f),
-                       Vec4(_12, _22, _32, 0.0f),
-                       Vec4(_13, _23, _33, 0.0f),
-                       Vec4(0.0f, 0.0f, 0.0f, 1.0f));
+// Interpolates linearly and renormalizes, the short way around. Cheaper than slerp and just
+// as smooth, but speeds up in the middle (by up to ~40% for 180 degree rotations).
+inline Quat pass_by_register
+quat_nlerp(Quat a, Quat b, f32 t)
+{
+  f32x4 cos_theta = dot_splat_f32(a.avx, b.avx);
+  // q and -q are the same rotation, flipping b makes sure this goes the short way.
+  f32x4 flip = _mm_and_ps(cos_theta, _mm_set1_ps(-0.0f));
+  f32x4 to = _mm_xor_ps(b.avx, flip);
+  return normalize_f32(a.avx + (to - a.avx) * t);
+}
+
+// Constant angular velocity from a to b, the short way around.
+inline Quat pass_by_register
+quat_slerp(Quat a, Quat b, f32 t)
+{
+  f32 cos_theta = quat_dot(a, b);
+  f32x4 to = b.avx;
+  if (cos_theta < 0.0f)
+  {
+    cos_theta = -cos_theta;
+    to = _mm_sub_ps(_mm_setzero_ps(), to);
+  }
+
+  if (cos_theta > kQuatSlerpThreshold)
+    return normalize_f32(a.avx + (to - a.avx) * t);
+
+  f32 theta = acosf(cos_theta);
+  f32 inv_sin_theta = 1.0f / sinf(theta);
+  f32 weight_a = sinf((1.0f - t) * theta) * inv_sin_theta;
+  f32 weight_b = sinf(t * theta) * inv_sin_theta;
+  return a.avx * weight_a + to * weight_b;
 }
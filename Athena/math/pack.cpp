@@ -0,0 +1,471 @@
+#include "pack.h"
+#include "simd.h"
+
+// Halfs, with F16C. The conversions are single instructions, so the only thing that changes with
+// the level is how many go through at once.
+static f32x4  load_f32(const f32* src, f32x4)  { return _mm_loadu_ps(src); }
+static f32x8  load_f32(const f32* src, f32x8)  { return _mm256_loadu_ps(src); }
+static f32x16 load_f32(const f32* src, f32x16) { return _mm512_loadu_ps(src); }
+
+static void
+store_f16(u16* dst, f32x4 v)
+{
+  _mm_storel_epi64((__m128i*)dst, _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+static void
+store_f16(u16* dst, f32x8 v)
+{
+  _mm_storeu_si128((__m128i*)dst, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+static void
+store_f16(u16* dst, f32x16 v)
+{
+  _mm256_storeu_si256((__m256i*)dst, _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+static f32x4  load_f16(const u16* src, f32x4)  { return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)src)); }
+static f32x8  load_f16(const u16* src, f32x8)  { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)src)); }
+static f32x16 load_f16(const u16* src, f32x16) { return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)src)); }
+
+static void store_f32(f32* dst, f32x4 v)  { _mm_storeu_ps(dst, v); }
+static void store_f32(f32* dst, f32x8 v)  { _mm256_storeu_ps(dst, v); }
+static void store_f32(f32* dst, f32x16 v) { _mm512_storeu_ps(dst, v); }
+
+template <typename F>
+static void
+f32_to_f16_kernel(const f32* src, u16* dst, size_t count)
+{
+  constexpr u32 kWidth = sizeof(F) / sizeof(f32);
+
+  size_t i = 0;
+  for (; i + kWidth <= count; i += kWidth)
+  {
+    store_f16(dst + i, load_f32(src + i, F()));
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = f32_to_f16(src[i]);
+  }
+
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+}
+
+template <typename F>
+static void
+f16_to_f32_kernel(const u16* src, f32* dst, size_t count)
+{
+  constexpr u32 kWidth = sizeof(F) / sizeof(f32);
+
+  size_t i = 0;
+  for (; i + kWidth <= count; i += kWidth)
+  {
+    store_f32(dst + i, load_f16(src + i, F()));
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = f16_to_f32(src[i]);
+  }
+
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+}
+
+typedef void (*F32ToF16Kernel)(const f32* src, u16* dst, size_t count);
+typedef void (*F16ToF32Kernel)(const u16* src, f32* dst, size_t count);
+
+static const F32ToF16Kernel kF32ToF16Kernels[kSimdLevelCount] =
+{
+  &f32_to_f16_kernel<f32x4>,
+  &f32_to_f16_kernel<f32x8>,
+  &f32_to_f16_kernel<f32x16>,
+};
+
+static const F16ToF32Kernel kF16ToF32Kernels[kSimdLevelCount] =
+{
+  &f16_to_f32_kernel<f32x4>,
+  &f16_to_f32_kernel<f32x8>,
+  &f16_to_f32_kernel<f32x16>,
+};
+
+void
+batch_f32_to_f16(const f32* src, u16* dst, size_t count)
+{
+  if (!get_cpu_features().f16c)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      dst[i] = f32_to_f16(src[i]);
+    }
+    return;
+  }
+
+  kF32ToF16Kernels[get_simd_level()](src, dst, count);
+}
+
+void
+batch_f16_to_f32(const u16* src, f32* dst, size_t count)
+{
+  if (!get_cpu_features().f16c)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      dst[i] = f16_to_f32(src[i]);
+    }
+    return;
+  }
+
+  kF16ToF32Kernels[get_simd_level()](src, dst, count);
+}
+
+// Everything below is SSE2 and does exactly the same float ops in the same order as the scalar
+// versions in pack.h, which is what keeps the results identical.
+
+static f32x4
+select_f32(__m128i mask, f32x4 a, f32x4 b)
+{
+  f32x4 m = _mm_castsi128_ps(mask);
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+static __m128i
+select_u32(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static f32x4
+clamp_snorm(f32x4 v)
+{
+  return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+}
+
+void
+batch_f32_to_snorm8(const f32* src, s8* dst, size_t count)
+{
+  f32x4 scale = _mm_set1_ps(127.0f);
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i a = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(_mm_loadu_ps(src + i +  0)), scale));
+    __m128i b = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(_mm_loadu_ps(src + i +  4)), scale));
+    __m128i c = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(_mm_loadu_ps(src + i +  8)), scale));
+    __m128i d = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(_mm_loadu_ps(src + i + 12)), scale));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = f32_to_snorm8(src[i]);
+  }
+}
+
+static f32x4
+snorm_to_f32(__m128i v, f32x4 inv_scale)
+{
+  return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), inv_scale), _mm_set1_ps(-1.0f));
+}
+
+void
+batch_snorm8_to_f32(const s8* src, f32* dst, size_t count)
+{
+  f32x4 inv_scale = _mm_set1_ps(1.0f / 127.0f);
+
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    // Sign extended by putting each byte in the top of a wider lane and shifting it back down.
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i lo = _mm_unpacklo_epi8(bytes, bytes);
+    __m128i hi = _mm_unpackhi_epi8(bytes, bytes);
+    _mm_storeu_ps(dst + i +  0, snorm_to_f32(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24), inv_scale));
+    _mm_storeu_ps(dst + i +  4, snorm_to_f32(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24), inv_scale));
+    _mm_storeu_ps(dst + i +  8, snorm_to_f32(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24), inv_scale));
+    _mm_storeu_ps(dst + i + 12, snorm_to_f32(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24), inv_scale));
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = snorm8_to_f32(src[i]);
+  }
+}
+
+void
+batch_f32_to_snorm16(const f32* src, s16* dst, size_t count)
+{
+  f32x4 scale = _mm_set1_ps(32767.0f);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i a = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(_mm_loadu_ps(src + i + 0)), scale));
+    __m128i b = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(_mm_loadu_ps(src + i + 4)), scale));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = f32_to_snorm16(src[i]);
+  }
+}
+
+void
+batch_snorm16_to_f32(const s16* src, f32* dst, size_t count)
+{
+  f32x4 inv_scale = _mm_set1_ps(1.0f / 32767.0f);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_ps(dst + i + 0, snorm_to_f32(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), inv_scale));
+    _mm_storeu_ps(dst + i + 4, snorm_to_f32(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16), inv_scale));
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = snorm16_to_f32(src[i]);
+  }
+}
+
+// 1 where v >= 0, -1 everywhere else.
+static f32x4
+sign_not_zero(f32x4 v)
+{
+  __m128i nonnegative = _mm_castps_si128(_mm_cmpge_ps(v, _mm_setzero_ps()));
+  return select_f32(nonnegative, _mm_set1_ps(1.0f), _mm_set1_ps(-1.0f));
+}
+
+void
+batch_pack_oct_snorm16(Vec3Soa src, u32* dst, size_t count)
+{
+  f32x4 one = _mm_set1_ps(1.0f);
+  f32x4 scale = _mm_set1_ps(32767.0f);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    f32x4 nx = _mm_loadu_ps(src.x + i);
+    f32x4 ny = _mm_loadu_ps(src.y + i);
+    f32x4 nz = _mm_loadu_ps(src.z + i);
+
+    f32x4 inv_l1 = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(abs_f32(nx), abs_f32(ny)), abs_f32(nz)));
+    f32x4 x = _mm_mul_ps(nx, inv_l1);
+    f32x4 y = _mm_mul_ps(ny, inv_l1);
+
+    f32x4 folded_x = _mm_mul_ps(_mm_sub_ps(one, abs_f32(y)), sign_not_zero(x));
+    f32x4 folded_y = _mm_mul_ps(_mm_sub_ps(one, abs_f32(x)), sign_not_zero(y));
+    __m128i lower_half = _mm_castps_si128(_mm_cmplt_ps(nz, _mm_setzero_ps()));
+    x = select_f32(lower_half, folded_x, x);
+    y = select_f32(lower_half, folded_y, y);
+
+    __m128i xi = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(x), scale));
+    __m128i yi = _mm_cvtps_epi32(_mm_mul_ps(clamp_snorm(y), scale));
+    __m128i packed = _mm_or_si128(_mm_and_si128(xi, _mm_set1_epi32(0xFFFF)), _mm_slli_epi32(yi, 16));
+    _mm_storeu_si128((__m128i*)(dst + i), packed);
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = pack_oct_snorm16(Vec3(src.x[i], src.y[i], src.z[i]));
+  }
+}
+
+void
+batch_unpack_oct_snorm16(const u32* src, Vec3Soa dst, size_t count)
+{
+  f32x4 one = _mm_set1_ps(1.0f);
+  f32x4 zero = _mm_setzero_ps();
+  f32x4 sign_bit = _mm_set1_ps(-0.0f);
+  f32x4 inv_scale = _mm_set1_ps(1.0f / 32767.0f);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i packed = _mm_loadu_si128((const __m128i*)(src + i));
+    f32x4 ex = snorm_to_f32(_mm_srai_epi32(_mm_slli_epi32(packed, 16), 16), inv_scale);
+    f32x4 ey = snorm_to_f32(_mm_srai_epi32(packed, 16), inv_scale);
+
+    f32x4 z = _mm_sub_ps(_mm_sub_ps(one, abs_f32(ex)), abs_f32(ey));
+    f32x4 t = _mm_max_ps(_mm_xor_ps(z, sign_bit), zero);
+    f32x4 neg_t = _mm_xor_ps(t, sign_bit);
+    f32x4 x = _mm_add_ps(ex, select_f32(_mm_castps_si128(_mm_cmpge_ps(ex, zero)), neg_t, t));
+    f32x4 y = _mm_add_ps(ey, select_f32(_mm_castps_si128(_mm_cmpge_ps(ey, zero)), neg_t, t));
+
+    f32x4 length_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    f32x4 inv_length = _mm_div_ps(one, _mm_sqrt_ps(length_sq));
+    _mm_storeu_ps(dst.x + i, _mm_mul_ps(x, inv_length));
+    _mm_storeu_ps(dst.y + i, _mm_mul_ps(y, inv_length));
+    _mm_storeu_ps(dst.z + i, _mm_mul_ps(z, inv_length));
+  }
+
+  for (; i < count; i++)
+  {
+    Vec3 n = unpack_oct_snorm16(src[i]);
+    dst.x[i] = n.x;
+    dst.y[i] = n.y;
+    dst.z[i] = n.z;
+  }
+}
+
+// f32_to_small_float without the overflow case, since everything gets clamped to the largest
+// finite value first.
+template <u32 kMantissaBits>
+static __m128i
+f32_to_small_float_x4(f32x4 v)
+{
+  constexpr u32 kShift = 23 - kMantissaBits;
+  constexpr u32 kMinNormal = (127 - 14) << 23;
+  constexpr u32 kDenormMagic = ((127 - 15) + kShift + 1) << 23;
+
+  __m128i bits = _mm_castps_si128(v);
+  __m128i denormal_bits = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(v, _mm_castsi128_ps(_mm_set1_epi32(kDenormMagic)))),
+                                        _mm_set1_epi32(kDenormMagic));
+
+  __m128i mantissa_odd = _mm_and_si128(_mm_srli_epi32(bits, kShift), _mm_set1_epi32(1));
+  __m128i rounded = _mm_add_epi32(bits, _mm_set1_epi32(s32((u32(15 - 127) << 23) + (1u << (kShift - 1)) - 1)));
+  __m128i normal_bits = _mm_srli_epi32(_mm_add_epi32(rounded, mantissa_odd), kShift);
+
+  __m128i is_denormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(kMinNormal));
+  return select_u32(is_denormal, denormal_bits, normal_bits);
+}
+
+template <u32 kMantissaBits>
+static f32x4
+small_float_to_f32_x4(__m128i bits)
+{
+  constexpr u32 kShift = 23 - kMantissaBits;
+  __m128i exponent_mask = _mm_set1_epi32(0x1F << 23);
+
+  __m128i ret = _mm_slli_epi32(bits, kShift);
+  __m128i exponent = _mm_and_si128(ret, exponent_mask);
+  ret = _mm_add_epi32(ret, _mm_set1_epi32((127 - 15) << 23));
+
+  __m128i is_inf_nan = _mm_cmpeq_epi32(exponent, exponent_mask);
+  ret = _mm_add_epi32(ret, _mm_and_si128(is_inf_nan, _mm_set1_epi32((128 - 16) << 23)));
+
+  __m128i is_denormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+  f32x4 denormal = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(ret, _mm_set1_epi32(1 << 23))),
+                              _mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+  return select_f32(is_denormal, denormal, _mm_castsi128_ps(ret));
+}
+
+static f32x4
+clamp_unsigned(f32x4 v, f32 max)
+{
+  // maxps returns its second operand when the first is NaN, same as MAX(v, 0).
+  return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(max));
+}
+
+void
+batch_pack_r11g11b10(Vec3Soa src, u32* dst, size_t count)
+{
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i r = f32_to_small_float_x4<6>(clamp_unsigned(_mm_loadu_ps(src.x + i), kMaxR11G11Float));
+    __m128i g = f32_to_small_float_x4<6>(clamp_unsigned(_mm_loadu_ps(src.y + i), kMaxR11G11Float));
+    __m128i b = f32_to_small_float_x4<5>(clamp_unsigned(_mm_loadu_ps(src.z + i), kMaxB10Float));
+    __m128i packed = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 11)), _mm_slli_epi32(b, 22));
+    _mm_storeu_si128((__m128i*)(dst + i), packed);
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = pack_r11g11b10(Vec3(src.x[i], src.y[i], src.z[i]));
+  }
+}
+
+void
+batch_unpack_r11g11b10(const u32* src, Vec3Soa dst, size_t count)
+{
+  __m128i mask = _mm_set1_epi32(0x7FF);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i packed = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_ps(dst.x + i, small_float_to_f32_x4<6>(_mm_and_si128(packed, mask)));
+    _mm_storeu_ps(dst.y + i, small_float_to_f32_x4<6>(_mm_and_si128(_mm_srli_epi32(packed, 11), mask)));
+    _mm_storeu_ps(dst.z + i, small_float_to_f32_x4<5>(_mm_srli_epi32(packed, 22)));
+  }
+
+  for (; i < count; i++)
+  {
+    Vec3 v = unpack_r11g11b10(src[i]);
+    dst.x[i] = v.x;
+    dst.y[i] = v.y;
+    dst.z[i] = v.z;
+  }
+}
+
+void
+batch_pack_rgb9e5(Vec3Soa src, u32* dst, size_t count)
+{
+  f32x4 half = _mm_set1_ps(0.5f);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    f32x4 r = clamp_unsigned(_mm_loadu_ps(src.x + i), kMaxRgb9e5);
+    f32x4 g = clamp_unsigned(_mm_loadu_ps(src.y + i), kMaxRgb9e5);
+    f32x4 b = clamp_unsigned(_mm_loadu_ps(src.z + i), kMaxRgb9e5);
+    f32x4 max_channel = _mm_max_ps(_mm_max_ps(r, g), b);
+
+    __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(max_channel), 23), _mm_set1_epi32(127));
+    __m128i min_exponent = _mm_set1_epi32(-16);
+    exponent = select_u32(_mm_cmpgt_epi32(exponent, min_exponent), exponent, min_exponent);
+    exponent = _mm_add_epi32(exponent, _mm_set1_epi32(16));
+    f32x4 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127 + 24), exponent), 23));
+
+    __m128i max_mantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(max_channel, scale), half));
+    __m128i rounded_up = _mm_cmpeq_epi32(max_mantissa, _mm_set1_epi32(512));
+    exponent = _mm_sub_epi32(exponent, rounded_up);
+    scale = _mm_mul_ps(scale, select_f32(rounded_up, half, _mm_set1_ps(1.0f)));
+
+    __m128i rm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+    __m128i gm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+    __m128i bm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+    __m128i packed = _mm_or_si128(_mm_or_si128(rm, _mm_slli_epi32(gm, 9)),
+                                  _mm_or_si128(_mm_slli_epi32(bm, 18), _mm_slli_epi32(exponent, 27)));
+    _mm_storeu_si128((__m128i*)(dst + i), packed);
+  }
+
+  for (; i < count; i++)
+  {
+    dst[i] = pack_rgb9e5(Vec3(src.x[i], src.y[i], src.z[i]));
+  }
+}
+
+void
+batch_unpack_rgb9e5(const u32* src, Vec3Soa dst, size_t count)
+{
+  __m128i mask = _mm_set1_epi32(0x1FF);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i packed = _mm_loadu_si128((const __m128i*)(src + i));
+    f32x4 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_srli_epi32(packed, 27), _mm_set1_epi32(127 - 24)), 23));
+    _mm_storeu_ps(dst.x + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(packed, mask)), scale));
+    _mm_storeu_ps(dst.y + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 9), mask)), scale));
+    _mm_storeu_ps(dst.z + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 18), mask)), scale));
+  }
+
+  for (; i < count; i++)
+  {
+    Vec3 v = unpack_rgb9e5(src[i]);
+    dst.x[i] = v.x;
+    dst.y[i] = v.y;
+    dst.z[i] = v.z;
+  }
+}
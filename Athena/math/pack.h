@@ -0,0 +1,239 @@
+#pragma once
+#include "math.h"
+
+struct Vec3Soa;
+
+// Conversions between f32 and the smaller formats vertex and texture data gets stored in:
+// halfs, snorm8/16, octahedral normals, and the R11G11B10_FLOAT and R9G9B9E5_SHAREDEXP texture
+// formats. The scalar functions are the reference; the batch_ functions give bit-for-bit the
+// same results, just a register at a time.
+//
+// Everything rounds to nearest even like the GPU does. Halfs follow IEEE: too big becomes inf,
+// and NaN stays NaN. The unsigned float formats are meant for lighting, where an inf or NaN in
+// a baked texture is a bug rather than a value worth keeping, so negatives and NaNs become 0 and
+// anything too big becomes the largest finite value.
+
+// The bits of a float and back, without going through memory.
+inline u32 f32_bits(f32 v) { return u32(_mm_cvtsi128_si32(_mm_castps_si128(_mm_set_ss(v)))); }
+inline f32 f32_from_bits(u32 bits) { return _mm_cvtss_f32(_mm_castsi128_ps(_mm_cvtsi32_si128(s32(bits)))); }
+
+// Rounds to nearest even, the same as cvtps_epi32 does with the default rounding mode.
+inline s32 round_to_s32(f32 v) { return _mm_cvtss_si32(_mm_set_ss(v)); }
+
+// Any float format with a 5 bit exponent (bias 15) and kMantissaBits of mantissa, which covers
+// the half and all three channels of R11G11B10. The sign is left to the caller. `v` has to be
+// positive or zero and not NaN.
+//
+// The exponent gets rebiased with integer math, and the FPU does the rounding of denormals by
+// adding a magic number whose ulp is exactly the smallest denormal of the small format.
+template <u32 kMantissaBits>
+inline u32
+f32_to_small_float(f32 v)
+{
+  constexpr u32 kShift = 23 - kMantissaBits;
+  // 2^16, the smallest float that doesn't fit in any finite value.
+  constexpr u32 kOverflow = (127 + 16) << 23;
+  // 2^-14, the smallest normal.
+  constexpr u32 kMinNormal = (127 - 14) << 23;
+  constexpr u32 kDenormMagic = ((127 - 15) + kShift + 1) << 23;
+
+  u32 bits = f32_bits(v);
+  if (bits >= kOverflow)
+  {
+    return bits > (255u << 23) ? (0x1Fu << kMantissaBits) | (1u << (kMantissaBits - 1)) : 0x1Fu << kMantissaBits;
+  }
+
+  if (bits < kMinNormal)
+  {
+    return f32_bits(v + f32_from_bits(kDenormMagic)) - kDenormMagic;
+  }
+
+  u32 mantissa_odd = (bits >> kShift) & 1;
+  bits += (u32(15 - 127) << 23) + (1u << (kShift - 1)) - 1 + mantissa_odd;
+  return bits >> kShift;
+}
+
+template <u32 kMantissaBits>
+inline f32
+small_float_to_f32(u32 bits)
+{
+  constexpr u32 kShift = 23 - kMantissaBits;
+  constexpr u32 kExponentMask = 0x1Fu << 23;
+
+  u32 ret = bits << kShift;
+  u32 exponent = ret & kExponentMask;
+  ret += u32(127 - 15) << 23;
+  if (exponent == kExponentMask)
+  {
+    // Inf and NaN, the exponent has to go all the way up to 255.
+    ret += u32(128 - 16) << 23;
+  }
+  else if (exponent == 0)
+  {
+    // Denormal, renormalized by the FPU.
+    return f32_from_bits(ret + (1u << 23)) - f32_from_bits(113u << 23);
+  }
+  return f32_from_bits(ret);
+}
+
+inline u16
+f32_to_f16(f32 v)
+{
+  u32 sign = f32_bits(v) & 0x80000000u;
+  return u16((sign >> 16) | f32_to_small_float<10>(f32_from_bits(f32_bits(v) ^ sign)));
+}
+
+inline f32
+f16_to_f32(u16 v)
+{
+  return f32_from_bits(f32_bits(small_float_to_f32<10>(v & 0x7FFFu)) | (u32(v & 0x8000u) << 16));
+}
+
+// Clamped to [-1, 1]. -128 and -32768 are never produced, and both decode to -1 like they do
+// on the GPU.
+inline s8
+f32_to_snorm8(f32 v)
+{
+  return s8(round_to_s32(MIN(MAX(v, -1.0f), 1.0f) * 127.0f));
+}
+
+inline f32
+snorm8_to_f32(s8 v)
+{
+  return MAX(f32(v) * (1.0f / 127.0f), -1.0f);
+}
+
+inline s16
+f32_to_snorm16(f32 v)
+{
+  return s16(round_to_s32(MIN(MAX(v, -1.0f), 1.0f) * 32767.0f));
+}
+
+inline f32
+snorm16_to_f32(s16 v)
+{
+  return MAX(f32(v) * (1.0f / 32767.0f), -1.0f);
+}
+
+// Octahedral normal encoding (Cigolle et al., "A Survey of Efficient Representations for
+// Independent Unit Vectors"). The sphere gets projected onto an octahedron and unfolded into
+// the [-1, 1] square, which spends the bits far more evenly than storing x and y does.
+inline Vec2
+oct_encode(Vec3 n)
+{
+  f32 inv_l1 = 1.0f / (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+  f32 x = n.x * inv_l1;
+  f32 y = n.y * inv_l1;
+  if (n.z < 0.0f)
+  {
+    f32 folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    f32 folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = folded_x;
+    y = folded_y;
+  }
+  return Vec2(x, y);
+}
+
+inline Vec3
+oct_decode(Vec2 e)
+{
+  f32 z = 1.0f - fabsf(e.x) - fabsf(e.y);
+  f32 t = MAX(-z, 0.0f);
+  f32 x = e.x + (e.x >= 0.0f ? -t : t);
+  f32 y = e.y + (e.y >= 0.0f ? -t : t);
+  f32 inv_length = 1.0f / sqrtf(x * x + y * y + z * z);
+  return Vec3(x * inv_length, y * inv_length, z * inv_length);
+}
+
+// Two snorm16s, x in the low half. Good to about 0.003 degrees.
+inline u32
+pack_oct_snorm16(Vec3 n)
+{
+  Vec2 e = oct_encode(n);
+  return u32(u16(f32_to_snorm16(e.x))) | (u32(u16(f32_to_snorm16(e.y))) << 16);
+}
+
+inline Vec3
+unpack_oct_snorm16(u32 packed)
+{
+  return oct_decode(Vec2(snorm16_to_f32(s16(packed & 0xFFFF)), snorm16_to_f32(s16(packed >> 16))));
+}
+
+// The largest finite R11G11B10 channels: 65024 for the 11 bit ones and 64512 for the 10 bit one.
+constant f32 kMaxR11G11Float = 65024.0f;
+constant f32 kMaxB10Float    = 64512.0f;
+
+// DXGI_FORMAT_R11G11B10_FLOAT, r in the low bits.
+inline u32
+pack_r11g11b10(Vec3 v)
+{
+  // MAX(v, 0) also turns NaNs into 0, since NaN > 0 is false.
+  u32 r = f32_to_small_float<6>(MIN(MAX(v.x, 0.0f), kMaxR11G11Float));
+  u32 g = f32_to_small_float<6>(MIN(MAX(v.y, 0.0f), kMaxR11G11Float));
+  u32 b = f32_to_small_float<5>(MIN(MAX(v.z, 0.0f), kMaxB10Float));
+  return r | (g << 11) | (b << 22);
+}
+
+inline Vec3
+unpack_r11g11b10(u32 packed)
+{
+  return Vec3(small_float_to_f32<6>(packed & 0x7FF),
+              small_float_to_f32<6>((packed >> 11) & 0x7FF),
+              small_float_to_f32<5>(packed >> 22));
+}
+
+// (2^9 - 1) / 2^9 * 2^(31 - 15)
+constant f32 kMaxRgb9e5 = 65408.0f;
+
+// DXGI_FORMAT_R9G9B9E5_SHAREDEXP, 9 bits of mantissa per channel and a shared 5 bit exponent
+// picked for the largest channel. The smaller channels lose precision relative to the largest,
+// which is usually fine for colors. Same algorithm as the D3D spec and EXT_texture_shared_exponent.
+inline u32
+pack_rgb9e5(Vec3 v)
+{
+  f32 r = MIN(MAX(v.x, 0.0f), kMaxRgb9e5);
+  f32 g = MIN(MAX(v.y, 0.0f), kMaxRgb9e5);
+  f32 b = MIN(MAX(v.z, 0.0f), kMaxRgb9e5);
+  f32 max_channel = MAX(MAX(r, g), b);
+
+  // floor(log2(max_channel)) straight out of the exponent bits, which is exact, unlike log2f.
+  s32 exponent = MAX(s32(f32_bits(max_channel) >> 23) - 127, -16) + 16;
+  // 1 / 2^(exponent - 15 - 9)
+  f32 scale = f32_from_bits(u32(127 + 24 - exponent) << 23);
+  if (u32(max_channel * scale + 0.5f) == 512)
+  {
+    exponent++;
+    scale *= 0.5f;
+  }
+
+  u32 rm = u32(r * scale + 0.5f);
+  u32 gm = u32(g * scale + 0.5f);
+  u32 bm = u32(b * scale + 0.5f);
+  return rm | (gm << 9) | (bm << 18) | (u32(exponent) << 27);
+}
+
+inline Vec3
+unpack_rgb9e5(u32 packed)
+{
+  f32 scale = f32_from_bits(((packed >> 27) + 127 - 24) << 23);
+  return Vec3(f32(packed & 0x1FF) * scale, f32((packed >> 9) & 0x1FF) * scale, f32((packed >> 18) & 0x1FF) * scale);
+}
+
+// Halfs go through F16C when the CPU has it (8 or 16 at a time depending on get_simd_level()),
+// and one at a time otherwise. Everything else is SSE2, 4 values a time.
+void batch_f32_to_f16(const f32* src, u16* dst, size_t count);
+void batch_f16_to_f32(const u16* src, f32* dst, size_t count);
+
+void batch_f32_to_snorm8(const f32* src, s8* dst, size_t count);
+void batch_snorm8_to_f32(const s8* src, f32* dst, size_t count);
+void batch_f32_to_snorm16(const f32* src, s16* dst, size_t count);
+void batch_snorm16_to_f32(const s16* src, f32* dst, size_t count);
+
+void batch_pack_oct_snorm16(Vec3Soa src, u32* dst, size_t count);
+void batch_unpack_oct_snorm16(const u32* src, Vec3Soa dst, size_t count);
+
+void batch_pack_r11g11b10(Vec3Soa src, u32* dst, size_t count);
+void batch_unpack_r11g11b10(const u32* src, Vec3Soa dst, size_t count);
+
+void batch_pack_rgb9e5(Vec3Soa src, u32* dst, size_t count);
+void batch_unpack_rgb9e5(const u32* src, Vec3Soa dst, size_t count);
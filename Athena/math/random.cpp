@@ -0,0 +1,201 @@
+#include "random.h"
+#include "simd.h"
+#include "../atomics.h"
+
+// Arbitrary, just has to be the same every run.
+constant u64 kThreadRngSeed = 0x9E3779B97F4A7C15ull;
+
+static Atomic<u64> g_thread_rng_streams = 0;
+thread_local Pcg32 tls_rng;
+thread_local bool tls_rng_initialized = false;
+
+Pcg32*
+get_thread_rng()
+{
+  if (!tls_rng_initialized)
+  {
+    tls_rng = init_pcg32(kThreadRngSeed, atomic_fetch_add(&g_thread_rng_streams, 1, kMemoryOrderRelaxed));
+    tls_rng_initialized = true;
+  }
+  return &tls_rng;
+}
+
+static u64
+splitmix64(u64* state)
+{
+  u64 z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+RandomStreams
+init_random_streams(u64 seed)
+{
+  RandomStreams ret;
+  u64 state = seed;
+  for (u32 lane = 0; lane < kRandomStreamLanes; lane++)
+  {
+    u64 a = splitmix64(&state);
+    u64 b = splitmix64(&state);
+    ret.s[0][lane] = u32(a);
+    ret.s[1][lane] = u32(a >> 32);
+    ret.s[2][lane] = u32(b);
+    ret.s[3][lane] = u32(b >> 32);
+  }
+  return ret;
+}
+
+// Just enough 32 bit integer ops for xoshiro128+, at each width.
+static u32x4  load_u32(const u32* src, u32x4)  { return _mm_loadu_si128((const __m128i*)src); }
+static u32x8  load_u32(const u32* src, u32x8)  { return _mm256_loadu_si256((const __m256i*)src); }
+static u32x16 load_u32(const u32* src, u32x16) { return _mm512_loadu_si512(src); }
+
+static void store_u32(u32* dst, u32x4 v)  { _mm_storeu_si128((__m128i*)dst, v); }
+static void store_u32(u32* dst, u32x8 v)  { _mm256_storeu_si256((__m256i*)dst, v); }
+static void store_u32(u32* dst, u32x16 v) { _mm512_storeu_si512(dst, v); }
+
+static u32x4  add_u32(u32x4 a, u32x4 b)   { return _mm_add_epi32(a, b); }
+static u32x8  add_u32(u32x8 a, u32x8 b)   { return _mm256_add_epi32(a, b); }
+static u32x16 add_u32(u32x16 a, u32x16 b) { return _mm512_add_epi32(a, b); }
+
+static u32x4  xor_u32(u32x4 a, u32x4 b)   { return _mm_xor_si128(a, b); }
+static u32x8  xor_u32(u32x8 a, u32x8 b)   { return _mm256_xor_si256(a, b); }
+static u32x16 xor_u32(u32x16 a, u32x16 b) { return _mm512_xor_si512(a, b); }
+
+template <int kBits> static u32x4  shl_u32(u32x4 v)  { return _mm_slli_epi32(v, kBits); }
+template <int kBits> static u32x8  shl_u32(u32x8 v)  { return _mm256_slli_epi32(v, kBits); }
+template <int kBits> static u32x16 shl_u32(u32x16 v) { return _mm512_slli_epi32(v, kBits); }
+
+template <int kBits> static u32x4  rotl_u32(u32x4 v)  { return _mm_or_si128(_mm_slli_epi32(v, kBits), _mm_srli_epi32(v, 32 - kBits)); }
+template <int kBits> static u32x8  rotl_u32(u32x8 v)  { return _mm256_or_si256(_mm256_slli_epi32(v, kBits), _mm256_srli_epi32(v, 32 - kBits)); }
+template <int kBits> static u32x16 rotl_u32(u32x16 v) { return _mm512_rol_epi32(v, kBits); }
+
+// min + (bits >> 8) * 2^-24 * (max - min), the same conversion as pcg32_next_f32. Not fused
+// at any width, so that every level rounds the same way.
+static void
+store_f32(f32* dst, u32x4 bits, f32 min, f32 scale)
+{
+  f32x4 unit = _mm_cvtepi32_ps(_mm_srli_epi32(bits, 8));
+  _mm_storeu_ps(dst, _mm_add_ps(_mm_set1_ps(min), _mm_mul_ps(unit, _mm_set1_ps(scale))));
+}
+
+static void
+store_f32(f32* dst, u32x8 bits, f32 min, f32 scale)
+{
+  f32x8 unit = _mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8));
+  _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_set1_ps(min), _mm256_mul_ps(unit, _mm256_set1_ps(scale))));
+}
+
+static void
+store_f32(f32* dst, u32x16 bits, f32 min, f32 scale)
+{
+  f32x16 unit = _mm512_cvtepi32_ps(_mm512_srli_epi32(bits, 8));
+  _mm512_storeu_ps(dst, _mm512_add_ps(_mm512_set1_ps(min), _mm512_mul_ps(unit, _mm512_set1_ps(scale))));
+}
+
+// All 16 lanes of state stay in registers for the whole fill, in groups of whatever the
+// register width is. Each step writes 16 consecutive outputs, one per lane, which is what
+// makes the output the same no matter how wide the groups are.
+template <typename U, bool kFloat>
+static void
+random_streams_kernel(RandomStreams* streams, void* out, size_t count, f32 min, f32 max)
+{
+  constexpr u32 kWidth = sizeof(U) / sizeof(u32);
+  constexpr u32 kGroups = kRandomStreamLanes / kWidth;
+
+  U s0[kGroups], s1[kGroups], s2[kGroups], s3[kGroups];
+  for (u32 group = 0; group < kGroups; group++)
+  {
+    s0[group] = load_u32(streams->s[0] + group * kWidth, U());
+    s1[group] = load_u32(streams->s[1] + group * kWidth, U());
+    s2[group] = load_u32(streams->s[2] + group * kWidth, U());
+    s3[group] = load_u32(streams->s[3] + group * kWidth, U());
+  }
+
+  f32 scale = (max - min) * (1.0f / 16777216.0f);
+  auto step = [&](u32 group, void* dst)
+  {
+    U result = add_u32(s0[group], s3[group]);
+    if constexpr (kFloat)
+      store_f32((f32*)dst, result, min, scale);
+    else
+      store_u32((u32*)dst, result);
+
+    U t = shl_u32<9>(s1[group]);
+    s2[group] = xor_u32(s2[group], s0[group]);
+    s3[group] = xor_u32(s3[group], s1[group]);
+    s1[group] = xor_u32(s1[group], s2[group]);
+    s0[group] = xor_u32(s0[group], s3[group]);
+    s2[group] = xor_u32(s2[group], t);
+    s3[group] = rotl_u32<11>(s3[group]);
+  };
+
+  // Both outputs are 4 bytes per value.
+  u32* dst = (u32*)out;
+  size_t i = 0;
+  for (; i + kRandomStreamLanes <= count; i += kRandomStreamLanes)
+  {
+    for (u32 group = 0; group < kGroups; group++)
+    {
+      step(group, dst + i + group * kWidth);
+    }
+  }
+
+  if (i < count)
+  {
+    u32 leftover[kRandomStreamLanes];
+    for (u32 group = 0; group < kGroups; group++)
+    {
+      step(group, leftover + group * kWidth);
+    }
+    memcpy(dst + i, leftover, (count - i) * sizeof(u32));
+  }
+
+  for (u32 group = 0; group < kGroups; group++)
+  {
+    store_u32(streams->s[0] + group * kWidth, s0[group]);
+    store_u32(streams->s[1] + group * kWidth, s1[group]);
+    store_u32(streams->s[2] + group * kWidth, s2[group]);
+    store_u32(streams->s[3] + group * kWidth, s3[group]);
+  }
+
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+}
+
+typedef void (*RandomStreamsKernel)(RandomStreams* streams, void* out, size_t count, f32 min, f32 max);
+
+static const RandomStreamsKernel kRandomU32Kernels[kSimdLevelCount] =
+{
+  &random_streams_kernel<u32x4,  false>,
+  &random_streams_kernel<u32x8,  false>,
+  &random_streams_kernel<u32x16, false>,
+};
+
+static const RandomStreamsKernel kRandomF32Kernels[kSimdLevelCount] =
+{
+  &random_streams_kernel<u32x4,  true>,
+  &random_streams_kernel<u32x8,  true>,
+  &random_streams_kernel<u32x16, true>,
+};
+
+void
+batch_random_u32(RandomStreams* streams, u32* out, size_t count)
+{
+  kRandomU32Kernels[get_simd_level()](streams, out, count, 0.0f, 0.0f);
+}
+
+void
+batch_random_f32(RandomStreams* streams, f32* out, size_t count)
+{
+  kRandomF32Kernels[get_simd_level()](streams, out, count, 0.0f, 1.0f);
+}
+
+void
+batch_random_f32(RandomStreams* streams, f32 min, f32 max, f32* out, size_t count)
+{
+  kRandomF32Kernels[get_simd_level()](streams, out, count, min, max);
+}
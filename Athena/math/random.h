@@ -0,0 +1,194 @@
+#pragma once
+#include "math.h"
+
+// Random numbers and low-discrepancy sequences for the CPU side of the renderer (probe ray
+// rotations, jitter, sample patterns) and anything else that needs them.
+//
+// Pcg32 is the general purpose generator: 16 bytes of state, and whoever owns one gets the
+// same numbers out of it for the same seed, regardless of which thread it runs on. Use
+// get_thread_rng() when reproducibility doesn't matter and you just want something cheap
+// that no other thread is touching.
+//
+// RandomStreams is for filling big arrays. It's 16 xoshiro128+ generators side by side, one
+// per lane of the widest register, and the batch fills produce exactly the same numbers at
+// every SIMD level.
+//
+// The sequences do the same math as their HLSL versions in shaders/include/math.hlsli and
+// ddgi_common.hlsli, so a pattern generated on the CPU lines up with the one the shaders use
+// (up to the precision of the GPU's sin/cos).
+
+// PCG-XSH-RR, see https://www.pcg-random.org. Streams with different `stream` values are
+// independent of each other even with the same seed.
+struct Pcg32
+{
+  u64 state = 0x853C49E6748FEA9Bull;
+  u64 inc   = 0xDA3E39CB94B95BDBull;
+};
+
+inline u32
+pcg32_next_u32(Pcg32* rng)
+{
+  u64 old = rng->state;
+  rng->state = old * 6364136223846793005ull + rng->inc;
+  u32 xorshifted = u32(((old >> 18) ^ old) >> 27);
+  u32 rot = u32(old >> 59);
+  return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+}
+
+inline Pcg32
+init_pcg32(u64 seed, u64 stream = 0)
+{
+  Pcg32 ret;
+  ret.state = 0;
+  ret.inc = (stream << 1) | 1;
+  pcg32_next_u32(&ret);
+  ret.state += seed;
+  pcg32_next_u32(&ret);
+  return ret;
+}
+
+// [0, 1). The top 24 bits, so that every float that comes out is equally likely and 1.0 never
+// does (which converting all 32 bits would round up to).
+inline f32
+pcg32_next_f32(Pcg32* rng)
+{
+  return f32(pcg32_next_u32(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+// [min, max)
+inline f32
+pcg32_next_f32(Pcg32* rng, f32 min, f32 max)
+{
+  return min + pcg32_next_f32(rng) * (max - min);
+}
+
+// [0, bound), without the bias of a plain modulo. Lemire's multiply and reject, which almost
+// never has to reject anything.
+inline u32
+pcg32_next_bounded(Pcg32* rng, u32 bound)
+{
+  ASSERT(bound > 0);
+  u64 m = u64(pcg32_next_u32(rng)) * bound;
+  u32 low = u32(m);
+  if (low < bound)
+  {
+    u32 threshold = (0u - bound) % bound;
+    while (low < threshold)
+    {
+      m = u64(pcg32_next_u32(rng)) * bound;
+      low = u32(m);
+    }
+  }
+  return u32(m >> 32);
+}
+
+// A generator for the calling thread. Every thread gets its own stream the first time it asks,
+// so the numbers depend on which thread got there first. Own a Pcg32 for anything that should
+// come out the same every run.
+Pcg32* get_thread_rng();
+
+// Uniformly distributed over all rotations (Shoemake, "Uniform random rotations").
+inline Quat
+random_quat(Pcg32* rng)
+{
+  f32 u1 = pcg32_next_f32(rng);
+  f32 u2 = k2PI * pcg32_next_f32(rng);
+  f32 u3 = k2PI * pcg32_next_f32(rng);
+
+  f32 a = sqrtf(1.0f - u1);
+  f32 b = sqrtf(u1);
+  return Quat(b * cosf(u3), a * sinf(u2), a * cosf(u2), b * sinf(u3));
+}
+
+inline Mat4
+generate_random_rotation(Pcg32* rng)
+{
+  return quat_to_mat4(random_quat(rng));
+}
+
+constant u32 kRandomStreamLanes = 16;
+
+// xoshiro128+ state, one generator per lane. s[i][lane] is word i of that lane's state.
+struct alignas(64) RandomStreams
+{
+  u32 s[4][kRandomStreamLanes];
+};
+
+// Every lane gets seeded from splitmix64, so nearby seeds still give unrelated streams.
+RandomStreams init_random_streams(u64 seed);
+
+// Lane L of the streams writes out[L], out[L + 16], out[L + 32]... When count isn't a multiple
+// of 16 the lanes past the end still get advanced, their values just get dropped.
+void batch_random_u32(RandomStreams* streams, u32* out, size_t count);
+// [0, 1), same as pcg32_next_f32.
+void batch_random_f32(RandomStreams* streams, f32* out, size_t count);
+// [min, max)
+void batch_random_f32(RandomStreams* streams, f32 min, f32 max, f32* out, size_t count);
+
+// The bits of index mirrored around the binary point, i.e. the van der Corput sequence. Also
+// the first dimension of Sobol.
+inline f32
+radical_inverse_base2(u32 index)
+{
+  u32 bits = index;
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+  bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+  bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+  bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+  return f32(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// The radical inverse in any base. Bases should be prime, and different for every dimension.
+inline f32
+halton(u32 index, u32 base)
+{
+  f32 inv_base = 1.0f / f32(base);
+  f32 fraction = inv_base;
+  f32 ret = 0.0f;
+  while (index > 0)
+  {
+    ret += fraction * f32(index % base);
+    index /= base;
+    fraction *= inv_base;
+  }
+  return ret;
+}
+
+// Bases 2 and 3. Skip index 0 if (0, 0) is a problem.
+inline Vec2
+halton_2d(u32 index)
+{
+  return Vec2(radical_inverse_base2(index), halton(index, 3));
+}
+
+// The first two dimensions of Sobol. Any power of two sized run starting at a multiple of its
+// size is perfectly stratified in both dimensions (a (0, 2)-sequence), which Halton isn't.
+inline Vec2
+sobol_2d(u32 index)
+{
+  // The second dimension's direction numbers are v_0 = 2^31, v_k = v_(k-1) ^ (v_(k-1) >> 1).
+  u32 bits = 0;
+  u32 v = 1u << 31;
+  for (u32 i = index; i != 0; i >>= 1, v ^= v >> 1)
+  {
+    if (i & 1)
+    {
+      bits ^= v;
+    }
+  }
+  return Vec2(radical_inverse_base2(index), f32(bits >> 8) * (1.0f / 16777216.0f));
+}
+
+// Evenly spread points on the unit sphere, same as the DDGI probe rays in ddgi_common.hlsli.
+inline Vec3
+spherical_fibonacci(f32 sample_idx, f32 num_samples)
+{
+  const f32 b = (sqrtf(5.0f) * 0.5f + 0.5f) - 1.0f;
+  f32 phi_fraction = sample_idx * b;
+  f32 phi = k2PI * (phi_fraction - floorf(phi_fraction));
+  f32 cos_theta = 1.0f - (2.0f * sample_idx + 1.0f) * (1.0f / num_samples);
+  f32 sin_theta = sqrtf(MAX(0.0f, MIN(1.0f, 1.0f - cos_theta * cos_theta)));
+
+  return Vec3(cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta);
+}
@@ -0,0 +1,241 @@
+#pragma once
+#include "simd.h"
+
+// Ray vs. triangle and ray vs. box tests for ray queries on the CPU, which everything else
+// (bvh.h) is built out of.
+//
+// Every test is a template over the lane type like the rest of simd.h, and works on whatever
+// is in the lanes: N rays against one broadcast triangle/box (packets), or one broadcast ray
+// against N triangles/boxes. With F = f32 it's just the single ray against a single triangle.
+//
+// Like aabb_frustum_distance, the tests don't return masks. They return a value per lane that
+// is >= 0 where the ray hits, so hits can be combined with simd_min and turned into a bitmask
+// with simd_nonnegative_mask. Degenerate cases (zero area triangles, rays parallel to the
+// plane) come out as NaN or negative, so they never hit.
+
+struct Ray
+{
+  Vec3 origin;
+  Vec3 direction;
+  // Only hits in [t_min, t_max] count, in units of the direction's length.
+  f32 t_min = 0.0f;
+  f32 t_max = F32_MAX;
+};
+
+template <typename F>
+struct RayxN
+{
+  Vec3xN<F> origin;
+  Vec3xN<F> direction;
+  // Infinite for components that are 0, which the slab test relies on.
+  Vec3xN<F> inv_direction;
+  F t_min;
+  F t_max;
+};
+
+template <typename F>
+inline RayxN<F>
+finish_ray(Vec3xN<F> origin, Vec3xN<F> direction, F t_min, F t_max)
+{
+  RayxN<F> ret;
+  ret.origin = origin;
+  ret.direction = direction;
+
+  F one = simd_set1<F>(1.0f);
+  ret.inv_direction = {simd_div(one, direction.x), simd_div(one, direction.y), simd_div(one, direction.z)};
+  ret.t_min = t_min;
+  ret.t_max = t_max;
+  return ret;
+}
+
+// The same ray in every lane.
+template <typename F>
+inline RayxN<F>
+broadcast_ray(const Ray& ray)
+{
+  return finish_ray<F>({simd_set1<F>(ray.origin.x), simd_set1<F>(ray.origin.y), simd_set1<F>(ray.origin.z)},
+                       {simd_set1<F>(ray.direction.x), simd_set1<F>(ray.direction.y), simd_set1<F>(ray.direction.z)},
+                       simd_set1<F>(ray.t_min),
+                       simd_set1<F>(ray.t_max));
+}
+
+// rays[0] in lane 0, rays[1] in lane 1... Lanes past `count` get a copy of the first ray with
+// a t_max of -1, so they can't hit anything.
+template <typename F>
+inline RayxN<F>
+load_rays(const Ray* rays, u32 count)
+{
+  constexpr u32 kWidth = SimdWidth<F>::kValue;
+  ASSERT(count > 0 && count <= kWidth);
+
+  f32 lanes[8][kWidth];
+  for (u32 lane = 0; lane < kWidth; lane++)
+  {
+    const Ray& ray = rays[lane < count ? lane : 0];
+    lanes[0][lane] = ray.origin.x;
+    lanes[1][lane] = ray.origin.y;
+    lanes[2][lane] = ray.origin.z;
+    lanes[3][lane] = ray.direction.x;
+    lanes[4][lane] = ray.direction.y;
+    lanes[5][lane] = ray.direction.z;
+    lanes[6][lane] = ray.t_min;
+    lanes[7][lane] = lane < count ? ray.t_max : -1.0f;
+  }
+
+  return finish_ray<F>({simd_load<F>(lanes[0]), simd_load<F>(lanes[1]), simd_load<F>(lanes[2])},
+                       {simd_load<F>(lanes[3]), simd_load<F>(lanes[4]), simd_load<F>(lanes[5])},
+                       simd_load<F>(lanes[6]),
+                       simd_load<F>(lanes[7]));
+}
+
+// Slab test against the box [box_min, box_max], clipped to [t_min, t_max]. t_enter gets where
+// the ray enters the box, which is t_min when it starts inside. A ray lying exactly in one of
+// the box's planes can go either way.
+//
+// The exit distance gets pushed out by the most the rounding can be off (Ize, "Robust BVH Ray
+// Traversal"), so a box that's flat in one axis, like the bounds of a single axis aligned
+// triangle, can't be missed by a ray that hits the triangle.
+template <typename F>
+inline F
+intersect_ray_aabb(const RayxN<F>& ray, Vec3xN<F> box_min, Vec3xN<F> box_max, F* t_enter)
+{
+  F tx0 = simd_mul(simd_sub(box_min.x, ray.origin.x), ray.inv_direction.x);
+  F tx1 = simd_mul(simd_sub(box_max.x, ray.origin.x), ray.inv_direction.x);
+  F ty0 = simd_mul(simd_sub(box_min.y, ray.origin.y), ray.inv_direction.y);
+  F ty1 = simd_mul(simd_sub(box_max.y, ray.origin.y), ray.inv_direction.y);
+  F tz0 = simd_mul(simd_sub(box_min.z, ray.origin.z), ray.inv_direction.z);
+  F tz1 = simd_mul(simd_sub(box_max.z, ray.origin.z), ray.inv_direction.z);
+
+  F t_near = simd_max(simd_max(simd_min(tx0, tx1), simd_min(ty0, ty1)), simd_max(simd_min(tz0, tz1), ray.t_min));
+  F t_far  = simd_min(simd_max(tx0, tx1), simd_max(ty0, ty1));
+  t_far = simd_min(simd_mul(simd_min(t_far, simd_max(tz0, tz1)), simd_set1<F>(1.0f + 2.0f * 3.0f * 0x1p-24f)), ray.t_max);
+
+  *t_enter = t_near;
+  return simd_sub(t_far, t_near);
+}
+
+// Möller–Trumbore, "Fast, Minimum Storage Ray/Triangle Intersection". Both sides of the
+// triangle count. u and v are the barycentric weights of v1 and v2, so the hit is at
+// v0 + u * (v1 - v0) + v * (v2 - v0).
+//
+// Cheap, but not watertight: a ray through an edge shared by two triangles can miss both of
+// them by a rounding error.
+template <typename F>
+inline F
+intersect_ray_triangle(const RayxN<F>& ray, Vec3xN<F> v0, Vec3xN<F> v1, Vec3xN<F> v2, F* t, F* u, F* v)
+{
+  Vec3xN<F> e1 = v1 - v0;
+  Vec3xN<F> e2 = v2 - v0;
+  Vec3xN<F> p = cross_f32(ray.direction, e2);
+  F inv_det = simd_div(simd_set1<F>(1.0f), dot_f32(e1, p));
+
+  Vec3xN<F> s = ray.origin - v0;
+  Vec3xN<F> q = cross_f32(s, e1);
+  *u = simd_mul(dot_f32(s, p), inv_det);
+  *v = simd_mul(dot_f32(ray.direction, q), inv_det);
+  *t = simd_mul(dot_f32(e2, q), inv_det);
+
+  F w = simd_sub(simd_sub(simd_set1<F>(1.0f), *u), *v);
+  F ret = simd_min(simd_min(*u, *v), w);
+  return simd_min(ret, simd_min(simd_sub(*t, ray.t_min), simd_sub(ray.t_max, *t)));
+}
+
+// What the watertight test needs per ray: which component points the most along the ray
+// (which becomes z), and the shear that lines the ray up with z.
+template <typename F>
+struct WatertightRayxN
+{
+  // The component that becomes z is x where kz_is_x >= 0, otherwise y where kz_is_y >= 0,
+  // otherwise z. The other two become x and y in order, wrapping around.
+  F kz_is_x;
+  F kz_is_y;
+  F shear_x;
+  F shear_y;
+  F shear_z;
+};
+
+// v with the components moved around so that the ray's dominant axis is z.
+template <typename F>
+inline Vec3xN<F>
+permute_for_ray(const WatertightRayxN<F>& ray, Vec3xN<F> v)
+{
+  Vec3xN<F> ret;
+  ret.x = simd_select_nonnegative(ray.kz_is_x, v.y, simd_select_nonnegative(ray.kz_is_y, v.z, v.x));
+  ret.y = simd_select_nonnegative(ray.kz_is_x, v.z, simd_select_nonnegative(ray.kz_is_y, v.x, v.y));
+  ret.z = simd_select_nonnegative(ray.kz_is_x, v.x, simd_select_nonnegative(ray.kz_is_y, v.y, v.z));
+  return ret;
+}
+
+template <typename F>
+inline WatertightRayxN<F>
+setup_watertight_ray(const RayxN<F>& ray)
+{
+  // |d| as max(d, -d).
+  F zero = simd_set1<F>(0.0f);
+  F abs_x = simd_max(ray.direction.x, simd_sub(zero, ray.direction.x));
+  F abs_y = simd_max(ray.direction.y, simd_sub(zero, ray.direction.y));
+  F abs_z = simd_max(ray.direction.z, simd_sub(zero, ray.direction.z));
+
+  WatertightRayxN<F> ret;
+  ret.kz_is_x = simd_min(simd_sub(abs_x, abs_y), simd_sub(abs_x, abs_z));
+  ret.kz_is_y = simd_sub(abs_y, abs_z);
+
+  Vec3xN<F> d = permute_for_ray(ret, ray.direction);
+  ret.shear_z = simd_div(simd_set1<F>(1.0f), d.z);
+  ret.shear_x = simd_mul(d.x, ret.shear_z);
+  ret.shear_y = simd_mul(d.y, ret.shear_z);
+  return ret;
+}
+
+// Woop, Benthin and Wald, "Watertight Ray/Triangle Intersection". The vertices get moved into
+// a space where the ray is the +z axis, and the edge functions are evaluated in 2D, so a ray
+// through a shared edge or vertex always hits at least one of the triangles around it. Same
+// outputs as intersect_ray_triangle.
+//
+// The paper redoes the edge functions in double precision when one of them comes out exactly
+// 0. That's skipped here: an exact 0 counts as inside, which keeps shared edges watertight and
+// at worst reports a hit on both triangles.
+template <typename F>
+inline F
+intersect_ray_triangle_watertight(const RayxN<F>& ray,
+                                  const WatertightRayxN<F>& watertight,
+                                  Vec3xN<F> v0,
+                                  Vec3xN<F> v1,
+                                  Vec3xN<F> v2,
+                                  F* t,
+                                  F* u,
+                                  F* v)
+{
+  Vec3xN<F> a = permute_for_ray(watertight, v0 - ray.origin);
+  Vec3xN<F> b = permute_for_ray(watertight, v1 - ray.origin);
+  Vec3xN<F> c = permute_for_ray(watertight, v2 - ray.origin);
+
+  F ax = simd_sub(a.x, simd_mul(watertight.shear_x, a.z));
+  F ay = simd_sub(a.y, simd_mul(watertight.shear_y, a.z));
+  F bx = simd_sub(b.x, simd_mul(watertight.shear_x, b.z));
+  F by = simd_sub(b.y, simd_mul(watertight.shear_y, b.z));
+  F cx = simd_sub(c.x, simd_mul(watertight.shear_x, c.z));
+  F cy = simd_sub(c.y, simd_mul(watertight.shear_y, c.z));
+
+  // Not fused, so that the edge function of a shared edge comes out as exactly the negative in
+  // the triangle on the other side of it. That's what makes this watertight.
+  F edge_u = simd_sub(simd_mul(cx, by), simd_mul(cy, bx));
+  F edge_v = simd_sub(simd_mul(ax, cy), simd_mul(ay, cx));
+  F edge_w = simd_sub(simd_mul(bx, ay), simd_mul(by, ax));
+  F det = simd_add(simd_add(edge_u, edge_v), edge_w);
+
+  F scaled_t = simd_madd(edge_w, simd_mul(watertight.shear_z, c.z),
+                         simd_madd(edge_v, simd_mul(watertight.shear_z, b.z),
+                                   simd_mul(edge_u, simd_mul(watertight.shear_z, a.z))));
+
+  F inv_det = simd_div(simd_set1<F>(1.0f), det);
+  *u = simd_mul(edge_v, inv_det);
+  *v = simd_mul(edge_w, inv_det);
+  *t = simd_mul(scaled_t, inv_det);
+
+  // All three edge functions have to have the same sign as the determinant. Flipping them by
+  // its sign turns that into all of them being >= 0.
+  F sign = simd_select_nonnegative(det, simd_set1<F>(1.0f), simd_set1<F>(-1.0f));
+  F ret = simd_min(simd_min(simd_mul(edge_u, sign), simd_mul(edge_v, sign)), simd_mul(edge_w, sign));
+  return simd_min(ret, simd_min(simd_sub(*t, ray.t_min), simd_sub(ray.t_max, *t)));
+}
@@ -0,0 +1,421 @@
+#include "simd.h"
+#include <intrin.h>
+
+static CpuFeatures
+query_cpu_features()
+{
+  CpuFeatures ret;
+
+  s32 regs[4];
+  __cpuid(regs, 0);
+  s32 max_leaf = regs[0];
+
+  __cpuid(regs, 1);
+  u32 ecx1 = u32(regs[2]);
+  ret.sse41 = (ecx1 & (1u << 19)) != 0;
+  bool fma     = (ecx1 & (1u << 12)) != 0;
+  bool osxsave = (ecx1 & (1u << 27)) != 0;
+  bool avx     = (ecx1 & (1u << 28)) != 0;
+  bool f16c    = (ecx1 & (1u << 29)) != 0;
+
+  // The CPU supporting AVX doesn't mean anything if the OS doesn't save the upper halves
+  // of the registers on a context switch, which is what XCR0 tells us.
+  u64 xcr0 = osxsave ? _xgetbv(0) : 0;
+  bool os_ymm = (xcr0 & 0x6) == 0x6;
+  bool os_zmm = (xcr0 & 0xE6) == 0xE6;
+
+  u32 ebx7 = 0;
+  if (max_leaf >= 7)
+  {
+    __cpuidex(regs, 7, 0);
+    ebx7 = u32(regs[1]);
+  }
+
+  ret.fma     = avx && os_ymm && fma;
+  ret.f16c    = avx && os_ymm && f16c;
+  ret.avx2    = avx && os_ymm && (ebx7 & (1u << 5)) != 0;
+  ret.avx512f = os_zmm && (ebx7 & (1u << 16)) != 0;
+
+  return ret;
+}
+
+const CpuFeatures&
+get_cpu_features()
+{
+  static const CpuFeatures s_features = query_cpu_features();
+  return s_features;
+}
+
+SimdLevel
+get_max_simd_level()
+{
+  const CpuFeatures& features = get_cpu_features();
+  if (features.avx512f && features.avx2 && features.fma)
+    return kSimdLevelAvx512;
+
+  if (features.avx2 && features.fma)
+    return kSimdLevelAvx2;
+
+  return kSimdLevelSse2;
+}
+
+const char*
+simd_level_name(SimdLevel level)
+{
+  switch (level)
+  {
+    case kSimdLevelSse2:   return "SSE2";
+    case kSimdLevelAvx2:   return "AVX2";
+    case kSimdLevelAvx512: return "AVX-512";
+    default: UNREACHABLE;
+  }
+  return nullptr;
+}
+
+Vec3Soa
+alloc_vec3_soa(MEMORY_ARENA_PARAM, size_t count)
+{
+  Vec3Soa ret;
+  ret.x = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.y = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.z = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  return ret;
+}
+
+Vec4Soa
+alloc_vec4_soa(MEMORY_ARENA_PARAM, size_t count)
+{
+  Vec4Soa ret;
+  ret.x = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.y = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.z = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.w = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  return ret;
+}
+
+QuatSoa
+alloc_quat_soa(MEMORY_ARENA_PARAM, size_t count)
+{
+  QuatSoa ret;
+  ret.w = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.x = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.y = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  ret.z = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * count, 64);
+  return ret;
+}
+
+// Every kernel is written once against Vec3xN<F>, and then gets run F wide for as much
+// of the stream as it can and one at a time (F = f32) for whatever is left over.
+template <typename F, typename Kernel>
+static void
+run_batch_kernel(size_t count, Kernel kernel)
+{
+  constexpr u32 kWidth = SimdWidth<F>::kValue;
+
+  size_t i = 0;
+  for (; i + kWidth <= count; i += kWidth)
+  {
+    kernel.template operator()<F>(i);
+  }
+
+  for (; i < count; i++)
+  {
+    kernel.template operator()<f32>(i);
+  }
+
+  // Going back to SSE code with dirty upper halves of the ymm/zmm registers stalls.
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+}
+
+// The matrix broadcast for both the wide part of a kernel and the leftovers, so that it
+// only gets broadcast once per batch rather than once per iteration.
+template <typename F>
+struct BatchMat4
+{
+  BatchMat4(const Mat4& m) : wide(broadcast_mat4<F>(m)), scalar(broadcast_mat4<f32>(m)) {}
+
+  template <typename G>
+  const Mat4xN<G>&
+  get() const
+  {
+    if constexpr (std::is_same_v<G, f32>)
+      return scalar;
+    else
+      return wide;
+  }
+
+  Mat4xN<F> wide;
+  Mat4xN<f32> scalar;
+};
+
+template <typename F>
+static void
+transform_points_kernel(const Mat4& m, Vec3Soa in, Vec3Soa out, size_t count)
+{
+  BatchMat4<F> mat(m);
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_vec3xn(out, i, transform_point(mat.template get<G>(), load_vec3xn<G>(in, i)));
+  });
+}
+
+template <typename F>
+static void
+transform_vec4_kernel(const Mat4& m, Vec4Soa in, Vec4Soa out, size_t count)
+{
+  BatchMat4<F> mat(m);
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_vec4xn(out, i, mat.template get<G>() * load_vec4xn<G>(in, i));
+  });
+}
+
+template <typename F>
+static void
+dot_vec3_kernel(Vec3Soa a, Vec3Soa b, f32* out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    simd_store(out + i, dot_f32(load_vec3xn<G>(a, i), load_vec3xn<G>(b, i)));
+  });
+}
+
+template <typename F>
+static void
+cross_vec3_kernel(Vec3Soa a, Vec3Soa b, Vec3Soa out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_vec3xn(out, i, cross_f32(load_vec3xn<G>(a, i), load_vec3xn<G>(b, i)));
+  });
+}
+
+template <typename F>
+static void
+normalize_vec3_kernel(Vec3Soa in, Vec3Soa out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_vec3xn(out, i, normalize_f32(load_vec3xn<G>(in, i)));
+  });
+}
+
+template <typename F>
+struct BatchFrustum
+{
+  BatchFrustum(const Frustum& f) : wide(broadcast_frustum<F>(f)), scalar(broadcast_frustum<f32>(f)) {}
+
+  template <typename G>
+  const FrustumxN<G>&
+  get() const
+  {
+    if constexpr (std::is_same_v<G, f32>)
+      return scalar;
+    else
+      return wide;
+  }
+
+  FrustumxN<F> wide;
+  FrustumxN<f32> scalar;
+};
+
+template <typename F>
+static void
+store_visible(u8* dst, F distance)
+{
+  u32 mask = simd_nonnegative_mask(distance);
+  for (u32 lane = 0; lane < SimdWidth<F>::kValue; lane++)
+  {
+    dst[lane] = u8((mask >> lane) & 1);
+  }
+}
+
+template <typename F>
+static void
+cull_aabbs_kernel(const Frustum& f, Vec3Soa centers, Vec3Soa extents, u8* visible, size_t count)
+{
+  BatchFrustum<F> frustum(f);
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    G distance = aabb_frustum_distance(frustum.template get<G>(), load_vec3xn<G>(centers, i), load_vec3xn<G>(extents, i));
+    store_visible(visible + i, distance);
+  });
+}
+
+template <typename F>
+static void
+cull_spheres_kernel(const Frustum& f, Vec3Soa centers, const f32* radii, u8* visible, size_t count)
+{
+  BatchFrustum<F> frustum(f);
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    G distance = sphere_frustum_distance(frustum.template get<G>(), load_vec3xn<G>(centers, i), simd_load<G>(radii + i));
+    store_visible(visible + i, distance);
+  });
+}
+
+template <typename F>
+static void
+rotate_vec3_kernel(QuatSoa q, Vec3Soa in, Vec3Soa out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_vec3xn(out, i, rotate_vec3_by_quat(load_vec3xn<G>(in, i), load_quatxn<G>(q, i)));
+  });
+}
+
+template <typename F>
+static void
+quat_mul_kernel(QuatSoa a, QuatSoa b, QuatSoa out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_quatxn(out, i, quat_mul(load_quatxn<G>(a, i), load_quatxn<G>(b, i)));
+  });
+}
+
+template <typename F>
+static void
+quat_nlerp_kernel(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_quatxn(out, i, quat_nlerp(load_quatxn<G>(a, i), load_quatxn<G>(b, i), simd_load<G>(t + i)));
+  });
+}
+
+template <typename F>
+static void
+quat_slerp_kernel(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count)
+{
+  run_batch_kernel<F>(count, [&]<typename G>(size_t i)
+  {
+    store_quatxn(out, i, quat_slerp(load_quatxn<G>(a, i), load_quatxn<G>(b, i), simd_load<G>(t + i)));
+  });
+}
+
+struct BatchMathKernels
+{
+  void (*transform_points)(const Mat4& m, Vec3Soa in, Vec3Soa out, size_t count);
+  void (*transform_vec4)(const Mat4& m, Vec4Soa in, Vec4Soa out, size_t count);
+  void (*dot_vec3)(Vec3Soa a, Vec3Soa b, f32* out, size_t count);
+  void (*cross_vec3)(Vec3Soa a, Vec3Soa b, Vec3Soa out, size_t count);
+  void (*normalize_vec3)(Vec3Soa in, Vec3Soa out, size_t count);
+  void (*cull_aabbs)(const Frustum& frustum, Vec3Soa centers, Vec3Soa extents, u8* visible, size_t count);
+  void (*cull_spheres)(const Frustum& frustum, Vec3Soa centers, const f32* radii, u8* visible, size_t count);
+  void (*rotate_vec3)(QuatSoa q, Vec3Soa in, Vec3Soa out, size_t count);
+  void (*quat_mul)(QuatSoa a, QuatSoa b, QuatSoa out, size_t count);
+  void (*quat_nlerp)(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count);
+  void (*quat_slerp)(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count);
+};
+
+template <typename F>
+static constexpr BatchMathKernels
+batch_math_kernels()
+{
+  return BatchMathKernels
+  {
+    .transform_points = &transform_points_kernel<F>,
+    .transform_vec4   = &transform_vec4_kernel<F>,
+    .dot_vec3         = &dot_vec3_kernel<F>,
+    .cross_vec3       = &cross_vec3_kernel<F>,
+    .normalize_vec3   = &normalize_vec3_kernel<F>,
+    .cull_aabbs       = &cull_aabbs_kernel<F>,
+    .cull_spheres     = &cull_spheres_kernel<F>,
+    .rotate_vec3      = &rotate_vec3_kernel<F>,
+    .quat_mul         = &quat_mul_kernel<F>,
+    .quat_nlerp       = &quat_nlerp_kernel<F>,
+    .quat_slerp       = &quat_slerp_kernel<F>,
+  };
+}
+
+static const BatchMathKernels kBatchMathKernels[kSimdLevelCount] =
+{
+  batch_math_kernels<f32x4>(),
+  batch_math_kernels<f32x8>(),
+  batch_math_kernels<f32x16>(),
+};
+
+static SimdLevel g_simd_level = get_max_simd_level();
+
+SimdLevel
+get_simd_level()
+{
+  return g_simd_level;
+}
+
+void
+set_simd_level(SimdLevel level)
+{
+  ASSERT(level <= get_max_simd_level());
+  g_simd_level = level;
+}
+
+void
+batch_transform_points(const Mat4& m, Vec3Soa in, Vec3Soa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].transform_points(m, in, out, count);
+}
+
+void
+batch_transform_vec4(const Mat4& m, Vec4Soa in, Vec4Soa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].transform_vec4(m, in, out, count);
+}
+
+void
+batch_dot_vec3(Vec3Soa a, Vec3Soa b, f32* out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].dot_vec3(a, b, out, count);
+}
+
+void
+batch_cross_vec3(Vec3Soa a, Vec3Soa b, Vec3Soa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].cross_vec3(a, b, out, count);
+}
+
+void
+batch_normalize_vec3(Vec3Soa in, Vec3Soa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].normalize_vec3(in, out, count);
+}
+
+void
+batch_cull_aabbs(const Frustum& frustum, Vec3Soa centers, Vec3Soa extents, u8* visible, size_t count)
+{
+  kBatchMathKernels[g_simd_level].cull_aabbs(frustum, centers, extents, visible, count);
+}
+
+void
+batch_cull_spheres(const Frustum& frustum, Vec3Soa centers, const f32* radii, u8* visible, size_t count)
+{
+  kBatchMathKernels[g_simd_level].cull_spheres(frustum, centers, radii, visible, count);
+}
+
+void
+batch_rotate_vec3(QuatSoa q, Vec3Soa in, Vec3Soa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].rotate_vec3(q, in, out, count);
+}
+
+void
+batch_quat_mul(QuatSoa a, QuatSoa b, QuatSoa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].quat_mul(a, b, out, count);
+}
+
+void
+batch_quat_nlerp(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].quat_nlerp(a, b, t, out, count);
+}
+
+void
+batch_quat_slerp(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count)
+{
+  kBatchMathKernels[g_simd_level].quat_slerp(a, b, t, out, count);
+}
@@ -0,0 +1,563 @@
+#pragma once
+#include "math.h"
+
+// Wide struct-of-arrays versions of the vector math in math.h, for when there's a whole lot of
+// the same operation to do (transforming every vertex in a mesh, normalizing every normal...).
+//
+// Vec3/Vec4 keep one vector in one register, so every dot/cross/length has to shuffle lanes
+// around. Vec3xN/Vec4xN instead keep N vectors in one register per component (all of the x's,
+// all of the y's...), so all of those become plain vertical adds and multiplies and every lane
+// is doing useful work.
+//
+// The batch_* functions run over whole SoA streams and pick the widest kernel the CPU
+// supports at runtime, so the engine itself doesn't have to be compiled for AVX2/AVX-512.
+
+enum SimdLevel : u8
+{
+  // 4 wide, which is the engine's baseline.
+  kSimdLevelSse2,
+  // 8 wide with FMA.
+  kSimdLevelAvx2,
+  // 16 wide with FMA.
+  kSimdLevelAvx512,
+
+  kSimdLevelCount,
+};
+
+struct CpuFeatures
+{
+  bool sse41   = false;
+  bool fma     = false;
+  bool f16c    = false;
+  // These are only set if the OS also saves the ymm/zmm registers.
+  bool avx2    = false;
+  bool avx512f = false;
+};
+
+// Queried once with CPUID and cached after that.
+const CpuFeatures& get_cpu_features();
+SimdLevel get_max_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+// Which kernels the batch_* functions use. Defaults to get_max_simd_level(), this is only
+// really here so that benchmarks and tests can compare the different levels.
+SimdLevel get_simd_level();
+void set_simd_level(SimdLevel level);
+
+template <typename F>
+struct SimdWidth;
+
+template <> struct SimdWidth<f32>    { static constexpr u32 kValue = 1;  };
+template <> struct SimdWidth<f32x4>  { static constexpr u32 kValue = 4;  };
+template <> struct SimdWidth<f32x8>  { static constexpr u32 kValue = 8;  };
+template <> struct SimdWidth<f32x16> { static constexpr u32 kValue = 16; };
+
+// Loads/stores are unaligned, on anything recent that costs nothing when the data happens
+// to be aligned anyway.
+template <typename F> F simd_load(const f32* src);
+template <> inline f32    simd_load<f32>(const f32* src)    { return *src; }
+template <> inline f32x4  simd_load<f32x4>(const f32* src)  { return _mm_loadu_ps(src); }
+template <> inline f32x8  simd_load<f32x8>(const f32* src)  { return _mm256_loadu_ps(src); }
+template <> inline f32x16 simd_load<f32x16>(const f32* src) { return _mm512_loadu_ps(src); }
+
+template <typename F> F simd_set1(f32 v);
+template <> inline f32    simd_set1<f32>(f32 v)    { return v; }
+template <> inline f32x4  simd_set1<f32x4>(f32 v)  { return _mm_set1_ps(v); }
+template <> inline f32x8  simd_set1<f32x8>(f32 v)  { return _mm256_set1_ps(v); }
+template <> inline f32x16 simd_set1<f32x16>(f32 v) { return _mm512_set1_ps(v); }
+
+inline void simd_store(f32* dst, f32 v)    { *dst = v; }
+inline void simd_store(f32* dst, f32x4 v)  { _mm_storeu_ps(dst, v); }
+inline void simd_store(f32* dst, f32x8 v)  { _mm256_storeu_ps(dst, v); }
+inline void simd_store(f32* dst, f32x16 v) { _mm512_storeu_ps(dst, v); }
+
+inline f32    simd_add(f32 a, f32 b)       { return a + b; }
+inline f32x4  simd_add(f32x4 a, f32x4 b)   { return _mm_add_ps(a, b); }
+inline f32x8  simd_add(f32x8 a, f32x8 b)   { return _mm256_add_ps(a, b); }
+inline f32x16 simd_add(f32x16 a, f32x16 b) { return _mm512_add_ps(a, b); }
+
+inline f32    simd_sub(f32 a, f32 b)       { return a - b; }
+inline f32x4  simd_sub(f32x4 a, f32x4 b)   { return _mm_sub_ps(a, b); }
+inline f32x8  simd_sub(f32x8 a, f32x8 b)   { return _mm256_sub_ps(a, b); }
+inline f32x16 simd_sub(f32x16 a, f32x16 b) { return _mm512_sub_ps(a, b); }
+
+inline f32    simd_mul(f32 a, f32 b)       { return a * b; }
+inline f32x4  simd_mul(f32x4 a, f32x4 b)   { return _mm_mul_ps(a, b); }
+inline f32x8  simd_mul(f32x8 a, f32x8 b)   { return _mm256_mul_ps(a, b); }
+inline f32x16 simd_mul(f32x16 a, f32x16 b) { return _mm512_mul_ps(a, b); }
+
+inline f32    simd_div(f32 a, f32 b)       { return a / b; }
+inline f32x4  simd_div(f32x4 a, f32x4 b)   { return _mm_div_ps(a, b); }
+inline f32x8  simd_div(f32x8 a, f32x8 b)   { return _mm256_div_ps(a, b); }
+inline f32x16 simd_div(f32x16 a, f32x16 b) { return _mm512_div_ps(a, b); }
+
+// a * b + c. The AVX2 and AVX-512 levels both imply FMA, so those are fused.
+inline f32    simd_madd(f32 a, f32 b, f32 c)          { return a * b + c; }
+inline f32x4  simd_madd(f32x4 a, f32x4 b, f32x4 c)    { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline f32x8  simd_madd(f32x8 a, f32x8 b, f32x8 c)    { return _mm256_fmadd_ps(a, b, c); }
+inline f32x16 simd_madd(f32x16 a, f32x16 b, f32x16 c) { return _mm512_fmadd_ps(a, b, c); }
+
+// a * b - c
+inline f32    simd_msub(f32 a, f32 b, f32 c)          { return a * b - c; }
+inline f32x4  simd_msub(f32x4 a, f32x4 b, f32x4 c)    { return _mm_sub_ps(_mm_mul_ps(a, b), c); }
+inline f32x8  simd_msub(f32x8 a, f32x8 b, f32x8 c)    { return _mm256_fmsub_ps(a, b, c); }
+inline f32x16 simd_msub(f32x16 a, f32x16 b, f32x16 c) { return _mm512_fmsub_ps(a, b, c); }
+
+inline f32    simd_sqrt(f32 a)    { return sqrtf(a); }
+inline f32x4  simd_sqrt(f32x4 a)  { return _mm_sqrt_ps(a); }
+inline f32x8  simd_sqrt(f32x8 a)  { return _mm256_sqrt_ps(a); }
+inline f32x16 simd_sqrt(f32x16 a) { return _mm512_sqrt_ps(a); }
+
+inline f32    simd_min(f32 a, f32 b)       { return a < b ? a : b; }
+inline f32x4  simd_min(f32x4 a, f32x4 b)   { return _mm_min_ps(a, b); }
+inline f32x8  simd_min(f32x8 a, f32x8 b)   { return _mm256_min_ps(a, b); }
+inline f32x16 simd_min(f32x16 a, f32x16 b) { return _mm512_min_ps(a, b); }
+
+inline f32    simd_max(f32 a, f32 b)       { return a > b ? a : b; }
+inline f32x4  simd_max(f32x4 a, f32x4 b)   { return _mm_max_ps(a, b); }
+inline f32x8  simd_max(f32x8 a, f32x8 b)   { return _mm256_max_ps(a, b); }
+inline f32x16 simd_max(f32x16 a, f32x16 b) { return _mm512_max_ps(a, b); }
+
+// Per lane, cond >= 0 ? a : b. NaNs count as negative.
+inline f32    simd_select_nonnegative(f32 cond, f32 a, f32 b) { return cond >= 0.0f ? a : b; }
+inline f32x4
+simd_select_nonnegative(f32x4 cond, f32x4 a, f32x4 b)
+{
+  f32x4 mask = _mm_cmpge_ps(cond, _mm_setzero_ps());
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+inline f32x8  simd_select_nonnegative(f32x8 cond, f32x8 a, f32x8 b)    { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(cond, _mm256_setzero_ps(), _CMP_GE_OQ)); }
+inline f32x16 simd_select_nonnegative(f32x16 cond, f32x16 a, f32x16 b) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(cond, _mm512_setzero_ps(), _CMP_GE_OQ), b, a); }
+
+// One bit per lane, set where the lane is >= 0. NaNs count as negative.
+inline u32 simd_nonnegative_mask(f32 a)    { return a >= 0.0f ? 1 : 0; }
+inline u32 simd_nonnegative_mask(f32x4 a)  { return u32(_mm_movemask_ps(_mm_cmpge_ps(a, _mm_setzero_ps()))); }
+inline u32 simd_nonnegative_mask(f32x8 a)  { return u32(_mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ))); }
+inline u32 simd_nonnegative_mask(f32x16 a) { return u32(_mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_GE_OQ)); }
+
+template <typename F>
+struct Vec3xN
+{
+  F x;
+  F y;
+  F z;
+};
+
+template <typename F>
+struct Vec4xN
+{
+  F x;
+  F y;
+  F z;
+  F w;
+};
+
+typedef Vec3xN<f32x4>  Vec3x4;
+typedef Vec3xN<f32x8>  Vec3x8;
+typedef Vec3xN<f32x16> Vec3x16;
+typedef Vec4xN<f32x4>  Vec4x4;
+typedef Vec4xN<f32x8>  Vec4x8;
+typedef Vec4xN<f32x16> Vec4x16;
+
+template <typename F>
+inline Vec3xN<F>
+operator+(Vec3xN<F> a, Vec3xN<F> b)
+{
+  return {simd_add(a.x, b.x), simd_add(a.y, b.y), simd_add(a.z, b.z)};
+}
+
+template <typename F>
+inline Vec3xN<F>
+operator-(Vec3xN<F> a, Vec3xN<F> b)
+{
+  return {simd_sub(a.x, b.x), simd_sub(a.y, b.y), simd_sub(a.z, b.z)};
+}
+
+template <typename F>
+inline Vec3xN<F>
+operator*(Vec3xN<F> a, F scale)
+{
+  return {simd_mul(a.x, scale), simd_mul(a.y, scale), simd_mul(a.z, scale)};
+}
+
+template <typename F>
+inline F
+dot_f32(Vec3xN<F> a, Vec3xN<F> b)
+{
+  return simd_madd(a.z, b.z, simd_madd(a.y, b.y, simd_mul(a.x, b.x)));
+}
+
+template <typename F>
+inline F
+dot_f32(Vec4xN<F> a, Vec4xN<F> b)
+{
+  return simd_madd(a.w, b.w, simd_madd(a.z, b.z, simd_madd(a.y, b.y, simd_mul(a.x, b.x))));
+}
+
+// No shuffles needed (unlike cross_f32(f32x4, f32x4)), since the components are already
+// in separate registers.
+template <typename F>
+inline Vec3xN<F>
+cross_f32(Vec3xN<F> a, Vec3xN<F> b)
+{
+  return {simd_msub(a.y, b.z, simd_mul(a.z, b.y)),
+          simd_msub(a.z, b.x, simd_mul(a.x, b.z)),
+          simd_msub(a.x, b.y, simd_mul(a.y, b.x))};
+}
+
+template <typename F>
+inline F
+length_f32(Vec3xN<F> v)
+{
+  return simd_sqrt(dot_f32(v, v));
+}
+
+template <typename F>
+inline Vec3xN<F>
+normalize_f32(Vec3xN<F> v)
+{
+  F inv_length = simd_div(simd_set1<F>(1.0f), length_f32(v));
+  return v * inv_length;
+}
+
+// A Mat4 with every entry broadcast across all of the lanes, so the same matrix can be
+// applied to N vectors at once.
+template <typename F>
+struct Mat4xN
+{
+  // Same layout as Mat4, [column][row].
+  F entries[4][4];
+};
+
+template <typename F>
+inline Mat4xN<F>
+broadcast_mat4(const Mat4& m)
+{
+  Mat4xN<F> ret;
+  for (u32 col = 0; col < 4; col++)
+  {
+    for (u32 row = 0; row < 4; row++)
+    {
+      ret.entries[col][row] = simd_set1<F>(m.entries[col][row]);
+    }
+  }
+  return ret;
+}
+
+template <typename F>
+inline Vec4xN<F>
+operator*(const Mat4xN<F>& m, Vec4xN<F> v)
+{
+  Vec4xN<F> ret;
+  ret.x = simd_madd(m.entries[3][0], v.w, simd_madd(m.entries[2][0], v.z, simd_madd(m.entries[1][0], v.y, simd_mul(m.entries[0][0], v.x))));
+  ret.y = simd_madd(m.entries[3][1], v.w, simd_madd(m.entries[2][1], v.z, simd_madd(m.entries[1][1], v.y, simd_mul(m.entries[0][1], v.x))));
+  ret.z = simd_madd(m.entries[3][2], v.w, simd_madd(m.entries[2][2], v.z, simd_madd(m.entries[1][2], v.y, simd_mul(m.entries[0][2], v.x))));
+  ret.w = simd_madd(m.entries[3][3], v.w, simd_madd(m.entries[2][3], v.z, simd_madd(m.entries[1][3], v.y, simd_mul(m.entries[0][3], v.x))));
+  return ret;
+}
+
+// Same as m * Vec4(v, 1.0f), without the w row. No divide by w, so this is only right for
+// affine transforms.
+template <typename F>
+inline Vec3xN<F>
+transform_point(const Mat4xN<F>& m, Vec3xN<F> v)
+{
+  Vec3xN<F> ret;
+  ret.x = simd_madd(m.entries[2][0], v.z, simd_madd(m.entries[1][0], v.y, simd_madd(m.entries[0][0], v.x, m.entries[3][0])));
+  ret.y = simd_madd(m.entries[2][1], v.z, simd_madd(m.entries[1][1], v.y, simd_madd(m.entries[0][1], v.x, m.entries[3][1])));
+  ret.z = simd_madd(m.entries[2][2], v.z, simd_madd(m.entries[1][2], v.y, simd_madd(m.entries[0][2], v.x, m.entries[3][2])));
+  return ret;
+}
+
+// A Frustum with every plane broadcast across all of the lanes. The absolute values of the
+// normals are kept around too, for projecting box extents onto them.
+template <typename F>
+struct FrustumxN
+{
+  Vec3xN<F> normals[6];
+  Vec3xN<F> abs_normals[6];
+  F d[6];
+};
+
+template <typename F>
+inline FrustumxN<F>
+broadcast_frustum(const Frustum& frustum)
+{
+  FrustumxN<F> ret;
+  for (u32 i = 0; i < 6; i++)
+  {
+    const Vec4& plane = frustum.planes[i];
+    ret.normals[i] = {simd_set1<F>(plane.x), simd_set1<F>(plane.y), simd_set1<F>(plane.z)};
+    ret.abs_normals[i] = {simd_set1<F>(fabsf(plane.x)), simd_set1<F>(fabsf(plane.y)), simd_set1<F>(fabsf(plane.z))};
+    ret.d[i] = simd_set1<F>(plane.w);
+  }
+  return ret;
+}
+
+// Same test as aabb_in_frustum, for N boxes at once. Rather than bailing out on the first plane
+// a box is outside of, this keeps the smallest distance + radius over all of the planes, so
+// there are no branches at all.
+template <typename F>
+inline F
+aabb_frustum_distance(const FrustumxN<F>& frustum, Vec3xN<F> center, Vec3xN<F> extents)
+{
+  F ret = simd_add(simd_add(dot_f32(frustum.normals[0], center), frustum.d[0]), dot_f32(frustum.abs_normals[0], extents));
+  for (u32 i = 1; i < 6; i++)
+  {
+    F distance = simd_add(simd_add(dot_f32(frustum.normals[i], center), frustum.d[i]), dot_f32(frustum.abs_normals[i], extents));
+    ret = simd_min(ret, distance);
+  }
+  return ret;
+}
+
+template <typename F>
+inline F
+sphere_frustum_distance(const FrustumxN<F>& frustum, Vec3xN<F> center, F radius)
+{
+  F ret = simd_add(simd_add(dot_f32(frustum.normals[0], center), frustum.d[0]), radius);
+  for (u32 i = 1; i < 6; i++)
+  {
+    ret = simd_min(ret, simd_add(simd_add(dot_f32(frustum.normals[i], center), frustum.d[i]), radius));
+  }
+  return ret;
+}
+
+// N quaternions, one register per component like Vec4xN.
+template <typename F>
+struct QuatxN
+{
+  F w;
+  F x;
+  F y;
+  F z;
+};
+
+// Same as quat_mul, N at a time.
+template <typename F>
+inline QuatxN<F>
+quat_mul(QuatxN<F> a, QuatxN<F> b)
+{
+  QuatxN<F> ret;
+  ret.w = simd_sub(simd_msub(a.w, b.w, simd_mul(a.x, b.x)), simd_madd(a.y, b.y, simd_mul(a.z, b.z)));
+  ret.x = simd_add(simd_madd(a.w, b.x, simd_mul(a.x, b.w)), simd_msub(a.y, b.z, simd_mul(a.z, b.y)));
+  ret.y = simd_add(simd_msub(a.w, b.y, simd_mul(a.x, b.z)), simd_madd(a.y, b.w, simd_mul(a.z, b.x)));
+  ret.z = simd_add(simd_madd(a.w, b.z, simd_mul(a.x, b.y)), simd_msub(a.z, b.w, simd_mul(a.y, b.x)));
+  return ret;
+}
+
+// Same as rotate_vec3_by_quat, N at a time. The quaternions have to be normalized.
+template <typename F>
+inline Vec3xN<F>
+rotate_vec3_by_quat(Vec3xN<F> v, QuatxN<F> q)
+{
+  Vec3xN<F> xyz = {q.x, q.y, q.z};
+  Vec3xN<F> t = cross_f32(xyz, v) * simd_set1<F>(2.0f);
+  Vec3xN<F> ret = cross_f32(xyz, t);
+  ret.x = simd_madd(q.w, t.x, simd_add(ret.x, v.x));
+  ret.y = simd_madd(q.w, t.y, simd_add(ret.y, v.y));
+  ret.z = simd_madd(q.w, t.z, simd_add(ret.z, v.z));
+  return ret;
+}
+
+// a * weight_a + b * weight_b, normalized.
+template <typename F>
+inline QuatxN<F>
+quat_blend_normalize(QuatxN<F> a, F weight_a, QuatxN<F> b, F weight_b)
+{
+  QuatxN<F> ret;
+  ret.w = simd_madd(a.w, weight_a, simd_mul(b.w, weight_b));
+  ret.x = simd_madd(a.x, weight_a, simd_mul(b.x, weight_b));
+  ret.y = simd_madd(a.y, weight_a, simd_mul(b.y, weight_b));
+  ret.z = simd_madd(a.z, weight_a, simd_mul(b.z, weight_b));
+
+  F length_sq = simd_madd(ret.z, ret.z, simd_madd(ret.y, ret.y, simd_madd(ret.x, ret.x, simd_mul(ret.w, ret.w))));
+  F inv_length = simd_div(simd_set1<F>(1.0f), simd_sqrt(length_sq));
+  ret.w = simd_mul(ret.w, inv_length);
+  ret.x = simd_mul(ret.x, inv_length);
+  ret.y = simd_mul(ret.y, inv_length);
+  ret.z = simd_mul(ret.z, inv_length);
+  return ret;
+}
+
+template <typename F>
+inline F
+quat_dot(QuatxN<F> a, QuatxN<F> b)
+{
+  return simd_madd(a.z, b.z, simd_madd(a.y, b.y, simd_madd(a.x, b.x, simd_mul(a.w, b.w))));
+}
+
+// Same as quat_nlerp, N at a time.
+template <typename F>
+inline QuatxN<F>
+quat_nlerp(QuatxN<F> a, QuatxN<F> b, F t)
+{
+  F cos_theta = quat_dot(a, b);
+  F weight_b = simd_select_nonnegative(cos_theta, t, simd_sub(simd_set1<F>(0.0f), t));
+  return quat_blend_normalize(a, simd_sub(simd_set1<F>(1.0f), t), b, weight_b);
+}
+
+// acos(x) for x in [0, 1], to within 2e-8. Abramowitz and Stegun 4.4.46.
+template <typename F>
+inline F
+acos_unit_f32(F x)
+{
+  F p = simd_set1<F>(-0.0012624911f);
+  p = simd_madd(p, x, simd_set1<F>( 0.0066700901f));
+  p = simd_madd(p, x, simd_set1<F>(-0.0170881256f));
+  p = simd_madd(p, x, simd_set1<F>( 0.0308918810f));
+  p = simd_madd(p, x, simd_set1<F>(-0.0501743046f));
+  p = simd_madd(p, x, simd_set1<F>( 0.0889789874f));
+  p = simd_madd(p, x, simd_set1<F>(-0.2145988016f));
+  p = simd_madd(p, x, simd_set1<F>( 1.5707963050f));
+  return simd_mul(simd_sqrt(simd_sub(simd_set1<F>(1.0f), x)), p);
+}
+
+// sin(x) for x in [0, pi / 2], to within 4e-8. Taylor series up to x^11.
+template <typename F>
+inline F
+sin_half_pi_f32(F x)
+{
+  F x2 = simd_mul(x, x);
+  F p = simd_set1<F>(-1.0f / 39916800.0f);
+  p = simd_madd(p, x2, simd_set1<F>( 1.0f / 362880.0f));
+  p = simd_madd(p, x2, simd_set1<F>(-1.0f / 5040.0f));
+  p = simd_madd(p, x2, simd_set1<F>( 1.0f / 120.0f));
+  p = simd_madd(p, x2, simd_set1<F>(-1.0f / 6.0f));
+  p = simd_madd(p, x2, simd_set1<F>( 1.0f));
+  return simd_mul(p, x);
+}
+
+// Same as quat_slerp, N at a time, without any branches. acos and sin are polynomials rather
+// than the CRT versions, which are good to within a few 1e-7 after the final normalize.
+template <typename F>
+inline QuatxN<F>
+quat_slerp(QuatxN<F> a, QuatxN<F> b, F t)
+{
+  F zero = simd_set1<F>(0.0f);
+  F one  = simd_set1<F>(1.0f);
+
+  F cos_theta = quat_dot(a, b);
+  F abs_cos_theta = simd_max(cos_theta, simd_sub(zero, cos_theta));
+
+  // Only ever up to pi / 2, since this always goes the short way around.
+  F theta = acos_unit_f32(abs_cos_theta);
+  // (1 - c) * (1 + c) rather than 1 - c * c, since 1 - c is exact for c > 0.5.
+  F sin_theta = simd_sqrt(simd_mul(simd_sub(one, abs_cos_theta), simd_add(one, abs_cos_theta)));
+  F inv_sin_theta = simd_div(one, sin_theta);
+
+  F one_minus_t = simd_sub(one, t);
+  F weight_a = simd_mul(sin_half_pi_f32(simd_mul(one_minus_t, theta)), inv_sin_theta);
+  F weight_b = simd_mul(sin_half_pi_f32(simd_mul(t, theta)), inv_sin_theta);
+
+  // Close enough to each other that it's just nlerp. This also covers sin_theta = 0.
+  F slerp = simd_sub(simd_set1<F>(kQuatSlerpThreshold), abs_cos_theta);
+  weight_a = simd_select_nonnegative(slerp, weight_a, one_minus_t);
+  weight_b = simd_select_nonnegative(slerp, weight_b, t);
+
+  weight_b = simd_select_nonnegative(cos_theta, weight_b, simd_sub(zero, weight_b));
+  return quat_blend_normalize(a, weight_a, b, weight_b);
+}
+
+// Pointers to the separate component arrays of a bunch of vectors. These aren't required to
+// be aligned, but alloc_vec3_soa/alloc_vec4_soa align them to cache lines anyway.
+struct Vec3Soa
+{
+  f32* x = nullptr;
+  f32* y = nullptr;
+  f32* z = nullptr;
+};
+
+struct Vec4Soa
+{
+  f32* x = nullptr;
+  f32* y = nullptr;
+  f32* z = nullptr;
+  f32* w = nullptr;
+};
+
+struct QuatSoa
+{
+  f32* w = nullptr;
+  f32* x = nullptr;
+  f32* y = nullptr;
+  f32* z = nullptr;
+};
+
+Vec3Soa alloc_vec3_soa(MEMORY_ARENA_PARAM, size_t count);
+Vec4Soa alloc_vec4_soa(MEMORY_ARENA_PARAM, size_t count);
+QuatSoa alloc_quat_soa(MEMORY_ARENA_PARAM, size_t count);
+
+template <typename F>
+inline Vec3xN<F>
+load_vec3xn(Vec3Soa src, size_t index)
+{
+  return {simd_load<F>(src.x + index), simd_load<F>(src.y + index), simd_load<F>(src.z + index)};
+}
+
+template <typename F>
+inline Vec4xN<F>
+load_vec4xn(Vec4Soa src, size_t index)
+{
+  return {simd_load<F>(src.x + index), simd_load<F>(src.y + index), simd_load<F>(src.z + index), simd_load<F>(src.w + index)};
+}
+
+template <typename F>
+inline void
+store_vec3xn(Vec3Soa dst, size_t index, Vec3xN<F> v)
+{
+  simd_store(dst.x + index, v.x);
+  simd_store(dst.y + index, v.y);
+  simd_store(dst.z + index, v.z);
+}
+
+template <typename F>
+inline void
+store_vec4xn(Vec4Soa dst, size_t index, Vec4xN<F> v)
+{
+  simd_store(dst.x + index, v.x);
+  simd_store(dst.y + index, v.y);
+  simd_store(dst.z + index, v.z);
+  simd_store(dst.w + index, v.w);
+}
+
+template <typename F>
+inline QuatxN<F>
+load_quatxn(QuatSoa src, size_t index)
+{
+  return {simd_load<F>(src.w + index), simd_load<F>(src.x + index), simd_load<F>(src.y + index), simd_load<F>(src.z + index)};
+}
+
+template <typename F>
+inline void
+store_quatxn(QuatSoa dst, size_t index, QuatxN<F> q)
+{
+  simd_store(dst.w + index, q.w);
+  simd_store(dst.x + index, q.x);
+  simd_store(dst.y + index, q.y);
+  simd_store(dst.z + index, q.z);
+}
+
+// All of these take any count, and `out` is allowed to be the same stream as an input.
+
+// out[i] = m * Vec4(in[i], 1.0f), see transform_point.
+void batch_transform_points(const Mat4& m, Vec3Soa in, Vec3Soa out, size_t count);
+// out[i] = m * in[i]
+void batch_transform_vec4(const Mat4& m, Vec4Soa in, Vec4Soa out, size_t count);
+// out[i] = dot(a[i], b[i])
+void batch_dot_vec3(Vec3Soa a, Vec3Soa b, f32* out, size_t count);
+// out[i] = cross(a[i], b[i])
+void batch_cross_vec3(Vec3Soa a, Vec3Soa b, Vec3Soa out, size_t count);
+// out[i] = normalize(in[i])
+void batch_normalize_vec3(Vec3Soa in, Vec3Soa out, size_t count);
+// visible[i] = aabb_in_frustum(frustum, Aabb{centers[i], extents[i]}) ? 1 : 0
+void batch_cull_aabbs(const Frustum& frustum, Vec3Soa centers, Vec3Soa extents, u8* visible, size_t count);
+// visible[i] = sphere_in_frustum(frustum, centers[i], radii[i]) ? 1 : 0
+void batch_cull_spheres(const Frustum& frustum, Vec3Soa centers, const f32* radii, u8* visible, size_t count);
+// out[i] = rotate_vec3_by_quat(in[i], q[i]), the quaternions have to be normalized.
+void batch_rotate_vec3(QuatSoa q, Vec3Soa in, Vec3Soa out, size_t count);
+// out[i] = a[i] * b[i]
+void batch_quat_mul(QuatSoa a, QuatSoa b, QuatSoa out, size_t count);
+// out[i] = quat_nlerp(a[i], b[i], t[i])
+void batch_quat_nlerp(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count);
+// out[i] = quat_slerp(a[i], b[i], t[i]), to within a few 1e-7.
+void batch_quat_slerp(QuatSoa a, QuatSoa b, const f32* t, QuatSoa out, size_t count);
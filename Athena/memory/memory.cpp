@@ -2,6 +2,9 @@
 #include "../context.h"
 #include <windows.h>
 
+// VirtualAlloc2 and MapViewOfFile3
+#pragma comment(lib, "onecore.lib")
+
 static void* g_memory_start = NULL;
 
 enum struct MemoryLocation : u8
@@ -203,6 +206,12 @@ memory_arena_pos_ptr(MEMORY_ARENA_PARAM)
   return memory_arena->use_ctx_pos ? context_get_scratch_arena_pos_ptr() : &memory_arena->pos;
 }
 
+size_t
+memory_arena_used(MEMORY_ARENA_PARAM)
+{
+  return size_t(*memory_arena_pos_ptr(MEMORY_ARENA_FWD) - memory_arena->start);
+}
+
 void*
 push_memory_arena_aligned(MEMORY_ARENA_PARAM, size_t size, size_t alignment)
 {
@@ -233,4 +242,70 @@ sub_alloc_memory_arena(MEMORY_ARENA_PARAM, size_t size, size_t alignment)
   ret.use_ctx_pos = false;
 
   return ret;
-}
\ No newline at end of file
+}
+
+MirroredMemory
+alloc_mirrored_memory(size_t size)
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  size = ALIGN_POW2(size, (size_t)info.dwAllocationGranularity);
+
+  MirroredMemory ret = {0};
+  ret.size = size;
+  ret.section = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                   nullptr,
+                                   PAGE_READWRITE,
+                                   DWORD(u64(size) >> 32),
+                                   DWORD(u64(size) & 0xFFFFFFFF),
+                                   nullptr);
+  ASSERT(ret.section != nullptr);
+
+  // Reserve a placeholder big enough for both views so that nothing else can end up
+  // in between them, then split it in two and map the section over each half.
+  void* placeholder = VirtualAlloc2(nullptr,
+                                    nullptr,
+                                    2 * size,
+                                    MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+                                    PAGE_NOACCESS,
+                                    nullptr,
+                                    0);
+  ASSERT(placeholder != nullptr);
+
+  BOOL split = VirtualFree(placeholder, size, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER);
+  ASSERT(split);
+
+  ret.base = (byte*)MapViewOfFile3(ret.section,
+                                   nullptr,
+                                   placeholder,
+                                   0,
+                                   size,
+                                   MEM_REPLACE_PLACEHOLDER,
+                                   PAGE_READWRITE,
+                                   nullptr,
+                                   0);
+  ASSERT(ret.base == placeholder);
+
+  void* mirror = MapViewOfFile3(ret.section,
+                                nullptr,
+                                ret.base + size,
+                                0,
+                                size,
+                                MEM_REPLACE_PLACEHOLDER,
+                                PAGE_READWRITE,
+                                nullptr,
+                                0);
+  ASSERT(mirror == ret.base + size);
+
+  return ret;
+}
+
+void
+free_mirrored_memory(MirroredMemory* memory)
+{
+  UnmapViewOfFile(memory->base + memory->size);
+  UnmapViewOfFile(memory->base);
+  CloseHandle(memory->section);
+
+  *memory = {0};
+}
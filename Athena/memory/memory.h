@@ -1,5 +1,6 @@
 #pragma once
 #include "../types.h"
+#include <string.h>
 
 #define ALIGN_POW2(v, alignment) (((v) + ((alignment) - 1)) & ~(((v) - (v)) + (alignment) - 1))
 
@@ -9,6 +10,23 @@ is_pow2(u64 v)
   return (v & ~(v - 1)) == v;
 }
 
+// Rounds up to the next power of 2 (or returns v if it already is one).
+inline u64
+next_pow2(u64 v)
+{
+  if (v <= 1)
+    return 1;
+
+  v--;
+  v |= v >> 1;
+  v |= v >> 2;
+  v |= v >> 4;
+  v |= v >> 8;
+  v |= v >> 16;
+  v |= v >> 32;
+  return v + 1;
+}
+
 inline uintptr_t
 align_address(uintptr_t address, size_t alignment)
 {
@@ -32,11 +50,9 @@ align_ptr(T* ptr, size_t alignment)
 inline void
 zero_memory(void* memory, size_t size)
 {
-  byte *b = reinterpret_cast<byte*>(memory);
-  while(size--)
-  {
-    *b++ = 0;
-  }
+  // The byte loop this used to be doesn't get vectorized in debug builds, which made
+  // clearing anything large (like job stacks) really slow.
+  memset(memory, 0, size);
 }
 
 void init_application_memory();
@@ -59,6 +75,8 @@ void free_memory_arena(MEMORY_ARENA_PARAM);
 void reset_memory_arena(MEMORY_ARENA_PARAM);
 
 uintptr_t* memory_arena_pos_ptr(MEMORY_ARENA_PARAM);
+// How many bytes have been pushed since the arena was last reset.
+size_t memory_arena_used(MEMORY_ARENA_PARAM);
 
 void* push_memory_arena_aligned(MEMORY_ARENA_PARAM, size_t size, size_t alignment = 1);
 
@@ -70,3 +88,18 @@ push_memory_arena(MEMORY_ARENA_PARAM, size_t count = 1)
 }
 
 MemoryArena sub_alloc_memory_arena(MEMORY_ARENA_PARAM, size_t size, size_t alignment = 1);
+
+// The same memory mapped twice back to back, so base[i] and base[i + size] are the same byte.
+// Anything that runs off the end of the first mapping just keeps going into the start of it
+// through the second one, which is what lets MirroredRingBuffer hand out contiguous pointers.
+struct MirroredMemory
+{
+  byte* base = nullptr;
+  // Size of _one_ of the mappings, 2 * size of address space is used.
+  size_t size = 0;
+  void* section = nullptr;
+};
+
+// The size gets rounded up to the allocation granularity (64KiB on Windows).
+MirroredMemory alloc_mirrored_memory(size_t size);
+void free_mirrored_memory(MirroredMemory* memory);
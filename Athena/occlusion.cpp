@@ -0,0 +1,418 @@
+#include "occlusion.h"
+#include "math/simd.h"
+#include "job_system.h"
+
+// Below this many triangles kicking the bins as jobs costs more than rasterizing them.
+constant u32 kMinOccluderTrianglesForJobs = 1024;
+
+// Relative, so that a mesh's own bounds can't end up hidden behind the mesh through rounding
+// when it is also an occluder.
+constant f32 kOcclusionDepthBias = 1e-4f;
+
+OcclusionBuffer
+init_occlusion_buffer(MEMORY_ARENA_PARAM, u32 width, u32 height, u32 max_triangles)
+{
+  ASSERT(width > 0 && width % 16 == 0 && width <= U16_MAX);
+  ASSERT(height > 0 && height % kOcclusionTileSize == 0 && height <= U16_MAX);
+
+  OcclusionBuffer ret;
+  ret.width = width;
+  ret.height = height;
+  ret.tiles_x = width / kOcclusionTileSize;
+  ret.tiles_y = height / kOcclusionTileSize;
+  ret.bins_x = (width + kOcclusionBinWidth - 1) / kOcclusionBinWidth;
+  ret.bins_y = (height + kOcclusionBinHeight - 1) / kOcclusionBinHeight;
+
+  ret.depth = (f32*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(f32) * width * height, 64);
+  ret.tile_depth = push_memory_arena<f32>(MEMORY_ARENA_FWD, ret.tiles_x * ret.tiles_y);
+  ret.triangles = push_memory_arena<OccluderTriangle>(MEMORY_ARENA_FWD, max_triangles);
+  ret.triangle_capacity = max_triangles;
+
+  begin_occlusion_frame(&ret, Mat4());
+  return ret;
+}
+
+void
+begin_occlusion_frame(OcclusionBuffer* buffer, const Mat4& view_proj)
+{
+  zero_memory(buffer->depth, sizeof(f32) * buffer->width * buffer->height);
+  zero_memory(buffer->tile_depth, sizeof(f32) * buffer->tiles_x * buffer->tiles_y);
+  buffer->view_proj = view_proj;
+  buffer->triangle_count = 0;
+  buffer->triangles_dropped = 0;
+}
+
+// Returns false for anything that doesn't need to be rasterized: triangles crossing the near
+// plane, back facing ones, degenerate ones, and ones that don't cover a single pixel center.
+static bool
+setup_occluder_triangle(const OcclusionBuffer& buffer, const Vec4* clip, OccluderTriangle* out)
+{
+  f32 x[3];
+  f32 y[3];
+  f32 z[3];
+  for (u32 i = 0; i < 3; i++)
+  {
+    // Clipping would mean splitting the triangle up, and just skipping it is still
+    // conservative.
+    if (clip[i].w <= 0.0f || clip[i].z > clip[i].w)
+      return false;
+
+    f32 inv_w = 1.0f / clip[i].w;
+    x[i] = (clip[i].x * inv_w * 0.5f + 0.5f) * f32(buffer.width);
+    y[i] = (0.5f - clip[i].y * inv_w * 0.5f) * f32(buffer.height);
+    z[i] = clip[i].z * inv_w;
+  }
+
+  // Pixel i is covered when its center, i + 0.5, is. Clamped as floats first since
+  // the vertices can be way off screen.
+  f32 min_x = MIN(x[0], MIN(x[1], x[2])) - 0.5f;
+  f32 min_y = MIN(y[0], MIN(y[1], y[2])) - 0.5f;
+  f32 max_x = MAX(x[0], MAX(x[1], x[2])) - 0.5f;
+  f32 max_y = MAX(y[0], MAX(y[1], y[2])) - 0.5f;
+
+  u32 pixel_min_x = u32(ceilf(MIN(MAX(min_x, 0.0f), f32(buffer.width))));
+  u32 pixel_min_y = u32(ceilf(MIN(MAX(min_y, 0.0f), f32(buffer.height))));
+  u32 pixel_max_x = u32(floorf(MIN(MAX(max_x, -1.0f), f32(buffer.width) - 1.0f)) + 1.0f);
+  u32 pixel_max_y = u32(floorf(MIN(MAX(max_y, -1.0f), f32(buffer.height) - 1.0f)) + 1.0f);
+  if (pixel_min_x >= pixel_max_x || pixel_min_y >= pixel_max_y)
+    return false;
+
+  // Culled the same way the GPU does it (FrontCounterClockwise = false with back face culling,
+  // see init_graphics_pipeline), since a triangle that never shows up on screen can't hide
+  // anything either. With y pointing down the screen, clockwise is a positive area.
+  f32 area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area < 1e-6f)
+    return false;
+
+  for (u32 i = 0; i < 3; i++)
+  {
+    u32 j = (i + 1) % 3;
+    out->edge_a[i] = y[i] - y[j];
+    out->edge_b[i] = x[j] - x[i];
+    out->edge_c[i] = (y[j] - y[i]) * x[i] - (x[j] - x[i]) * y[i];
+  }
+
+  out->z_dx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+  out->z_dy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+  out->z_c = z[0] - out->z_dx * x[0] - out->z_dy * y[0];
+  out->z_min = MIN(z[0], MIN(z[1], z[2]));
+  out->z_max = MAX(z[0], MAX(z[1], z[2]));
+
+  out->min_x = u16(pixel_min_x);
+  out->min_y = u16(pixel_min_y);
+  out->max_x = u16(pixel_max_x);
+  out->max_y = u16(pixel_max_y);
+  return true;
+}
+
+void
+add_occluder(OcclusionBuffer* buffer, const Mat4& model, const OccluderMesh& mesh)
+{
+  Mat4 mvp = buffer->view_proj * model;
+  for (u32 i = 0; i < mesh.triangle_count; i++)
+  {
+    if (buffer->triangle_count == buffer->triangle_capacity)
+    {
+      buffer->triangles_dropped += mesh.triangle_count - i;
+      return;
+    }
+
+    Vec4 clip[3];
+    for (u32 vertex = 0; vertex < 3; vertex++)
+    {
+      clip[vertex] = mvp * Vec4(mesh.positions[mesh.indices[i * 3 + vertex]], 1.0f).avx;
+    }
+
+    if (setup_occluder_triangle(*buffer, clip, &buffer->triangles[buffer->triangle_count]))
+    {
+      buffer->triangle_count++;
+    }
+  }
+}
+
+alignas(64) static const f32 kLanePixelCenters[16] =
+{
+  0.5f, 1.5f, 2.5f,  3.5f,  4.5f,  5.5f,  6.5f,  7.5f,
+  8.5f, 9.5f, 10.5f, 11.5f, 12.5f, 13.5f, 14.5f, 15.5f,
+};
+
+// The farthest depth of every tile in the rectangle, which has to be tile aligned.
+static void
+update_tile_depths(OcclusionBuffer* buffer, u32 x0, u32 y0, u32 x1, u32 y1)
+{
+  for (u32 tile_y = y0 / kOcclusionTileSize; tile_y < y1 / kOcclusionTileSize; tile_y++)
+  {
+    for (u32 tile_x = x0 / kOcclusionTileSize; tile_x < x1 / kOcclusionTileSize; tile_x++)
+    {
+      const f32* src = buffer->depth + tile_y * kOcclusionTileSize * buffer->width + tile_x * kOcclusionTileSize;
+
+      f32x4 farthest = _mm_min_ps(_mm_load_ps(src), _mm_load_ps(src + 4));
+      for (u32 row = 1; row < kOcclusionTileSize; row++)
+      {
+        src += buffer->width;
+        farthest = _mm_min_ps(farthest, _mm_min_ps(_mm_load_ps(src), _mm_load_ps(src + 4)));
+      }
+      farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+      farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+
+      buffer->tile_depth[tile_y * buffer->tiles_x + tile_x] = _mm_cvtss_f32(farthest);
+    }
+  }
+}
+
+// Rasterizes every triangle in a bin, F pixels of a row at a time. The bin's x range is a
+// multiple of 16 pixels, so a row never has any leftover pixels that don't fill a register.
+template <typename F>
+static void
+rasterize_bin(OcclusionBuffer* buffer, const u32* triangles, u32 count, u32 bin_x0, u32 bin_y0, u32 bin_x1, u32 bin_y1)
+{
+  constexpr u32 kWidth = SimdWidth<F>::kValue;
+  const F lane_centers = simd_load<F>(kLanePixelCenters);
+
+  for (u32 i = 0; i < count; i++)
+  {
+    const OccluderTriangle& tri = buffer->triangles[triangles[i]];
+
+    u32 x0 = MAX(u32(tri.min_x), bin_x0) & ~(kWidth - 1);
+    u32 y0 = MAX(u32(tri.min_y), bin_y0);
+    u32 x1 = MIN(u32(tri.max_x), bin_x1);
+    u32 y1 = MIN(u32(tri.max_y), bin_y1);
+
+    F a0 = simd_set1<F>(tri.edge_a[0]);
+    F a1 = simd_set1<F>(tri.edge_a[1]);
+    F a2 = simd_set1<F>(tri.edge_a[2]);
+    F z_dx = simd_set1<F>(tri.z_dx);
+    F z_min = simd_set1<F>(tri.z_min);
+    F z_max = simd_set1<F>(tri.z_max);
+
+    for (u32 y = y0; y < y1; y++)
+    {
+      // Everything that only depends on y gets folded into one constant per row.
+      f32 pixel_y = f32(y) + 0.5f;
+      F row0 = simd_set1<F>(tri.edge_b[0] * pixel_y + tri.edge_c[0]);
+      F row1 = simd_set1<F>(tri.edge_b[1] * pixel_y + tri.edge_c[1]);
+      F row2 = simd_set1<F>(tri.edge_b[2] * pixel_y + tri.edge_c[2]);
+      F row_z = simd_set1<F>(tri.z_dy * pixel_y + tri.z_c);
+
+      f32* row = buffer->depth + y * buffer->width;
+      for (u32 x = x0; x < x1; x += kWidth)
+      {
+        F pixel_x = simd_add(simd_set1<F>(f32(x)), lane_centers);
+
+        F inside = simd_min(simd_min(simd_madd(a0, pixel_x, row0), simd_madd(a1, pixel_x, row1)), simd_madd(a2, pixel_x, row2));
+        F z = simd_max(simd_min(simd_madd(z_dx, pixel_x, row_z), z_max), z_min);
+
+        F depth = simd_load<F>(row + x);
+        simd_store(row + x, simd_select_nonnegative(inside, simd_max(depth, z), depth));
+      }
+    }
+  }
+
+  update_tile_depths(buffer, bin_x0, bin_y0, bin_x1, bin_y1);
+
+  if constexpr (kWidth > 4)
+  {
+    _mm256_zeroupper();
+  }
+}
+
+typedef void (*RasterizeBinKernel)(OcclusionBuffer* buffer, const u32* triangles, u32 count, u32 bin_x0, u32 bin_y0, u32 bin_x1, u32 bin_y1);
+
+static const RasterizeBinKernel kRasterizeBinKernels[kSimdLevelCount] =
+{
+  &rasterize_bin<f32x4>,
+  &rasterize_bin<f32x8>,
+  &rasterize_bin<f32x16>,
+};
+
+void
+rasterize_occluders(MEMORY_ARENA_PARAM, OcclusionBuffer* buffer, bool parallel)
+{
+  u32 bins_x = buffer->bins_x;
+  u32 bin_count = bins_x * buffer->bins_y;
+
+  // Counting sort of the triangles into every bin that their bounds touch.
+  u32* bin_offsets = push_memory_arena<u32>(MEMORY_ARENA_FWD, bin_count + 1);
+  zero_memory(bin_offsets, sizeof(u32) * (bin_count + 1));
+
+  for (u32 i = 0; i < buffer->triangle_count; i++)
+  {
+    const OccluderTriangle& tri = buffer->triangles[i];
+    for (u32 bin_y = tri.min_y / kOcclusionBinHeight; bin_y <= (tri.max_y - 1u) / kOcclusionBinHeight; bin_y++)
+    {
+      for (u32 bin_x = tri.min_x / kOcclusionBinWidth; bin_x <= (tri.max_x - 1u) / kOcclusionBinWidth; bin_x++)
+      {
+        bin_offsets[bin_y * bins_x + bin_x + 1]++;
+      }
+    }
+  }
+
+  for (u32 bin = 0; bin < bin_count; bin++)
+  {
+    bin_offsets[bin + 1] += bin_offsets[bin];
+  }
+
+  u32* bin_triangles = push_memory_arena<u32>(MEMORY_ARENA_FWD, MAX(bin_offsets[bin_count], 1u));
+  u32* bin_cursors = push_memory_arena<u32>(MEMORY_ARENA_FWD, bin_count);
+  memcpy(bin_cursors, bin_offsets, sizeof(u32) * bin_count);
+
+  for (u32 i = 0; i < buffer->triangle_count; i++)
+  {
+    const OccluderTriangle& tri = buffer->triangles[i];
+    for (u32 bin_y = tri.min_y / kOcclusionBinHeight; bin_y <= (tri.max_y - 1u) / kOcclusionBinHeight; bin_y++)
+    {
+      for (u32 bin_x = tri.min_x / kOcclusionBinWidth; bin_x <= (tri.max_x - 1u) / kOcclusionBinWidth; bin_x++)
+      {
+        bin_triangles[bin_cursors[bin_y * bins_x + bin_x]++] = i;
+      }
+    }
+  }
+
+  RasterizeBinKernel kernel = kRasterizeBinKernels[get_simd_level()];
+  auto rasterize = [=](u32 bin)
+  {
+    u32 x0 = (bin % bins_x) * kOcclusionBinWidth;
+    u32 y0 = (bin / bins_x) * kOcclusionBinHeight;
+    u32 x1 = MIN(x0 + kOcclusionBinWidth, buffer->width);
+    u32 y1 = MIN(y0 + kOcclusionBinHeight, buffer->height);
+    kernel(buffer, bin_triangles + bin_offsets[bin], bin_offsets[bin + 1] - bin_offsets[bin], x0, y0, x1, y1);
+  };
+
+  // Empty bins are already cleared, tile depths included.
+  if (!parallel || buffer->triangle_count < kMinOccluderTrianglesForJobs)
+  {
+    for (u32 bin = 0; bin < bin_count; bin++)
+    {
+      if (bin_offsets[bin + 1] > bin_offsets[bin])
+      {
+        rasterize(bin);
+      }
+    }
+    return;
+  }
+
+  JobDesc* descs = push_memory_arena<JobDesc>(MEMORY_ARENA_FWD, bin_count);
+  u32 job_count = 0;
+  for (u32 bin = 0; bin < bin_count; bin++)
+  {
+    if (bin_offsets[bin + 1] > bin_offsets[bin])
+    {
+      descs[job_count++] = init_job_desc_from_closure([=]() { rasterize(bin); });
+    }
+  }
+  blocking_kick_job_descs(kJobPriorityHigh, descs, job_count, JOB_DEBUG_INFO_STRUCT);
+}
+
+static f32
+horizontal_min(f32x4 v)
+{
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtss_f32(v);
+}
+
+static f32
+horizontal_max(f32x4 v)
+{
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtss_f32(v);
+}
+
+// One clip space component of all 8 corners of a box, given the projected center and axes.
+// The -z corners end up in lo and the +z ones in hi.
+static void
+box_corners_component(f32 center, f32 axis_x, f32 axis_y, f32 axis_z, f32x4* lo, f32x4* hi)
+{
+  const f32x4 kSignX = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+  const f32x4 kSignY = _mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+
+  f32x4 xy = _mm_add_ps(_mm_set1_ps(center), _mm_add_ps(_mm_mul_ps(kSignX, _mm_set1_ps(axis_x)), _mm_mul_ps(kSignY, _mm_set1_ps(axis_y))));
+  *lo = _mm_sub_ps(xy, _mm_set1_ps(axis_z));
+  *hi = _mm_add_ps(xy, _mm_set1_ps(axis_z));
+}
+
+bool
+is_aabb_occluded(const OcclusionBuffer& buffer, const Aabb& box)
+{
+  // Corners are the projected center plus or minus each projected axis, all 8 of them at once
+  // rather than 8 separate matrix multiplies.
+  const Mat4& m = buffer.view_proj;
+  Vec4 center = m * Vec4(box.center, 1.0f).avx;
+  Vec4 axis_x = m.cols[0] * box.extents.x;
+  Vec4 axis_y = m.cols[1] * box.extents.y;
+  Vec4 axis_z = m.cols[2] * box.extents.z;
+
+  f32x4 x_lo, x_hi, y_lo, y_hi, z_lo, z_hi, w_lo, w_hi;
+  box_corners_component(center.x, axis_x.x, axis_y.x, axis_z.x, &x_lo, &x_hi);
+  box_corners_component(center.y, axis_x.y, axis_y.y, axis_z.y, &y_lo, &y_hi);
+  box_corners_component(center.z, axis_x.z, axis_y.z, axis_z.z, &z_lo, &z_hi);
+  box_corners_component(center.w, axis_x.w, axis_y.w, axis_z.w, &w_lo, &w_hi);
+
+  // Any corner behind the camera or in front of the near plane.
+  f32x4 zero = _mm_setzero_ps();
+  f32x4 clipped = _mm_or_ps(_mm_or_ps(_mm_cmple_ps(w_lo, zero), _mm_cmple_ps(w_hi, zero)),
+                            _mm_or_ps(_mm_cmpgt_ps(z_lo, w_lo), _mm_cmpgt_ps(z_hi, w_hi)));
+  if (_mm_movemask_ps(clipped) != 0)
+    return false;
+
+  f32x4 inv_w_lo = _mm_div_ps(_mm_set1_ps(1.0f), w_lo);
+  f32x4 inv_w_hi = _mm_div_ps(_mm_set1_ps(1.0f), w_hi);
+  f32x4 ndc_x_lo = _mm_mul_ps(x_lo, inv_w_lo);
+  f32x4 ndc_x_hi = _mm_mul_ps(x_hi, inv_w_hi);
+  f32x4 ndc_y_lo = _mm_mul_ps(y_lo, inv_w_lo);
+  f32x4 ndc_y_hi = _mm_mul_ps(y_hi, inv_w_hi);
+
+  // Screen y is flipped, so the top of the rectangle comes from the biggest NDC y.
+  f32 min_x = (horizontal_min(_mm_min_ps(ndc_x_lo, ndc_x_hi)) * 0.5f + 0.5f) * f32(buffer.width);
+  f32 max_x = (horizontal_max(_mm_max_ps(ndc_x_lo, ndc_x_hi)) * 0.5f + 0.5f) * f32(buffer.width);
+  f32 min_y = (0.5f - horizontal_max(_mm_max_ps(ndc_y_lo, ndc_y_hi)) * 0.5f) * f32(buffer.height);
+  f32 max_y = (0.5f - horizontal_min(_mm_min_ps(ndc_y_lo, ndc_y_hi)) * 0.5f) * f32(buffer.height);
+  f32 nearest = horizontal_max(_mm_max_ps(_mm_mul_ps(z_lo, inv_w_lo), _mm_mul_ps(z_hi, inv_w_hi)));
+
+  // Past the far plane, if there is one. Frustum culling is what gets rid of these.
+  if (nearest <= 0.0f)
+    return false;
+
+  nearest *= 1.0f + kOcclusionDepthBias;
+
+  // Every pixel that the box overlaps at all. Boxes that are completely off screen are left
+  // to frustum culling too.
+  f32 rect_min_x = MAX(floorf(min_x), 0.0f);
+  f32 rect_min_y = MAX(floorf(min_y), 0.0f);
+  f32 rect_max_x = MIN(ceilf(max_x), f32(buffer.width));
+  f32 rect_max_y = MIN(ceilf(max_y), f32(buffer.height));
+  if (rect_min_x >= rect_max_x || rect_min_y >= rect_max_y)
+    return false;
+
+  u32 x0 = u32(rect_min_x);
+  u32 y0 = u32(rect_min_y);
+  u32 x1 = u32(rect_max_x);
+  u32 y1 = u32(rect_max_y);
+
+  for (u32 tile_y = y0 / kOcclusionTileSize; tile_y <= (y1 - 1) / kOcclusionTileSize; tile_y++)
+  {
+    for (u32 tile_x = x0 / kOcclusionTileSize; tile_x <= (x1 - 1) / kOcclusionTileSize; tile_x++)
+    {
+      // Everything in the tile is in front of the box, no need to look any closer.
+      if (nearest < buffer.tile_depth[tile_y * buffer.tiles_x + tile_x])
+        continue;
+
+      u32 tile_x0 = MAX(x0, tile_x * kOcclusionTileSize);
+      u32 tile_y0 = MAX(y0, tile_y * kOcclusionTileSize);
+      u32 tile_x1 = MIN(x1, (tile_x + 1) * kOcclusionTileSize);
+      u32 tile_y1 = MIN(y1, (tile_y + 1) * kOcclusionTileSize);
+      for (u32 y = tile_y0; y < tile_y1; y++)
+      {
+        const f32* row = buffer.depth + y * buffer.width;
+        for (u32 x = tile_x0; x < tile_x1; x++)
+        {
+          if (row[x] <= nearest)
+            return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "math/math.h"
+
+// A small software depth buffer for culling draws that are hidden behind other geometry,
+// before they ever get recorded for the GPU.
+//
+// A set of cheap occluders (walls, floors, low poly proxies of bigger meshes) gets rasterized
+// into a low resolution reverse-Z depth buffer on the CPU, and then the screen space bounds of
+// every draw get tested against it. The buffer also keeps the farthest depth in every 8x8
+// tile, so most boxes get accepted or rejected a whole tile at a time without looking at
+// individual pixels.
+//
+// Triangles get binned into screen space bins first. Every bin only ever touches its own part
+// of the buffer, so the bins can be rasterized in parallel, and each one is rasterized a full
+// register of pixels at a time (4/8/16 wide, depending on get_simd_level()).
+//
+// Everything errs on the side of drawing: occluder triangles that cross the near plane get
+// dropped, back facing ones get culled the same way the GPU culls them, boxes that cross the
+// near plane are never occluded, and a box is tested with its nearest depth over the whole
+// screen rectangle it could cover.
+
+constant u32 kOcclusionTileSize = 8;
+constant u32 kOcclusionBinWidth = 64;
+constant u32 kOcclusionBinHeight = 32;
+
+// About 16:9. Big enough that small gaps between occluders still let things through, small
+// enough that clearing and rasterizing it is cheap.
+constant u32 kOcclusionBufferWidth = 320;
+constant u32 kOcclusionBufferHeight = 176;
+
+// Per frame. Anything past this just doesn't get used as an occluder.
+constant u32 kMaxOccluderTriangles = 32 * 1024;
+
+// A CPU side copy of the geometry of something that should be rasterized as an occluder.
+// Object space positions, 3 indices per triangle, with the front faces wound clockwise on
+// screen like every other mesh.
+struct OccluderMesh
+{
+  const Vec3* positions = nullptr;
+  const u32* indices = nullptr;
+  u32 triangle_count = 0;
+};
+
+// A triangle after it has been transformed to screen space and set up for rasterizing.
+struct OccluderTriangle
+{
+  // Edge functions a * x + b * y + c, which are >= 0 on the inside of all three edges, since
+  // only front facing triangles get set up.
+  f32 edge_a[3];
+  f32 edge_b[3];
+  f32 edge_c[3];
+
+  // Depth as a plane over the screen, z_dx * x + z_dy * y + z_c, clamped to [z_min, z_max]
+  // since the plane can overshoot the vertices a tiny bit right at the edges.
+  f32 z_dx;
+  f32 z_dy;
+  f32 z_c;
+  f32 z_min;
+  f32 z_max;
+
+  // Pixel bounds, already clipped to the buffer. The max is exclusive.
+  u16 min_x;
+  u16 min_y;
+  u16 max_x;
+  u16 max_y;
+};
+
+struct OcclusionBuffer
+{
+  u32 width = 0;
+  u32 height = 0;
+  u32 tiles_x = 0;
+  u32 tiles_y = 0;
+  u32 bins_x = 0;
+  u32 bins_y = 0;
+
+  // Reverse-Z like the GPU depth buffer, so bigger is closer and 0 means nothing is there.
+  f32* depth = nullptr;
+  // The smallest (farthest) depth of every tile.
+  f32* tile_depth = nullptr;
+
+  Mat4 view_proj;
+
+  OccluderTriangle* triangles = nullptr;
+  u32 triangle_count = 0;
+  u32 triangle_capacity = 0;
+  // Triangles that didn't fit this frame, which only means less gets culled.
+  u32 triangles_dropped = 0;
+};
+
+// The width has to be a multiple of 16 and the height a multiple of kOcclusionTileSize.
+OcclusionBuffer init_occlusion_buffer(MEMORY_ARENA_PARAM,
+                                      u32 width = kOcclusionBufferWidth,
+                                      u32 height = kOcclusionBufferHeight,
+                                      u32 max_triangles = kMaxOccluderTriangles);
+
+// Clears the buffer and starts collecting occluders for this view.
+void begin_occlusion_frame(OcclusionBuffer* buffer, const Mat4& view_proj);
+
+// Transforms and sets up the triangles of an occluder. Nothing is rasterized until
+// rasterize_occluders.
+void add_occluder(OcclusionBuffer* buffer, const Mat4& model, const OccluderMesh& mesh);
+
+// Bins and rasterizes everything added since begin_occlusion_frame. The bin lists are pushed
+// onto the arena. With parallel = false everything is done on the calling thread, otherwise
+// the bins get kicked as jobs.
+void rasterize_occluders(MEMORY_ARENA_PARAM, OcclusionBuffer* buffer, bool parallel = true);
+
+// World space bounds. True only if every pixel the box could cover already has an occluder
+// in front of it.
+bool is_aabb_occluded(const OcclusionBuffer& buffer, const Aabb& box);
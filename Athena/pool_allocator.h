@@ -47,19 +47,29 @@ init_pool(MEMORY_ARENA_PARAM, size_t size = 0)
   return ret;
 }
 
+// The memory is left with whatever was in it when it was freed. Use this for large
+// allocations that get fully overwritten anyways (like stacks).
 template <typename T>
-T* pool_alloc(Pool<T>* pool)
+T* pool_alloc_no_zero(Pool<T>* pool)
 {
   ASSERT(pool->free_count >= 1);
 
   pool->free_count--;
-  T* ret = pool->free[pool->free_count];
+  return pool->free[pool->free_count];
+}
+
+template <typename T>
+T* pool_alloc(Pool<T>* pool)
+{
+  T* ret = pool_alloc_no_zero(pool);
 
   zero_memory(ret, sizeof(T));
 
   return ret;
 }
 
+// NOTE: This doesn't zero, pool_alloc already does that, so doing it here too
+// was just clearing everything twice.
 template <typename T>
 void pool_free(Pool<T>* pool, T* memory)
 {
@@ -67,5 +77,4 @@ void pool_free(Pool<T>* pool, T* memory)
 
   pool->free[pool->free_count] = memory;
   pool->free_count++;
-  zero_memory(memory, sizeof(T));
 }
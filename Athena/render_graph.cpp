@@ -11,10 +11,10 @@ namespace gfx::render
   init_render_graph(MEMORY_ARENA_PARAM)
   {
     RenderGraph ret = {0};
-    ret.render_passes = init_array<RenderPass>(MEMORY_ARENA_FWD, 64);
+    ret.render_passes = init_growable_array<RenderPass*>(MEMORY_ARENA_FWD, 16);
     ret.imported_resources = init_hash_table<ResourceHandle, PhysicalResource>(MEMORY_ARENA_FWD, 32);
     ret.transient_resources = init_hash_table<ResourceHandle, TransientResourceDesc>(MEMORY_ARENA_FWD, 32);
-    ret.resource_list = init_array<ResourceHandle>(MEMORY_ARENA_FWD, 64);
+    ret.imported_set = init_hash_set<const void*>(MEMORY_ARENA_FWD, 32);
     ret.handle_index = 0;
 
 
@@ -85,13 +85,20 @@ namespace gfx::render
   RenderPass*
   add_render_pass(MEMORY_ARENA_PARAM, RenderGraph* graph, CmdQueueType queue, const char* name)
   {
-    RenderPass* ret = array_add(&graph->render_passes);
+    // Passes are allocated individually so that the pointer we hand out stays valid
+    // when render_passes grows.
+    RenderPass* ret = push_memory_arena<RenderPass>(MEMORY_ARENA_FWD);
+    zero_memory(ret, sizeof(RenderPass));
+    *array_add(&graph->render_passes) = ret;
 
     ret->allocator = sub_alloc_memory_arena(MEMORY_ARENA_FWD, KiB(16));
 
-    ret->cmd_buffer = init_array<RenderGraphCmd>(MEMORY_ARENA_FWD, 1024);
-    ret->read_resources = init_array<ResourceHandle>(MEMORY_ARENA_FWD, 16);
-    ret->write_resources = init_array<ResourceHandle>(MEMORY_ARENA_FWD, 16);
+    // These start out sized for a typical pass and grow from there. The fixed capacities they
+    // replaced (1024 commands, 16 reads/writes and 64 sync entries) took about 161 KiB of the
+    // frame arena per pass, almost all of it commands, where these start at about 5 KiB.
+    ret->cmd_buffer = init_growable_array<RenderGraphCmd>(MEMORY_ARENA_FWD, 32);
+    ret->read_resources = init_growable_array<ResourceHandle>(MEMORY_ARENA_FWD, 8);
+    ret->write_resources = init_growable_array<ResourceHandle>(MEMORY_ARENA_FWD, 8);
     ret->resource_states = init_hash_table<ResourceHandle, D3D12_RESOURCE_STATES>(MEMORY_ARENA_FWD, 32);
 
     ret->pass_id = u32(graph->render_passes.size) - 1;
@@ -99,8 +106,8 @@ namespace gfx::render
 
     // TODO(Brandon): We should allocate these when we're actually compiling, instead of here
     // to save on memory.
-    ret->passes_to_sync_with = init_array<RenderPassId>(MEMORY_ARENA_FWD, 64);
-    ret->synchronization_index = init_array<RenderPassId>(MEMORY_ARENA_FWD, 64);
+    ret->passes_to_sync_with = init_growable_array<RenderPassId>(MEMORY_ARENA_FWD, 8);
+    ret->synchronization_index = init_growable_array<RenderPassId>(MEMORY_ARENA_FWD, 8);
     ret->name = name;
 
     return ret;
@@ -119,7 +126,6 @@ namespace gfx::render
     resource->image_desc = desc;
     resource->type = resource_handle.type;
     resource->name = name;
-    *array_add(&graph->resource_list) = resource_handle;
 
     Handle<GpuImage> ret = {resource_handle.id, resource_handle.lifetime};
     return ret;
@@ -136,7 +142,6 @@ namespace gfx::render
     TransientResourceDesc* resource = hash_table_insert(&graph->transient_resources, resource_handle);
     resource->type = resource_handle.type;
     resource->name = name;
-    *array_add(&graph->resource_list) = resource_handle;
 
     Handle<Sampler> ret = {resource_handle.id, resource_handle.lifetime};
     return ret;
@@ -154,7 +159,6 @@ namespace gfx::render
     resource->buffer_desc.gpu_info = desc;
     resource->buffer_desc.has_upload_data = (bool)src;
     resource->name = name;
-    *array_add(&graph->resource_list) = resource_handle;
 
     if (src)
     {
@@ -168,11 +172,12 @@ namespace gfx::render
     return ret;
   }
 
-  // TODO(Brandon): We need to ensure that you can't import the same resource twice.
-  // Probably fix through just storing a HashSet of void*
   Handle<GpuImage>
   import_image(RenderGraph* graph, const GpuImage* image)
   {
+    bool newly_imported = hash_set_insert(&graph->imported_set, image);
+    ASSERT(newly_imported);
+
     ResourceHandle resource_handle = {0};
     resource_handle.id = handle_index(graph);
     resource_handle.type = kResourceTypeImage;
@@ -183,7 +188,6 @@ namespace gfx::render
     resource->state = D3D12_RESOURCE_STATE_COMMON;
     resource->type = resource_handle.type;
     resource->needs_initialization = false;
-    *array_add(&graph->resource_list) = resource_handle;
 
     Handle<GpuImage> ret = {resource_handle.id, resource_handle.lifetime};
     return ret;
@@ -202,6 +206,9 @@ namespace gfx::render
   Handle<GpuBuffer>
   import_buffer(RenderGraph* graph, const GpuBuffer* buffer)
   {
+    bool newly_imported = hash_set_insert(&graph->imported_set, buffer);
+    ASSERT(newly_imported);
+
     ResourceHandle resource_handle = {0};
     resource_handle.id = handle_index(graph);
     resource_handle.type = kResourceTypeBuffer;
@@ -212,7 +219,6 @@ namespace gfx::render
     resource->state = D3D12_RESOURCE_STATE_COMMON;
     resource->type = resource_handle.type;
     resource->needs_initialization = false;
-    *array_add(&graph->resource_list) = resource_handle;
 
     Handle<GpuBuffer> ret = {resource_handle.id, resource_handle.lifetime};
     return ret;
@@ -314,9 +320,10 @@ namespace gfx::render
       Array<RenderPassId>* pass_adjacency_list = array_add(&adjacency_list); 
       *pass_adjacency_list = init_array<RenderPassId>(SCRATCH_ARENA_PASS, graph->render_passes.size);
 
-      RenderPass* pass = &graph->render_passes[i];
-      for (RenderPass& other : graph->render_passes)
+      RenderPass* pass = graph->render_passes[i];
+      for (RenderPass* other_pass : graph->render_passes)
       {
+        RenderPass& other = *other_pass;
         // TODO(Brandon): This is a hack that makes it so that the order in which you call `add_render_pass`
         // matters so that you can do read -> write -> read sorts of things without a lot of fuss.
         // Eventually we'll want a better system of dealing with this...
@@ -407,7 +414,7 @@ namespace gfx::render
         u64 level_execution_index = 0;
         for (RenderPassId pass_id : lvl.passes)
         {
-          RenderPass* pass = &graph->render_passes[pass_id];
+          RenderPass* pass = graph->render_passes[pass_id];
           pass->global_execution_index = global_execution_index;
           pass->level_execution_index = level_execution_index;
           pass->queue_execution_index = queue_execution_indices[pass->queue]++;
@@ -419,21 +426,6 @@ namespace gfx::render
     }
   }
 
-  struct PhysicalDescriptorKey
-  {
-    u32 id = 0;
-    DescriptorType type = kDescriptorTypeCbv;
-    u8 __padding0__ = 0;
-    u16 __padding1__ = 0;
-
-    auto operator<=>(const PhysicalDescriptorKey& rhs) const = default;
-  };
-  static_assert(offsetof(PhysicalDescriptorKey, id) == 0);
-  static_assert(offsetof(PhysicalDescriptorKey, type) == 4);
-  static_assert(offsetof(PhysicalDescriptorKey, __padding0__) == 5);
-  static_assert(offsetof(PhysicalDescriptorKey, __padding1__) == 6);
-  static_assert(sizeof(PhysicalDescriptorKey) == 8);
-
   struct CompiledResourceMap
   {
     HashTable<ResourceHandle, PhysicalResource>  resource_map;
@@ -898,10 +890,8 @@ namespace gfx::render
 
     u64 buffer_count = 0;
     u64 image_count = 0;
-    for (const ResourceHandle& resource : graph->resource_list)
+    for (auto [resource, desc] : graph->transient_resources)
     {
-      if (resource.lifetime != kResourceLifetimeTransient)
-        continue;
       if (resource.type == kResourceTypeBuffer)
       {
         buffer_count++;
@@ -943,7 +933,7 @@ namespace gfx::render
       {
         for (RenderPassId pass_id : dependency_level.passes)
         {
-          const RenderPass& pass = graph->render_passes[pass_id];
+          const RenderPass& pass = *graph->render_passes[pass_id];
           for (ResourceHandle resource : pass.read_resources)
           {
             D3D12_RESOURCE_FLAGS* flags = hash_table_insert(&additional_flags, resource);
@@ -958,58 +948,58 @@ namespace gfx::render
         }
       }
 
-      for (const ResourceHandle& resource : graph->resource_list)
+      for (auto [resource, imported] : graph->imported_resources)
       {
-        PhysicalResource physical = { 0 };
-        if (resource.lifetime == kResourceLifetimeImported)
+        PhysicalResource physical = imported;
+        physical.needs_initialization = false;
+        if (resource.type == kResourceTypeImage)
         {
-          physical = *unwrap(hash_table_find(&graph->imported_resources, resource));
-          physical.needs_initialization = false;
-          if (resource.type == kResourceTypeImage)
-          {
-            // TODO(Brandon): I'm pretty sure this isn't really right. Because we never explicitly transition imported resources back to their initial state...
-            physical.state = physical.image->desc.initial_state;
-          }
+          // TODO(Brandon): I'm pretty sure this isn't really right. Because we never explicitly transition imported resources back to their initial state...
+          physical.state = physical.image->desc.initial_state;
         }
-        else if (resource.lifetime == kResourceLifetimeTransient)
+        physical.type = resource.type;
+        *hash_table_insert(&compiled_map.resource_map, resource) = physical;
+      }
+
+      for (auto [resource, transient] : graph->transient_resources)
+      {
+        PhysicalResource physical = { 0 };
+        TransientResourceDesc desc = transient;
+        D3D12_RESOURCE_FLAGS default_flags = D3D12_RESOURCE_FLAG_NONE;
+        switch (resource.type)
         {
-          TransientResourceDesc desc = *unwrap(hash_table_find(&graph->transient_resources, resource));
-          D3D12_RESOURCE_FLAGS default_flags = D3D12_RESOURCE_FLAG_NONE;
-          switch (resource.type)
+          case kResourceTypeImage:
+          {  
+            desc.image_desc.flags |= *unwrap_or(hash_table_find(&additional_flags, resource), &default_flags);
+            GpuImage image = alloc_gpu_image_2D(device, local_heap, desc.image_desc, desc.name);
+            GpuImage* ptr = array_add(&gpu_images);
+            *ptr = image;
+            physical.image = ptr;
+            physical.needs_initialization = true;
+          } break;
+          case kResourceTypeBuffer:
           {
-            case kResourceTypeImage:
-            {  
-              desc.image_desc.flags |= *unwrap_or(hash_table_find(&additional_flags, resource), &default_flags);
-              GpuImage image = alloc_gpu_image_2D(device, local_heap, desc.image_desc, desc.name);
-              GpuImage* ptr = array_add(&gpu_images);
-              *ptr = image;
-              physical.image = ptr;
-              physical.needs_initialization = true;
-            } break;
-            case kResourceTypeBuffer:
+            desc.buffer_desc.gpu_info.flags |= *unwrap_or(hash_table_find(&additional_flags, resource), &default_flags);
+            GpuBuffer buffer = { 0 };
+            if (desc.buffer_desc.has_upload_data)
             {
-              desc.buffer_desc.gpu_info.flags |= *unwrap_or(hash_table_find(&additional_flags, resource), &default_flags);
-              GpuBuffer buffer = { 0 };
-              if (desc.buffer_desc.has_upload_data)
-              {
-                buffer = alloc_gpu_buffer(device, upload_heap, desc.buffer_desc.gpu_info, desc.name);
-                memcpy(unwrap(buffer.mapped), desc.buffer_desc.upload_data, buffer.desc.size);
-                physical.needs_initialization = false;
-              }
-              else
-              {
-                buffer = alloc_gpu_buffer(device, local_heap, desc.buffer_desc.gpu_info, desc.name);
-                physical.needs_initialization = true;
-              }
-              GpuBuffer* ptr = array_add(&gpu_buffers);
-              *ptr = buffer;
-              physical.buffer = ptr;
-            } break;
-            // We don't need to do anything if it's a sampler.
-            case kResourceTypeSampler: break;
-            default: UNREACHABLE;
-          }
-        } else { UNREACHABLE; }
+              buffer = alloc_gpu_buffer(device, upload_heap, desc.buffer_desc.gpu_info, desc.name);
+              memcpy(unwrap(buffer.mapped), desc.buffer_desc.upload_data, buffer.desc.size);
+              physical.needs_initialization = false;
+            }
+            else
+            {
+              buffer = alloc_gpu_buffer(device, local_heap, desc.buffer_desc.gpu_info, desc.name);
+              physical.needs_initialization = true;
+            }
+            GpuBuffer* ptr = array_add(&gpu_buffers);
+            *ptr = buffer;
+            physical.buffer = ptr;
+          } break;
+          // We don't need to do anything if it's a sampler.
+          case kResourceTypeSampler: break;
+          default: UNREACHABLE;
+        }
         physical.type = resource.type;
         *hash_table_insert(&compiled_map.resource_map, resource) = physical;
       }
@@ -1028,7 +1018,7 @@ namespace gfx::render
         PIXBeginEvent(cmd_list.d3d12_list, kPIXTransitionColor, "Transition Barrier");
         for (RenderPassId pass_id : dependency_level.passes)
         {
-          const RenderPass& pass = graph->render_passes[pass_id];
+          const RenderPass& pass = *graph->render_passes[pass_id];
           for (ResourceHandle resource : pass.read_resources)
           {
             execute_d3d12_transition(&cmd_list, resource, &compiled_map, pass);
@@ -1053,7 +1043,7 @@ namespace gfx::render
   
         for (RenderPassId pass_id : dependency_level.passes)
         {
-          const RenderPass& pass = graph->render_passes[pass_id];
+          const RenderPass& pass = *graph->render_passes[pass_id];
           CmdListAllocator* allocator = get_cmd_list_allocator(cache, pass.queue);
   
           CmdList list = alloc_cmd_list(allocator);
@@ -1115,16 +1105,11 @@ namespace gfx::render
     {
       CmdListAllocator* allocator = get_cmd_list_allocator(cache, kCmdQueueTypeGraphics);
       CmdList cmd_list = alloc_cmd_list(allocator);
-      for (const ResourceHandle& resource : graph->resource_list)
+      for (auto [resource, physical] : graph->imported_resources)
       {
-        PhysicalResource physical = { 0 };
-        if (resource.lifetime != kResourceLifetimeImported)
-          continue;
-  
         if (graph->back_buffer && resource.id == unwrap(graph->back_buffer).id)
           continue;
   
-        physical = *unwrap(hash_table_find(&graph->imported_resources, resource));
         if (resource.type == kResourceTypeImage)
         {
           execute_d3d12_transition(&cmd_list, resource, &compiled_map, physical.image->desc.initial_state);
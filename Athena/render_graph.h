@@ -72,6 +72,21 @@ namespace gfx::render
   static_assert(offsetof(ResourceHandle, __padding__) == 6);
   static_assert(sizeof(ResourceHandle) == 8);
 
+  struct PhysicalDescriptorKey
+  {
+    u32 id = 0;
+    DescriptorType type = kDescriptorTypeCbv;
+    u8 __padding0__ = 0;
+    u16 __padding1__ = 0;
+
+    auto operator<=>(const PhysicalDescriptorKey& rhs) const = default;
+  };
+  static_assert(offsetof(PhysicalDescriptorKey, id) == 0);
+  static_assert(offsetof(PhysicalDescriptorKey, type) == 4);
+  static_assert(offsetof(PhysicalDescriptorKey, __padding0__) == 5);
+  static_assert(offsetof(PhysicalDescriptorKey, __padding1__) == 6);
+  static_assert(sizeof(PhysicalDescriptorKey) == 8);
+
   struct Sampler;
 
   template <typename T>
@@ -448,12 +463,12 @@ namespace gfx::render
 
   struct RenderGraph
   {
-    Array<RenderPass> render_passes;
+    Array<RenderPass*> render_passes;
     HashTable<ResourceHandle, PhysicalResource> imported_resources;
     HashTable<ResourceHandle, TransientResourceDesc> transient_resources;
 
-    // TODO(Brandon): Only exists because we don't have an iterator for HashTable
-    Array<ResourceHandle> resource_list;
+    // The GpuImage/GpuBuffer pointers that have been imported, so the same resource can't be imported twice.
+    HashSet<const void*> imported_set;
 
     Option<ResourceHandle> back_buffer = None;
 
@@ -3,6 +3,7 @@
 #include <assimp/postprocess.h>
 
 #include "renderer.h"
+#include "math/simd.h"
 #include "shaders/interlop.hlsli"
 #include "vendor/ufbx/ufbx.h"
 #include "vendor/imgui/imgui.h"
@@ -41,6 +42,7 @@ init_renderer(MEMORY_ARENA_PARAM, const GraphicsDevice* device, const SwapChain*
 {
   Renderer ret = {0};
   ret.transient_resource_cache = init_transient_resource_cache(MEMORY_ARENA_FWD, device);
+  ret.occlusion_buffer = init_occlusion_buffer(MEMORY_ARENA_FWD);
 
   GraphicsPipelineDesc fullscreen_pipeline_desc = 
   {
@@ -96,6 +98,7 @@ init_renderer(MEMORY_ARENA_PARAM, const GraphicsDevice* device, const SwapChain*
   ret.ddgi_vol_desc.probe_num_rays = 128;
   ret.ddgi_vol_desc.probe_hysteresis = 0.97f;
   ret.ddgi_vol_desc.probe_max_ray_distance = 20.0f;
+  ret.probe_ray_rng = init_pcg32(0xDD61);
 
   GpuImageDesc probe_ray_data_desc = {0};
   probe_ray_data_desc.width             = ret.ddgi_vol_desc.probe_num_rays;
@@ -168,13 +171,99 @@ build_acceleration_structures(gfx::GraphicsDevice* device, Scene* scene)
 void
 begin_renderer_recording(MEMORY_ARENA_PARAM, Renderer* renderer)
 {
-  renderer->meshes = init_array<Mesh>(MEMORY_ARENA_FWD, 128);
+  renderer->draws = init_soa_array<const GraphicsPSO*, u32, u32, u32, f32, f32, f32, f32, f32, f32>(MEMORY_ARENA_FWD, 32);
+  renderer->transforms = init_growable_array<interlop::Transform>(MEMORY_ARENA_FWD, 8);
+  renderer->occluders = init_growable_array<OccluderDraw>(MEMORY_ARENA_FWD, 8);
 }
 
+u32
+submit_transform(Renderer* renderer, const Mat4& world, const Mat4& normal)
+{
+  u32 ret = u32(renderer->transforms.size);
+  interlop::Transform* transform = array_add(&renderer->transforms);
+  transform->model = world;
+  // The shaders want the plain inverse and transpose it themselves.
+  transform->model_inverse = transpose_f32(normal);
+  return ret;
+}
+
+// The mesh needs to stay alive until the frame has been submitted, since the draw list
+// just points at its PSO.
 void
-submit_mesh(Renderer* renderer, Mesh mesh)
+submit_mesh(Renderer* renderer, const Mesh& mesh, u32 transform)
 {
-  *array_add(&renderer->meshes) = mesh;
+  ASSERT(transform < renderer->transforms.size);
+  Aabb bounds = transform_aabb(renderer->transforms[transform].model, mesh.bounds);
+  soa_push(&renderer->draws,
+           &mesh.gbuffer_pso,
+           mesh.index_buffer_offset,
+           mesh.index_count,
+           transform,
+           bounds.center.x,
+           bounds.center.y,
+           bounds.center.z,
+           bounds.extents.x,
+           bounds.extents.y,
+           bounds.extents.z);
+
+  if (mesh.occluder.triangle_count > 0)
+  {
+    OccluderDraw* occluder = array_add(&renderer->occluders);
+    occluder->mesh = &mesh.occluder;
+    occluder->transform = transform;
+  }
+}
+
+// Drops every draw whose bounds are completely outside of the camera frustum.
+static void
+frustum_cull_draws(MEMORY_ARENA_PARAM, Renderer* renderer, const Mat4& view_proj)
+{
+  DrawList* draws = &renderer->draws;
+
+  Vec3Soa centers = {soa_column<kDrawCenterX>(draws), soa_column<kDrawCenterY>(draws), soa_column<kDrawCenterZ>(draws)};
+  Vec3Soa extents = {soa_column<kDrawExtentX>(draws), soa_column<kDrawExtentY>(draws), soa_column<kDrawExtentZ>(draws)};
+
+  u8* visible = push_memory_arena<u8>(MEMORY_ARENA_FWD, draws->size);
+  batch_cull_aabbs(frustum_from_view_proj(view_proj), centers, extents, visible, draws->size);
+
+  size_t submitted = draws->size;
+  soa_filter(MEMORY_ARENA_FWD, draws, [&](size_t i) { return visible[i] != 0; });
+
+  renderer->stats.draws_submitted = u32(submitted);
+  renderer->stats.draws_frustum_culled = u32(submitted - draws->size);
+}
+
+// Rasterizes every submitted occluder into the occlusion buffer and then drops every draw that
+// is completely hidden behind them. Occluders that got frustum culled still get rasterized,
+// they'll just get clipped away almost immediately.
+static void
+occlusion_cull_draws(MEMORY_ARENA_PARAM, Renderer* renderer, const Mat4& view_proj)
+{
+  OcclusionBuffer* buffer = &renderer->occlusion_buffer;
+  begin_occlusion_frame(buffer, view_proj);
+  for (const OccluderDraw& occluder : renderer->occluders)
+  {
+    add_occluder(buffer, renderer->transforms[occluder.transform].model, *occluder.mesh);
+  }
+  rasterize_occluders(MEMORY_ARENA_FWD, buffer);
+
+  DrawList* draws = &renderer->draws;
+  const f32* center_x = soa_column<kDrawCenterX>(draws);
+  const f32* center_y = soa_column<kDrawCenterY>(draws);
+  const f32* center_z = soa_column<kDrawCenterZ>(draws);
+  const f32* extent_x = soa_column<kDrawExtentX>(draws);
+  const f32* extent_y = soa_column<kDrawExtentY>(draws);
+  const f32* extent_z = soa_column<kDrawExtentZ>(draws);
+
+  size_t visible = draws->size;
+  soa_filter(MEMORY_ARENA_FWD, draws, [&](size_t i)
+  {
+    Aabb bounds = {Vec3(center_x[i], center_y[i], center_z[i]), Vec3(extent_x[i], extent_y[i], extent_z[i])};
+    return !is_aabb_occluded(*buffer, bounds);
+  });
+
+  renderer->stats.draws_occlusion_culled = u32(visible - draws->size);
+  renderer->stats.occluder_triangles = buffer->triangle_count;
 }
 
 static
@@ -249,6 +338,18 @@ execute_render(MEMORY_ARENA_PARAM,
   scene.camera_world_pos = camera->world_pos;
   scene.directional_light = directional_light;
 
+  // Before anything gets recorded, so culled meshes never make it into the graph at all.
+  frustum_cull_draws(MEMORY_ARENA_FWD, renderer, scene.view_proj);
+  if (render_options.occlusion_culling)
+  {
+    occlusion_cull_draws(MEMORY_ARENA_FWD, renderer, scene.view_proj);
+  }
+  else
+  {
+    renderer->stats.draws_occlusion_culled = 0;
+    renderer->stats.occluder_triangles = 0;
+  }
+
   Handle<GpuBuffer> scene_buffer = create_buffer(&graph, "Scene Buffer", scene);
 
   // Render GBuffers
@@ -261,22 +362,35 @@ execute_render(MEMORY_ARENA_PARAM,
   cmd_clear_depth_stencil_view(geometry_pass, &RENDER_BUFFER(kGBufferDepth), D3D12_CLEAR_FLAG_DEPTH, 0.0f, 0);
   cmd_om_set_render_targets(geometry_pass, Span(&render_buffers[RenderBuffers::kGBufferMaterialId], kGBufferRTCount), RENDER_BUFFER(kGBufferDepth));
 
-  interlop::Transform transform;
-  transform.model = Mat4::columns(Vec4(1, 0, 0, 0),
-                                  Vec4(0, 1, 0, 0),
-                                  Vec4(0, 0, 1, 0),
-                                  Vec4(0, 0, 10, 1));
-  transform.model_inverse = transform_inverse_no_scale(transform.model);
-  Handle<GpuBuffer> transform_buffer = create_buffer(&graph, "Transform Buffer", transform);
+  Handle<GpuBuffer>* transform_buffers = push_memory_arena<Handle<GpuBuffer>>(MEMORY_ARENA_FWD, renderer->transforms.size);
+  for (size_t i = 0; i < renderer->transforms.size; i++)
+  {
+    transform_buffers[i] = create_buffer(&graph, "Transform Buffer", renderer->transforms[i]);
+  }
 
 
   Handle<GpuBuffer> graph_vertex_buffer = import_buffer(&graph, &vertex_buffer);
   cmd_ia_set_index_buffer(geometry_pass, &index_buffer);
-  for (Mesh mesh : renderer->meshes)
+
+  // Group the draws by PSO so that we only switch pipelines when we actually have to.
+  const GraphicsPSO* const* draw_psos = soa_column<kDrawPso>(&renderer->draws);
+  soa_sort(MEMORY_ARENA_FWD, &renderer->draws, [&](size_t i) { return u64(draw_psos[i]->d3d12_pso); });
+
+  const u32* draw_index_offsets = soa_column<kDrawIndexOffset>(&renderer->draws);
+  const u32* draw_index_counts = soa_column<kDrawIndexCount>(&renderer->draws);
+  const u32* draw_transforms = soa_column<kDrawTransform>(&renderer->draws);
+
+  ID3D12PipelineState* current_pso = nullptr;
+  for (size_t i = 0; i < renderer->draws.size; i++)
   {
-    cmd_set_graphics_pso(geometry_pass, &mesh.gbuffer_pso);
-    cmd_graphics_bind_shader_resources<interlop::MaterialRenderResources>(geometry_pass, {.vertices = graph_vertex_buffer, .scene = scene_buffer, .transform = transform_buffer});
-    cmd_draw_indexed_instanced(geometry_pass, mesh.index_count, 1, mesh.index_buffer_offset, 0, 0);
+    const GraphicsPSO* pso = draw_psos[i];
+    if (pso->d3d12_pso != current_pso)
+    {
+      cmd_set_graphics_pso(geometry_pass, pso);
+      current_pso = pso->d3d12_pso;
+    }
+    cmd_graphics_bind_shader_resources<interlop::MaterialRenderResources>(geometry_pass, {.vertices = graph_vertex_buffer, .scene = scene_buffer, .transform = transform_buffers[draw_transforms[i]]});
+    cmd_draw_indexed_instanced(geometry_pass, draw_index_counts[i], 1, draw_index_offsets[i], 0, 0);
   }
 
   u32 fullres_dispatch_x = (swap_chain->width + 7)  / 8;
@@ -292,7 +406,7 @@ execute_render(MEMORY_ARENA_PARAM,
   u32 eighthres_dispatch_y = ((swap_chain->height >> 3) + 7) / 8;
 
   interlop::DDGIVolDesc* vol_desc = &renderer->ddgi_vol_desc;
-  vol_desc->probe_ray_rotation = generate_random_rotation();
+  vol_desc->probe_ray_rotation = generate_random_rotation(&renderer->probe_ray_rng);
   Handle<GpuBuffer> vol_desc_buffer = create_buffer(&graph, "DDGI Volume Description Buffer", *vol_desc);
   Handle<GpuImage> probe_ray_data  = import_image(&graph, &renderer->probe_ray_data);
   Handle<GpuImage> probe_irradiance = import_image(&graph, &renderer->probe_irradiance);
@@ -529,7 +643,9 @@ execute_render(MEMORY_ARENA_PARAM,
   swap_chain_submit(swap_chain, device, back_buffer);
 
   // Clear the render entries
-  clear_array(&renderer->meshes);
+  clear_soa_array(&renderer->draws);
+  clear_array(&renderer->transforms);
+  clear_array(&renderer->occluders);
 }
 
 Scene
@@ -538,7 +654,9 @@ init_scene(MEMORY_ARENA_PARAM, const gfx::GraphicsDevice* device)
   Scene ret = {0};
   ret.scene_objects = init_array<SceneObject>(MEMORY_ARENA_FWD, 128);
   ret.point_lights  = init_array<interlop::PointLight>(MEMORY_ARENA_FWD, 128);
-  ret.scene_object_heap = sub_alloc_memory_arena(MEMORY_ARENA_FWD, MiB(8));
+  ret.transforms    = init_transform_hierarchy(MEMORY_ARENA_FWD, 128);
+  // Also holds the CPU copies of the occluder meshes.
+  ret.scene_object_heap = sub_alloc_memory_arena(MEMORY_ARENA_FWD, MiB(32));
   GpuBufferDesc vertex_uber_desc = {0};
   vertex_uber_desc.size = MiB(512);
 
@@ -660,6 +778,9 @@ mesh_import_scene(const aiScene* assimp_scene, Array<Mesh>* out,  Scene* scene)
 
     const aiVector3D kAssimpZero3D(0.0f, 0.0f, 0.0f);
 
+    f32x4 bounds_min = _mm_set1_ps(F32_MAX);
+    f32x4 bounds_max = _mm_set1_ps(-F32_MAX);
+
     for (u32 ivertex = 0; ivertex < assimp_mesh->mNumVertices; ivertex++)
     {
       const aiVector3D* a_pos     = &assimp_mesh->mVertices[ivertex];
@@ -671,8 +792,13 @@ mesh_import_scene(const aiScene* assimp_scene, Array<Mesh>* out,  Scene* scene)
       vertices[ivertex].position = Vec4(a_pos->x, a_pos->y, a_pos->z, 1.0f);
       vertices[ivertex].normal   = Vec4(a_normal->x, a_normal->y, a_normal->z, 1.0f);
       vertices[ivertex].uv       = Vec4(a_uv->x, a_uv->y, 0.0f, 0.0f);
+
+      bounds_min = _mm_min_ps(bounds_min, Vec3(a_pos->x, a_pos->y, a_pos->z).avx);
+      bounds_max = _mm_max_ps(bounds_max, Vec3(a_pos->x, a_pos->y, a_pos->z).avx);
     }
 
+    out_mesh->bounds = num_vertices > 0 ? aabb_from_min_max(bounds_min, bounds_max) : Aabb{};
+
     u32 vertex_buffer_offset = alloc_into_vertex_uber(scene, num_vertices);
 
     u32* indices = push_memory_arena<u32>(&g_upload_context.cpu_upload_arena, num_indices);
@@ -697,6 +823,25 @@ mesh_import_scene(const aiScene* assimp_scene, Array<Mesh>* out,  Scene* scene)
 
     num_indices = iindex;
 
+    // The occlusion rasterizer wants its own copy without the uber buffer offset baked in.
+    u32 num_triangles = num_indices / 3;
+    if (num_triangles > 0 && num_triangles <= kMaxOccluderMeshTriangles)
+    {
+      Vec3* occluder_positions = push_memory_arena<Vec3>(&scene->scene_object_heap, num_vertices);
+      for (u32 ivertex = 0; ivertex < num_vertices; ivertex++)
+      {
+        occluder_positions[ivertex] = Vec3(vertices[ivertex].position.x, vertices[ivertex].position.y, vertices[ivertex].position.z);
+      }
+
+      u32* occluder_indices = push_memory_arena<u32>(&scene->scene_object_heap, num_indices);
+      for (u32 i = 0; i < num_indices; i++)
+      {
+        occluder_indices[i] = indices[i] - vertex_buffer_offset;
+      }
+
+      out_mesh->occluder = {occluder_positions, occluder_indices, num_triangles};
+    }
+
 
     out_mesh->index_count = num_indices;
     out_mesh->index_buffer_offset = alloc_into_index_uber(scene, num_indices);
@@ -764,6 +909,7 @@ add_scene_object(Scene* scene,
 {
   SceneObject* ret = array_add(&scene->scene_objects);
   ret->flags = kSceneObjectMesh;
+  ret->transform = add_transform_node(&scene->transforms);
   ret->meshes = load_mesh_from_file(&scene->scene_object_heap, scene, shader_manager, mesh, vertex_shader, material_shader);
 
   return ret;
@@ -794,9 +940,12 @@ submit_scene(const Scene& scene, Renderer* renderer)
 //      flags &= ~kSceneObjectPendingLoad;
 //    }
 
+    u32 transform = submit_transform(renderer,
+                                     get_world_transform(scene.transforms, obj.transform),
+                                     get_normal_transform(scene.transforms, obj.transform));
     for (const Mesh& mesh : obj.meshes)
     {
-      submit_mesh(renderer, mesh);
+      submit_mesh(renderer, mesh, transform);
     }
   }
 }
@@ -1,6 +1,10 @@
 #pragma once
 #include "job_system.h"
 #include "render_graph.h"
+#include "soa_array.h"
+#include "transform_hierarchy.h"
+#include "occlusion.h"
+#include "math/random.h"
 #include "shaders/interlop.hlsli"
 
 constant D3D12_COMPARISON_FUNC kDepthComparison = D3D12_COMPARISON_FUNC_GREATER;
@@ -100,6 +104,49 @@ struct Mesh
   u32 index_count = 0;
   ShaderIndex vertex_shader = kVsBasic;
   ShaderIndex material_shader = kPsBasicNormalGloss;
+  // Object space, computed from the vertices at import.
+  Aabb bounds;
+  // Only kept for meshes with at most kMaxOccluderMeshTriangles triangles, empty otherwise.
+  OccluderMesh occluder;
+};
+
+// Meshes this small get rasterized as occluders as they are, anything bigger would cost more
+// to rasterize than it saves.
+constant u32 kMaxOccluderMeshTriangles = 4096;
+
+// The per-frame list of meshes to draw, split up by field so that sorting and culling only
+// touch the columns they need.
+enum DrawListField
+{
+  kDrawPso,
+  kDrawIndexOffset,
+  kDrawIndexCount,
+  // Index into Renderer::transforms.
+  kDrawTransform,
+  // World space bounds, split up by component so that they can be culled in batches.
+  kDrawCenterX,
+  kDrawCenterY,
+  kDrawCenterZ,
+  kDrawExtentX,
+  kDrawExtentY,
+  kDrawExtentZ,
+};
+typedef SoaArray<const gfx::GraphicsPSO*, u32, u32, u32, f32, f32, f32, f32, f32, f32> DrawList;
+
+struct OccluderDraw
+{
+  const OccluderMesh* mesh = nullptr;
+  // Index into Renderer::transforms.
+  u32 transform = 0;
+};
+
+struct RenderStats
+{
+  u32 draws_submitted = 0;
+  u32 draws_frustum_culled = 0;
+  u32 draws_occlusion_culled = 0;
+  // That made it into the occlusion buffer, after near plane and off screen ones were dropped.
+  u32 occluder_triangles = 0;
 };
 
 enum ResolutionScale
@@ -216,6 +263,7 @@ struct RenderOptions
   f32 focal_dist = 3.0f;
   f32 focal_range = 20.0f;
   RenderBuffers::Entry debug_view = RenderBuffers::kDoFBlurredNear;
+  bool occlusion_culling = true;
 };
 
 struct Renderer
@@ -249,12 +297,21 @@ struct Renderer
   gfx::DescriptorLinearAllocator imgui_descriptor_heap;
 
 	interlop::DDGIVolDesc ddgi_vol_desc;
+  // Only used for the per-frame probe ray rotation, so that runs are reproducible.
+  Pcg32 probe_ray_rng;
   gfx::GpuImage probe_ray_data;
   gfx::GpuImage probe_irradiance;
   gfx::GpuImage probe_distance;
   gfx::GpuImage probe_offset;
 
-  Array<Mesh> meshes;
+  DrawList draws;
+  Array<interlop::Transform> transforms;
+  Array<OccluderDraw> occluders;
+
+  OcclusionBuffer occlusion_buffer;
+
+  // From the last execute_render.
+  RenderStats stats;
 };
 
 Renderer init_renderer(MEMORY_ARENA_PARAM,
@@ -266,7 +323,9 @@ void destroy_renderer(Renderer* renderer);
 
 
 void begin_renderer_recording(MEMORY_ARENA_PARAM, Renderer* renderer);
-void submit_mesh(Renderer* renderer, Mesh mesh);
+// Returns the index to submit meshes with.
+u32 submit_transform(Renderer* renderer, const Mat4& world, const Mat4& normal);
+void submit_mesh(Renderer* renderer, const Mesh& mesh, u32 transform);
 
 struct Camera
 {
@@ -296,6 +355,8 @@ enum SceneObjectFlags : u8
 struct SceneObject
 {
   Array<Mesh> meshes;
+  // Node in Scene::transforms.
+  u32 transform = 0;
   u8 flags = 0;
 };
 
@@ -314,6 +375,7 @@ struct Scene
   
   Array<SceneObject>          scene_objects;
   Array<interlop::PointLight> point_lights;
+  TransformHierarchy          transforms;
   Camera                      camera;
   interlop::DirectionalLight  directional_light;
   MemoryArena                 scene_object_heap;
@@ -120,3 +120,85 @@ bool ring_buffer_is_empty(const RingBuffer& rb)
 {
   return rb.read == rb.write;
 }
+
+MirroredRingBuffer
+init_mirrored_ring_buffer(size_t size)
+{
+  ASSERT(size > 0);
+
+  // The allocation granularity is a power of 2 too, so rounding up to it afterwards keeps this one.
+  MirroredRingBuffer ret;
+  ret.memory = alloc_mirrored_memory(next_pow2(size));
+  ASSERT(is_pow2(ret.memory.size));
+
+  return ret;
+}
+
+void
+destroy_mirrored_ring_buffer(MirroredRingBuffer* rb)
+{
+  free_mirrored_memory(&rb->memory);
+  rb->write = 0;
+  rb->read = 0;
+}
+
+check_return void*
+try_mirrored_ring_buffer_push(MirroredRingBuffer* rb, size_t size)
+{
+  if (rb->memory.size - (rb->write - rb->read) < size)
+    return nullptr;
+
+  // Even if this runs off the end, the rest of it lands at the start through the mirror.
+  void* ret = rb->memory.base + (rb->write & (rb->memory.size - 1));
+  rb->write += size;
+
+  return ret;
+}
+
+void*
+mirrored_ring_buffer_push(MirroredRingBuffer* rb, size_t size)
+{
+  void* ret = try_mirrored_ring_buffer_push(rb, size);
+  ASSERT(ret != nullptr);
+  return ret;
+}
+
+check_return void*
+mirrored_ring_buffer_peek(const MirroredRingBuffer* rb, size_t size)
+{
+  if (rb->write - rb->read < size)
+    return nullptr;
+
+  return rb->memory.base + (rb->read & (rb->memory.size - 1));
+}
+
+check_return void*
+try_mirrored_ring_buffer_pop(MirroredRingBuffer* rb, size_t size)
+{
+  void* ret = mirrored_ring_buffer_peek(rb, size);
+  if (ret == nullptr)
+    return nullptr;
+
+  rb->read += size;
+  return ret;
+}
+
+void*
+mirrored_ring_buffer_pop(MirroredRingBuffer* rb, size_t size)
+{
+  void* ret = try_mirrored_ring_buffer_pop(rb, size);
+  ASSERT(ret != nullptr);
+  return ret;
+}
+
+u64
+mirrored_ring_buffer_size(const MirroredRingBuffer& rb)
+{
+  return rb.write - rb.read;
+}
+
+bool
+mirrored_ring_buffer_is_empty(const MirroredRingBuffer& rb)
+{
+  return rb.read == rb.write;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "memory/memory.h"
+#include "atomics.h"
 
 struct RingBuffer
 {
@@ -24,6 +25,39 @@ void ring_buffer_pop(RingBuffer* rb, size_t size, void* out = nullptr);
 //bool ring_buffer_is_full(const RingBuffer& rb);
 bool ring_buffer_is_empty(const RingBuffer& rb);
 
+// A ring buffer on top of MirroredMemory, so every record is contiguous no matter where it
+// lands, even if it straddles the end of the buffer. That means no watermark, no wasted space
+// at the end for variable sized records, and push/pop can hand back pointers into the buffer
+// instead of copying through caller storage.
+//
+// It owns its memory rather than taking an arena, since it needs its own mapping.
+// Single threaded, same as RingBuffer.
+struct MirroredRingBuffer
+{
+  MirroredMemory memory;
+  // Only ever count up, and get masked into the buffer. write - read is how much is in it.
+  u64 write = 0;
+  u64 read = 0;
+};
+
+// The size gets rounded up to a power of 2 that's at least the allocation granularity (64KiB on
+// Windows), since the positions get masked into the buffer.
+MirroredRingBuffer init_mirrored_ring_buffer(size_t size);
+void destroy_mirrored_ring_buffer(MirroredRingBuffer* rb);
+
+// Returns where to write the `size` bytes being pushed, or nullptr if there isn't room.
+check_return void* try_mirrored_ring_buffer_push(MirroredRingBuffer* rb, size_t size);
+void* mirrored_ring_buffer_push(MirroredRingBuffer* rb, size_t size);
+// Returns the `size` bytes at the front without popping them, or nullptr if there aren't that many.
+check_return void* mirrored_ring_buffer_peek(const MirroredRingBuffer* rb, size_t size);
+// Returns the `size` bytes that were popped, or nullptr if there aren't that many. The
+// memory stays valid until a push reuses it.
+check_return void* try_mirrored_ring_buffer_pop(MirroredRingBuffer* rb, size_t size);
+void* mirrored_ring_buffer_pop(MirroredRingBuffer* rb, size_t size);
+
+u64 mirrored_ring_buffer_size(const MirroredRingBuffer& rb);
+bool mirrored_ring_buffer_is_empty(const MirroredRingBuffer& rb);
+
 template <typename T>
 struct RingQueue
 {
@@ -86,3 +120,337 @@ ring_queue_peak_front(const RingQueue<T>& queue, T* out = nullptr)
   ASSERT(!ring_queue_is_empty(queue));
   memcpy(out, queue.buffer.buffer + queue.buffer.read, sizeof(T));
 }
+
+// Lock-free queues for passing things between threads without wrapping a RingQueue in a lock.
+//
+// Both of these use read/write indices that only ever count up and get masked into a power of
+// 2 sized buffer, so unlike RingBuffer every slot can actually be used and full vs. empty is
+// just write - read == capacity vs. write == read. The indices are 64 bits, so they're never
+// going to wrap.
+//
+// The indices that different threads write to are on their own cache lines, otherwise a
+// producer and consumer on different cores would keep stealing the same line from each other
+// even though they never touch the same data.
+
+// Single producer, single consumer. Exactly one thread may push and exactly one thread may pop
+// (which can be a different one), everything else is undefined. The producer keeps a cached copy
+// of the read index and the consumer a cached copy of the write index, so they only have to
+// look at each other's cache line when the queue looks full/empty from their side.
+template <typename T>
+struct SpscQueue
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  // Never written after init.
+  alignas(64) T* buffer = nullptr;
+  u64 mask = 0;
+
+  // Producer's line.
+  alignas(64) Atomic<u64> write = 0;
+  u64 cached_read = 0;
+
+  // Consumer's line.
+  alignas(64) Atomic<u64> read = 0;
+  u64 cached_write = 0;
+};
+
+// The capacity gets rounded up to a power of 2.
+template <typename T>
+inline SpscQueue<T>
+init_spsc_queue(MEMORY_ARENA_PARAM, size_t capacity)
+{
+  ASSERT(capacity > 0);
+  capacity = next_pow2(capacity);
+
+  SpscQueue<T> ret;
+  ret.buffer = (T*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(T) * capacity, MAX(alignof(T), 64));
+  ret.mask   = capacity - 1;
+  return ret;
+}
+
+template <typename T>
+inline u64
+spsc_queue_capacity(const SpscQueue<T>* queue)
+{
+  return queue->mask + 1;
+}
+
+// Pushes as many of items as will fit (up to count) and returns how many that was. They all
+// become visible to the consumer at once.
+template <typename T>
+inline size_t
+spsc_queue_push_batch(SpscQueue<T>* queue, const T* items, size_t count)
+{
+  u64 write    = atomic_load(&queue->write, kMemoryOrderRelaxed);
+  u64 capacity = spsc_queue_capacity(queue);
+  if (capacity - (write - queue->cached_read) < count)
+  {
+    queue->cached_read = atomic_load(&queue->read, kMemoryOrderAcquire);
+  }
+
+  size_t n = MIN(count, capacity - (write - queue->cached_read));
+  if (n == 0)
+    return 0;
+
+  // At most two copies, one up to the end of the buffer and one from the start.
+  u64 start = write & queue->mask;
+  size_t first = MIN(n, capacity - start);
+  memcpy(queue->buffer + start, items, sizeof(T) * first);
+  memcpy(queue->buffer, items + first, sizeof(T) * (n - first));
+
+  atomic_store(&queue->write, write + n, kMemoryOrderRelease);
+  return n;
+}
+
+template <typename T>
+inline check_return bool
+try_spsc_queue_push(SpscQueue<T>* queue, const T& item)
+{
+  return spsc_queue_push_batch(queue, &item, 1) == 1;
+}
+
+// Pops up to count items into out and returns how many there were.
+template <typename T>
+inline size_t
+spsc_queue_pop_batch(SpscQueue<T>* queue, T* out, size_t count)
+{
+  u64 read = atomic_load(&queue->read, kMemoryOrderRelaxed);
+  if (queue->cached_write - read < count)
+  {
+    queue->cached_write = atomic_load(&queue->write, kMemoryOrderAcquire);
+  }
+
+  size_t n = MIN(count, queue->cached_write - read);
+  if (n == 0)
+    return 0;
+
+  u64 capacity = spsc_queue_capacity(queue);
+  u64 start = read & queue->mask;
+  size_t first = MIN(n, capacity - start);
+  memcpy(out, queue->buffer + start, sizeof(T) * first);
+  memcpy(out + first, queue->buffer, sizeof(T) * (n - first));
+
+  atomic_store(&queue->read, read + n, kMemoryOrderRelease);
+  return n;
+}
+
+template <typename T>
+inline check_return bool
+try_spsc_queue_pop(SpscQueue<T>* queue, T* out)
+{
+  return spsc_queue_pop_batch(queue, out, 1) == 1;
+}
+
+// Only a snapshot, it's allowed to be stale by the time you look at it.
+template <typename T>
+inline u64
+spsc_queue_size(const SpscQueue<T>* queue)
+{
+  u64 read = atomic_load(&queue->read, kMemoryOrderRelaxed);
+  return atomic_load(&queue->write, kMemoryOrderRelaxed) - read;
+}
+
+// Bounded multi producer, multi consumer queue (Dmitry Vyukov's). Every cell has a sequence
+// number that says whose turn it is: a producer at index i can write a cell once its sequence
+// is i, and then publishes it by setting it to i + 1. A consumer at index i can read a cell once
+// its sequence is i + 1, and then hands it back to the producers by setting it to
+// i + capacity. Threads claim an index with a CAS on write/read, so there's no lock, and
+// producers and consumers only ever contend with each other on the cells themselves.
+template <typename T>
+struct MpmcQueue
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  struct Cell
+  {
+    Atomic<u64> sequence;
+    T data;
+  };
+
+  // Never written after init.
+  alignas(64) Cell* cells = nullptr;
+  u64 mask = 0;
+
+  alignas(64) Atomic<u64> write = 0;
+  alignas(64) Atomic<u64> read = 0;
+};
+
+// The capacity gets rounded up to a power of 2.
+template <typename T>
+inline MpmcQueue<T>
+init_mpmc_queue(MEMORY_ARENA_PARAM, size_t capacity)
+{
+  using Cell = typename MpmcQueue<T>::Cell;
+
+  ASSERT(capacity > 0);
+  capacity = next_pow2(capacity);
+
+  MpmcQueue<T> ret;
+  ret.cells = (Cell*)push_memory_arena_aligned(MEMORY_ARENA_FWD, sizeof(Cell) * capacity, MAX(alignof(Cell), 64));
+  ret.mask  = capacity - 1;
+  for (u64 i = 0; i < capacity; i++)
+  {
+    atomic_store(&ret.cells[i].sequence, i, kMemoryOrderRelaxed);
+  }
+
+  return ret;
+}
+
+template <typename T>
+inline u64
+mpmc_queue_capacity(const MpmcQueue<T>* queue)
+{
+  return queue->mask + 1;
+}
+
+template <typename T>
+inline check_return bool
+try_mpmc_queue_push(MpmcQueue<T>* queue, const T& item)
+{
+  u64 write = atomic_load(&queue->write, kMemoryOrderRelaxed);
+  typename MpmcQueue<T>::Cell* cell = nullptr;
+  while (true)
+  {
+    cell = queue->cells + (write & queue->mask);
+    u64 sequence = atomic_load(&cell->sequence, kMemoryOrderAcquire);
+    s64 diff = s64(sequence - write);
+    if (diff == 0)
+    {
+      if (atomic_compare_exchange_weak(&queue->write, &write, write + 1, kMemoryOrderRelaxed, kMemoryOrderRelaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      // The consumer from the last lap hasn't taken this cell yet, so we're full.
+      return false;
+    }
+    else
+    {
+      // Someone else got this index first.
+      write = atomic_load(&queue->write, kMemoryOrderRelaxed);
+    }
+  }
+
+  cell->data = item;
+  atomic_store(&cell->sequence, write + 1, kMemoryOrderRelease);
+  return true;
+}
+
+template <typename T>
+inline check_return bool
+try_mpmc_queue_pop(MpmcQueue<T>* queue, T* out)
+{
+  u64 read = atomic_load(&queue->read, kMemoryOrderRelaxed);
+  typename MpmcQueue<T>::Cell* cell = nullptr;
+  while (true)
+  {
+    cell = queue->cells + (read & queue->mask);
+    u64 sequence = atomic_load(&cell->sequence, kMemoryOrderAcquire);
+    s64 diff = s64(sequence - (read + 1));
+    if (diff == 0)
+    {
+      if (atomic_compare_exchange_weak(&queue->read, &read, read + 1, kMemoryOrderRelaxed, kMemoryOrderRelaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      // Nothing has been published here yet, so we're empty.
+      return false;
+    }
+    else
+    {
+      read = atomic_load(&queue->read, kMemoryOrderRelaxed);
+    }
+  }
+
+  *out = cell->data;
+  atomic_store(&cell->sequence, read + queue->mask + 1, kMemoryOrderRelease);
+  return true;
+}
+
+// Claims room for up to count items with a single CAS and returns how many it pushed. This is
+// what makes kicking a big batch of jobs cheap, since all of the producers only fight over the
+// write index once per batch instead of once per item.
+//
+// The catch is that a claimed cell might still be getting read by a consumer from the last lap
+// (it bumped read but hasn't finished copying out yet), so this has to wait for that consumer
+// to hand the cell back. That's only ever a copy's worth of waiting unless the consumer gets
+// descheduled right in the middle of it.
+template <typename T>
+inline size_t
+mpmc_queue_push_batch(MpmcQueue<T>* queue, const T* items, size_t count)
+{
+  u64 capacity = mpmc_queue_capacity(queue);
+  u64 write = atomic_load(&queue->write, kMemoryOrderRelaxed);
+  size_t n = 0;
+  while (true)
+  {
+    u64 read = atomic_load(&queue->read, kMemoryOrderAcquire);
+    s64 used = s64(write - read);
+    n = MIN(count, size_t(capacity - MAX(used, 0)));
+    if (n == 0)
+      return 0;
+
+    if (atomic_compare_exchange_weak(&queue->write, &write, write + n, kMemoryOrderRelaxed, kMemoryOrderRelaxed))
+      break;
+  }
+
+  for (size_t i = 0; i < n; i++)
+  {
+    auto* cell = queue->cells + ((write + i) & queue->mask);
+    while (atomic_load(&cell->sequence, kMemoryOrderAcquire) != write + i)
+    {
+      cpu_relax();
+    }
+
+    cell->data = items[i];
+    atomic_store(&cell->sequence, write + i + 1, kMemoryOrderRelease);
+  }
+
+  return n;
+}
+
+// Same idea as mpmc_queue_push_batch: claims up to count of the items that producers have
+// claimed so far, then waits for any of those that are still being written.
+template <typename T>
+inline size_t
+mpmc_queue_pop_batch(MpmcQueue<T>* queue, T* out, size_t count)
+{
+  u64 read = atomic_load(&queue->read, kMemoryOrderRelaxed);
+  size_t n = 0;
+  while (true)
+  {
+    u64 write = atomic_load(&queue->write, kMemoryOrderAcquire);
+    s64 available = s64(write - read);
+    n = MIN(count, size_t(MAX(available, 0)));
+    if (n == 0)
+      return 0;
+
+    if (atomic_compare_exchange_weak(&queue->read, &read, read + n, kMemoryOrderRelaxed, kMemoryOrderRelaxed))
+      break;
+  }
+
+  for (size_t i = 0; i < n; i++)
+  {
+    auto* cell = queue->cells + ((read + i) & queue->mask);
+    while (atomic_load(&cell->sequence, kMemoryOrderAcquire) != read + i + 1)
+    {
+      cpu_relax();
+    }
+
+    out[i] = cell->data;
+    atomic_store(&cell->sequence, read + i + queue->mask + 1, kMemoryOrderRelease);
+  }
+
+  return n;
+}
+
+// Only a snapshot, it's allowed to be stale by the time you look at it.
+template <typename T>
+inline u64
+mpmc_queue_size(const MpmcQueue<T>* queue)
+{
+  u64 read  = atomic_load(&queue->read, kMemoryOrderRelaxed);
+  u64 write = atomic_load(&queue->write, kMemoryOrderRelaxed);
+  return write > read ? write - read : 0;
+}
@@ -16,4 +16,43 @@ float3 quaternion_rotate(float3 v, float4 q)
   return (v * (q.w * q.w - b2) + b * (dot(v, b) * 2.f) + cross(b, v) * (q.w * 2.f));
 }
 
+// Low-discrepancy sequences, same as the ones in math/random.h on the CPU.
+float radical_inverse_base2(uint index)
+{
+  return float(reversebits(index) >> 8) * (1.f / 16777216.f);
+}
+
+float halton(uint index, uint base)
+{
+  float inv_base = 1.f / float(base);
+  float fraction = inv_base;
+  float ret = 0.f;
+  while (index > 0)
+  {
+    ret += fraction * float(index % base);
+    index /= base;
+    fraction *= inv_base;
+  }
+  return ret;
+}
+
+float2 halton_2d(uint index)
+{
+  return float2(radical_inverse_base2(index), halton(index, 3));
+}
+
+float2 sobol_2d(uint index)
+{
+  uint bits = 0;
+  uint v = 1u << 31;
+  for (uint i = index; i != 0; i >>= 1, v ^= v >> 1)
+  {
+    if (i & 1)
+    {
+      bits ^= v;
+    }
+  }
+  return float2(radical_inverse_base2(index), float(bits >> 8) * (1.f / 16777216.f));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,341 @@
+#pragma once
+#include "memory/memory.h"
+#include "array.h"
+#include <tuple>
+
+// Struct-of-arrays container, each field gets its own contiguous column. Loops that only
+// touch one or two fields (culling on bounds, sorting on a key, summing index counts) then
+// only pull those columns through the cache instead of every whole record.
+//
+// Fields are accessed by index, so it's a good idea to give them names with an enum:
+//
+//   enum { kDrawPso, kDrawIndexCount };
+//   SoaArray<const GraphicsPSO*, u32> draws = init_soa_array<const GraphicsPSO*, u32>(arena, 128);
+//   soa_push(&draws, pso, index_count);
+//   u32* counts = soa_column<kDrawIndexCount>(&draws);
+//   for (auto [pso, index_count] : draws) { ... }
+//
+// The fields are copied around with memcpy, so they need to be trivially copyable.
+template <typename... Fields>
+struct SoaArray
+{
+  static_assert((std::is_trivially_copyable_v<Fields> && ...));
+
+  static constexpr size_t kFieldCount = sizeof...(Fields);
+
+  template <size_t I>
+  using Field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+  void* columns[kFieldCount] = {};
+  size_t size = 0;
+  size_t capacity = 0;
+  // Grows into this arena when it runs out of capacity, so it needs to outlive the array.
+  MemoryArena* arena = nullptr;
+
+  template <typename Container, typename Row>
+  struct Iter
+  {
+    Container* container = nullptr;
+    size_t index = 0;
+
+    Row operator*() const { return container->row(index, std::index_sequence_for<Fields...>{}); }
+    Iter& operator++() { index++; return *this; }
+    bool operator!=(const Iter& rhs) const { return index != rhs.index; }
+  };
+
+  template <size_t... Is>
+  std::tuple<Fields&...> row(size_t index, std::index_sequence<Is...>)
+  {
+    return std::tuple<Fields&...>(((Fields*)columns[Is])[index]...);
+  }
+
+  template <size_t... Is>
+  std::tuple<const Fields&...> row(size_t index, std::index_sequence<Is...>) const
+  {
+    return std::tuple<const Fields&...>(((const Fields*)columns[Is])[index]...);
+  }
+
+  Iter<SoaArray, std::tuple<Fields&...>> begin() { return {this, 0}; }
+  Iter<SoaArray, std::tuple<Fields&...>> end() { return {this, size}; }
+  Iter<const SoaArray, std::tuple<const Fields&...>> begin() const { return {this, 0}; }
+  Iter<const SoaArray, std::tuple<const Fields&...>> end() const { return {this, size}; }
+};
+
+template <size_t I, typename... Fields>
+inline typename SoaArray<Fields...>::template Field<I>*
+soa_column(SoaArray<Fields...>* arr)
+{
+  return (typename SoaArray<Fields...>::template Field<I>*)arr->columns[I];
+}
+
+template <size_t I, typename... Fields>
+inline const typename SoaArray<Fields...>::template Field<I>*
+soa_column(const SoaArray<Fields...>* arr)
+{
+  return (const typename SoaArray<Fields...>::template Field<I>*)arr->columns[I];
+}
+
+template <size_t I, typename... Fields>
+inline Span<typename SoaArray<Fields...>::template Field<I>>
+soa_span(const SoaArray<Fields...>* arr)
+{
+  return Span<typename SoaArray<Fields...>::template Field<I>>(soa_column<I>(arr), arr->size);
+}
+
+template <typename... Fields>
+inline std::tuple<Fields&...>
+soa_at(SoaArray<Fields...>* arr, size_t index)
+{
+  ASSERT(index < arr->size);
+  return arr->row(index, std::index_sequence_for<Fields...>{});
+}
+
+template <typename... Fields>
+inline void
+soa_alloc_columns(SoaArray<Fields...>* arr, size_t capacity)
+{
+  size_t sizes[] = { sizeof(Fields)... };
+  size_t alignments[] = { alignof(Fields)... };
+
+  for (size_t i = 0; i < sizeof...(Fields); i++)
+  {
+    // Cache line aligned so that SIMD loops over a column don't straddle lines at the start.
+    void* column = push_memory_arena_aligned(arr->arena, sizes[i] * capacity, MAX(alignments[i], 64));
+    if (arr->size > 0)
+    {
+      memcpy(column, arr->columns[i], sizes[i] * arr->size);
+    }
+    arr->columns[i] = column;
+  }
+
+  arr->capacity = capacity;
+}
+
+template <typename... Fields>
+inline SoaArray<Fields...>
+init_soa_array(MEMORY_ARENA_PARAM, size_t capacity)
+{
+  ASSERT(capacity > 0);
+
+  SoaArray<Fields...> ret;
+  ret.arena = MEMORY_ARENA_FWD;
+  soa_alloc_columns(&ret, capacity);
+  return ret;
+}
+
+// Unlike a growable Array this can't extend in place since there's more than one block, so
+// growing always copies every column into new blocks.
+template <typename... Fields>
+inline void
+soa_reserve(SoaArray<Fields...>* arr, size_t capacity)
+{
+  if (capacity <= arr->capacity)
+    return;
+
+  soa_alloc_columns(arr, MAX(capacity, arr->capacity * 2));
+}
+
+// Adds a zeroed row and returns its index.
+template <typename... Fields>
+inline size_t
+soa_add(SoaArray<Fields...>* arr)
+{
+  soa_reserve(arr, arr->size + 1);
+
+  size_t sizes[] = { sizeof(Fields)... };
+  for (size_t i = 0; i < sizeof...(Fields); i++)
+  {
+    zero_memory((u8*)arr->columns[i] + sizes[i] * arr->size, sizes[i]);
+  }
+
+  return arr->size++;
+}
+
+template <typename... Fields>
+inline size_t
+soa_push(SoaArray<Fields...>* arr, const std::type_identity_t<Fields>&... values)
+{
+  soa_reserve(arr, arr->size + 1);
+
+  size_t index = arr->size++;
+  soa_at(arr, index) = std::tuple<const Fields&...>(values...);
+  return index;
+}
+
+// NOTE: This is an unordered remove, same as array_remove.
+template <typename... Fields>
+inline void
+soa_remove(SoaArray<Fields...>* arr, size_t index)
+{
+  ASSERT(index < arr->size);
+
+  arr->size--;
+  size_t sizes[] = { sizeof(Fields)... };
+  for (size_t i = 0; i < sizeof...(Fields); i++)
+  {
+    u8* column = (u8*)arr->columns[i];
+    memcpy(column + sizes[i] * index, column + sizes[i] * arr->size, sizes[i]);
+  }
+}
+
+template <typename... Fields>
+inline void
+clear_soa_array(SoaArray<Fields...>* arr)
+{
+  arr->size = 0;
+}
+
+template <typename T>
+inline void
+soa_compact_column(T* column, const u32* kept_rows, size_t kept_count)
+{
+  for (size_t i = 0; i < kept_count; i++)
+  {
+    column[i] = column[kept_rows[i]];
+  }
+}
+
+template <typename T>
+inline void
+soa_gather_column(MEMORY_ARENA_PARAM, T* column, const u32* order, size_t count)
+{
+  T* tmp = push_memory_arena<T>(MEMORY_ARENA_FWD, count);
+  for (size_t i = 0; i < count; i++)
+  {
+    tmp[i] = column[order[i]];
+  }
+  memcpy(column, tmp, sizeof(T) * count);
+}
+
+// Keeps only the rows for which keep(index) returns true, in their original order. keep gets
+// called exactly once per row, before anything has moved, so it can look at whatever columns
+// it needs. Then each column gets compacted on its own, so each one is a single forward pass.
+// Scratch space is pushed onto the arena and popped again before returning.
+template <typename... Fields, typename F>
+inline void
+soa_filter(MEMORY_ARENA_PARAM, SoaArray<Fields...>* arr, F keep)
+{
+  uintptr_t* pos = memory_arena_pos_ptr(MEMORY_ARENA_FWD);
+  uintptr_t saved_pos = *pos;
+  defer { *pos = saved_pos; };
+
+  u32* kept_rows = push_memory_arena<u32>(MEMORY_ARENA_FWD, arr->size);
+  size_t kept_count = 0;
+  for (size_t i = 0; i < arr->size; i++)
+  {
+    kept_rows[kept_count] = u32(i);
+    kept_count += keep(i) ? 1 : 0;
+  }
+
+  [&]<size_t... Is>(std::index_sequence<Is...>)
+  {
+    (soa_compact_column(soa_column<Is>(arr), kept_rows, kept_count), ...);
+  }(std::index_sequence_for<Fields...>{});
+
+  arr->size = kept_count;
+}
+
+// Reorders the rows so that row i ends up being what was previously row order[i].
+template <typename... Fields>
+inline void
+soa_permute(MEMORY_ARENA_PARAM, SoaArray<Fields...>* arr, const u32* order)
+{
+  uintptr_t* pos = memory_arena_pos_ptr(MEMORY_ARENA_FWD);
+  uintptr_t saved_pos = *pos;
+  defer { *pos = saved_pos; };
+
+  [&]<size_t... Is>(std::index_sequence<Is...>)
+  {
+    (soa_gather_column(MEMORY_ARENA_FWD, soa_column<Is>(arr), order, arr->size), ...);
+  }(std::index_sequence_for<Fields...>{});
+}
+
+// Stable LSD radix sort of (key, index) pairs, 8 bits at a time. Passes where every key has the
+// same byte are skipped, so small keys (like a 16 bit sort key in a u64) only pay for the bytes
+// they actually use. Scratch space is pushed onto the arena and popped again before returning.
+inline void
+radix_sort_u64(MEMORY_ARENA_PARAM, u64* keys, u32* indices, size_t count)
+{
+  if (count == 0)
+    return;
+
+  uintptr_t* pos = memory_arena_pos_ptr(MEMORY_ARENA_FWD);
+  uintptr_t saved_pos = *pos;
+  defer { *pos = saved_pos; };
+
+  u64* src_keys = keys;
+  u32* src_indices = indices;
+  u64* dst_keys = push_memory_arena<u64>(MEMORY_ARENA_FWD, count);
+  u32* dst_indices = push_memory_arena<u32>(MEMORY_ARENA_FWD, count);
+
+  // All 8 histograms in one pass over the keys.
+  u32 histograms[8][256] = {};
+  for (size_t i = 0; i < count; i++)
+  {
+    u64 key = keys[i];
+    for (u32 b = 0; b < 8; b++)
+    {
+      histograms[b][(key >> (b * 8)) & 0xFF]++;
+    }
+  }
+
+  for (u32 b = 0; b < 8; b++)
+  {
+    u32 shift = b * 8;
+    u32* histogram = histograms[b];
+    if (histogram[(keys[0] >> shift) & 0xFF] == count)
+      continue;
+
+    u32 offset = 0;
+    for (u32 i = 0; i < 256; i++)
+    {
+      u32 bucket = histogram[i];
+      histogram[i] = offset;
+      offset += bucket;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      u32 dst = histogram[(src_keys[i] >> shift) & 0xFF]++;
+      dst_keys[dst] = src_keys[i];
+      dst_indices[dst] = src_indices[i];
+    }
+
+    u64* swap_keys = src_keys;
+    src_keys = dst_keys;
+    dst_keys = swap_keys;
+
+    u32* swap_indices = src_indices;
+    src_indices = dst_indices;
+    dst_indices = swap_indices;
+  }
+
+  // An odd number of passes leaves the result in the scratch buffers.
+  if (src_keys != keys)
+  {
+    memcpy(keys, src_keys, sizeof(u64) * count);
+    memcpy(indices, src_indices, sizeof(u32) * count);
+  }
+}
+
+// Stable sort of the rows by key(index), which can be anything that fits in a u64. Sorts
+// (key, row) pairs and then moves each column once.
+template <typename... Fields, typename F>
+inline void
+soa_sort(MEMORY_ARENA_PARAM, SoaArray<Fields...>* arr, F key)
+{
+  uintptr_t* pos = memory_arena_pos_ptr(MEMORY_ARENA_FWD);
+  uintptr_t saved_pos = *pos;
+  defer { *pos = saved_pos; };
+
+  u64* keys = push_memory_arena<u64>(MEMORY_ARENA_FWD, arr->size);
+  u32* order = push_memory_arena<u32>(MEMORY_ARENA_FWD, arr->size);
+  for (size_t i = 0; i < arr->size; i++)
+  {
+    keys[i] = key(i);
+    order[i] = u32(i);
+  }
+
+  radix_sort_u64(MEMORY_ARENA_FWD, keys, order, arr->size);
+  soa_permute(MEMORY_ARENA_FWD, arr, order);
+}
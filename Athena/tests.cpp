@@ -1,9 +1,18 @@
 #include "types.h"
 #include "math/math.h"
+#include "math/mat.h"
+#include "math/pack.h"
+#include "math/random.h"
+#include "math/simd.h"
 #include "ring_buffer.h"
 #include "pool_allocator.h"
 #include "job_system.h"
 #include "hash_table.h"
+#include "concurrent_hash_table.h"
+#include "soa_array.h"
+#include "transform_hierarchy.h"
+#include "occlusion.h"
+#include "bvh.h"
 #include "render_graph.h"
 
 void
@@ -180,6 +189,311 @@ test_vector_operators()
 //}
 
 
+static bool
+nearly_equal(f32 a, f32 b, f32 tolerance = 1e-5f)
+{
+  return fabsf(a - b) <= tolerance * MAX(1.0f, MAX(fabsf(a), fabsf(b)));
+}
+
+static void
+test_dot_f32_arrays()
+{
+  Vec4 a[8];
+  Vec4 b[8];
+  for (u32 i = 0; i < 8; i++)
+  {
+    a[i] = Vec4(f32(i), f32(i) + 1.0f, -2.0f, 0.5f * f32(i));
+    b[i] = Vec4(1.0f, -1.0f, f32(i), 3.0f);
+  }
+
+  f32 out[8];
+  dot_f32_arrays_x4(a, b, 8, out);
+  for (u32 i = 0; i < 8; i++)
+  {
+    ASSERT(nearly_equal(out[i], dot_f32(a[i].avx, b[i].avx)));
+  }
+}
+
+// The in-register reductions against doubles, and the rsqrt + Newton-Raphson versions against
+// the error bound documented on rsqrt_fast_f32, over a spread of magnitudes from tiny to huge.
+static void
+test_vector_reductions()
+{
+  Vec4 a(1.0f, -2.0f, 3.0f, 4.0f);
+  Vec4 b(5.0f, 6.0f, -7.0f, 8.0f);
+  ASSERT(dot_f32(a.avx, b.avx) == 5.0f - 12.0f - 21.0f + 32.0f);
+
+  Vec4 splat = dot_splat_f32(a.avx, b.avx);
+  ASSERT(splat.x == 4.0f && splat.y == 4.0f && splat.z == 4.0f && splat.w == 4.0f);
+
+  // Whatever is in w shouldn't leak into a Vec3 dot, or y into a Vec2 one.
+  Vec3 a3 = Vec3(_mm_setr_ps(1.0f, 2.0f, 3.0f, 100.0f));
+  Vec3 b3 = Vec3(_mm_setr_ps(4.0f, 5.0f, 6.0f, 100.0f));
+  ASSERT(dot_f32(a3, b3) == 32.0f);
+  ASSERT(dot_f32(Vec2(3.0f, 4.0f), Vec2(2.0f, -1.0f)) == 2.0f);
+
+  ASSERT(length_f32(Vec4(2.0f, 3.0f, 6.0f, 0.0f).avx) == 7.0f);
+
+  constant f32 kFastMaxError = 4.8e-7f; // 2^-21
+  f64 max_rsqrt_error = 0.0;
+  f64 max_normalize_error = 0.0;
+  for (s32 exponent = -30; exponent <= 30; exponent++)
+  {
+    for (u32 i = 0; i < 64; i++)
+    {
+      f32 t = f32(i);
+      f32 scale = powf(2.0f, f32(exponent)) * (1.0f + t / 64.0f);
+      Vec4 v(sinf(t) * scale, cosf(t * 1.3f) * scale, (t / 32.0f - 1.0f) * scale, 0.0f);
+
+      f64 x = v.x, y = v.y, z = v.z;
+      f64 length = sqrt(x * x + y * y + z * z);
+
+      f64 relative = fabs(f64(length_f32(v.avx)) - length) / length;
+      ASSERT(relative < 1e-6);
+
+      relative = fabs(f64(length_fast_f32(v.avx)) - length) / length;
+      max_rsqrt_error = MAX(max_rsqrt_error, relative);
+
+      Vec4 exact = normalize_f32(v.avx);
+      Vec4 fast = normalize_fast_f32(v.avx);
+      f64 expected[3] = { x / length, y / length, z / length };
+      f32 got_exact[3] = { exact.x, exact.y, exact.z };
+      f32 got_fast[3] = { fast.x, fast.y, fast.z };
+      for (u32 c = 0; c < 3; c++)
+      {
+        // Relative to the whole vector, since a component can be right next to zero.
+        ASSERT(fabs(f64(got_exact[c]) - expected[c]) < 1e-6);
+        max_normalize_error = MAX(max_normalize_error, fabs(f64(got_fast[c]) - expected[c]));
+      }
+    }
+  }
+
+  ASSERT(max_rsqrt_error < kFastMaxError);
+  ASSERT(max_normalize_error < kFastMaxError);
+}
+
+// Every batch kernel at every level the CPU has, against the one at a time versions in
+// math.h. 37 so that there are leftovers for every width.
+static void
+test_batch_math()
+{
+  MemoryArena arena = alloc_memory_arena(KiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u32 kCount = 37;
+  Vec3Soa a = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa b = alloc_vec3_soa(&arena, kCount);
+  Vec4Soa c = alloc_vec4_soa(&arena, kCount);
+  Vec3Soa out3 = alloc_vec3_soa(&arena, kCount);
+  Vec4Soa out4 = alloc_vec4_soa(&arena, kCount);
+  f32* dots = push_memory_arena<f32>(&arena, kCount);
+
+  for (u32 i = 0; i < kCount; i++)
+  {
+    f32 t = f32(i);
+    a.x[i] = t * 0.5f - 3.0f;  a.y[i] = 1.0f + t * 0.25f;  a.z[i] = sinf(t);
+    b.x[i] = cosf(t);          b.y[i] = -t;                b.z[i] = 2.0f;
+    c.x[i] = a.x[i];           c.y[i] = a.y[i];            c.z[i] = a.z[i];  c.w[i] = 1.0f - t;
+  }
+
+  Mat4 m = Mat4::columns(Vec4(1.0f, 2.0f, 0.0f, 0.5f),
+                         Vec4(0.0f, 1.0f, -1.0f, 0.0f),
+                         Vec4(3.0f, 0.0f, 1.0f, 0.0f),
+                         Vec4(4.0f, 5.0f, 6.0f, 1.0f));
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    batch_transform_points(m, a, out3, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec4 expected = m * Vec4(Vec3(a.x[i], a.y[i], a.z[i]), 1.0f).avx;
+      ASSERT(nearly_equal(out3.x[i], expected.x) && nearly_equal(out3.y[i], expected.y) && nearly_equal(out3.z[i], expected.z));
+    }
+
+    batch_transform_vec4(m, c, out4, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec4 expected = m * Vec4(c.x[i], c.y[i], c.z[i], c.w[i]).avx;
+      ASSERT(nearly_equal(out4.x[i], expected.x) && nearly_equal(out4.y[i], expected.y));
+      ASSERT(nearly_equal(out4.z[i], expected.z) && nearly_equal(out4.w[i], expected.w));
+    }
+
+    batch_dot_vec3(a, b, dots, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(nearly_equal(dots[i], dot_f32(Vec3(a.x[i], a.y[i], a.z[i]), Vec3(b.x[i], b.y[i], b.z[i]))));
+    }
+
+    batch_cross_vec3(a, b, out3, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec3 expected = cross_f32(Vec3(a.x[i], a.y[i], a.z[i]), Vec3(b.x[i], b.y[i], b.z[i]));
+      ASSERT(nearly_equal(out3.x[i], expected.x) && nearly_equal(out3.y[i], expected.y) && nearly_equal(out3.z[i], expected.z));
+    }
+
+    // In place.
+    batch_normalize_vec3(b, b, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(nearly_equal(b.x[i] * b.x[i] + b.y[i] * b.y[i] + b.z[i] * b.z[i], 1.0f));
+    }
+  }
+}
+
+// Known boxes and spheres around a camera at the origin looking down +z, then the batch
+// versions against aabb_in_frustum/sphere_in_frustum at every level.
+static void
+test_frustum_culling()
+{
+  Mat4 proj = perspective_infinite_reverse_lh(kPI / 2.0f, 1.0f, 0.1f);
+  Mat4 view = look_at_lh(Vec3(0.0f), Vec3(0.0f, 0.0f, 1.0f), Vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = frustum_from_view_proj(proj * view);
+
+  Vec3 half(0.5f);
+  ASSERT( aabb_in_frustum(frustum, Aabb{Vec3(0.0f, 0.0f, 10.0f), half}));
+  ASSERT( aabb_in_frustum(frustum, Aabb{Vec3(0.0f, 0.0f, 1e6f), half}));
+  // Behind the camera and in front of the near plane.
+  ASSERT(!aabb_in_frustum(frustum, Aabb{Vec3(0.0f, 0.0f, -10.0f), half}));
+  ASSERT(!aabb_in_frustum(frustum, Aabb{Vec3(0.0f, 0.0f, 0.0f), Vec3(0.01f)}));
+  // 90 degree fov, so x = z is the edge.
+  ASSERT(!aabb_in_frustum(frustum, Aabb{Vec3(12.0f, 0.0f, 10.0f), half}));
+  ASSERT( aabb_in_frustum(frustum, Aabb{Vec3(10.2f, 0.0f, 10.0f), half}));
+  ASSERT(!aabb_in_frustum(frustum, Aabb{Vec3(0.0f, -12.0f, 10.0f), half}));
+  // Anything around the camera.
+  ASSERT( aabb_in_frustum(frustum, Aabb{Vec3(0.0f), Vec3(100.0f)}));
+
+  ASSERT( sphere_in_frustum(frustum, Vec3(0.0f, 0.0f, 10.0f), 1.0f));
+  ASSERT(!sphere_in_frustum(frustum, Vec3(0.0f, 0.0f, -10.0f), 1.0f));
+  ASSERT( sphere_in_frustum(frustum, Vec3(0.0f, 0.0f, -10.0f), 10.5f));
+  // sqrt(2) * 2 away from the x = z plane.
+  ASSERT(!sphere_in_frustum(frustum, Vec3(14.0f, 0.0f, 10.0f), 2.8f));
+  ASSERT( sphere_in_frustum(frustum, Vec3(14.0f, 0.0f, 10.0f), 2.9f));
+
+  // Rotating a unit box by 45 degrees makes it sqrt(2) wide.
+  Aabb rotated = transform_aabb(trs_to_mat4(Vec3(1.0f, 2.0f, 3.0f), quat_from_rotation_y(kPI / 4.0f), Vec3(1.0f)), Aabb{Vec3(0.0f), half});
+  ASSERT(nearly_equal(rotated.center.x, 1.0f) && nearly_equal(rotated.center.y, 2.0f) && nearly_equal(rotated.center.z, 3.0f));
+  ASSERT(nearly_equal(rotated.extents.x, 0.70710678f) && nearly_equal(rotated.extents.y, 0.5f) && nearly_equal(rotated.extents.z, 0.70710678f));
+
+  MemoryArena arena = alloc_memory_arena(KiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u32 kCount = 37 * 8;
+  Vec3Soa centers = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa extents = alloc_vec3_soa(&arena, kCount);
+  f32* radii = push_memory_arena<f32>(&arena, kCount);
+  u8* visible = push_memory_arena<u8>(&arena, kCount);
+
+  for (u32 i = 0; i < kCount; i++)
+  {
+    f32 t = f32(i);
+    centers.x[i] = sinf(t * 0.7f) * 30.0f;
+    centers.y[i] = cosf(t * 1.3f) * 30.0f;
+    centers.z[i] = sinf(t * 0.1f) * 30.0f;
+    extents.x[i] = 1.0f + fmodf(t, 3.0f);
+    extents.y[i] = 0.5f;
+    extents.z[i] = 2.0f;
+    radii[i] = fmodf(t, 5.0f);
+  }
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    u32 visible_count = 0;
+    batch_cull_aabbs(frustum, centers, extents, visible, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Aabb box = {Vec3(centers.x[i], centers.y[i], centers.z[i]), Vec3(extents.x[i], extents.y[i], extents.z[i])};
+      ASSERT(visible[i] == (aabb_in_frustum(frustum, box) ? 1 : 0));
+      visible_count += visible[i];
+    }
+    // Make sure there's actually a mix.
+    ASSERT(visible_count > 0 && visible_count < kCount);
+
+    batch_cull_spheres(frustum, centers, radii, visible, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(visible[i] == (sphere_in_frustum(frustum, Vec3(centers.x[i], centers.y[i], centers.z[i]), radii[i]) ? 1 : 0));
+    }
+  }
+}
+
+// A wall in front of a camera at the origin looking down +z, with boxes behind it, in front of
+// it, around its edges and through the near plane, at every level.
+static void
+test_occlusion_culling()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(2));
+  defer { free_memory_arena(&arena); };
+
+  OcclusionBuffer buffer = init_occlusion_buffer(&arena, kOcclusionBufferWidth, kOcclusionBufferHeight, 16);
+
+  Mat4 proj = perspective_infinite_reverse_lh(kPI / 2.0f, f32(buffer.width) / f32(buffer.height), 0.1f);
+  Mat4 view = look_at_lh(Vec3(0.0f), Vec3(0.0f, 0.0f, 1.0f), Vec3(0.0f, 1.0f, 0.0f));
+
+  // 10 x 6 at z = 10, facing the camera (clockwise on screen), and the same wall from behind.
+  Vec3 positions[] = { Vec3(-5.0f, -3.0f, 10.0f), Vec3(5.0f, -3.0f, 10.0f), Vec3(5.0f, 3.0f, 10.0f), Vec3(-5.0f, 3.0f, 10.0f) };
+  u32 indices[] = { 0, 3, 2, 0, 2, 1 };
+  u32 back_indices[] = { 0, 2, 3, 0, 1, 2 };
+  OccluderMesh wall = {positions, indices, 2};
+  OccluderMesh back_wall = {positions, back_indices, 2};
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    begin_occlusion_frame(&buffer, proj * view);
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 20.0f), Vec3(1.0f)}));
+
+    add_occluder(&buffer, Mat4(), wall);
+    ASSERT(buffer.triangle_count == 2);
+    rasterize_occluders(&arena, &buffer, false);
+
+    // The projection puts near / z in the depth buffer.
+    ASSERT(nearly_equal(buffer.depth[(buffer.height / 2) * buffer.width + buffer.width / 2], 0.01f));
+
+    ASSERT( is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 20.0f), Vec3(1.0f)}));
+    ASSERT( is_aabb_occluded(buffer, Aabb{Vec3(-3.0f, 2.0f, 50.0f), Vec3(1.0f)}));
+    // Right behind it, and touching it.
+    ASSERT( is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 10.5f), Vec3(0.5f, 0.5f, 0.4f)}));
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 10.5f), Vec3(0.5f)}));
+    // Its own bounds.
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 10.0f), Vec3(5.0f, 3.0f, 0.0f)}));
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 5.0f), Vec3(0.5f)}));
+    // The edge of the wall is at x = z / 2, so these stick halfway and all the way out.
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(10.0f, 0.0f, 20.0f), Vec3(1.0f)}));
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(12.0f, 0.0f, 20.0f), Vec3(1.0f)}));
+    // Through the near plane, and behind the camera.
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f), Vec3(1.0f)}));
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, -20.0f), Vec3(1.0f)}));
+
+    // The GPU culls the back of the wall, so it can't hide anything behind it.
+    begin_occlusion_frame(&buffer, proj * view);
+    add_occluder(&buffer, Mat4(), back_wall);
+    ASSERT(buffer.triangle_count == 0);
+    rasterize_occluders(&arena, &buffer, false);
+    ASSERT(!is_aabb_occluded(buffer, Aabb{Vec3(0.0f, 0.0f, 20.0f), Vec3(1.0f)}));
+  }
+
+  // Occluders that cross the near plane get dropped rather than clipped.
+  begin_occlusion_frame(&buffer, proj * view);
+  Vec3 floor_positions[] = { Vec3(-5.0f, -1.0f, -5.0f), Vec3(5.0f, -1.0f, -5.0f), Vec3(0.0f, -1.0f, 20.0f) };
+  u32 floor_indices[] = { 0, 1, 2 };
+  add_occluder(&buffer, Mat4(), OccluderMesh{floor_positions, floor_indices, 1});
+  ASSERT(buffer.triangle_count == 0);
+}
+
 static void
 test_ring_buffer()
 {
@@ -221,6 +535,271 @@ test_ring_buffer()
   ASSERT(data == 0);
 }
 
+static void
+test_mirrored_ring_buffer()
+{
+  MirroredRingBuffer buffer = init_mirrored_ring_buffer(1);
+  defer { destroy_mirrored_ring_buffer(&buffer); };
+
+  size_t size = buffer.memory.size;
+  ASSERT(size >= 1 && is_pow2(size));
+
+  // Both mappings are the same memory.
+  buffer.memory.base[0] = 42;
+  ASSERT(buffer.memory.base[size] == 42);
+  buffer.memory.base[size + 1] = 7;
+  ASSERT(buffer.memory.base[1] == 7);
+
+  // The whole thing is usable.
+  ASSERT(try_mirrored_ring_buffer_push(&buffer, size) != nullptr);
+  ASSERT(try_mirrored_ring_buffer_push(&buffer, 1) == nullptr);
+  ASSERT(try_mirrored_ring_buffer_pop(&buffer, size) == buffer.memory.base);
+  ASSERT(mirrored_ring_buffer_is_empty(buffer));
+
+  // Leave the write position just short of the end, so the next record straddles it.
+  mirrored_ring_buffer_push(&buffer, size - 100);
+  mirrored_ring_buffer_pop(&buffer, size - 100);
+
+  u8* record = (u8*)mirrored_ring_buffer_push(&buffer, 300);
+  for (u32 i = 0; i < 300; i++)
+  {
+    record[i] = u8(i);
+  }
+  ASSERT(mirrored_ring_buffer_size(buffer) == 300);
+  ASSERT(mirrored_ring_buffer_peek(&buffer, 301) == nullptr);
+
+  u8* popped = (u8*)mirrored_ring_buffer_pop(&buffer, 300);
+  ASSERT(popped == record);
+  for (u32 i = 0; i < 300; i++)
+  {
+    ASSERT(popped[i] == u8(i));
+  }
+  ASSERT(try_mirrored_ring_buffer_pop(&buffer, 1) == nullptr);
+
+  // Not a multiple of the allocation granularity or a power of 2.
+  MirroredRingBuffer odd = init_mirrored_ring_buffer(KiB(150));
+  defer { destroy_mirrored_ring_buffer(&odd); };
+
+  ASSERT(odd.memory.size == KiB(256));
+  ASSERT(try_mirrored_ring_buffer_push(&odd, KiB(256)) != nullptr);
+  ASSERT(try_mirrored_ring_buffer_pop(&odd, KiB(256)) == odd.memory.base);
+}
+
+template <typename Queue, typename Push, typename Pop, typename PushBatch, typename PopBatch>
+static void
+test_lock_free_queue(Queue* queue, Push push, Pop pop, PushBatch push_batch, PopBatch pop_batch)
+{
+  // Asked for 3, rounded up to 4, and all 4 are usable.
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT(push(queue, i));
+  }
+  ASSERT(!push(queue, 4));
+
+  int data = -1;
+  ASSERT(pop(queue, &data) && data == 0);
+  ASSERT(pop(queue, &data) && data == 1);
+
+  // Only 2 of these fit, and they go in across the end of the buffer.
+  int batch[] = { 4, 5, 6 };
+  ASSERT(push_batch(queue, batch, 3) == 2);
+
+  int out[8] = {};
+  ASSERT(pop_batch(queue, out, 8) == 4);
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT(out[i] == i + 2);
+  }
+  ASSERT(!pop(queue, &data));
+  ASSERT(pop_batch(queue, out, 8) == 0);
+}
+
+static void
+test_lock_free_queues()
+{
+  MemoryArena arena = alloc_memory_arena(KiB(4));
+  defer { free_memory_arena(&arena); };
+
+  SpscQueue<int> spsc = init_spsc_queue<int>(&arena, 3);
+  ASSERT(spsc_queue_capacity(&spsc) == 4);
+  test_lock_free_queue(&spsc,
+                       [](SpscQueue<int>* q, int v) { return try_spsc_queue_push(q, v); },
+                       [](SpscQueue<int>* q, int* out) { return try_spsc_queue_pop(q, out); },
+                       [](SpscQueue<int>* q, const int* items, size_t count) { return spsc_queue_push_batch(q, items, count); },
+                       [](SpscQueue<int>* q, int* out, size_t count) { return spsc_queue_pop_batch(q, out, count); });
+
+  MpmcQueue<int> mpmc = init_mpmc_queue<int>(&arena, 3);
+  ASSERT(mpmc_queue_capacity(&mpmc) == 4);
+  test_lock_free_queue(&mpmc,
+                       [](MpmcQueue<int>* q, int v) { return try_mpmc_queue_push(q, v); },
+                       [](MpmcQueue<int>* q, int* out) { return try_mpmc_queue_pop(q, out); },
+                       [](MpmcQueue<int>* q, const int* items, size_t count) { return mpmc_queue_push_batch(q, items, count); },
+                       [](MpmcQueue<int>* q, int* out, size_t count) { return mpmc_queue_pop_batch(q, out, count); });
+}
+
+static void
+test_growable_array()
+{
+  MemoryArena arena = alloc_memory_arena(KiB(64));
+  defer { free_memory_arena(&arena); };
+
+  // Nothing else on the arena, so it should just keep extending in place.
+  auto arr = init_growable_array<u32>(&arena, 2);
+  u32* start = arr.memory;
+  for (u32 i = 0; i < 100; i++)
+  {
+    *array_add(&arr) = i;
+  }
+  ASSERT(arr.memory == start);
+  ASSERT(arr.size == 100 && arr.capacity >= 100);
+
+  // Something else in the way means it has to move, but the contents come with it.
+  auto other = init_growable_array<u32>(&arena, 4);
+  *array_add(&other) = 1;
+  for (u32 i = 100; i < 1000; i++)
+  {
+    *array_add(&arr) = i;
+  }
+  ASSERT(arr.memory != start);
+  for (u32 i = 0; i < 1000; i++)
+  {
+    ASSERT(arr[i] == i);
+  }
+  ASSERT(other[0] == 1);
+
+  *array_insert(&other, 0) = 0;
+  for (u32 i = 2; i < 64; i++)
+  {
+    *array_add(&other) = i;
+  }
+  for (u32 i = 0; i < 64; i++)
+  {
+    ASSERT(other[i] == i);
+  }
+}
+
+static void
+test_soa_array()
+{
+  MemoryArena arena = alloc_memory_arena(KiB(64));
+  defer { free_memory_arena(&arena); };
+
+  enum { kKey, kValue, kFlag };
+  auto arr = init_soa_array<u64, u32, u8>(&arena, 2);
+  for (u32 i = 0; i < 100; i++)
+  {
+    soa_push(&arr, u64(100 - i), i, u8(i & 1));
+  }
+  ASSERT(arr.size == 100 && arr.capacity >= 100);
+
+  u32 expected = 0;
+  for (auto [key, value, flag] : arr)
+  {
+    ASSERT(key == 100 - expected && value == expected && flag == (expected & 1));
+    expected++;
+  }
+
+  // Keeps the order of whatever's left.
+  const u8* flags = soa_column<kFlag>(&arr);
+  soa_filter(&arena, &arr, [&](size_t i) { return flags[i] == 0; });
+  ASSERT(arr.size == 50);
+  for (size_t i = 0; i < arr.size; i++)
+  {
+    ASSERT(soa_column<kValue>(&arr)[i] == i * 2);
+  }
+
+  const u64* keys = soa_column<kKey>(&arr);
+  soa_sort(&arena, &arr, [&](size_t i) { return keys[i]; });
+  for (size_t i = 0; i < arr.size; i++)
+  {
+    auto [key, value, flag] = soa_at(&arr, i);
+    ASSERT(key == 100 - value && flag == 0);
+    if (i > 0)
+    {
+      ASSERT(soa_column<kKey>(&arr)[i - 1] < key);
+    }
+  }
+
+  // Unordered, the last row takes the removed row's place.
+  u32 last = soa_column<kValue>(&arr)[arr.size - 1];
+  soa_remove(&arr, 0);
+  ASSERT(arr.size == 49 && soa_column<kValue>(&arr)[0] == last);
+
+  size_t index = soa_add(&arr);
+  ASSERT(std::get<kKey>(soa_at(&arr, index)) == 0 && std::get<kValue>(soa_at(&arr, index)) == 0);
+
+  u64 key_sum = 0;
+  for (u64 key : soa_span<kKey>(&arr))
+  {
+    key_sum += key;
+  }
+  ASSERT(key_sum > 0);
+}
+
+static bool
+nearly_equal(const Mat4& a, const Mat4& b, f32 tolerance = 1e-5f)
+{
+  for (u32 col = 0; col < 4; col++)
+  {
+    for (u32 row = 0; row < 4; row++)
+    {
+      if (!nearly_equal(a.entries[col][row], b.entries[col][row], tolerance))
+        return false;
+    }
+  }
+  return true;
+}
+
+// A small hierarchy added out of depth order, checked against composing the matrices by hand
+// and the inverse-transposes against inverse_mat4.
+static void
+test_transform_hierarchy()
+{
+  MemoryArena arena = alloc_memory_arena(KiB(64));
+  defer { free_memory_arena(&arena); };
+
+  // Starts too small so that it has to grow.
+  TransformHierarchy hierarchy = init_transform_hierarchy(&arena, 2);
+
+  Quat spin = quat_from_rotation_y(kPI / 2.0f);
+  u32 root  = add_transform_node(&hierarchy, kTransformNoParent, Vec3(1.0f, 2.0f, 3.0f), spin, Vec3(2.0f));
+  u32 child = add_transform_node(&hierarchy, root, Vec3(0.0f, 1.0f, 0.0f), quat_from_rotation_x(0.3f), Vec3(1.0f, 3.0f, 0.5f));
+  u32 other_root = add_transform_node(&hierarchy);
+  u32 grandchild = add_transform_node(&hierarchy, child, Vec3(-4.0f, 0.0f, 2.0f), quat_from_rotation_z(-1.2f), Vec3(0.25f, 1.0f, 1.0f));
+  u32 other_child = add_transform_node(&hierarchy, other_root, Vec3(5.0f, 0.0f, 0.0f), Quat(), Vec3(1.0f));
+
+  update_transform_hierarchy(&hierarchy, false);
+  ASSERT(hierarchy.level_count == 3);
+
+  // Rotating +x by 90 degrees around y lands on -z.
+  Vec4 x_axis = quat_to_mat4(spin) * Vec4(1.0f, 0.0f, 0.0f, 0.0f).avx;
+  ASSERT(nearly_equal(x_axis.x, 0.0f) && nearly_equal(x_axis.y, 0.0f) && nearly_equal(x_axis.z, -1.0f));
+
+  Mat4 root_world = trs_to_mat4(Vec3(1.0f, 2.0f, 3.0f), spin, Vec3(2.0f));
+  Mat4 child_world = root_world * trs_to_mat4(Vec3(0.0f, 1.0f, 0.0f), quat_from_rotation_x(0.3f), Vec3(1.0f, 3.0f, 0.5f));
+  Mat4 grandchild_world = child_world * trs_to_mat4(Vec3(-4.0f, 0.0f, 2.0f), quat_from_rotation_z(-1.2f), Vec3(0.25f, 1.0f, 1.0f));
+
+  ASSERT(nearly_equal(get_world_transform(hierarchy, root), root_world));
+  ASSERT(nearly_equal(get_world_transform(hierarchy, child), child_world));
+  ASSERT(nearly_equal(get_world_transform(hierarchy, grandchild), grandchild_world));
+  ASSERT(nearly_equal(get_world_transform(hierarchy, other_root), Mat4()));
+
+  Vec4 point = get_world_transform(hierarchy, other_child) * Vec4(1.0f, 1.0f, 1.0f, 1.0f).avx;
+  ASSERT(point.x == 6.0f && point.y == 1.0f && point.z == 1.0f && point.w == 1.0f);
+
+  for (u32 node = 0; node < hierarchy.nodes.size; node++)
+  {
+    Mat4 expected = transpose_f32(inverse_mat4(get_world_transform(hierarchy, node)));
+    ASSERT(nearly_equal(get_normal_transform(hierarchy, node), expected, 1e-4f));
+  }
+
+  // Moving a parent moves everything under it on the next update.
+  set_transform_node(&hierarchy, root, Vec3(0.0f), Quat(), Vec3(1.0f));
+  update_transform_hierarchy(&hierarchy, false);
+  Mat4 local = trs_to_mat4(Vec3(0.0f, 1.0f, 0.0f), quat_from_rotation_x(0.3f), Vec3(1.0f, 3.0f, 0.5f));
+  ASSERT(nearly_equal(get_world_transform(hierarchy, child), local));
+}
+
 static void
 test_pool_allocator()
 {
@@ -277,67 +856,508 @@ test_fiber()
 }
 
 static void
-test_hash_table()
+test_job_system_stats_json()
 {
-  MemoryArena memory_arena = alloc_memory_arena(MiB(64));
-  defer { free_memory_arena(&memory_arena); };
+  JobSystemStats stats;
+  stats.thread_count = 2;
+  stats.threads[0].jobs_launched = 3;
+  stats.threads[1].jobs_launched = 4;
+  stats.totals.jobs_launched = 7;
+  stats.deadlines.missed = 1;
 
-  // Test inserting a key-value pair into an empty HashTable
-  const u64 HASH_TABLE_SIZE = 5000;
-  auto table = init_hash_table<int, int>(&memory_arena, HASH_TABLE_SIZE);
-  int key = 42;
-  int* value = hash_table_insert(&table, key);
-  *value = 100;
-  ASSERT(*unwrap(hash_table_find(&table, key)) == 100);
+  char json[2048];
+  size_t len = job_system_stats_to_json(stats, json, sizeof(json));
+  ASSERT(len == strlen(json));
+  ASSERT(json[0] == '{' && json[len - 1] == '}');
+  ASSERT(strstr(json, "\"jobs_launched\":7") != nullptr);
+  ASSERT(strstr(json, "\"missed\":1}") != nullptr);
 
-  // Test inserting a key-value pair when the key already exists
-  key = 42;
-  value = hash_table_insert(&table, key);
-  ASSERT(*value == 100);
-  *value = 200;
-  ASSERT(*unwrap(hash_table_find(&table, key)) == 200);
-  ASSERT(hash_table_erase(&table, key));
-  ASSERT(!hash_table_erase(&table, key));
+  // Truncated output should still be null terminated and report what was actually written.
+  char truncated[32];
+  len = job_system_stats_to_json(stats, truncated, sizeof(truncated));
+  ASSERT(len == sizeof(truncated) - 1);
+  ASSERT(strlen(truncated) == len);
+}
 
-  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+static u32
+kick_and_run_jobs_thread(void* param)
+{
+  u32* ran = reinterpret_cast<u32*>(param);
+  for (u32 i = 0; i < 2; i++)
   {
-    value = hash_table_insert(&table, i);
-    *value = i;
-    ASSERT(table.used == i + 1);
+    kick_closure_job(kJobPriorityMedium, [=]() { (*ran)++; });
   }
+  run_queued_jobs();
+  return 0;
+}
 
-  for (int i = 0; i < HASH_TABLE_SIZE; i++)
-  {
-    ASSERT(*unwrap(hash_table_find(&table, i)) == i);
-  }
+static void
+test_job_system_stats_aggregation()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(16));
+  defer { free_memory_arena(&arena); };
 
-  for (int i = 0; i < HASH_TABLE_SIZE; i++)
-  {
-    ASSERT(hash_table_erase(&table, i));
-  }
+  JobSystem* job_system = init_job_system(&arena, 64);
+  defer { destroy_job_system(job_system); };
 
-  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  u32 ran = 0;
+  for (u32 i = 0; i < 3; i++)
   {
-    ASSERT(!hash_table_erase(&table, i));
-    ASSERT(!hash_table_find(&table, i));
+    kick_closure_job(kJobPriorityHigh, [&ran]() { ran++; });
   }
+  run_queued_jobs(job_system);
 
-  ASSERT(!hash_table_find(&table, 0));
+  // Only starts once this thread is done, so each thread runs exactly the jobs it kicked.
+  Thread thread = create_thread(sub_alloc_memory_arena(&arena, KiB(16)), KiB(64), &kick_and_run_jobs_thread, &ran, 0);
+  join_threads(&thread, 1);
+  destroy_thread(&thread);
+  ASSERT(ran == 5);
 
-  // Test inserting a key-value pair with a custom type
-  struct CustomType
-  {
-    int value;
-    auto operator<=>(const CustomType& rhs) const = default;
-  };
+  JobSystemStats stats = get_job_system_stats(job_system);
+  ASSERT(stats.thread_count == 2);
+  ASSERT(atomic_load(&stats.threads[0].jobs_kicked, kMemoryOrderRelaxed) == 3);
+  ASSERT(atomic_load(&stats.threads[0].jobs_launched, kMemoryOrderRelaxed) == 3);
+  ASSERT(atomic_load(&stats.threads[1].jobs_kicked, kMemoryOrderRelaxed) == 2);
+  ASSERT(atomic_load(&stats.threads[1].jobs_launched, kMemoryOrderRelaxed) == 2);
+  ASSERT(atomic_load(&stats.totals.jobs_kicked, kMemoryOrderRelaxed) == 5);
+  ASSERT(atomic_load(&stats.totals.jobs_launched, kMemoryOrderRelaxed) == 5);
+  ASSERT(atomic_load(&stats.totals.jobs_yielded, kMemoryOrderRelaxed) == 0);
+  ASSERT(atomic_load(&stats.totals.spin_lock_acquires, kMemoryOrderRelaxed) ==
+         atomic_load(&stats.threads[0].spin_lock_acquires, kMemoryOrderRelaxed) +
+         atomic_load(&stats.threads[1].spin_lock_acquires, kMemoryOrderRelaxed));
 
-  auto custom_table = init_hash_table<CustomType, int>(&memory_arena, 32);
-  CustomType custom_key;
-  custom_key.value = 42;
-  int* val = hash_table_insert(&custom_table, custom_key);
-  ASSERT(val != nullptr);
-  *val = 100;
+  // Each thread keeps reusing the stack it cached after its first job, so that's one fiber
+  // per thread.
+  ASSERT(stats.fibers_used == 2);
+  ASSERT(atomic_load(&stats.fiber_totals.jobs_run, kMemoryOrderRelaxed) == 5);
+  ASSERT(atomic_load(&stats.fiber_max.jobs_run, kMemoryOrderRelaxed) == 3);
+  ASSERT(atomic_load(&stats.fiber_totals.yields, kMemoryOrderRelaxed) == 0);
+}
+
+static void
+test_thread_signal()
+{
+  ThreadSignal signal = init_thread_signal();
+  ASSERT(!is_thread_signaled(&signal));
+
+  // Notifying before anyone waits used to be lost and the wait would hang forever.
+  notify_all_thread_signal(&signal);
+  ASSERT(is_thread_signaled(&signal));
+  wait_for_thread_signal(&signal);
+}
+
+static void
+test_job_deadline_scheduling()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(16));
+  defer { free_memory_arena(&arena); };
+
+  // No workers, so nothing runs until run_queued_jobs, which runs them in the order a worker
+  // would pick them up in.
+  JobSystem* job_system = init_job_system(&arena, 64);
+  defer { destroy_job_system(job_system); };
+
+  u32 order[64];
+  u32 run_count = 0;
+  auto record = [&](u32 tag)
+  {
+    u32* out = order;
+    u32* count = &run_count;
+    return [=]() { out[(*count)++] = tag; };
+  };
+
+  // A steady stream of high priority jobs lets a medium priority one through after
+  // kJobAgingThreshold of them.
+  kick_closure_job(kJobPriorityMedium, record(100));
+  for (u32 i = 0; i < kJobAgingThreshold + 2; i++)
+  {
+    kick_closure_job(kJobPriorityHigh, record(i));
+  }
+  run_queued_jobs(job_system);
+  ASSERT(run_count == kJobAgingThreshold + 3);
+  for (u32 i = 0; i < kJobAgingThreshold; i++)
+  {
+    ASSERT(order[i] == i);
+  }
+  ASSERT(order[kJobAgingThreshold] == 100);
+  ASSERT(order[kJobAgingThreshold + 1] == kJobAgingThreshold);
+  ASSERT(order[kJobAgingThreshold + 2] == kJobAgingThreshold + 1);
+
+  // Nothing is due soon, so they all wait for idle time and then come out earliest first.
+  u64 frame = get_job_system_frame(job_system);
+  constant u32 kDeadlines[] = { 5, 3, 9, 4, 7, 3 };
+  run_count = 0;
+  for (u32 deadline : kDeadlines)
+  {
+    kick_closure_job_with_deadline(frame + deadline, record(deadline));
+  }
+  run_queued_jobs(job_system);
+  ASSERT(run_count == ARRAY_LENGTH(kDeadlines));
+  for (u32 i = 1; i < run_count; i++)
+  {
+    ASSERT(order[i - 1] <= order[i]);
+  }
+
+  // Only deadlines within kJobUrgentDeadlineFrames jump ahead of the priority queues.
+  run_count = 0;
+  kick_closure_job(kJobPriorityMedium, record(200));
+  kick_closure_job(kJobPriorityHigh, record(201));
+  kick_closure_job_with_deadline(frame + kJobUrgentDeadlineFrames + 1, record(202));
+  kick_closure_job_with_deadline(frame + kJobUrgentDeadlineFrames, record(203));
+  run_queued_jobs(job_system);
+  ASSERT(run_count == 4);
+  ASSERT(order[0] == 203 && order[1] == 201 && order[2] == 200 && order[3] == 202);
+
+  // A job finishing after the frame it was due in counts as missed.
+  JobDeadlineStats before = get_job_deadline_stats(job_system);
+  ASSERT(atomic_load(&before.missed, kMemoryOrderRelaxed) == 0);
+  kick_closure_job_with_deadline(frame + 1, record(300));
+  advance_job_system_frame(job_system);
+  advance_job_system_frame(job_system);
+  kick_closure_job_with_deadline(get_job_system_frame(job_system) + 1, record(301));
+  run_queued_jobs(job_system);
+
+  JobDeadlineStats after = get_job_deadline_stats(job_system);
+  ASSERT(atomic_load(&after.kicked, kMemoryOrderRelaxed) == atomic_load(&before.kicked, kMemoryOrderRelaxed) + 2);
+  ASSERT(atomic_load(&after.completed, kMemoryOrderRelaxed) == atomic_load(&before.completed, kMemoryOrderRelaxed) + 2);
+  ASSERT(atomic_load(&after.missed, kMemoryOrderRelaxed) == 1);
+
+  // Once the heap is empty, polling for a job skips its lock. The working job queue's lock
+  // is the only one left.
+  ASSERT(atomic_load(&job_system->deadline_priority.earliest_deadline_frame, kMemoryOrderRelaxed) == kJobNoDeadline);
+  JobSystemStats idle_before = get_job_system_stats(job_system);
+  run_queued_jobs(job_system);
+  JobSystemStats idle_after = get_job_system_stats(job_system);
+  ASSERT(atomic_load(&idle_after.totals.spin_lock_acquires, kMemoryOrderRelaxed) ==
+         atomic_load(&idle_before.totals.spin_lock_acquires, kMemoryOrderRelaxed) + 1);
+}
+
+static void
+test_blocking_kick_helps()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(16));
+  defer { free_memory_arena(&arena); };
+
+  // Without any workers, the only way a blocking kick can return is by running the jobs on
+  // the thread that's blocked on them.
+  JobSystem* job_system = init_job_system(&arena, 64);
+  defer { destroy_job_system(job_system); };
+
+  u32 ran = 0;
+  kick_closure_job(kJobPriorityMedium, [&ran]() { ran++; });
+
+  JobDesc jobs[4];
+  for (u32 i = 0; i < ARRAY_LENGTH(jobs); i++)
+  {
+    jobs[i] = init_job_desc_from_closure([&ran]() { ran++; });
+  }
+  blocking_kick_job_descs(kJobPriorityHigh, jobs, ARRAY_LENGTH(jobs), JOB_DEBUG_INFO_STRUCT, kJobWaitHelp);
+
+  // High priority goes first, so the one that was already queued is still waiting.
+  ASSERT(ran == ARRAY_LENGTH(jobs));
+  JobSystemStats stats = get_job_system_stats(job_system);
+  ASSERT(atomic_load(&stats.totals.jobs_launched, kMemoryOrderRelaxed) == ARRAY_LENGTH(jobs));
+
+  run_queued_jobs(job_system);
+  ASSERT(ran == ARRAY_LENGTH(jobs) + 1);
+}
+
+static void
+test_hash_table()
+{
+  MemoryArena memory_arena = alloc_memory_arena(MiB(64));
+  defer { free_memory_arena(&memory_arena); };
+
+  // Test inserting a key-value pair into an empty HashTable
+  const u64 HASH_TABLE_SIZE = 5000;
+  auto table = init_hash_table<int, int>(&memory_arena, HASH_TABLE_SIZE);
+  int key = 42;
+  int* value = hash_table_insert(&table, key);
+  *value = 100;
+  ASSERT(*unwrap(hash_table_find(&table, key)) == 100);
+
+  // Test inserting a key-value pair when the key already exists
+  key = 42;
+  value = hash_table_insert(&table, key);
+  ASSERT(*value == 100);
+  *value = 200;
+  ASSERT(*unwrap(hash_table_find(&table, key)) == 200);
+  ASSERT(hash_table_erase(&table, key));
+  ASSERT(!hash_table_erase(&table, key));
+
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    value = hash_table_insert(&table, i);
+    *value = i;
+    ASSERT(table.used == i + 1);
+  }
+
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    ASSERT(*unwrap(hash_table_find(&table, i)) == i);
+  }
+
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    ASSERT(hash_table_erase(&table, i));
+  }
+
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    ASSERT(!hash_table_erase(&table, i));
+    ASSERT(!hash_table_find(&table, i));
+  }
+
+  ASSERT(!hash_table_find(&table, 0));
+
+  // Test growing past the initial capacity
+  auto small_table = init_hash_table<int, int>(&memory_arena, 4);
+  u64 initial_capacity = small_table.capacity;
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    *hash_table_insert(&small_table, i) = i;
+  }
+  ASSERT(small_table.capacity > initial_capacity);
+  ASSERT(small_table.used == HASH_TABLE_SIZE);
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    ASSERT(*unwrap(hash_table_find(&small_table, i)) == i);
+  }
+
+  // Test that a table fits the capacity it was made with without growing, at every group width
+  MemoryArena exact_arena = sub_alloc_memory_arena(&memory_arena, hash_table_arena_size<int, int>(1024));
+  for (u64 capacity = 1; capacity <= 1024; capacity++)
+  {
+    reset_memory_arena(&exact_arena);
+    auto exact_table = init_hash_table<int, int>(&exact_arena, capacity);
+    u64 groups_size = exact_table.groups_size;
+    for (int i = 0; i < capacity; i++)
+    {
+      *hash_table_insert(&exact_table, i) = i;
+    }
+    ASSERT(exact_table.used == capacity);
+    ASSERT(exact_table.groups_size == groups_size);
+  }
+
+  // Test that constant insert/erase churn cleans up tombstones instead of growing forever
+  auto churn_table = init_hash_table<int, int>(&memory_arena, 64);
+  u64 churn_capacity = churn_table.capacity;
+  for (int i = 0; i < HASH_TABLE_SIZE * 20; i++)
+  {
+    *hash_table_insert(&churn_table, i) = i;
+    if (i >= 32)
+    {
+      ASSERT(hash_table_erase(&churn_table, i - 32));
+    }
+  }
+  ASSERT(churn_table.capacity == churn_capacity);
+  ASSERT(churn_table.used == 32);
+  for (int i = HASH_TABLE_SIZE * 20 - 32; i < HASH_TABLE_SIZE * 20; i++)
+  {
+    ASSERT(*unwrap(hash_table_find(&churn_table, i)) == i);
+  }
+
+  // Test inserting a key-value pair with a custom type
+  struct CustomType
+  {
+    int value;
+    auto operator<=>(const CustomType& rhs) const = default;
+  };
+
+  auto custom_table = init_hash_table<CustomType, int>(&memory_arena, 32);
+  CustomType custom_key;
+  custom_key.value = 42;
+  int* val = hash_table_insert(&custom_table, custom_key);
+  ASSERT(val != nullptr);
+  *val = 100;
   ASSERT(*unwrap(hash_table_find(&custom_table, custom_key)) == 100);
+
+  // Test comparing whole groups of keys at once
+  auto simd_table = init_hash_table<u64, int, SimdCompareHasher<u64>>(&memory_arena, 64);
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    *hash_table_insert(&simd_table, u64(i) << 32) = i;
+  }
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    ASSERT(*unwrap(hash_table_find(&simd_table, u64(i) << 32)) == i);
+    // Only differs in the lower half, which the SSE2 path compares separately.
+    ASSERT(!hash_table_find(&simd_table, (u64(i) << 32) | 1));
+  }
+
+  // Test string keys compare by contents rather than by pointer
+  auto string_table = init_hash_table<const char*, int, CStringHasher>(&memory_arena, 32);
+  char string_key[] = "albedo";
+  *hash_table_insert(&string_table, "albedo") = 1;
+  *hash_table_insert(&string_table, "normal") = 2;
+  ASSERT(*unwrap(hash_table_find(&string_table, string_key)) == 1);
+  ASSERT(string_table.used == 2);
+
+  // Test a custom hasher for a key with implicit padding, which can't be hashed as raw bytes
+  struct PaddedKey
+  {
+    u8 a;
+    u32 b;
+    bool operator==(const PaddedKey& rhs) const = default;
+  };
+  struct PaddedKeyHasher
+  {
+    static u64 hash(const PaddedKey& key) { return hash_int_mix((u64(key.a) << 32) | key.b); }
+    static bool equal(const PaddedKey& lhs, const PaddedKey& rhs) { return lhs == rhs; }
+  };
+
+  auto padded_table = init_hash_table<PaddedKey, int, PaddedKeyHasher>(&memory_arena, 32);
+  PaddedKey padded_key;
+  memset(&padded_key, 0xCD, sizeof(padded_key));
+  padded_key.a = 1;
+  padded_key.b = 2;
+  *hash_table_insert(&padded_table, padded_key) = 3;
+  ASSERT(*unwrap(hash_table_find(&padded_table, PaddedKey{1, 2})) == 3);
+
+  // Test iterating visits every element exactly once, including after erases
+  auto iter_table = init_hash_table<int, int>(&memory_arena, 16);
+  u64 count = 0;
+  for (auto [k, v] : iter_table)
+  {
+    count++;
+  }
+  ASSERT(count == 0);
+
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    *hash_table_insert(&iter_table, i) = i * 2;
+  }
+  for (int i = 0; i < HASH_TABLE_SIZE; i += 3)
+  {
+    ASSERT(hash_table_erase(&iter_table, i));
+  }
+
+  s64 expected_sum = 0;
+  for (int i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    if (i % 3 != 0)
+    {
+      expected_sum += i;
+    }
+  }
+
+  s64 sum = 0;
+  count = 0;
+  for (auto [k, v] : iter_table)
+  {
+    ASSERT(v == k * 2);
+    sum += k;
+    count++;
+    v = 0;
+  }
+  ASSERT(count == iter_table.used);
+  ASSERT(sum == expected_sum);
+  ASSERT(*unwrap(hash_table_find(&iter_table, 1)) == 0);
+
+  // Test the HashSet
+  auto set = init_hash_set<u64>(&memory_arena, 16);
+  for (u64 i = 0; i < HASH_TABLE_SIZE; i++)
+  {
+    ASSERT(hash_set_insert(&set, i));
+    ASSERT(!hash_set_insert(&set, i));
+  }
+  ASSERT(set.table.values == nullptr);
+  for (u64 i = 0; i < HASH_TABLE_SIZE; i += 2)
+  {
+    ASSERT(hash_set_erase(&set, i));
+  }
+
+  count = 0;
+  for (u64 k : set)
+  {
+    ASSERT(k % 2 == 1);
+    count++;
+  }
+  ASSERT(count == HASH_TABLE_SIZE / 2);
+  ASSERT(hash_set_contains(&set, 1));
+  ASSERT(!hash_set_contains(&set, 2));
+}
+
+static void
+test_concurrent_hash_table()
+{
+  MemoryArena memory_arena = alloc_memory_arena(MiB(32));
+  defer { free_memory_arena(&memory_arena); };
+
+  const u64 kCount = 5000;
+  // Starts out way smaller than it ends up, so every shard has to grow into its own arena.
+  auto table = init_concurrent_hash_table<u64, u64>(&memory_arena, 16, kCount);
+  for (u64 i = 0; i < kCount; i++)
+  {
+    ASSERT(concurrent_hash_table_insert(&table, i, i * 3));
+  }
+  ASSERT(!concurrent_hash_table_insert(&table, 7, 8));
+  ASSERT(unwrap(concurrent_hash_table_find(&table, 7)) == 8);
+  ASSERT(concurrent_hash_table_size(&table) == kCount);
+
+  u32 used_shards = 0;
+  for (u32 i = 0; i < table.shard_count; i++)
+  {
+    used_shards += table.shards[i].table.used > 0 ? 1 : 0;
+  }
+  ASSERT(used_shards == table.shard_count);
+
+  for (u64 i = 0; i < kCount; i += 2)
+  {
+    ASSERT(concurrent_hash_table_erase(&table, i));
+  }
+  for (u64 i = 0; i < kCount; i++)
+  {
+    ASSERT(concurrent_hash_table_contains(&table, i) == (i % 2 == 1));
+  }
+
+  bool found = concurrent_hash_table_write(&table, 9, [](auto* shard)
+  {
+    Option<u64*> value = hash_table_find(shard, 9);
+    if (!value)
+      return false;
+
+    *unwrap(value) += 1;
+    return true;
+  });
+  ASSERT(found);
+
+  u64 value = concurrent_hash_table_read(&table, 9, [](const auto* shard) { return *unwrap(hash_table_find(shard, 9)); });
+  ASSERT(value == 28);
+  ASSERT(concurrent_hash_table_size(&table) == kCount / 2);
+
+  // Every key landing in the same shard has to fit too, and then the same again in a different
+  // shard after the first one is emptied out, since the first shard's arena doesn't get any
+  // of its memory back.
+  const u64 kSkewedCount = 1024;
+  auto skewed = init_concurrent_hash_table<u64, u64>(&memory_arena, 16, kSkewedCount);
+  for (u32 shard_index = 0; shard_index < 2; shard_index++)
+  {
+    auto* shard = skewed.shards + shard_index;
+    u64 key = 0;
+    for (u64 i = 0; i < kSkewedCount; i++, key++)
+    {
+      while (concurrent_hash_table_shard(&skewed, concurrent_hash_table_hash(&skewed, key)) != shard)
+      {
+        key++;
+      }
+      ASSERT(concurrent_hash_table_insert(&skewed, key, i));
+    }
+    ASSERT(shard->table.used == kSkewedCount);
+    ASSERT(concurrent_hash_table_size(&skewed) == kSkewedCount);
+
+    key = 0;
+    for (u64 i = 0; i < kSkewedCount; i++, key++)
+    {
+      while (concurrent_hash_table_shard(&skewed, concurrent_hash_table_hash(&skewed, key)) != shard)
+      {
+        key++;
+      }
+      ASSERT(unwrap(concurrent_hash_table_find(&skewed, key)) == i);
+      ASSERT(concurrent_hash_table_erase(&skewed, key));
+    }
+    ASSERT(concurrent_hash_table_size(&skewed) == 0);
+  }
 }
 
 // Define a small tolerance value to account for floating-point precision errors
@@ -371,6 +1391,173 @@ test_quaternions()
   ASSERT(result.x == expected_result.x);
   ASSERT(result.y == expected_result.y);
   ASSERT(result.z == expected_result.z);
+
+  // Test case 3, lhs.w != 1
+  q1 = Quat(2.0f, 1.0f, 0.0f, 0.0f);
+  q2 = Quat(3.0f, 0.0f, 1.0f, 0.0f);
+  result = quat_mul(q1, q2);
+  expected_result = Quat(6.0f, 3.0f, 2.0f, 1.0f);
+  ASSERT(result.w == expected_result.w);
+  ASSERT(result.x == expected_result.x);
+  ASSERT(result.y == expected_result.y);
+  ASSERT(result.z == expected_result.z);
+}
+
+struct QuatF64
+{
+  f64 w, x, y, z;
+};
+
+static QuatF64
+to_quat_f64(Quat q)
+{
+  return QuatF64{q.w, q.x, q.y, q.z};
+}
+
+static QuatF64
+quat_mul_f64(QuatF64 a, QuatF64 b)
+{
+  return QuatF64{a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+                 a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                 a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                 a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+static QuatF64
+quat_slerp_f64(QuatF64 a, QuatF64 b, f64 t)
+{
+  f64 cos_theta = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+  f64 sign = cos_theta < 0.0 ? -1.0 : 1.0;
+  f64 theta = acos(MIN(fabs(cos_theta), 1.0));
+  f64 weight_a = 1.0 - t;
+  f64 weight_b = t;
+  if (theta > 1e-9)
+  {
+    weight_a = sin((1.0 - t) * theta) / sin(theta);
+    weight_b = sin(t * theta) / sin(theta);
+  }
+  weight_b *= sign;
+  return QuatF64{a.w * weight_a + b.w * weight_b,
+                 a.x * weight_a + b.x * weight_b,
+                 a.y * weight_a + b.y * weight_b,
+                 a.z * weight_a + b.z * weight_b};
+}
+
+static bool
+nearly_equal(Quat q, QuatF64 expected, f64 tolerance)
+{
+  return fabs(q.w - expected.w) < tolerance && fabs(q.x - expected.x) < tolerance &&
+         fabs(q.y - expected.y) < tolerance && fabs(q.z - expected.z) < tolerance;
+}
+
+// Every quaternion operation against the same math done in doubles, over a spread of
+// rotations. The pairs include ones on opposite hemispheres (so interpolation has to flip one)
+// and ones close enough together that slerp falls back to nlerp.
+static void
+test_quaternion_accuracy()
+{
+  MemoryArena arena = alloc_memory_arena(KiB(64));
+  defer { free_memory_arena(&arena); };
+
+  constant u32 kCount = 67;
+  Quat a[kCount];
+  Quat b[kCount];
+  f32 t[kCount];
+  for (u32 i = 0; i < kCount; i++)
+  {
+    f32 s = f32(i);
+    a[i] = quat_from_axis_angle(Vec3(sinf(s * 1.7f), cosf(s * 2.3f), sinf(s * 0.7f + 1.0f)), s * 0.37f - 3.0f);
+    if (i % 4 == 3)
+    {
+      b[i] = a[i] * quat_from_axis_angle(Vec3(1.0f, s, 2.0f), 1e-3f * s);
+    }
+    else
+    {
+      b[i] = quat_from_axis_angle(Vec3(cosf(s), 0.5f, sinf(s * 3.1f)), 6.0f - s * 0.29f);
+    }
+    t[i] = fmodf(s * 0.137f, 1.0f);
+  }
+
+  for (u32 i = 0; i < kCount; i++)
+  {
+    QuatF64 qa = to_quat_f64(a[i]);
+    QuatF64 qb = to_quat_f64(b[i]);
+    ASSERT(nearly_equal(a[i] * b[i], quat_mul_f64(qa, qb), 1e-6));
+    ASSERT(nearly_equal(quat_inverse(a[i] * Quat(2.0f, 0.0f, 0.0f, 0.0f)) * a[i], QuatF64{0.5, 0.0, 0.0, 0.0}, 1e-6));
+
+    Vec3 v(f32(i) - 30.0f, 2.0f, sinf(f32(i)) * 10.0f);
+    QuatF64 rotated = quat_mul_f64(quat_mul_f64(qa, QuatF64{0.0, v.x, v.y, v.z}), QuatF64{qa.w, -qa.x, -qa.y, -qa.z});
+    Vec3 got = rotate_vec3_by_quat(v, a[i]);
+    ASSERT(fabs(got.x - rotated.x) < 1e-5 * 30.0 && fabs(got.y - rotated.y) < 1e-5 * 30.0 && fabs(got.z - rotated.z) < 1e-5 * 30.0);
+    ASSERT(nearly_equal(Vec4(quat_to_mat4(a[i]) * Vec4(v, 0.0f).avx).x, got.x, 1e-5f));
+
+    // q and -q are the same rotation, so either one is fine coming back out of the matrix.
+    Quat round_trip = mat4_to_quat(quat_to_mat4(a[i]));
+    if (quat_dot(round_trip, a[i]) < 0.0f)
+    {
+      round_trip = Quat(-round_trip.avx);
+    }
+    ASSERT(nearly_equal(round_trip, qa, 1e-6));
+
+    QuatF64 expected = quat_slerp_f64(qa, qb, t[i]);
+    ASSERT(nearly_equal(quat_slerp(a[i], b[i], t[i]), expected, 1e-6));
+
+    // Never exactly on the slerp path, but always a unit quaternion between the two.
+    Quat nlerp = quat_nlerp(a[i], b[i], t[i]);
+    ASSERT(nearly_equal(quat_dot(nlerp, nlerp), 1.0f));
+    ASSERT(nearly_equal(quat_nlerp(a[i], b[i], 0.0f), qa, 1e-6));
+  }
+
+  // Exactly the same rotation, where slerp would divide by sin(0).
+  ASSERT(nearly_equal(quat_slerp(a[5], a[5], 0.5f), to_quat_f64(a[5]), 1e-6));
+
+  QuatSoa qa = alloc_quat_soa(&arena, kCount);
+  QuatSoa qb = alloc_quat_soa(&arena, kCount);
+  QuatSoa out = alloc_quat_soa(&arena, kCount);
+  Vec3Soa vecs = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa rotated = alloc_vec3_soa(&arena, kCount);
+  for (u32 i = 0; i < kCount; i++)
+  {
+    qa.w[i] = a[i].w;  qa.x[i] = a[i].x;  qa.y[i] = a[i].y;  qa.z[i] = a[i].z;
+    qb.w[i] = b[i].w;  qb.x[i] = b[i].x;  qb.y[i] = b[i].y;  qb.z[i] = b[i].z;
+    vecs.x[i] = f32(i);  vecs.y[i] = -1.0f;  vecs.z[i] = 0.5f;
+  }
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    batch_quat_mul(qa, qb, out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Quat got(out.w[i], out.x[i], out.y[i], out.z[i]);
+      ASSERT(nearly_equal(got, quat_mul_f64(to_quat_f64(a[i]), to_quat_f64(b[i])), 1e-6));
+    }
+
+    batch_rotate_vec3(qa, vecs, rotated, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec3 expected = rotate_vec3_by_quat(Vec3(vecs.x[i], vecs.y[i], vecs.z[i]), a[i]);
+      ASSERT(nearly_equal(rotated.x[i], expected.x) && nearly_equal(rotated.y[i], expected.y) && nearly_equal(rotated.z[i], expected.z));
+    }
+
+    batch_quat_slerp(qa, qb, t, out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Quat got(out.w[i], out.x[i], out.y[i], out.z[i]);
+      ASSERT(nearly_equal(got, quat_slerp_f64(to_quat_f64(a[i]), to_quat_f64(b[i]), t[i]), 1e-6));
+    }
+
+    batch_quat_nlerp(qa, qb, t, out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Quat got(out.w[i], out.x[i], out.y[i], out.z[i]);
+      ASSERT(nearly_equal(got, to_quat_f64(quat_nlerp(a[i], b[i], t[i])), 1e-6));
+    }
+  }
 }
 
 void test_inverse_mat4()
@@ -426,14 +1613,676 @@ void test_inverse_mat4()
   }
 }
 
+// Most of this is static_asserts, since the whole point of Mat<R, C> is that it works at
+// compile time. The runtime paths get checked against the Mat4 versions.
+static void
+test_fixed_size_matrices()
+{
+  // Determinant 1 with integer entries, so the inverses are exact.
+  constexpr Mat3 kLinear = Mat3::rows({{1.0f, 2.0f, 0.0f},
+                                       {0.0f, 1.0f, 0.0f},
+                                       {0.0f, 3.0f, 1.0f}});
+  static_assert(determinant_mat3(kLinear) == 1.0f);
+  static_assert(kLinear * inverse_mat3(kLinear) == Mat3());
+  static_assert(transpose_f32(transpose_f32(kLinear)) == kLinear);
+  static_assert(transpose_f32(Mat<2, 3>::rows({{1.0f, 2.0f, 3.0f}, {4.0f, 5.0f, 6.0f}}))(2, 1) == 6.0f);
+  static_assert((Mat<2, 3>() * Mat<3, 2>())(1, 1) == 1.0f);
+
+  constexpr Mat3x4 kAffine = Mat3x4::rows({{1.0f, 2.0f, 0.0f,  5.0f},
+                                           {0.0f, 1.0f, 0.0f, -3.0f},
+                                           {0.0f, 3.0f, 1.0f,  2.0f}});
+  constexpr Mat3x4 kAffineInverse = inverse_mat3x4(kAffine);
+  static_assert(kAffine * kAffineInverse == Mat3x4());
+  static_assert((kAffine * kAffine)(0, 3) == 1.0f * 5.0f + 2.0f * -3.0f + 5.0f);
+
+  // The same thing at runtime goes through affine_mul/affine_inverse.
+  Mat3x4 affine = kAffine;
+  ASSERT(affine * inverse_mat3x4(affine) == Mat3x4());
+  ASSERT(inverse_mat3x4(affine) == kAffineInverse);
+  ASSERT(to_mat3x4(to_mat4(affine)) == affine);
+
+  Mat4 expanded = to_mat4(affine);
+  ASSERT(expanded.entries[3][0] == 5.0f && expanded.entries[3][1] == -3.0f && expanded.entries[3][2] == 2.0f);
+  ASSERT(expanded.entries[0][3] == 0.0f && expanded.entries[3][3] == 1.0f);
+  ASSERT(to_mat4x4(expanded) == Mat4x4::rows({{1.0f, 2.0f, 0.0f,  5.0f},
+                                              {0.0f, 1.0f, 0.0f, -3.0f},
+                                              {0.0f, 3.0f, 1.0f,  2.0f},
+                                              {0.0f, 0.0f, 0.0f,  1.0f}}));
+
+  constexpr Mat4x4 kProj = perspective_infinite_reverse_lh_mat4x4(kPI / 4.0f, 16.0f / 9.0f, 0.1f);
+  ASSERT(nearly_equal(to_mat4(kProj), perspective_infinite_reverse_lh(kPI / 4.0f, 16.0f / 9.0f, 0.1f)));
+
+  // Scale, shear and rotation all at once, against the general versions.
+  Mat4 a = trs_to_mat4(Vec3(1.0f, -2.0f, 3.0f), quat_from_euler_xyz(0.3f, -1.1f, 2.0f), Vec3(0.5f, 2.0f, 3.0f));
+  Mat4 b = trs_to_mat4(Vec3(-4.0f, 0.5f, 0.0f), quat_from_rotation_z(0.7f), Vec3(1.0f, 1.0f, 0.25f));
+  Mat4 sheared = a * b;
+  ASSERT(nearly_equal(affine_mul(a, b), sheared));
+  ASSERT(nearly_equal(affine_inverse(sheared), inverse_mat4(sheared), 1e-4f));
+  ASSERT(nearly_equal(affine_mul(sheared, affine_inverse(sheared)), Mat4(), 1e-5f));
+}
+
+// Reference xoshiro128+, one lane at a time.
+static u32
+xoshiro128_next(u32 s[4])
+{
+  u32 result = s[0] + s[3];
+  u32 t = s[1] << 9;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 11) | (s[3] >> 21);
+  return result;
+}
+
+// PCG against the reference implementation's published output, the batch streams against a
+// plain scalar xoshiro128+ at every level, and the sequences against their known first points
+// and stratification.
+static void
+test_random()
+{
+  // pcg32_srandom_r(&rng, 42, 54) from the reference pcg32-demo.
+  Pcg32 rng = init_pcg32(42, 54);
+  constant u32 kExpected[] = { 0xA15C02B7, 0x7B47F409, 0xBA1D3330, 0x83D2F293, 0xBFA4784B, 0xCBED606E };
+  for (u32 expected : kExpected)
+  {
+    ASSERT(pcg32_next_u32(&rng) == expected);
+  }
+
+  u32 buckets[10] = {};
+  for (u32 i = 0; i < 10000; i++)
+  {
+    f32 f = pcg32_next_f32(&rng);
+    ASSERT(f >= 0.0f && f < 1.0f);
+    f32 r = pcg32_next_f32(&rng, -2.0f, 3.0f);
+    ASSERT(r >= -2.0f && r < 3.0f);
+    buckets[pcg32_next_bounded(&rng, 10)]++;
+  }
+  for (u32 count : buckets)
+  {
+    ASSERT(count > 850 && count < 1150);
+  }
+
+  ASSERT(get_thread_rng() == get_thread_rng());
+
+  for (u32 i = 0; i < 16; i++)
+  {
+    Quat q = random_quat(&rng);
+    ASSERT(nearly_equal(quat_dot(q, q), 1.0f));
+
+    Mat4 rotation = generate_random_rotation(&rng);
+    ASSERT(nearly_equal(dot_f32(Vec3(rotation.cols[0]), Vec3(rotation.cols[1])), 0.0f));
+    ASSERT(nearly_equal(dot_f32(cross_f32(rotation.cols[0], rotation.cols[1]), rotation.cols[2]), 1.0f));
+  }
+
+  // 37 so that the last step only uses some of the lanes, then another fill to make sure that
+  // picks up where the first one left off.
+  constant u32 kCount = 37;
+  u32 expected[2 * 48];
+  RandomStreams reference = init_random_streams(1234);
+  for (u32 step = 0; step < 6; step++)
+  {
+    for (u32 lane = 0; lane < kRandomStreamLanes; lane++)
+    {
+      u32 s[4] = { reference.s[0][lane], reference.s[1][lane], reference.s[2][lane], reference.s[3][lane] };
+      expected[step * kRandomStreamLanes + lane] = xoshiro128_next(s);
+      for (u32 word = 0; word < 4; word++)
+      {
+        reference.s[word][lane] = s[word];
+      }
+    }
+  }
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    RandomStreams streams = init_random_streams(1234);
+    u32 bits[kCount];
+    batch_random_u32(&streams, bits, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(bits[i] == expected[i]);
+    }
+    batch_random_u32(&streams, bits, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(bits[i] == expected[48 + i]);
+    }
+
+    streams = init_random_streams(1234);
+    f32 floats[kCount];
+    batch_random_f32(&streams, floats, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(floats[i] == f32(expected[i] >> 8) * (1.0f / 16777216.0f));
+    }
+    batch_random_f32(&streams, 10.0f, 20.0f, floats, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(floats[i] >= 10.0f && floats[i] <= 20.0f);
+    }
+  }
+
+  ASSERT(radical_inverse_base2(1) == 0.5f && radical_inverse_base2(2) == 0.25f && radical_inverse_base2(3) == 0.75f);
+  ASSERT(nearly_equal(halton(1, 3), 1.0f / 3.0f) && nearly_equal(halton(5, 3), 7.0f / 9.0f));
+
+  Vec2 sobol[4] = { sobol_2d(0), sobol_2d(1), sobol_2d(2), sobol_2d(3) };
+  ASSERT(sobol[0].x == 0.0f  && sobol[0].y == 0.0f);
+  ASSERT(sobol[1].x == 0.5f  && sobol[1].y == 0.5f);
+  ASSERT(sobol[2].x == 0.25f && sobol[2].y == 0.75f);
+  ASSERT(sobol[3].x == 0.75f && sobol[3].y == 0.25f);
+
+  // Any 256 point run (at a multiple of 256) has exactly one point in every cell of a 16x16 grid.
+  u32 cells[16 * 16] = {};
+  for (u32 i = 256; i < 512; i++)
+  {
+    Vec2 p = sobol_2d(i);
+    cells[u32(p.y * 16.0f) * 16 + u32(p.x * 16.0f)]++;
+  }
+  for (u32 count : cells)
+  {
+    ASSERT(count == 1);
+  }
+
+  Vec3 sum(0.0f);
+  for (u32 i = 0; i < 128; i++)
+  {
+    Vec3 dir = spherical_fibonacci(f32(i), 128.0f);
+    ASSERT(nearly_equal(length_f32(dir), 1.0f));
+    sum += dir;
+  }
+  ASSERT(length_f32(sum) < 1.0f);
+}
+
+// The scalar conversions against known values and their own inverses, F16C (when the CPU has
+// it) against the scalar halfs, and every batch conversion against the scalar ones bit for bit
+// at every level. 1003 values so that every width has leftovers.
+static void
+test_packing()
+{
+  MemoryArena arena = alloc_memory_arena(MiB(2));
+  defer { free_memory_arena(&arena); };
+
+  ASSERT(f32_to_f16(1.0f) == 0x3C00);
+  ASSERT(f32_to_f16(-2.0f) == 0xC000);
+  ASSERT(f32_to_f16(65504.0f) == 0x7BFF);
+  // Halfway between 65504 and the next step up rounds to even, which is inf.
+  ASSERT(f32_to_f16(65520.0f) == 0x7C00);
+  ASSERT(f32_to_f16(exp2f(-24.0f)) == 0x0001);
+  ASSERT(f32_to_f16(exp2f(-26.0f)) == 0x0000);
+  ASSERT(f32_to_f16(1.0f + exp2f(-11.0f)) == 0x3C00);
+  ASSERT(f32_to_f16(1.0f + 3.0f * exp2f(-11.0f)) == 0x3C02);
+  ASSERT(f32_to_f16(INFINITY) == 0x7C00);
+  u16 nan = f32_to_f16(NAN);
+  ASSERT((nan & 0x7C00) == 0x7C00 && (nan & 0x3FF) != 0);
+  ASSERT(f16_to_f32(0x0001) == exp2f(-24.0f));
+  ASSERT(f16_to_f32(0xFBFF) == -65504.0f);
+
+  // Every half survives a round trip, and the midpoint between any two neighbours rounds to
+  // the even one.
+  constant u32 kHalfCount = 1 << 16;
+  u16* halfs = push_memory_arena<u16>(&arena, kHalfCount);
+  f32* floats = push_memory_arena<f32>(&arena, kHalfCount);
+  u16* halfs_out = push_memory_arena<u16>(&arena, kHalfCount);
+  f32* floats_out = push_memory_arena<f32>(&arena, kHalfCount);
+  for (u32 i = 0; i < kHalfCount; i++)
+  {
+    halfs[i] = u16(i);
+    floats[i] = f16_to_f32(u16(i));
+    if ((i & 0x7C00) != 0x7C00)
+    {
+      ASSERT(f32_to_f16(floats[i]) == i);
+    }
+    if ((i & 0x7FFF) < 0x7BFF)
+    {
+      f32 midpoint = f16_to_f32(u16(i)) + (f16_to_f32(u16(i + 1)) - f16_to_f32(u16(i))) * 0.5f;
+      ASSERT(f32_to_f16(midpoint) == ((i & 1) ? i + 1 : i));
+    }
+  }
+
+  constant u32 kCount = 1003;
+  Pcg32 rng = init_pcg32(49);
+  f32* values = push_memory_arena<f32>(&arena, kCount);
+  for (u32 i = 0; i < kCount; i++)
+  {
+    // Random bits cover denormals, huge numbers and infs. NaNs are left out since F16C keeps
+    // their payloads and the scalar version doesn't bother.
+    u32 bits = pcg32_next_u32(&rng);
+    values[i] = (bits & 0x7F800000) == 0x7F800000 ? 0.0f : f32_from_bits(bits);
+    if (i % 3 == 0)
+    {
+      values[i] = pcg32_next_f32(&rng, -1.5f, 1.5f);
+    }
+  }
+
+  s8* snorm8 = push_memory_arena<s8>(&arena, kCount);
+  s16* snorm16 = push_memory_arena<s16>(&arena, kCount);
+  u32* packed = push_memory_arena<u32>(&arena, kCount);
+  Vec3Soa vectors = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa normals = alloc_vec3_soa(&arena, kCount);
+  Vec3Soa vectors_out = alloc_vec3_soa(&arena, kCount);
+  for (u32 i = 0; i < kCount; i++)
+  {
+    vectors.x[i] = values[i];
+    vectors.y[i] = values[(i + 1) % kCount] * 100.0f;
+    vectors.z[i] = pcg32_next_f32(&rng, -10.0f, 70000.0f);
+
+    Vec3 n = spherical_fibonacci(f32(i), f32(kCount));
+    normals.x[i] = n.x;
+    normals.y[i] = n.y;
+    normals.z[i] = n.z;
+  }
+  vectors.x[0] = NAN;
+  normals.x[1] = 0.0f; normals.y[1] = 0.0f; normals.z[1] = -1.0f;
+  normals.x[2] = 0.0f; normals.y[2] = -1.0f; normals.z[2] = 0.0f;
+
+  auto same_bits = [](f32 a, f32 b) { return f32_bits(a) == f32_bits(b); };
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+  for (u32 level = 0; level <= get_max_simd_level(); level++)
+  {
+    set_simd_level(SimdLevel(level));
+
+    batch_f16_to_f32(halfs, floats_out, kHalfCount);
+    batch_f32_to_f16(floats, halfs_out, kHalfCount);
+    for (u32 i = 0; i < kHalfCount; i++)
+    {
+      ASSERT(same_bits(floats_out[i], floats[i]) || floats[i] != floats[i]);
+      if (floats[i] == floats[i])
+      {
+        ASSERT(halfs_out[i] == halfs[i]);
+      }
+    }
+
+    batch_f32_to_f16(values, halfs_out, kCount);
+    batch_f16_to_f32(halfs_out, floats_out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(halfs_out[i] == f32_to_f16(values[i]));
+      ASSERT(same_bits(floats_out[i], f16_to_f32(halfs_out[i])));
+    }
+
+    batch_f32_to_snorm8(values, snorm8, kCount);
+    batch_snorm8_to_f32(snorm8, floats_out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(snorm8[i] == f32_to_snorm8(values[i]));
+      ASSERT(same_bits(floats_out[i], snorm8_to_f32(snorm8[i])));
+    }
+
+    batch_f32_to_snorm16(values, snorm16, kCount);
+    batch_snorm16_to_f32(snorm16, floats_out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      ASSERT(snorm16[i] == f32_to_snorm16(values[i]));
+      ASSERT(same_bits(floats_out[i], snorm16_to_f32(snorm16[i])));
+    }
+
+    batch_pack_oct_snorm16(normals, packed, kCount);
+    batch_unpack_oct_snorm16(packed, vectors_out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec3 n(normals.x[i], normals.y[i], normals.z[i]);
+      ASSERT(packed[i] == pack_oct_snorm16(n));
+      Vec3 decoded = unpack_oct_snorm16(packed[i]);
+      ASSERT(same_bits(vectors_out.x[i], decoded.x) && same_bits(vectors_out.y[i], decoded.y) && same_bits(vectors_out.z[i], decoded.z));
+      // The chord is as good as the angle this close.
+      ASSERT(length_f32(n - decoded) < 0.005f * kPI / 180.0f);
+    }
+
+    batch_pack_r11g11b10(vectors, packed, kCount);
+    batch_unpack_r11g11b10(packed, vectors_out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec3 v(vectors.x[i], vectors.y[i], vectors.z[i]);
+      ASSERT(packed[i] == pack_r11g11b10(v));
+      Vec3 decoded = unpack_r11g11b10(packed[i]);
+      ASSERT(same_bits(vectors_out.x[i], decoded.x) && same_bits(vectors_out.y[i], decoded.y) && same_bits(vectors_out.z[i], decoded.z));
+    }
+
+    batch_pack_rgb9e5(vectors, packed, kCount);
+    batch_unpack_rgb9e5(packed, vectors_out, kCount);
+    for (u32 i = 0; i < kCount; i++)
+    {
+      Vec3 v(vectors.x[i], vectors.y[i], vectors.z[i]);
+      ASSERT(packed[i] == pack_rgb9e5(v));
+      Vec3 decoded = unpack_rgb9e5(packed[i]);
+      ASSERT(same_bits(vectors_out.x[i], decoded.x) && same_bits(vectors_out.y[i], decoded.y) && same_bits(vectors_out.z[i], decoded.z));
+    }
+  }
+
+  for (s32 i = -32767; i <= 32767; i++)
+  {
+    ASSERT(f32_to_snorm16(snorm16_to_f32(s16(i))) == i);
+  }
+  for (s32 i = -127; i <= 127; i++)
+  {
+    ASSERT(f32_to_snorm8(snorm8_to_f32(s8(i))) == i);
+  }
+  ASSERT(snorm16_to_f32(-32768) == -1.0f && snorm8_to_f32(-128) == -1.0f);
+  ASSERT(f32_to_snorm8(2.0f) == 127 && f32_to_snorm8(-2.0f) == -127 && f32_to_snorm8(NAN) == -127);
+
+  // Every finite 11 and 10 bit float survives a round trip.
+  for (u32 i = 0; i < (0x1Fu << 6); i++)
+  {
+    ASSERT(f32_to_small_float<6>(small_float_to_f32<6>(i)) == i);
+  }
+  for (u32 i = 0; i < (0x1Fu << 5); i++)
+  {
+    ASSERT(f32_to_small_float<5>(small_float_to_f32<5>(i)) == i);
+  }
+
+  Vec3 clamped = unpack_r11g11b10(pack_r11g11b10(Vec3(-1.0f, NAN, 1e9f)));
+  ASSERT(clamped.x == 0.0f && clamped.y == 0.0f && clamped.z == kMaxB10Float);
+  Vec3 lighting(0.25f, 3.7f, 1200.0f);
+  Vec3 decoded = unpack_r11g11b10(pack_r11g11b10(lighting));
+  ASSERT(fabsf(decoded.x - lighting.x) <= lighting.x * exp2f(-7.0f));
+  ASSERT(fabsf(decoded.y - lighting.y) <= lighting.y * exp2f(-7.0f));
+  ASSERT(fabsf(decoded.z - lighting.z) <= lighting.z * exp2f(-6.0f));
+
+  ASSERT(pack_rgb9e5(Vec3(1.0f, 1.0f, 1.0f)) == (0x100u | (0x100u << 9) | (0x100u << 18) | (16u << 27)));
+  ASSERT(unpack_rgb9e5(pack_rgb9e5(Vec3(1e9f, -1.0f, 0.0f))).x == kMaxRgb9e5);
+  // The largest channel is good to half a step of 9 bits, the others to half a step of the
+  // largest one's exponent.
+  decoded = unpack_rgb9e5(pack_rgb9e5(lighting));
+  f32 step = exp2f(floorf(log2f(lighting.z)) - 8.0f);
+  ASSERT(fabsf(decoded.x - lighting.x) <= step * 0.5f);
+  ASSERT(fabsf(decoded.y - lighting.y) <= step * 0.5f);
+  ASSERT(fabsf(decoded.z - lighting.z) <= step * 0.5f);
+  // 511.75 rounds up to 512, which has to bump the shared exponent.
+  Vec3 bumped = unpack_rgb9e5(pack_rgb9e5(Vec3(511.75f, 0.0f, 0.0f)));
+  ASSERT(bumped.x == 512.0f);
+}
+
+// A UV sphere with shared vertices, so it's closed: a ray from outside aimed at a point on it
+// has to hit it no later than that point.
+static void
+push_sphere(Vec3* positions, u32* indices, u32* vertex_count, u32* index_count, Vec3 center, f32 radius)
+{
+  constant u32 kRings = 16;
+  constant u32 kSegments = 32;
+
+  u32 first = *vertex_count;
+  positions[(*vertex_count)++] = center + Vec3(0.0f, radius, 0.0f);
+  positions[(*vertex_count)++] = center - Vec3(0.0f, radius, 0.0f);
+  for (u32 ring = 1; ring < kRings; ring++)
+  {
+    f32 theta = kPI * f32(ring) / f32(kRings);
+    for (u32 segment = 0; segment < kSegments; segment++)
+    {
+      f32 phi = k2PI * f32(segment) / f32(kSegments);
+      positions[(*vertex_count)++] = center + Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)) * radius;
+    }
+  }
+
+  auto ring_vertex = [&](u32 ring, u32 segment) { return first + 2 + (ring - 1) * kSegments + segment % kSegments; };
+  auto push_triangle = [&](u32 a, u32 b, u32 c)
+  {
+    indices[(*index_count)++] = a;
+    indices[(*index_count)++] = b;
+    indices[(*index_count)++] = c;
+  };
+  for (u32 segment = 0; segment < kSegments; segment++)
+  {
+    push_triangle(first, ring_vertex(1, segment + 1), ring_vertex(1, segment));
+    push_triangle(first + 1, ring_vertex(kRings - 1, segment), ring_vertex(kRings - 1, segment + 1));
+    for (u32 ring = 1; ring < kRings - 1; ring++)
+    {
+      push_triangle(ring_vertex(ring, segment), ring_vertex(ring, segment + 1), ring_vertex(ring + 1, segment));
+      push_triangle(ring_vertex(ring + 1, segment), ring_vertex(ring, segment + 1), ring_vertex(ring + 1, segment + 1));
+    }
+  }
+}
+
+// The tests against hand checked cases, then the BVH against testing every triangle one at
+// a time, for single rays and packets at every level. Half the rays are aimed right at the
+// middle of an edge of the spheres, which the watertight test must never let through.
+static void
+test_ray_tracing()
+{
+  {
+    Vec3xN<f32> v0 = {0.0f, 0.0f, 0.0f};
+    Vec3xN<f32> v1 = {1.0f, 0.0f, 0.0f};
+    Vec3xN<f32> v2 = {0.0f, 1.0f, 0.0f};
+
+    Ray ray;
+    ray.origin = Vec3(0.25f, 0.5f, -2.0f);
+    ray.direction = Vec3(0.0f, 0.0f, 2.0f);
+    RayxN<f32> r = broadcast_ray<f32>(ray);
+    WatertightRayxN<f32> watertight = setup_watertight_ray(r);
+
+    f32 t, u, v;
+    ASSERT(intersect_ray_triangle(r, v0, v1, v2, &t, &u, &v) >= 0.0f);
+    ASSERT(nearly_equal(t, 1.0f) && nearly_equal(u, 0.25f) && nearly_equal(v, 0.5f));
+    ASSERT(intersect_ray_triangle_watertight(r, watertight, v0, v1, v2, &t, &u, &v) >= 0.0f);
+    ASSERT(nearly_equal(t, 1.0f) && nearly_equal(u, 0.25f) && nearly_equal(v, 0.5f));
+    // From the back too.
+    ASSERT(intersect_ray_triangle_watertight(r, watertight, v0, v2, v1, &t, &u, &v) >= 0.0f);
+    ASSERT(nearly_equal(t, 1.0f) && nearly_equal(u, 0.5f) && nearly_equal(v, 0.25f));
+
+    r.t_max = 0.9f;
+    ASSERT(!(intersect_ray_triangle(r, v0, v1, v2, &t, &u, &v) >= 0.0f));
+    ASSERT(!(intersect_ray_triangle_watertight(r, watertight, v0, v1, v2, &t, &u, &v) >= 0.0f));
+
+    // Outside of the triangle, behind the origin, and parallel to it.
+    ray.origin = Vec3(0.75f, 0.5f, -2.0f);
+    r = broadcast_ray<f32>(ray);
+    ASSERT(!(intersect_ray_triangle(r, v0, v1, v2, &t, &u, &v) >= 0.0f));
+    ASSERT(!(intersect_ray_triangle_watertight(r, watertight, v0, v1, v2, &t, &u, &v) >= 0.0f));
+    ray.origin = Vec3(0.25f, 0.25f, 2.0f);
+    r = broadcast_ray<f32>(ray);
+    ASSERT(!(intersect_ray_triangle(r, v0, v1, v2, &t, &u, &v) >= 0.0f));
+    ASSERT(!(intersect_ray_triangle_watertight(r, watertight, v0, v1, v2, &t, &u, &v) >= 0.0f));
+    ray.origin = Vec3(-1.0f, 0.25f, 0.0f);
+    ray.direction = Vec3(1.0f, 0.0f, 0.0f);
+    r = broadcast_ray<f32>(ray);
+    watertight = setup_watertight_ray(r);
+    ASSERT(!(intersect_ray_triangle(r, v0, v1, v2, &t, &u, &v) >= 0.0f));
+    ASSERT(!(intersect_ray_triangle_watertight(r, watertight, v0, v1, v2, &t, &u, &v) >= 0.0f));
+
+    // Boxes, with a direction that has zeros in it.
+    Vec3xN<f32> box_min = {-1.0f, -1.0f, -1.0f};
+    Vec3xN<f32> box_max = { 1.0f,  1.0f,  1.0f};
+    ray.origin = Vec3(-3.0f, 0.5f, 0.0f);
+    f32 t_enter;
+    ASSERT(intersect_ray_aabb(broadcast_ray<f32>(ray), box_min, box_max, &t_enter) >= 0.0f && t_enter == 2.0f);
+    ray.origin = Vec3(0.0f, 0.0f, 0.0f);
+    ASSERT(intersect_ray_aabb(broadcast_ray<f32>(ray), box_min, box_max, &t_enter) >= 0.0f && t_enter == 0.0f);
+    ray.origin = Vec3(-3.0f, 1.5f, 0.0f);
+    ASSERT(!(intersect_ray_aabb(broadcast_ray<f32>(ray), box_min, box_max, &t_enter) >= 0.0f));
+    ray.origin = Vec3(3.0f, 0.5f, 0.0f);
+    ASSERT(!(intersect_ray_aabb(broadcast_ray<f32>(ray), box_min, box_max, &t_enter) >= 0.0f));
+    ray.origin = Vec3(-3.0f, 0.5f, 0.0f);
+    ray.t_max = 1.5f;
+    ASSERT(!(intersect_ray_aabb(broadcast_ray<f32>(ray), box_min, box_max, &t_enter) >= 0.0f));
+  }
+
+  MemoryArena arena = alloc_memory_arena(MiB(4));
+  defer { free_memory_arena(&arena); };
+
+  constant u32 kSphereCount = 3;
+  constant f32 kSpacing = 2.5f;
+  Vec3* positions = push_memory_arena<Vec3>(&arena, 1024 * kSphereCount);
+  u32* indices = push_memory_arena<u32>(&arena, 3 * 1024 * kSphereCount);
+  u32 vertex_count = 0;
+  u32 index_count = 0;
+  for (u32 i = 0; i < kSphereCount; i++)
+  {
+    push_sphere(positions, indices, &vertex_count, &index_count, Vec3(f32(i) * kSpacing, 0.0f, 0.0f), 1.0f);
+  }
+  u32 triangle_count = index_count / 3;
+
+  Bvh bvh = build_bvh(&arena, positions, indices, triangle_count);
+  ASSERT(bvh.triangle_count == triangle_count);
+  for (u32 i = 0; i < bvh.node_count; i++)
+  {
+    ASSERT(bvh.nodes[i].triangle_count <= kBvhMaxLeafTriangles);
+  }
+
+  constant u32 kRayCount = 203;
+  Ray* rays = push_memory_arena<Ray>(&arena, kRayCount);
+  RayHit* expected = push_memory_arena<RayHit>(&arena, kRayCount);
+  RayHit* hits = push_memory_arena<RayHit>(&arena, kRayCount);
+
+  // What each ray should do regardless of the BVH: hit something no later than its target,
+  // hit something at all, miss everything, or anything (when t_max cuts it short).
+  enum : u8 { kHitByTarget, kHit, kMiss, kAnything };
+  u8* kinds = push_memory_arena<u8>(&arena, kRayCount);
+
+  Pcg32 rng = init_pcg32(50);
+  for (u32 i = 0; i < kRayCount; i++)
+  {
+    // From somewhere on a big sphere around everything, so from outside all of the spheres.
+    Vec3 origin = Vec3(kSpacing, 0.0f, 0.0f) + Vec3(normalize_f32(Vec3(pcg32_next_f32(&rng, -1.0f, 1.0f),
+                                                                  pcg32_next_f32(&rng, -1.0f, 1.0f),
+                                                                  pcg32_next_f32(&rng, -1.0f, 1.0f)))) * 8.0f;
+    Vec3 target;
+    if (i % 2 == 0)
+    {
+      // The middle of an edge on the side of a sphere facing the origin, well away from the
+      // silhouette where rounding the midpoint could legitimately put it outside.
+      kinds[i] = kHitByTarget;
+      while (true)
+      {
+        u32 triangle = pcg32_next_bounded(&rng, triangle_count);
+        u32 corner = pcg32_next_bounded(&rng, 3);
+        target = (positions[indices[triangle * 3 + corner]] + positions[indices[triangle * 3 + (corner + 1) % 3]]) * 0.5f;
+        Vec3 center = Vec3(roundf(target.x / kSpacing) * kSpacing, 0.0f, 0.0f);
+        if (dot_f32(Vec3(normalize_f32(target - center)), Vec3(normalize_f32(origin - target))) > 0.2f)
+        {
+          break;
+        }
+      }
+    }
+    else if (i % 3 == 0)
+    {
+      kinds[i] = kMiss;
+      target = origin * 2.0f;
+    }
+    else
+    {
+      kinds[i] = kHit;
+      target = Vec3(f32(pcg32_next_bounded(&rng, kSphereCount)) * kSpacing, 0.0f, 0.0f);
+    }
+
+    rays[i] = Ray();
+    rays[i].origin = origin;
+    rays[i].direction = target - origin;
+    if (i % 5 == 0)
+    {
+      rays[i].t_max = 0.5f;
+      kinds[i] = kAnything;
+    }
+  }
+
+  auto brute_force = [&](const Ray& ray, RayTriangleTest test)
+  {
+    RayxN<f32> r = broadcast_ray<f32>(ray);
+    WatertightRayxN<f32> watertight = setup_watertight_ray(r);
+    RayHit ret;
+    ret.t = ray.t_max;
+    for (u32 i = 0; i < triangle_count; i++)
+    {
+      Vec3 a = positions[indices[i * 3 + 0]];
+      Vec3 b = positions[indices[i * 3 + 1]];
+      Vec3 c = positions[indices[i * 3 + 2]];
+      Vec3xN<f32> v0 = {a.x, a.y, a.z}, v1 = {b.x, b.y, b.z}, v2 = {c.x, c.y, c.z};
+      f32 t, u, v;
+      f32 hit = test == kRayTriangleWatertight ? intersect_ray_triangle_watertight(r, watertight, v0, v1, v2, &t, &u, &v)
+                                               : intersect_ray_triangle(r, v0, v1, v2, &t, &u, &v);
+      if (hit >= 0.0f && t <= ret.t)
+      {
+        ret = {t, u, v, i};
+      }
+    }
+    return ret;
+  };
+
+  // The same closest hit, up to the rounding differences between the widths and FMA. Those
+  // differences are enough for a ray right through an edge to slip through the crack with
+  // Möller–Trumbore, so only the watertight test has to agree on them.
+  auto same_hit = [&](const RayHit& a, const RayHit& b, u32 ray, RayTriangleTest test)
+  {
+    if (test == kRayTriangleMollerTrumbore && kinds[ray] == kHitByTarget)
+    {
+      return true;
+    }
+
+    if (a.triangle == kRayMiss || b.triangle == kRayMiss)
+    {
+      return a.triangle == b.triangle;
+    }
+    return nearly_equal(a.t, b.t, 1e-4f);
+  };
+
+  SimdLevel original_level = get_simd_level();
+  defer { set_simd_level(original_level); };
+  for (RayTriangleTest test : {kRayTriangleWatertight, kRayTriangleMollerTrumbore})
+  {
+    for (u32 i = 0; i < kRayCount; i++)
+    {
+      expected[i] = brute_force(rays[i], test);
+      if (test == kRayTriangleWatertight)
+      {
+        ASSERT(kinds[i] != kHitByTarget || (expected[i].triangle != kRayMiss && expected[i].t <= 1.0f + 1e-4f));
+        ASSERT(kinds[i] != kHit || expected[i].triangle != kRayMiss);
+        ASSERT(kinds[i] != kMiss || expected[i].triangle == kRayMiss);
+      }
+    }
+
+    for (u32 level = 0; level <= get_max_simd_level(); level++)
+    {
+      set_simd_level(SimdLevel(level));
+
+      for (u32 i = 0; i < kRayCount; i++)
+      {
+        ASSERT(same_hit(trace_ray(bvh, rays[i], test), expected[i], i, test));
+      }
+
+      trace_rays(bvh, rays, hits, kRayCount, test);
+      for (u32 i = 0; i < kRayCount; i++)
+      {
+        ASSERT(same_hit(hits[i], expected[i], i, test));
+      }
+    }
+  }
+}
+
 void
 run_all_tests()
 {
   test_quaternions();
+  test_quaternion_accuracy();
   test_vector_operators();
+  test_dot_f32_arrays();
+  test_vector_reductions();
+  test_batch_math();
+  test_frustum_culling();
+  test_occlusion_culling();
   test_ring_buffer();
+  test_mirrored_ring_buffer();
+  test_lock_free_queues();
   test_pool_allocator();
+  test_growable_array();
+  test_soa_array();
+  test_transform_hierarchy();
   test_fiber();
+  test_job_system_stats_json();
+  test_job_system_stats_aggregation();
+  test_thread_signal();
+  test_job_deadline_scheduling();
+  test_blocking_kick_helps();
   test_hash_table();
+  test_concurrent_hash_table();
   test_inverse_mat4();
+  test_fixed_size_matrices();
+  test_random();
+  test_packing();
+  test_ray_tracing();
 }
@@ -138,29 +138,57 @@ void
 wait_for_thread_signal(ThreadSignal* signal)
 {
   AcquireSRWLockExclusive(&signal->lock);
-  SleepConditionVariableSRW(&signal->cond_var, &signal->lock, INFINITE, 0);
+  while (!signal->signaled)
+  {
+    SleepConditionVariableSRW(&signal->cond_var, &signal->lock, INFINITE, 0);
+  }
   ReleaseSRWLockExclusive(&signal->lock);
 }
 
+bool
+is_thread_signaled(ThreadSignal* signal)
+{
+  AcquireSRWLockShared(&signal->lock);
+  bool ret = signal->signaled;
+  ReleaseSRWLockShared(&signal->lock);
+  return ret;
+}
+
+// NOTE: The wake happens while still holding the lock on purpose. Signals usually
+// live on the waiter's stack, and the waiter can't see signaled until we release, so we
+// never touch the signal after the waiter is able to return.
 void
 notify_one_thread_signal(ThreadSignal* signal)
 {
+  AcquireSRWLockExclusive(&signal->lock);
+  signal->signaled = true;
   WakeConditionVariable(&signal->cond_var);
+  ReleaseSRWLockExclusive(&signal->lock);
 }
 
 void
 notify_all_thread_signal(ThreadSignal* signal)
 {
+  AcquireSRWLockExclusive(&signal->lock);
+  signal->signaled = true;
   WakeAllConditionVariable(&signal->cond_var);
+  ReleaseSRWLockExclusive(&signal->lock);
 }
 
+// Test and test-and-set: we only try to take the lock with an RMW when it looks free,
+// otherwise we'd be bouncing the cache line between cores on every spin.
 void
 spin_acquire(SpinLock* spin_lock)
 {
   for (;;)
   {
-    if (InterlockedCompareExchange(&spin_lock->value, 1, 0) == 0)
+    if (atomic_exchange(&spin_lock->value, 1, kMemoryOrderAcquire) == 0)
       break;
+
+    while (atomic_load(&spin_lock->value, kMemoryOrderRelaxed) != 0)
+    {
+      cpu_relax();
+    }
   }
 }
 
@@ -169,8 +197,11 @@ try_spin_acquire(SpinLock* spin_lock, u64 max_cycles)
 {
   while (max_cycles-- != 0)
   {
-    if (InterlockedCompareExchange(&spin_lock->value, 1, 0) == 0)
+    if (atomic_load(&spin_lock->value, kMemoryOrderRelaxed) == 0 &&
+        atomic_exchange(&spin_lock->value, 1, kMemoryOrderAcquire) == 0)
       return true;
+
+    cpu_relax();
   }
 
   return false;
@@ -179,5 +210,5 @@ try_spin_acquire(SpinLock* spin_lock, u64 max_cycles)
 void
 spin_release(SpinLock* spin_lock)
 {
-  spin_lock->value = 0;
+  atomic_store(&spin_lock->value, 0, kMemoryOrderRelease);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "types.h"
+#include "atomics.h"
 #include "memory/memory.h"
 
 typedef u32 (*ThreadProc)(void*);
@@ -39,20 +40,25 @@ struct Mutex
 void mutex_acquire(Mutex* mutex);
 void mutex_release(Mutex* mutex);
 
+// One-shot signal: once notified it stays signaled, so a notify that happens before
+// the wait can't be missed and spurious wake-ups just go back to sleep.
 struct ThreadSignal
 {
   CONDITION_VARIABLE cond_var;
   SRWLOCK lock = {0};
+  // Protected by lock.
+  bool signaled = false;
 };
 
 ThreadSignal init_thread_signal();
 void wait_for_thread_signal(ThreadSignal* signal);
+bool is_thread_signaled(ThreadSignal* signal);
 void notify_one_thread_signal(ThreadSignal* signal);
 void notify_all_thread_signal(ThreadSignal* signal);
 
 struct SpinLock
 {
-  volatile u64 value = 0;
+  Atomic<u32> value = 0;
 };
 
 
@@ -80,30 +86,6 @@ struct SpinLocked
 
 #define ACQUIRE(lock, var) (*lock) * [&](var)
 
-inline u32
-test_and_set(volatile u32* dst, u32 val)
-{
-  u32 prev, compare_operand;
-  do 
-  {
-    prev = InterlockedCompareExchange(dst, val, compare_operand);
-  } while (compare_operand != prev);
-
-  return prev;
-}
-
-inline s64
-test_and_set(volatile s64* dst, s64 val)
-{
-  s64 prev, compare_operand;
-  do 
-  {
-    prev = InterlockedCompareExchange64(dst, val, compare_operand);
-  } while (compare_operand != prev);
-
-  return prev;
-}
-
 template <typename T, typename F, typename R>
 struct __SpinUnlocked__
 {
@@ -0,0 +1,157 @@
+#include "transform_hierarchy.h"
+#include "job_system.h"
+
+TransformHierarchy
+init_transform_hierarchy(MEMORY_ARENA_PARAM, size_t capacity)
+{
+  TransformHierarchy ret;
+  ret.nodes = init_soa_array<u32, u32, Vec3, Quat, Vec3, Mat4, Mat4>(MEMORY_ARENA_FWD, capacity);
+  return ret;
+}
+
+u32
+add_transform_node(TransformHierarchy* hierarchy, u32 parent, Vec3 translation, Quat rotation, Vec3 scale)
+{
+  u32 index = u32(hierarchy->nodes.size);
+
+  u32 depth = 0;
+  if (parent != kTransformNoParent)
+  {
+    // Parents have to come first, which is also what rules out cycles.
+    ASSERT(parent < index);
+    depth = soa_column<kTransformDepth>(&hierarchy->nodes)[parent] + 1;
+  }
+
+  soa_push(&hierarchy->nodes, parent, depth, translation, rotation, scale, Mat4(), Mat4());
+  return index;
+}
+
+u32
+add_transform_node(TransformHierarchy* hierarchy, u32 parent)
+{
+  return add_transform_node(hierarchy, parent, Vec3(0.0f), Quat(), Vec3(1.0f));
+}
+
+void
+set_transform_node(TransformHierarchy* hierarchy, u32 node, Vec3 translation, Quat rotation, Vec3 scale)
+{
+  ASSERT(node < hierarchy->nodes.size);
+  soa_column<kTransformTranslation>(&hierarchy->nodes)[node] = translation;
+  soa_column<kTransformRotation>(&hierarchy->nodes)[node] = rotation;
+  soa_column<kTransformScale>(&hierarchy->nodes)[node] = scale;
+}
+
+// Counting sort of the nodes by depth.
+static void
+rebuild_transform_levels(TransformHierarchy* hierarchy)
+{
+  size_t count = hierarchy->nodes.size;
+  if (hierarchy->order_size == count)
+    return;
+
+  if (count > hierarchy->order_capacity)
+  {
+    // The deepest a node can be is count - 1, so that's also the most levels there can be.
+    size_t capacity = hierarchy->nodes.capacity;
+    hierarchy->order = push_memory_arena<u32>(hierarchy->nodes.arena, capacity);
+    hierarchy->level_offsets = push_memory_arena<u32>(hierarchy->nodes.arena, capacity + 1);
+    hierarchy->order_capacity = capacity;
+  }
+
+  const u32* depths = soa_column<kTransformDepth>(&hierarchy->nodes);
+  u32* offsets = hierarchy->level_offsets;
+
+  u32 level_count = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    level_count = MAX(level_count, depths[i] + 1);
+  }
+
+  zero_memory(offsets, sizeof(u32) * (level_count + 1));
+  for (size_t i = 0; i < count; i++)
+  {
+    offsets[depths[i] + 1]++;
+  }
+
+  for (u32 level = 0; level < level_count; level++)
+  {
+    offsets[level + 1] += offsets[level];
+  }
+
+  // Scattering bumps every offset up to the start of the next level, so shift them back after.
+  for (size_t i = 0; i < count; i++)
+  {
+    hierarchy->order[offsets[depths[i]]++] = u32(i);
+  }
+
+  for (u32 level = level_count; level > 0; level--)
+  {
+    offsets[level] = offsets[level - 1];
+  }
+  offsets[0] = 0;
+
+  hierarchy->level_count = level_count;
+  hierarchy->order_size = count;
+}
+
+// Every parent in [begin, end) has to already be up to date.
+static void
+update_transform_range(TransformHierarchy* hierarchy, u32 begin, u32 end)
+{
+  TransformNodes* nodes = &hierarchy->nodes;
+  const u32*  order        = hierarchy->order;
+  const u32*  parents      = soa_column<kTransformParent>(nodes);
+  const Vec3* translations = soa_column<kTransformTranslation>(nodes);
+  const Quat* rotations    = soa_column<kTransformRotation>(nodes);
+  const Vec3* scales       = soa_column<kTransformScale>(nodes);
+  Mat4*       worlds       = soa_column<kTransformWorld>(nodes);
+  Mat4*       normals      = soa_column<kTransformNormal>(nodes);
+
+  for (u32 i = begin; i < end; i++)
+  {
+    u32 node = order[i];
+    Mat4 world = trs_to_mat4(translations[node], rotations[node], scales[node]);
+
+    u32 parent = parents[node];
+    if (parent != kTransformNoParent)
+    {
+      world = affine_mul(worlds[parent], world);
+    }
+
+    worlds[node] = world;
+    normals[node] = affine_inverse_transpose(world);
+  }
+}
+
+void
+update_transform_hierarchy(TransformHierarchy* hierarchy, bool parallel)
+{
+  rebuild_transform_levels(hierarchy);
+
+  for (u32 level = 0; level < hierarchy->level_count; level++)
+  {
+    u32 begin = hierarchy->level_offsets[level];
+    u32 end = hierarchy->level_offsets[level + 1];
+    u32 count = end - begin;
+
+    if (!parallel || count < 2 * kTransformNodesPerJob)
+    {
+      update_transform_range(hierarchy, begin, end);
+      continue;
+    }
+
+    // Capped so that the descs fit on the stack, past that each job just gets more nodes.
+    constant u32 kMaxJobs = 64;
+    u32 job_count = MIN((count + kTransformNodesPerJob - 1) / kTransformNodesPerJob, kMaxJobs);
+    u32 nodes_per_job = (count + job_count - 1) / job_count;
+
+    JobDesc descs[kMaxJobs];
+    for (u32 i = 0; i < job_count; i++)
+    {
+      u32 job_begin = MIN(begin + i * nodes_per_job, end);
+      u32 job_end = MIN(job_begin + nodes_per_job, end);
+      descs[i] = init_job_desc_from_closure([=]() { update_transform_range(hierarchy, job_begin, job_end); });
+    }
+    blocking_kick_job_descs(kJobPriorityHigh, descs, job_count, JOB_DEBUG_INFO_STRUCT);
+  }
+}
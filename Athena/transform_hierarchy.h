@@ -0,0 +1,74 @@
+#pragma once
+#include "soa_array.h"
+#include "math/math.h"
+
+// Parent-relative transforms for a whole scene, flattened into world matrices (and the
+// inverse-transpose for normals) in one batched update per frame.
+//
+// Nodes are stored struct-of-arrays, so the update streams through the TRS columns and the
+// output matrices without dragging the rest of each node along. A node's parent has to be
+// added before it is, which means every node at depth N only depends on nodes at depth < N.
+// The update walks one depth at a time, and everything at one depth is independent, so big
+// levels get split up across the job system.
+enum TransformNodeField
+{
+  kTransformParent,
+  kTransformDepth,
+  kTransformTranslation,
+  kTransformRotation,
+  kTransformScale,
+  kTransformWorld,
+  kTransformNormal,
+};
+typedef SoaArray<u32, u32, Vec3, Quat, Vec3, Mat4, Mat4> TransformNodes;
+
+constant u32 kTransformNoParent = U32_MAX;
+
+// Levels smaller than this get updated on the calling thread, anything bigger gets split into
+// jobs of about this many nodes. Below a few thousand nodes the kick costs more than it saves.
+constant u32 kTransformNodesPerJob = 4096;
+
+struct TransformHierarchy
+{
+  TransformNodes nodes;
+
+  // Node indices grouped by depth, so level L is order[level_offsets[L]..level_offsets[L + 1]).
+  // Parents can't change after a node is added, so these only get rebuilt when nodes are added.
+  u32* order = nullptr;
+  u32* level_offsets = nullptr;
+  u32 level_count = 0;
+  size_t order_size = 0;
+  size_t order_capacity = 0;
+};
+
+TransformHierarchy init_transform_hierarchy(MEMORY_ARENA_PARAM, size_t capacity);
+
+// Starts out as the identity relative to its parent. The world matrices aren't valid until
+// the next update_transform_hierarchy.
+u32 add_transform_node(TransformHierarchy* hierarchy, u32 parent = kTransformNoParent);
+u32 add_transform_node(TransformHierarchy* hierarchy,
+                       u32 parent,
+                       Vec3 translation,
+                       Quat rotation,
+                       Vec3 scale = Vec3(1.0f));
+
+void set_transform_node(TransformHierarchy* hierarchy, u32 node, Vec3 translation, Quat rotation, Vec3 scale = Vec3(1.0f));
+
+// With parallel = false everything is done on the calling thread, which is also what you want
+// when the job system isn't running (like in the tests).
+void update_transform_hierarchy(TransformHierarchy* hierarchy, bool parallel = true);
+
+inline const Mat4&
+get_world_transform(const TransformHierarchy& hierarchy, u32 node)
+{
+  ASSERT(node < hierarchy.nodes.size);
+  return soa_column<kTransformWorld>(&hierarchy.nodes)[node];
+}
+
+// The inverse-transpose of the world transform, for transforming normals.
+inline const Mat4&
+get_normal_transform(const TransformHierarchy& hierarchy, u32 node)
+{
+  ASSERT(node < hierarchy.nodes.size);
+  return soa_column<kTransformNormal>(&hierarchy.nodes)[node];
+}
@@ -23,6 +23,7 @@ typedef unsigned char byte;
 // SSE2 support is _required_ for this engine.
 typedef __m128 f32x4;
 typedef __m256 f32x8;
+typedef __m512 f32x16;
 typedef __m128d f64x2;
 typedef __m256d f64x4;
 
@@ -36,6 +37,22 @@ typedef __m128i u16x8;
 typedef __m128i u32x4;
 typedef __m128i u64x2;
 
+typedef __m256i s8x32;
+typedef __m256i s16x16;
+typedef __m256i s32x8;
+typedef __m256i s64x4;
+
+typedef __m256i u8x32;
+typedef __m256i u16x16;
+typedef __m256i u32x8;
+typedef __m256i u64x4;
+
+typedef __m512i s32x16;
+typedef __m512i s64x8;
+
+typedef __m512i u32x16;
+typedef __m512i u64x8;
+
 template <typename T>
 using InitializerList = std::initializer_list<T>;
 
@@ -51,6 +68,7 @@ using InitializerList = std::initializer_list<T>;
 #define S32_MIN ((s32)0x80000000)
 #define S16_MIN ((s16)0x8000)
 #define S8_MIN ((s8)0x80)
+#define F32_MAX (3.402823466e+38f)
 
 
 inline s32